@@ -77,6 +77,10 @@ have them calculated manually. Since calculating folder sizes can be slow, it's
 not enabled by default, and there's an option to enable it only while holding
 the Shift key.
 
+Calculated folder sizes of folders on local fixed drives are cached and updated
+when files change, so a folder's size is only calculated again if something
+changed inside it. The cache can optionally be kept after Explorer restarts.
+
 ## Mix files and folders when sorting by size
 
 When sorting by size, files end up in one separate chunk, and folders in
@@ -119,6 +123,18 @@ KiB?](https://devblogs.microsoft.com/oldnewthing/20090611-00/?p=17933).
   - everything: Enabled via "Everything" integration
   - always: Enabled, calculated manually (can be slow)
   - withShiftKey: Enabled, calculated manually while holding the Shift key
+- calculateFolderSizesInBackground: false
+  $name: Calculate folder sizes in the background
+  $description: >-
+    Applies to manually calculated folder sizes. Folders are shown right away,
+    and their sizes are filled in as they're calculated, starting with the most
+    recently shown folders.
+- persistFolderSizes: false
+  $name: Remember calculated folder sizes
+  $description: >-
+    Keep manually calculated folder sizes after Explorer restarts. Remembered
+    sizes are shown while folder sizes are calculated in the background, and
+    are replaced once the calculation completes.
 - sortSizesMixFolders: true
   $name: Mix files and folders when sorting by size
   $description: >-
@@ -136,7 +152,10 @@ KiB?](https://devblogs.microsoft.com/oldnewthing/20090611-00/?p=17933).
 
 #include <windhawk_utils.h>
 
+#include <algorithm>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -164,6 +183,8 @@ enum class CalculateFolderSizes {
 
 struct {
     CalculateFolderSizes calculateFolderSizes;
+    bool calculateFolderSizesInBackground;
+    bool persistFolderSizes;
     bool sortSizesMixFolders;
     bool disableKbOnlySizes;
     bool useIecTerms;
@@ -1127,6 +1148,7 @@ EVERYTHING3_UINT64 EVERYTHING3_API Everything3_GetFolderSizeFromFilenameW(EVERYT
 #define EVERYTHING_IPC_COPYDATA_QUERY2W			18
 #define EVERYTHING_IPC_SORT_NAME_ASCENDING		1
 
+#define EVERYTHING_IPC_QUERY2_REQUEST_NAME		0x00000001
 #define EVERYTHING_IPC_QUERY2_REQUEST_SIZE		0x00000010
 
 typedef struct {
@@ -1157,9 +1179,19 @@ typedef struct {
 
 constexpr DWORD kGsTimeoutIPC = 1000;
 
+// Limits the size of a single child folder sizes reply. Subfolders beyond
+// the limit are queried one by one.
+constexpr DWORD kGsMaxChildResults = 10000;
+
 #define GS_SEARCH_PREFIX L"folder:wfn:\""
+#define GS_SEARCH_CHILDREN_PREFIX L"folder:parent:\""
 #define GS_SEARCH_SUFFIX L"\""
 
+struct EverythingChildSize {
+    std::wstring name;
+    int64_t size;
+};
+
 std::atomic<HWND> g_gsReceiverWnd;
 
 struct {
@@ -1168,6 +1200,9 @@ struct {
     DWORD dwID;
     bool bResult;
     int64_t liSize;
+    // If set, the reply contains the name and size of each result, which are
+    // stored here.
+    std::vector<EverythingChildSize>* pChildren;
 } g_gsReply;
 
 std::mutex g_gsReplyMutex;
@@ -1261,39 +1296,7 @@ std::wstring ResolvePath(PCWSTR path) {
 
 DWORD WINAPI Everything4Wh_Thread(void* parameter);
 
-unsigned Everything4Wh_GetFileSize(PCWSTR folderPath, int64_t* size) {
-    *size = 0;
-
-    // Prevent querying from within the Everything process to avoid deadlocks.
-    if (g_isEverything) {
-        return ES_QUERY_NO_ES_IPC;
-    }
-
-    EVERYTHING3_CLIENT* pClient = Everything3_ConnectW(nullptr);
-    if (pClient) {
-        Wh_Log(L"Connected to Everything IPC (unnamed instance)");
-    } else {
-        pClient = Everything3_ConnectW(L"1.5a");
-        if (pClient) {
-            Wh_Log(L"Connected to Everything IPC (v1.5a)");
-        }
-    }
-
-    if (pClient) {
-        *size = Everything3_GetFolderSizeFromFilenameW(pClient, folderPath);
-        Everything3_DestroyClient(pClient);
-
-        if (*size == -1) {
-            return ES_QUERY_NO_INDEX;
-        }
-
-        if (!*size && IsReparse(folderPath)) {
-            return ES_QUERY_ZERO_SIZE_REPARSE_POINT;
-        }
-
-        return ES_QUERY_OK;
-    }
-
+HWND Everything4Wh_FindIpcWindow() {
     HWND hEverything = FindWindow(EVERYTHING_IPC_WNDCLASSW_15A, nullptr);
     if (hEverything) {
         Wh_Log(L"Found Everything IPC window (v1.5a) 0x%08X",
@@ -1306,10 +1309,10 @@ unsigned Everything4Wh_GetFileSize(PCWSTR folderPath, int64_t* size) {
         }
     }
 
-    if (!hEverything) {
-        return ES_QUERY_NO_ES_IPC;
-    }
+    return hEverything;
+}
 
+HWND Everything4Wh_GetReceiverWnd() {
     if (!g_everything4Wh_Thread) {
         std::lock_guard<std::mutex> guard(g_everything4Wh_ThreadMutex);
 
@@ -1331,15 +1334,20 @@ unsigned Everything4Wh_GetFileSize(PCWSTR folderPath, int64_t* size) {
         }
     }
 
-    HWND hReceiverWnd = g_gsReceiverWnd;
-
-    if (!hReceiverWnd) {
-        return ES_QUERY_NO_PLUGIN_IPC;
-    }
+    return g_gsReceiverWnd;
+}
 
+// Sends a search query to the Everything IPC window and waits for the reply.
+// If children is set, the name and size of all results are stored in it,
+// otherwise only the size of the first result is stored in size.
+unsigned Everything4Wh_SendQuery(HWND hEverything,
+                                 HWND hReceiverWnd,
+                                 std::wstring_view search,
+                                 DWORD maxResults,
+                                 int64_t* size,
+                                 std::vector<EverythingChildSize>* children) {
     DWORD dwSize = sizeof(EVERYTHING_IPC_QUERY2) +
-                   sizeof(GS_SEARCH_PREFIX GS_SEARCH_SUFFIX) +
-                   (wcslen(folderPath) * sizeof(WCHAR));
+                   (DWORD)((search.length() + 1) * sizeof(WCHAR));
     std::vector<BYTE> queryBuffer(dwSize, 0);
     EVERYTHING_IPC_QUERY2* pQuery = (EVERYTHING_IPC_QUERY2*)queryBuffer.data();
 
@@ -1349,14 +1357,15 @@ unsigned Everything4Wh_GetFileSize(PCWSTR folderPath, int64_t* size) {
     pQuery->search_flags =
         EVERYTHING_IPC_MATCHCASE | EVERYTHING_IPC_MATCHDIACRITICS;
     pQuery->offset = 0;
-    pQuery->max_results = 1;
+    pQuery->max_results = maxResults;
     pQuery->request_flags = EVERYTHING_IPC_QUERY2_REQUEST_SIZE;
+    if (children) {
+        pQuery->request_flags |= EVERYTHING_IPC_QUERY2_REQUEST_NAME;
+    }
     // Unused (defined for clarity).
     pQuery->sort_type = EVERYTHING_IPC_SORT_NAME_ASCENDING;
 
-    swprintf_s((LPWSTR)(pQuery + 1),
-               (dwSize - sizeof(*pQuery)) / sizeof(wchar_t), L"%s%s%s",
-               GS_SEARCH_PREFIX, folderPath, GS_SEARCH_SUFFIX);
+    memcpy(pQuery + 1, search.data(), search.length() * sizeof(WCHAR));
 
     COPYDATASTRUCT cds = {
         .dwData = EVERYTHING_IPC_COPYDATA_QUERY2W,
@@ -1369,6 +1378,7 @@ unsigned Everything4Wh_GetFileSize(PCWSTR folderPath, int64_t* size) {
     {
         std::lock_guard<std::mutex> copyDataGuard(g_gsReplyCopyDataMutex);
         g_gsReply.dwID = pQuery->reply_copydata_message;
+        g_gsReply.pChildren = children;
     }
 
     unsigned result;
@@ -1386,8 +1396,6 @@ unsigned Everything4Wh_GetFileSize(PCWSTR folderPath, int64_t* size) {
             result = ES_QUERY_REPLY_TIMEOUT;
         } else if (!g_gsReply.bResult) {
             result = ES_QUERY_NO_INDEX;
-        } else if (!g_gsReply.liSize && IsReparse(folderPath)) {
-            result = ES_QUERY_ZERO_SIZE_REPARSE_POINT;
         } else {
             *size = g_gsReply.liSize;
             result = ES_QUERY_OK;
@@ -1399,11 +1407,156 @@ unsigned Everything4Wh_GetFileSize(PCWSTR folderPath, int64_t* size) {
     {
         std::lock_guard<std::mutex> copyDataGuard(g_gsReplyCopyDataMutex);
         g_gsReply.dwID = 0;
+        g_gsReply.pChildren = nullptr;
+    }
+
+    return result;
+}
+
+unsigned Everything4Wh_GetFileSize(PCWSTR folderPath, int64_t* size) {
+    *size = 0;
+
+    // Prevent querying from within the Everything process to avoid deadlocks.
+    if (g_isEverything) {
+        return ES_QUERY_NO_ES_IPC;
+    }
+
+    EVERYTHING3_CLIENT* pClient = Everything3_ConnectW(nullptr);
+    if (pClient) {
+        Wh_Log(L"Connected to Everything IPC (unnamed instance)");
+    } else {
+        pClient = Everything3_ConnectW(L"1.5a");
+        if (pClient) {
+            Wh_Log(L"Connected to Everything IPC (v1.5a)");
+        }
+    }
+
+    if (pClient) {
+        *size = Everything3_GetFolderSizeFromFilenameW(pClient, folderPath);
+        Everything3_DestroyClient(pClient);
+
+        if (*size == -1) {
+            return ES_QUERY_NO_INDEX;
+        }
+
+        if (!*size && IsReparse(folderPath)) {
+            return ES_QUERY_ZERO_SIZE_REPARSE_POINT;
+        }
+
+        return ES_QUERY_OK;
+    }
+
+    HWND hEverything = Everything4Wh_FindIpcWindow();
+    if (!hEverything) {
+        return ES_QUERY_NO_ES_IPC;
+    }
+
+    HWND hReceiverWnd = Everything4Wh_GetReceiverWnd();
+    if (!hReceiverWnd) {
+        return ES_QUERY_NO_PLUGIN_IPC;
+    }
+
+    std::wstring search = GS_SEARCH_PREFIX;
+    search += folderPath;
+    search += GS_SEARCH_SUFFIX;
+
+    unsigned result = Everything4Wh_SendQuery(hEverything, hReceiverWnd,
+                                              search, 1, size, nullptr);
+    if (result == ES_QUERY_OK && !*size && IsReparse(folderPath)) {
+        result = ES_QUERY_ZERO_SIZE_REPARSE_POINT;
     }
 
     return result;
 }
 
+// Queries the names and sizes of all direct subfolders of a folder with a
+// single search query. Subfolders which aren't indexed are omitted, and the
+// list may be truncated, so callers should fall back to
+// Everything4Wh_GetFileSize for names which aren't found.
+//
+// The SDK3 pipe only supports querying a single folder size, so the query is
+// always sent via the IPC window, which is available in both 1.4 and 1.5.
+unsigned Everything4Wh_GetChildFolderSizes(
+    PCWSTR folderPath,
+    std::vector<EverythingChildSize>* children) {
+    children->clear();
+
+    if (g_isEverything) {
+        return ES_QUERY_NO_ES_IPC;
+    }
+
+    HWND hEverything = Everything4Wh_FindIpcWindow();
+    if (!hEverything) {
+        return ES_QUERY_NO_ES_IPC;
+    }
+
+    HWND hReceiverWnd = Everything4Wh_GetReceiverWnd();
+    if (!hReceiverWnd) {
+        return ES_QUERY_NO_PLUGIN_IPC;
+    }
+
+    std::wstring search = GS_SEARCH_CHILDREN_PREFIX;
+    search += folderPath;
+    search += GS_SEARCH_SUFFIX;
+
+    int64_t unused;
+    return Everything4Wh_SendQuery(hEverything, hReceiverWnd, search,
+                                   kGsMaxChildResults, &unused, children);
+}
+
+// Parses a reply with the name and size of each result. Returns false if the
+// reply is malformed.
+bool Everything4Wh_ParseChildSizes(const COPYDATASTRUCT* pcds,
+                                   std::vector<EverythingChildSize>* children) {
+    const BYTE* data = (const BYTE*)pcds->lpData;
+    const size_t dataSize = pcds->cbData;
+
+    if (dataSize < sizeof(EVERYTHING_IPC_LIST2)) {
+        return false;
+    }
+
+    const EVERYTHING_IPC_LIST2* list = (const EVERYTHING_IPC_LIST2*)data;
+
+    constexpr DWORD kRequiredFlags = EVERYTHING_IPC_QUERY2_REQUEST_NAME |
+                                     EVERYTHING_IPC_QUERY2_REQUEST_SIZE;
+    if ((list->request_flags & kRequiredFlags) != kRequiredFlags ||
+        list->numitems > (dataSize - sizeof(EVERYTHING_IPC_LIST2)) /
+                             sizeof(EVERYTHING_IPC_ITEM2)) {
+        return false;
+    }
+
+    const EVERYTHING_IPC_ITEM2* items = (const EVERYTHING_IPC_ITEM2*)(list + 1);
+
+    children->reserve(list->numitems);
+
+    for (DWORD i = 0; i < list->numitems; i++) {
+        // The item data is a DWORD name length, the null-terminated name,
+        // then the size.
+        size_t offset = items[i].data_offset;
+        if (offset > dataSize || dataSize - offset < sizeof(DWORD)) {
+            return false;
+        }
+
+        DWORD nameLength = *(const DWORD*)(data + offset);
+        offset += sizeof(DWORD);
+
+        size_t nameSize = ((size_t)nameLength + 1) * sizeof(WCHAR);
+        if (dataSize - offset < nameSize + sizeof(int64_t)) {
+            return false;
+        }
+
+        std::wstring name((PCWSTR)(data + offset), nameLength);
+        offset += nameSize;
+
+        int64_t size;
+        memcpy(&size, data + offset, sizeof(size));
+
+        children->push_back({std::move(name), size});
+    }
+
+    return true;
+}
+
 LRESULT CALLBACK Everything4Wh_ReceiverWndProc(HWND hWnd,
                                                UINT uMsg,
                                                WPARAM wParam,
@@ -1414,7 +1567,16 @@ LRESULT CALLBACK Everything4Wh_ReceiverWndProc(HWND hWnd,
 
             COPYDATASTRUCT* pcds = (COPYDATASTRUCT*)lParam;
 
-            if (pcds->dwData == g_gsReply.dwID) {
+            if (pcds->dwData == g_gsReply.dwID && g_gsReply.pChildren) {
+                g_gsReply.liSize = 0;
+                g_gsReply.bResult = Everything4Wh_ParseChildSizes(
+                    pcds, g_gsReply.pChildren);
+                if (!g_gsReply.bResult) {
+                    g_gsReply.pChildren->clear();
+                }
+
+                SetEvent(g_gsReply.hEvent);
+            } else if (pcds->dwData == g_gsReply.dwID) {
                 EVERYTHING_IPC_LIST2* list =
                     (EVERYTHING_IPC_LIST2*)pcds->lpData;
 
@@ -1530,6 +1692,20 @@ thread_local winrt::com_ptr<IShellFolder2> g_cacheShellFolder;
 thread_local std::map<std::vector<BYTE>, std::optional<ULONGLONG>>
     g_cacheShellFolderSizes;
 thread_local DWORD g_cacheShellFolderLastUsedTickCount;
+// Compares file names the way the file system does, ignoring case.
+struct FileNameLess {
+    using is_transparent = void;
+
+    bool operator()(std::wstring_view a, std::wstring_view b) const {
+        return CompareStringOrdinal(a.data(), a.size(), b.data(), b.size(),
+                                    TRUE) == CSTR_LESS_THAN;
+    }
+};
+
+// Sizes of the subfolders of g_cacheShellFolder by name, queried from
+// Everything on the first size request of a listing.
+thread_local std::optional<std::map<std::wstring, int64_t, FileNameLess>>
+    g_cacheEverythingChildSizes;
 
 constexpr GUID KStorage = {0xB725F130,
                            0x47EF,
@@ -1539,7 +1715,8 @@ constexpr PROPERTYKEY kPKEY_Size = {KStorage, 12};
 
 class SizeCalculator : public INamespaceWalkCB2 {
    public:
-    SizeCalculator() : m_totalSize(0) {}
+    explicit SizeCalculator(const std::atomic<bool>* cancelled)
+        : m_totalSize(0), m_cancelled(cancelled) {}
     virtual ~SizeCalculator() {}
 
     // IUnknown methods
@@ -1572,6 +1749,10 @@ class SizeCalculator : public INamespaceWalkCB2 {
     // INamespaceWalkCB methods
     HRESULT STDMETHODCALLTYPE FoundItem(IShellFolder* psf,
                                         LPCITEMIDLIST pidl) override {
+        if (IsCancelled()) {
+            return HRESULT_FROM_WIN32(ERROR_CANCELLED);
+        }
+
         winrt::com_ptr<IShellFolder2> psf2;
         HRESULT hr = psf->QueryInterface(IID_PPV_ARGS(psf2.put()));
         if (FAILED(hr)) {
@@ -1590,7 +1771,7 @@ class SizeCalculator : public INamespaceWalkCB2 {
 
     HRESULT STDMETHODCALLTYPE EnterFolder(IShellFolder* /*psf*/,
                                           LPCITEMIDLIST /*pidl*/) override {
-        return S_OK;
+        return IsCancelled() ? HRESULT_FROM_WIN32(ERROR_CANCELLED) : S_OK;
     }
 
     HRESULT STDMETHODCALLTYPE LeaveFolder(IShellFolder* /*psf*/,
@@ -1610,11 +1791,16 @@ class SizeCalculator : public INamespaceWalkCB2 {
     ULONGLONG GetTotalSize() const { return m_totalSize; }
 
    private:
+    bool IsCancelled() const { return m_cancelled && *m_cancelled; }
+
     ULONG m_refCount = 1;
     ULONGLONG m_totalSize;
+    const std::atomic<bool>* m_cancelled;
 };
 
-std::optional<ULONGLONG> CalculateFolderSize(IShellFolder2* shellFolder) {
+std::optional<ULONGLONG> CalculateFolderSizeWithNamespaceWalker(
+    IShellFolder2* shellFolder,
+    const std::atomic<bool>* cancelled = nullptr) {
     // Create the namespace walker.
     winrt::com_ptr<INamespaceWalk> namespaceWalk;
     HRESULT hr = CoCreateInstance(CLSID_NamespaceWalker, nullptr, CLSCTX_INPROC,
@@ -1625,7 +1811,7 @@ std::optional<ULONGLONG> CalculateFolderSize(IShellFolder2* shellFolder) {
     }
 
     // Create the callback object.
-    SizeCalculator* callback = new SizeCalculator();
+    SizeCalculator* callback = new SizeCalculator(cancelled);
 
     // Enumerate child items and sum sizes in the callback.
     hr = namespaceWalk->Walk(
@@ -1643,109 +1829,2247 @@ std::optional<ULONGLONG> CalculateFolderSize(IShellFolder2* shellFolder) {
     return totalSize;
 }
 
-std::wstring GetFolderPathFromIShellFolder(IShellFolder2* shellFolder) {
-    LPITEMIDLIST pidl;
-    HRESULT hr = SHGetIDListFromObject(shellFolder, &pidl);
-    if (FAILED(hr)) {
-        return {};
+struct FolderSizeTotals {
+    ULONGLONG size = 0;
+    ULONGLONG fileCount = 0;
+    ULONGLONG folderCount = 0;
+
+    void Add(const FolderSizeTotals& other) {
+        size += other.size;
+        fileCount += other.fileCount;
+        folderCount += other.folderCount;
     }
+};
 
-    std::wstring path;
-    path.resize(MAX_PATH);
-    while (
-        !SHGetPathFromIDListEx(pidl, &path[0], path.size(), GPFIDL_DEFAULT)) {
-        // The maximum path length is documented to be "approximately" 32,767.
-        if (path.size() >= 32767 + 256) {
-            CoTaskMemFree(pidl);
-            return {};
-        }
+// Returns the path in the form used as a cache key: without the
+// extended-length prefix and trailing backslashes, and in upper case, since
+// paths are case insensitive.
+std::wstring NormalizeFolderPath(std::wstring_view path) {
+    std::wstring result;
 
-        path.resize(path.size() * 2);
+    constexpr auto kUncPrefix = L"\\\\?\\UNC\\"sv;
+    constexpr auto kLocalPrefix = L"\\\\?\\"sv;
+    if (path.starts_with(kUncPrefix)) {
+        path.remove_prefix(kUncPrefix.size());
+        result = L"\\\\";
+    } else if (path.starts_with(kLocalPrefix)) {
+        path.remove_prefix(kLocalPrefix.size());
     }
 
-    path.resize(wcslen(path.c_str()));
-    CoTaskMemFree(pidl);
+    while (path.ends_with(L'\\')) {
+        path.remove_suffix(1);
+    }
 
-    // SHGetPathFromIDListEx() for long path returns path with super path prefix
-    // "\\\\?\\".
-    constexpr auto kSuperPathPrefix = L"\\\\?\\"sv;
-    if (path.starts_with(kSuperPathPrefix)) {
-        path = path.substr(kSuperPathPrefix.size());
+    result += path;
+    CharUpperBuff(result.data(), result.size());
+    return result;
+}
+
+// Returns the volume part of a normalized path, such as "C:" or
+// "\\SERVER\SHARE".
+std::wstring_view GetVolumePath(std::wstring_view normalizedPath) {
+    size_t volumeLength;
+    if (normalizedPath.starts_with(L"\\\\"sv)) {
+        size_t serverEnd = normalizedPath.find(L'\\', 2);
+        volumeLength = serverEnd == normalizedPath.npos
+                           ? normalizedPath.npos
+                           : normalizedPath.find(L'\\', serverEnd + 1);
+    } else {
+        volumeLength = normalizedPath.find(L'\\');
     }
 
-    return path;
+    return normalizedPath.substr(0, volumeLength);
 }
 
-using CFSFolder__GetSize_t = HRESULT(WINAPI*)(void* pCFSFolder,
-                                              const ITEMID_CHILD* itemidChild,
-                                              const void* idFolder,
-                                              PROPVARIANT* propVariant);
-CFSFolder__GetSize_t CFSFolder__GetSize_Original;
-HRESULT WINAPI CFSFolder__GetSize_Hook(void* pCFSFolder,
-                                       const ITEMID_CHILD* itemidChild,
-                                       const void* idFolder,
-                                       PROPVARIANT* propVariant) {
-    auto hookScope = hookRefCountScope();
+// Returns true if the normalized path is the folder or one of its descendants.
+bool IsPathInFolder(std::wstring_view normalizedPath,
+                    std::wstring_view normalizedFolderPath) {
+    return normalizedPath.starts_with(normalizedFolderPath) &&
+           (normalizedPath.size() == normalizedFolderPath.size() ||
+            normalizedPath[normalizedFolderPath.size()] == L'\\');
+}
 
-    HRESULT ret = CFSFolder__GetSize_Original(pCFSFolder, itemidChild, idFolder,
-                                              propVariant);
-    if (g_inCRecursiveFolderOperation_Prepare ||
-        g_inCRecursiveFolderOperation_Do || ret != S_OK ||
-        propVariant->vt != VT_EMPTY) {
-        return ret;
-    }
+// Receives file system change notifications.
+class FolderChangeSink {
+   public:
+    virtual ~FolderChangeSink() = default;
 
-    switch (g_settings.calculateFolderSizes) {
-        case CalculateFolderSizes::disabled:
-            return ret;
+    // An item in the folder was added, removed, renamed, or resized. The path
+    // is a normalized path.
+    virtual void OnFolderChanged(std::wstring_view folderPath) = 0;
 
-        case CalculateFolderSizes::withShiftKey:
-            if (GetAsyncKeyState(VK_SHIFT) >= 0) {
-                return ret;
-            }
-            break;
+    // Changes in the folder and its subfolders might have been missed, for
+    // example if the notification buffer overflowed, or are no longer
+    // reported. The path is a normalized path.
+    virtual void OnChangesLost(std::wstring_view folderPath) = 0;
+};
 
-        case CalculateFolderSizes::everything:
-        case CalculateFolderSizes::always:
-            break;
+// A source of file system change notifications for a FolderChangeSink.
+class FolderChangeFeed {
+   public:
+    virtual ~FolderChangeFeed() = default;
+
+    // Starts reporting changes in the folder and its subfolders, if not
+    // reported already. The path is a normalized path. Returns false if
+    // changes in the folder can't be tracked. If wait is false, also returns
+    // false while the reporting is still starting instead of waiting for it.
+    virtual bool WatchFolder(std::wstring_view folderPath, bool wait) = 0;
+};
+
+// A process-wide cache of folder sizes, stored as a tree of folders with the
+// totals of the files directly in each folder. The totals of whole subtrees
+// are aggregated on demand and kept until a change is reported for a folder
+// in the subtree, so that a change only invalidates the changed folder and
+// its ancestors. Only folders watched by a FolderChangeFeed should be stored.
+// Folders which are no longer watched, or were loaded from disk, are kept as
+// hints until they're walked again.
+class FolderSizeCache final : public FolderChangeSink {
+   public:
+    static constexpr size_t kMaxNodes = 100000;
+    static constexpr size_t kMaxChangeLogSize = 4096;
+
+    struct Subfolder {
+        std::wstring name;
+        FILETIME lastWriteTime;
+    };
+
+    // The result of enumerating a single folder: the totals of its direct
+    // children, and its subfolders, not including reparse points.
+    struct FolderRecord {
+        std::wstring path;
+        FolderSizeTotals totals;
+        std::vector<Subfolder> subfolders;
+    };
+
+    // Returns the totals of the folder and all of its subfolders, if they're
+    // all cached and up to date.
+    std::optional<FolderSizeTotals> Lookup(std::wstring_view folderPath) {
+        std::wstring normalizedPath = NormalizeFolderPath(folderPath);
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        Node* node = FindNode(normalizedPath, /*create=*/false);
+        if (!node) {
+            return std::nullopt;
+        }
+
+        node->lastUsedTickCount = GetTickCount64();
+        return GetSubtreeTotals(node, /*includeUnverified=*/false);
     }
 
-    Wh_Log(L">");
+    // Like Lookup, but doesn't mark the folder as recently used. Used while
+    // walking a folder tree.
+    std::optional<FolderSizeTotals> LookupSubtree(
+        std::wstring_view folderPath) {
+        std::wstring normalizedPath = NormalizeFolderPath(folderPath);
 
-    winrt::com_ptr<IShellFolder2> shellFolder2;
-    HRESULT hr =
-        ((IUnknown*)pCFSFolder)
-            ->QueryInterface(IID_IShellFolder2, shellFolder2.put_void());
-    if (FAILED(hr) || !shellFolder2) {
-        Wh_Log(L"Failed: %08X", hr);
-        return S_OK;
+        std::lock_guard<std::mutex> guard(m_mutex);
+        Node* node = FindNode(normalizedPath, /*create=*/false);
+        if (!node) {
+            return std::nullopt;
+        }
+
+        return GetSubtreeTotals(node, /*includeUnverified=*/false);
     }
 
-    if (shellFolder2 != g_cacheShellFolder ||
-        GetTickCount() - g_cacheShellFolderLastUsedTickCount > 1000) {
-        g_cacheShellFolderSizes.clear();
+    // Like Lookup, but also uses folders which are no longer tracked, such as
+    // folders loaded from disk. A change to the size of an existing file
+    // doesn't change its folder's last write time, so these totals might be
+    // out of date, and should only be shown until the folder is walked again.
+    std::optional<FolderSizeTotals> LookupHint(std::wstring_view folderPath) {
+        std::wstring normalizedPath = NormalizeFolderPath(folderPath);
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        Node* node = FindNode(normalizedPath, /*create=*/false);
+        if (!node) {
+            return std::nullopt;
+        }
+
+        return GetSubtreeTotals(node, /*includeUnverified=*/true);
     }
 
-    g_cacheShellFolder = shellFolder2;
+    // Returns the cached record of a single folder if it's up to date, so that
+    // the folder doesn't have to be enumerated again to get to a changed
+    // subfolder.
+    std::optional<FolderRecord> LookupFolder(std::wstring_view folderPath) {
+        std::wstring normalizedPath = NormalizeFolderPath(folderPath);
 
-    auto [cacheIt, cacheMissing] = g_cacheShellFolderSizes.try_emplace(
-        PIDLToVector(itemidChild), std::nullopt);
+        std::lock_guard<std::mutex> guard(m_mutex);
+        Node* node = FindNode(normalizedPath, /*create=*/false);
+        if (!node || !IsNodeUsable(node)) {
+            return std::nullopt;
+        }
 
-    if (cacheMissing) {
-        winrt::com_ptr<IShellFolder2> childFolder;
-        hr = shellFolder2->BindToObject(itemidChild, nullptr,
-                                        IID_PPV_ARGS(childFolder.put()));
-        if (FAILED(hr) || !childFolder) {
-            Wh_Log(L"Failed: %08X", hr);
-        } else if (g_settings.calculateFolderSizes ==
-                   CalculateFolderSizes::everything) {
-            const auto path = GetFolderPathFromIShellFolder(childFolder.get());
-            if (!path.empty()) {
-                Wh_Log(L"Getting size for %s", path.c_str());
+        FolderRecord record{.totals = node->totals};
+        record.subfolders.reserve(node->children.size());
+        for (const auto& [name, child] : node->children) {
+            record.subfolders.push_back({name, child->lastWriteTime});
+        }
 
-                int64_t size;
-                unsigned result =
-                    Everything4Wh_GetFileSize(path.c_str(), &size);
+        return record;
+    }
+
+    // Returns a value to pass to Store, to detect changes which happened
+    // while the folders were enumerated.
+    uint64_t GetChangeSequence() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_changeSequence;
+    }
+
+    // Stores the results of walking the folder tree of rootPath. Records of
+    // folders which changed since changeSequence was retrieved are dropped.
+    void Store(std::wstring_view rootPath,
+               std::vector<FolderRecord> records,
+               uint64_t changeSequence) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        if (m_changeSequence - changeSequence > m_changeLog.size()) {
+            // Too many changes to tell which folders changed.
+            return;
+        }
+
+        std::vector<std::wstring_view> changedFolders;
+        std::vector<std::wstring_view> changedSubtrees;
+        for (auto it = m_changeLog.end() - (m_changeSequence - changeSequence);
+             it != m_changeLog.end(); ++it) {
+            (it->subtree ? changedSubtrees : changedFolders)
+                .push_back(it->path);
+        }
+
+        std::sort(changedFolders.begin(), changedFolders.end());
+
+        auto isChanged = [&changedFolders,
+                          &changedSubtrees](std::wstring_view path) {
+            return std::binary_search(changedFolders.begin(),
+                                      changedFolders.end(), path) ||
+                   std::any_of(changedSubtrees.begin(), changedSubtrees.end(),
+                               [path](std::wstring_view subtreePath) {
+                                   return IsPathInFolder(path, subtreePath);
+                               });
+        };
+
+        for (auto& record : records) {
+            record.path = NormalizeFolderPath(record.path);
+        }
+
+        // Store parents before their subfolders, so that the subfolders' last
+        // write times are updated before their records are stored.
+        std::sort(records.begin(), records.end(),
+                  [](const FolderRecord& a, const FolderRecord& b) {
+                      return a.path < b.path;
+                  });
+
+        for (const auto& record : records) {
+            if (isChanged(record.path)) {
+                continue;
+            }
+
+            Node* node = FindNode(record.path, /*create=*/true);
+            node->totals = record.totals;
+            node->totalsValid = true;
+            node->unverified = false;
+            SetSubfolders(node, record.subfolders);
+            InvalidateSubtreeTotals(node);
+        }
+
+        if (Node* root =
+                FindNode(NormalizeFolderPath(rootPath), /*create=*/false)) {
+            root->lastUsedTickCount = GetTickCount64();
+        }
+
+        if (m_nodeCount > kMaxNodes) {
+            Evict();
+        }
+    }
+
+    void OnFolderChanged(std::wstring_view folderPath) override {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        InvalidateFolder(folderPath);
+        LogChange(folderPath, /*subtree=*/false);
+    }
+
+    void OnChangesLost(std::wstring_view folderPath) override {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (Node* node = FindNode(folderPath, /*create=*/false)) {
+            InvalidateSubtreeTotals(node);
+            MarkSubtreeUnverified(node);
+        }
+
+        LogChange(folderPath, /*subtree=*/true);
+    }
+
+    bool LoadFromFile(PCWSTR filePath);
+    bool SaveToFile(PCWSTR filePath);
+
+   private:
+    struct Node;
+    using NodeMap = std::map<std::wstring, std::unique_ptr<Node>, std::less<>>;
+
+    struct Node {
+        Node* parent = nullptr;
+        std::wstring_view name;
+        NodeMap children;
+        FolderSizeTotals totals;
+        std::optional<FolderSizeTotals> subtreeTotals;
+        FILETIME lastWriteTime{};
+        ULONGLONG lastUsedTickCount = 0;
+        bool totalsValid = false;
+        // Not tracked by the change feed, for example if loaded from disk, so
+        // the totals are only a hint until the folder is walked again.
+        bool unverified = false;
+    };
+
+    // A change reported for a single folder, or for a whole subtree.
+    struct Change {
+        std::wstring path;
+        bool subtree;
+    };
+
+    static constexpr uint32_t kFileMagic = 0x435A5346;  // "FSZC"
+    static constexpr uint32_t kFileVersion = 1;
+
+    template <typename Callback>
+    static void ForEachPathComponent(std::wstring_view path,
+                                     Callback callback) {
+        while (!path.empty()) {
+            size_t separator = path.find(L'\\');
+            if (separator != 0) {
+                if (!callback(path.substr(0, separator))) {
+                    return;
+                }
+            }
+
+            if (separator == path.npos) {
+                break;
+            }
+
+            path.remove_prefix(separator + 1);
+        }
+    }
+
+    Node* AddChild(NodeMap& children, Node* parent, std::wstring_view name) {
+        auto [it, inserted] =
+            children.try_emplace(std::wstring(name), std::make_unique<Node>());
+        Node* node = it->second.get();
+        if (inserted) {
+            node->parent = parent;
+            node->name = it->first;
+            m_nodeCount++;
+        }
+
+        return node;
+    }
+
+    Node* FindNode(std::wstring_view normalizedPath, bool create) {
+        std::wstring_view volumePath = GetVolumePath(normalizedPath);
+        if (volumePath.empty()) {
+            return nullptr;
+        }
+
+        Node* node;
+        if (create) {
+            node = AddChild(m_volumes, nullptr, volumePath);
+        } else {
+            auto it = m_volumes.find(volumePath);
+            if (it == m_volumes.end()) {
+                return nullptr;
+            }
+
+            node = it->second.get();
+        }
+
+        ForEachPathComponent(
+            normalizedPath.substr(volumePath.size()),
+            [this, &node, create](std::wstring_view name) {
+                if (create) {
+                    node = AddChild(node->children, node, name);
+                    return true;
+                }
+
+                auto it = node->children.find(name);
+                node = it != node->children.end() ? it->second.get() : nullptr;
+                return node != nullptr;
+            });
+
+        return node;
+    }
+
+    static std::wstring GetNodePath(const Node* node) {
+        std::vector<std::wstring_view> names;
+        for (; node; node = node->parent) {
+            names.push_back(node->name);
+        }
+
+        std::wstring path;
+        for (auto it = names.rbegin(); it != names.rend(); ++it) {
+            if (!path.empty()) {
+                path += L'\\';
+            }
+
+            path += *it;
+        }
+
+        return path;
+    }
+
+    static size_t CountNodes(const Node* root) {
+        size_t count = 0;
+        std::vector<const Node*> stack{root};
+        while (!stack.empty()) {
+            const Node* node = stack.back();
+            stack.pop_back();
+            count++;
+            for (const auto& [name, child] : node->children) {
+                stack.push_back(child.get());
+            }
+        }
+
+        return count;
+    }
+
+    static void InvalidateSubtreeTotals(Node* node) {
+        for (; node; node = node->parent) {
+            node->subtreeTotals.reset();
+        }
+    }
+
+    void InvalidateFolder(std::wstring_view normalizedPath) {
+        std::wstring_view volumePath = GetVolumePath(normalizedPath);
+        auto it = m_volumes.find(volumePath);
+        if (it == m_volumes.end()) {
+            return;
+        }
+
+        // Invalidate the aggregated totals of all cached ancestors, even if
+        // the folder itself isn't cached.
+        Node* node = it->second.get();
+        node->subtreeTotals.reset();
+        bool found = true;
+        ForEachPathComponent(normalizedPath.substr(volumePath.size()),
+                             [&node, &found](std::wstring_view name) {
+                                 auto it = node->children.find(name);
+                                 if (it == node->children.end()) {
+                                     found = false;
+                                     return false;
+                                 }
+
+                                 node = it->second.get();
+                                 node->subtreeTotals.reset();
+                                 return true;
+                             });
+
+        if (found) {
+            node->totalsValid = false;
+        }
+    }
+
+    void LogChange(std::wstring_view normalizedPath, bool subtree) {
+        m_changeSequence++;
+        m_changeLog.push_back({std::wstring(normalizedPath), subtree});
+        if (m_changeLog.size() > kMaxChangeLogSize) {
+            m_changeLog.pop_front();
+        }
+    }
+
+    void SetSubfolders(Node* node, const std::vector<Subfolder>& subfolders) {
+        NodeMap children;
+        for (const auto& subfolder : subfolders) {
+            std::wstring name = subfolder.name;
+            CharUpperBuff(name.data(), name.size());
+
+            Node* child;
+            if (auto nodeHandle = node->children.extract(name)) {
+                child = nodeHandle.mapped().get();
+                children.insert(std::move(nodeHandle));
+            } else {
+                child = AddChild(children, node, name);
+            }
+
+            if (CompareFileTime(&child->lastWriteTime,
+                                &subfolder.lastWriteTime) != 0) {
+                child->lastWriteTime = subfolder.lastWriteTime;
+                child->totalsValid = false;
+                child->subtreeTotals.reset();
+            }
+        }
+
+        // The remaining children no longer exist.
+        for (const auto& [name, child] : node->children) {
+            m_nodeCount -= CountNodes(child.get());
+        }
+
+        node->children = std::move(children);
+    }
+
+    static bool IsNodeUsable(const Node* node) {
+        return node->totalsValid && !node->unverified;
+    }
+
+    static void MarkSubtreeUnverified(Node* root) {
+        std::vector<Node*> stack{root};
+        while (!stack.empty()) {
+            Node* node = stack.back();
+            stack.pop_back();
+            node->unverified = true;
+            node->subtreeTotals.reset();
+            for (const auto& [name, child] : node->children) {
+                stack.push_back(child.get());
+            }
+        }
+    }
+
+    // Returns the totals of the subtree if all of its folders are cached,
+    // and keeps the aggregated totals of the subtree and its subfolders. Hints
+    // which include unverified folders aren't kept.
+    static std::optional<FolderSizeTotals> GetSubtreeTotals(
+        Node* root,
+        bool includeUnverified) {
+        if (root->subtreeTotals) {
+            return root->subtreeTotals;
+        }
+
+        auto isUsable = [includeUnverified](const Node* node) {
+            return includeUnverified ? node->totalsValid : IsNodeUsable(node);
+        };
+
+        if (!isUsable(root)) {
+            return std::nullopt;
+        }
+
+        // An explicit stack is used since folder trees can be very deep.
+        struct Frame {
+            Node* node;
+            NodeMap::iterator nextChild;
+            FolderSizeTotals totals;
+        };
+
+        std::vector<Frame> stack;
+        stack.push_back({root, root->children.begin(), root->totals});
+        while (true) {
+            Frame& frame = stack.back();
+            if (frame.nextChild == frame.node->children.end()) {
+                if (!includeUnverified) {
+                    frame.node->subtreeTotals = frame.totals;
+                }
+
+                FolderSizeTotals totals = frame.totals;
+                stack.pop_back();
+                if (stack.empty()) {
+                    return totals;
+                }
+
+                stack.back().totals.Add(totals);
+                continue;
+            }
+
+            Node* child = frame.nextChild->second.get();
+            ++frame.nextChild;
+
+            if (child->subtreeTotals) {
+                frame.totals.Add(*child->subtreeTotals);
+            } else if (isUsable(child)) {
+                stack.push_back(
+                    {child, child->children.begin(), child->totals});
+            } else {
+                return std::nullopt;
+            }
+        }
+    }
+
+    // Removes the least recently walked folder trees until the cache is
+    // reduced to three quarters of its maximum size.
+    void Evict() {
+        std::vector<std::pair<ULONGLONG, std::wstring>> walkedFolders;
+        std::vector<const Node*> stack;
+        for (const auto& [name, volume] : m_volumes) {
+            stack.push_back(volume.get());
+        }
+
+        while (!stack.empty()) {
+            const Node* node = stack.back();
+            stack.pop_back();
+
+            if (node->lastUsedTickCount) {
+                walkedFolders.push_back(
+                    {node->lastUsedTickCount, GetNodePath(node)});
+            }
+
+            for (const auto& [name, child] : node->children) {
+                stack.push_back(child.get());
+            }
+        }
+
+        std::sort(walkedFolders.begin(), walkedFolders.end());
+
+        for (const auto& [tickCount, path] : walkedFolders) {
+            if (m_nodeCount <= kMaxNodes / 4 * 3) {
+                break;
+            }
+
+            // Might have been removed with an ancestor.
+            Node* node = FindNode(path, /*create=*/false);
+            if (!node) {
+                continue;
+            }
+
+            m_nodeCount -= CountNodes(node);
+
+            Node* parent = node->parent;
+            if (!parent) {
+                m_volumes.erase(m_volumes.find(node->name));
+                continue;
+            }
+
+            // The parent's list of subfolders is now incomplete.
+            parent->totalsValid = false;
+            InvalidateSubtreeTotals(parent);
+            parent->children.erase(parent->children.find(node->name));
+        }
+
+        Wh_Log(L"Folder size cache: %zu folders after eviction", m_nodeCount);
+    }
+
+    std::mutex m_mutex;
+    NodeMap m_volumes;
+    size_t m_nodeCount = 0;
+    uint64_t m_changeSequence = 0;
+    std::deque<Change> m_changeLog;
+};
+
+bool FolderSizeCache::SaveToFile(PCWSTR filePath) {
+    std::vector<BYTE> buffer;
+    auto write = [&buffer](const void* data, size_t size) {
+        const BYTE* p = static_cast<const BYTE*>(data);
+        buffer.insert(buffer.end(), p, p + size);
+    };
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        uint32_t header[] = {kFileMagic, kFileVersion,
+                             static_cast<uint32_t>(m_volumes.size())};
+        write(header, sizeof(header));
+
+        // Nodes are written in pre-order, each followed by its children.
+        std::vector<const Node*> stack;
+        for (auto it = m_volumes.rbegin(); it != m_volumes.rend(); ++it) {
+            stack.push_back(it->second.get());
+        }
+
+        while (!stack.empty()) {
+            const Node* node = stack.back();
+            stack.pop_back();
+
+            uint32_t nameLength = static_cast<uint32_t>(node->name.size());
+            write(&nameLength, sizeof(nameLength));
+            write(node->name.data(), nameLength * sizeof(WCHAR));
+            write(&node->lastWriteTime, sizeof(node->lastWriteTime));
+            write(&node->totals, sizeof(node->totals));
+            uint32_t flags = node->totalsValid;
+            write(&flags, sizeof(flags));
+            uint32_t childCount = static_cast<uint32_t>(node->children.size());
+            write(&childCount, sizeof(childCount));
+
+            for (auto it = node->children.rbegin(); it != node->children.rend();
+                 ++it) {
+                stack.push_back(it->second.get());
+            }
+        }
+    }
+
+    std::wstring tempFilePath = filePath;
+    tempFilePath += L"." + std::to_wstring(GetCurrentProcessId()) + L".tmp";
+
+    HANDLE file = CreateFile(tempFilePath.c_str(), GENERIC_WRITE, 0, nullptr,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        Wh_Log(L"CreateFile failed: %u", GetLastError());
+        return false;
+    }
+
+    DWORD written = 0;
+    bool succeeded =
+        WriteFile(file, buffer.data(), static_cast<DWORD>(buffer.size()),
+                  &written, nullptr) &&
+        written == buffer.size();
+    CloseHandle(file);
+
+    if (!succeeded || !MoveFileEx(tempFilePath.c_str(), filePath,
+                                  MOVEFILE_REPLACE_EXISTING)) {
+        Wh_Log(L"Failed to write folder size cache: %u", GetLastError());
+        DeleteFile(tempFilePath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool FolderSizeCache::LoadFromFile(PCWSTR filePath) {
+    HANDLE file = CreateFile(filePath, GENERIC_READ,
+                             FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    std::vector<BYTE> buffer;
+    LARGE_INTEGER fileSize;
+    DWORD bytesRead = 0;
+    bool succeeded = GetFileSizeEx(file, &fileSize) &&
+                     fileSize.QuadPart <= 256 * 1024 * 1024;
+    if (succeeded) {
+        buffer.resize(static_cast<size_t>(fileSize.QuadPart));
+        succeeded = ReadFile(file, buffer.data(),
+                             static_cast<DWORD>(buffer.size()), &bytesRead,
+                             nullptr) &&
+                    bytesRead == buffer.size();
+    }
+
+    CloseHandle(file);
+
+    if (!succeeded) {
+        return false;
+    }
+
+    const BYTE* p = buffer.data();
+    const BYTE* end = p + buffer.size();
+    auto read = [&p, end](void* data, size_t size) {
+        if (size > static_cast<size_t>(end - p)) {
+            return false;
+        }
+
+        memcpy(data, p, size);
+        p += size;
+        return true;
+    };
+
+    uint32_t header[3];
+    if (!read(header, sizeof(header)) || header[0] != kFileMagic ||
+        header[1] != kFileVersion) {
+        return false;
+    }
+
+    NodeMap volumes;
+    size_t nodeCount = 0;
+
+    // Each entry holds a parent and the number of its children which are
+    // yet to be read.
+    std::vector<std::pair<Node*, uint32_t>> stack;
+    stack.push_back({nullptr, header[2]});
+    while (!stack.empty()) {
+        auto& [parent, remainingChildren] = stack.back();
+        if (remainingChildren == 0) {
+            stack.pop_back();
+            continue;
+        }
+
+        remainingChildren--;
+
+        uint32_t nameLength;
+        if (!read(&nameLength, sizeof(nameLength)) ||
+            nameLength > static_cast<size_t>(end - p) / sizeof(WCHAR)) {
+            return false;
+        }
+
+        std::wstring name(reinterpret_cast<const WCHAR*>(p), nameLength);
+        p += nameLength * sizeof(WCHAR);
+
+        auto node = std::make_unique<Node>();
+        uint32_t flags;
+        uint32_t childCount;
+        if (!read(&node->lastWriteTime, sizeof(node->lastWriteTime)) ||
+            !read(&node->totals, sizeof(node->totals)) ||
+            !read(&flags, sizeof(flags)) ||
+            !read(&childCount, sizeof(childCount))) {
+            return false;
+        }
+
+        node->parent = parent;
+        node->totalsValid = flags & 1;
+        node->unverified = node->totalsValid;
+
+        NodeMap& siblings = parent ? parent->children : volumes;
+        auto [it, inserted] = siblings.try_emplace(name, std::move(node));
+        if (!inserted) {
+            return false;
+        }
+
+        it->second->name = it->first;
+        nodeCount++;
+
+        stack.push_back({it->second.get(), childCount});
+    }
+
+    if (p != end) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_volumes = std::move(volumes);
+    m_nodeCount = nodeCount;
+    m_changeSequence++;
+    m_changeLog.clear();
+
+    Wh_Log(L"Loaded %zu folders from the folder size cache", m_nodeCount);
+    return true;
+}
+
+// Reports changes with ReadDirectoryChangesW, watching the subtrees of folders
+// from a single thread, which is only created once a folder is watched. Only
+// folders on fixed drives are watched, since an open handle prevents a
+// removable drive from being ejected, and watching network shares is costly
+// and unreliable. Watches which weren't used for a while are released, and
+// the cached folders in them are no longer tracked.
+class DirectoryChangeFeed final : public FolderChangeFeed {
+   public:
+    // The stop and wake events take two of the wait handles.
+    static constexpr size_t kMaxWatches = MAXIMUM_WAIT_OBJECTS - 2;
+
+    static constexpr DWORD kBufferSize = 64 * 1024;
+
+    static constexpr ULONGLONG kIdleTimeout = 5 * 60 * 1000;
+    static constexpr DWORD kIdleCheckInterval = 60 * 1000;
+
+    // How long to wait for the feed thread to start a new watch.
+    static constexpr DWORD kStartTimeout = 1000;
+
+    // Renaming or moving a watched folder isn't reported by its own watch, so
+    // its path is checked before the watch is reused, at most this often.
+    static constexpr ULONGLONG kPathCheckInterval = 1000;
+
+    explicit DirectoryChangeFeed(FolderChangeSink& sink) : m_sink(sink) {
+        m_stopEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+        m_wakeEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+    }
+
+    ~DirectoryChangeFeed() override {
+        if (m_thread) {
+            SetEvent(m_stopEvent);
+            WaitForSingleObject(m_thread, INFINITE);
+            CloseHandle(m_thread);
+        }
+
+        for (auto& watch : m_watches) {
+            if (watch->reading) {
+                CancelRead(watch.get());
+            }
+        }
+
+        m_watches.clear();
+
+        CloseHandle(m_wakeEvent);
+        CloseHandle(m_stopEvent);
+    }
+
+    bool WatchFolder(std::wstring_view folderPath, bool wait) override {
+        std::shared_ptr<FolderWatch> watch;
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            watch = FindWatch(folderPath);
+            if (watch && watch->started) {
+                return watch->reading;
+            }
+
+            if (!watch) {
+                if (!CanWatchVolume(GetVolumePath(folderPath))) {
+                    return false;
+                }
+
+                if (!m_thread) {
+                    m_thread =
+                        CreateThread(nullptr, 0, Thread, this, 0, nullptr);
+                    if (!m_thread) {
+                        Wh_Log(L"CreateThread failed: %u", GetLastError());
+                        return false;
+                    }
+                }
+
+                ReleaseWatchIfFull();
+
+                watch = std::make_shared<FolderWatch>();
+                watch->folderPath = folderPath;
+                watch->overlapped.hEvent =
+                    CreateEvent(nullptr, TRUE, FALSE, nullptr);
+                watch->startedEvent =
+                    CreateEvent(nullptr, TRUE, FALSE, nullptr);
+                watch->buffer.resize(kBufferSize / sizeof(DWORD));
+                watch->lastUsedTickCount = GetTickCount64();
+                watch->pathCheckTickCount = watch->lastUsedTickCount;
+                m_watches.push_back(watch);
+            }
+        }
+
+        // The reads are issued by the feed thread, since I/O is canceled
+        // when the thread which issued it exits.
+        SetEvent(m_wakeEvent);
+        if (WaitForSingleObject(watch->startedEvent,
+                                wait ? kStartTimeout : 0) != WAIT_OBJECT_0) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return watch->reading;
+    }
+
+   private:
+    struct FolderWatch {
+        ~FolderWatch() {
+            if (directory != INVALID_HANDLE_VALUE) {
+                CloseHandle(directory);
+            }
+
+            CloseHandle(overlapped.hEvent);
+            CloseHandle(startedEvent);
+        }
+
+        std::wstring folderPath;
+        std::wstring finalPath;
+        HANDLE directory = INVALID_HANDLE_VALUE;
+        HANDLE startedEvent = nullptr;
+        OVERLAPPED overlapped{};
+        std::vector<DWORD> buffer;
+        ULONGLONG lastUsedTickCount = 0;
+        ULONGLONG pathCheckTickCount = 0;
+        bool started = false;
+        bool reading = false;
+        bool releasing = false;
+    };
+
+    static DWORD WINAPI Thread(void* parameter) {
+        static_cast<DirectoryChangeFeed*>(parameter)->Run();
+        return 0;
+    }
+
+    static bool CanWatchVolume(std::wstring_view volumePath) {
+        if (volumePath.starts_with(L"\\\\"sv)) {
+            return false;
+        }
+
+        std::wstring rootPath(volumePath);
+        rootPath += L'\\';
+        UINT driveType = GetDriveType(rootPath.c_str());
+        return driveType == DRIVE_FIXED || driveType == DRIVE_RAMDISK;
+    }
+
+    static std::wstring GetFinalPath(HANDLE directory) {
+        DWORD size = GetFinalPathNameByHandle(directory, nullptr, 0,
+                                              FILE_NAME_NORMALIZED);
+        if (!size) {
+            return std::wstring{};
+        }
+
+        std::wstring path(size, L'\0');
+        size = GetFinalPathNameByHandle(directory, path.data(), path.size(),
+                                        FILE_NAME_NORMALIZED);
+        path.resize(size < path.size() ? size : 0);
+        return path;
+    }
+
+    // Returns a watch which covers the folder, and marks it as used. Must be
+    // called with the mutex held.
+    std::shared_ptr<FolderWatch> FindWatch(std::wstring_view folderPath) {
+        ULONGLONG tickCount = GetTickCount64();
+        for (const auto& watch : m_watches) {
+            if (watch->releasing ||
+                !IsPathInFolder(folderPath, watch->folderPath)) {
+                continue;
+            }
+
+            if (watch->reading &&
+                tickCount - watch->pathCheckTickCount >= kPathCheckInterval) {
+                watch->pathCheckTickCount = tickCount;
+                if (GetFinalPath(watch->directory) != watch->finalPath) {
+                    Wh_Log(L"Watched folder was moved: %s",
+                           watch->folderPath.c_str());
+                    watch->releasing = true;
+                    SetEvent(m_wakeEvent);
+                    continue;
+                }
+            }
+
+            // A watch which failed isn't kept alive, so that it's retried once
+            // it's released.
+            if (watch->reading || !watch->started) {
+                watch->lastUsedTickCount = tickCount;
+            }
+
+            return watch;
+        }
+
+        return nullptr;
+    }
+
+    // Makes room for a new watch by releasing the least recently used one.
+    // Must be called with the mutex held.
+    void ReleaseWatchIfFull() {
+        FolderWatch* leastRecentlyUsed = nullptr;
+        size_t count = 0;
+        for (const auto& watch : m_watches) {
+            if (watch->releasing) {
+                continue;
+            }
+
+            count++;
+            if (!leastRecentlyUsed ||
+                watch->lastUsedTickCount <
+                    leastRecentlyUsed->lastUsedTickCount) {
+                leastRecentlyUsed = watch.get();
+            }
+        }
+
+        if (count >= kMaxWatches) {
+            leastRecentlyUsed->releasing = true;
+        }
+    }
+
+    static bool IssueRead(FolderWatch* watch) {
+        ResetEvent(watch->overlapped.hEvent);
+        return ReadDirectoryChangesW(
+            watch->directory, watch->buffer.data(), kBufferSize, TRUE,
+            FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+                FILE_NOTIFY_CHANGE_SIZE,
+            nullptr, &watch->overlapped, nullptr);
+    }
+
+    static void CancelRead(FolderWatch* watch) {
+        CancelIoEx(watch->directory, &watch->overlapped);
+        DWORD bytes;
+        GetOverlappedResult(watch->directory, &watch->overlapped, &bytes, TRUE);
+    }
+
+    static bool StartWatch(FolderWatch* watch) {
+        std::wstring path = L"\\\\?\\" + watch->folderPath + L'\\';
+        watch->directory = CreateFile(
+            path.c_str(), FILE_LIST_DIRECTORY,
+            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr,
+            OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+            nullptr);
+        if (watch->directory == INVALID_HANDLE_VALUE) {
+            Wh_Log(L"Can't watch %s: %u", path.c_str(), GetLastError());
+            return false;
+        }
+
+        watch->finalPath = GetFinalPath(watch->directory);
+
+        if (!IssueRead(watch)) {
+            Wh_Log(L"Can't watch %s: %u", path.c_str(), GetLastError());
+            return false;
+        }
+
+        return true;
+    }
+
+    void ReportChanges(const FolderWatch* watch) {
+        const BYTE* p = reinterpret_cast<const BYTE*>(watch->buffer.data());
+        while (true) {
+            auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p);
+            std::wstring_view relativePath(
+                info->FileName, info->FileNameLength / sizeof(WCHAR));
+
+            // The folder which contains the changed item.
+            std::wstring folderPath = watch->folderPath;
+            size_t lastSeparator = relativePath.rfind(L'\\');
+            if (lastSeparator != relativePath.npos) {
+                folderPath += L'\\';
+                folderPath += relativePath.substr(0, lastSeparator);
+            }
+
+            m_sink.OnFolderChanged(NormalizeFolderPath(folderPath));
+
+            // If the item is a folder which was removed or renamed, its
+            // cached contents are no longer valid either.
+            if (info->Action == FILE_ACTION_REMOVED ||
+                info->Action == FILE_ACTION_RENAMED_OLD_NAME) {
+                folderPath = watch->folderPath;
+                folderPath += L'\\';
+                folderPath += relativePath;
+                m_sink.OnFolderChanged(NormalizeFolderPath(folderPath));
+            }
+
+            if (!info->NextEntryOffset) {
+                break;
+            }
+
+            p += info->NextEntryOffset;
+        }
+    }
+
+    void Run() {
+        std::vector<HANDLE> handles;
+        std::vector<FolderWatch*> handleWatches;
+        std::vector<std::shared_ptr<FolderWatch>> releasedWatches;
+        std::vector<std::shared_ptr<FolderWatch>> newWatches;
+
+        while (true) {
+            {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                ULONGLONG tickCount = GetTickCount64();
+                std::erase_if(m_watches, [&](const auto& watch) {
+                    if (watch->releasing ||
+                        (watch->started &&
+                         tickCount - watch->lastUsedTickCount >=
+                             kIdleTimeout)) {
+                        releasedWatches.push_back(watch);
+                        return true;
+                    }
+
+                    if (!watch->started) {
+                        newWatches.push_back(watch);
+                    }
+
+                    return false;
+                });
+            }
+
+            // Opening folders and reporting lost changes is done without
+            // holding the mutex, as it's also used by the UI threads. Lost
+            // changes are reported before new watches are started, so that
+            // a folder watched again isn't served from stale entries.
+            for (auto& watch : releasedWatches) {
+                if (watch->reading) {
+                    CancelRead(watch.get());
+                    m_sink.OnChangesLost(watch->folderPath);
+                }
+
+                // Wakes callers waiting for a watch which was released before
+                // it started.
+                SetEvent(watch->startedEvent);
+            }
+
+            releasedWatches.clear();
+
+            std::vector<bool> reading(newWatches.size());
+            for (size_t i = 0; i < newWatches.size(); i++) {
+                reading[i] = StartWatch(newWatches[i].get());
+            }
+
+            handles.assign({m_stopEvent, m_wakeEvent});
+            handleWatches.clear();
+
+            {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                for (size_t i = 0; i < newWatches.size(); i++) {
+                    newWatches[i]->started = true;
+                    newWatches[i]->reading = reading[i];
+                    SetEvent(newWatches[i]->startedEvent);
+                }
+
+                for (auto& watch : m_watches) {
+                    // Watches which are being released are skipped, so that
+                    // the number of handles stays within the limit.
+                    if (watch->reading && !watch->releasing) {
+                        handles.push_back(watch->overlapped.hEvent);
+                        handleWatches.push_back(watch.get());
+                    }
+                }
+            }
+
+            newWatches.clear();
+
+            DWORD waitResult = WaitForMultipleObjects(
+                handles.size(), handles.data(), FALSE, kIdleCheckInterval);
+            if (waitResult == WAIT_TIMEOUT ||
+                waitResult == WAIT_OBJECT_0 + 1) {
+                continue;
+            }
+
+            if (waitResult == WAIT_OBJECT_0 ||
+                waitResult >= WAIT_OBJECT_0 + handles.size()) {
+                // Stopped, or the wait failed.
+                break;
+            }
+
+            FolderWatch* watch = handleWatches[waitResult - WAIT_OBJECT_0 - 2];
+
+            DWORD bytes;
+            bool succeeded = GetOverlappedResult(
+                watch->directory, &watch->overlapped, &bytes, FALSE);
+            if (succeeded && bytes > 0) {
+                ReportChanges(watch);
+            } else {
+                // The buffer overflowed, or the folder is gone.
+                m_sink.OnChangesLost(watch->folderPath);
+            }
+
+            if (!succeeded || !IssueRead(watch)) {
+                std::lock_guard<std::mutex> guard(m_mutex);
+                watch->reading = false;
+            }
+        }
+    }
+
+    FolderChangeSink& m_sink;
+    std::mutex m_mutex;
+    std::vector<std::shared_ptr<FolderWatch>> m_watches;
+    HANDLE m_stopEvent;
+    HANDLE m_wakeEvent;
+    HANDLE m_thread = nullptr;
+};
+
+// Calculates folder sizes by enumerating the file system directly with large
+// fetch directory reads, instead of going through the shell namespace. Folders
+// are distributed between worker threads, each with its own queue. A worker
+// takes the most recently queued folder from its own queue, and when it's
+// empty, steals the oldest folder from another worker's queue.
+class FolderSizeWalker {
+   public:
+    static constexpr size_t kMaxWorkers = 8;
+
+    // Returns std::nullopt if the root folder can't be enumerated, or if the
+    // walk was cancelled. If a cache is passed, cached subtrees aren't
+    // enumerated again, and the results are stored in the cache.
+    static std::optional<FolderSizeTotals> Walk(
+        PCWSTR folderPath,
+        FolderSizeCache* cache,
+        const std::atomic<bool>* cancelled = nullptr) {
+        size_t workerCount = std::clamp<size_t>(
+            GetActiveProcessorCount(ALL_PROCESSOR_GROUPS), 1, kMaxWorkers);
+        FolderSizeWalker walker(workerCount, cache, cancelled);
+        return walker.Run(folderPath);
+    }
+
+   private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::wstring> folders;
+        FolderSizeTotals totals;
+        std::vector<FolderSizeCache::FolderRecord> records;
+    };
+
+    struct WorkerThreadParam {
+        FolderSizeWalker* walker;
+        size_t workerIndex;
+    };
+
+    FolderSizeWalker(size_t workerCount,
+                     FolderSizeCache* cache,
+                     const std::atomic<bool>* cancelled)
+        : m_workers(workerCount), m_cache(cache), m_cancelled(cancelled) {}
+
+    bool IsCancelled() const { return m_cancelled && *m_cancelled; }
+
+    std::optional<FolderSizeTotals> Run(PCWSTR folderPath) {
+        uint64_t changeSequence = m_cache ? m_cache->GetChangeSequence() : 0;
+
+        // Enumerate the root folder on the calling thread first, both to report
+        // a failure to open it, and to avoid creating threads for folders with
+        // no subfolders.
+        std::vector<std::wstring> subfolders;
+        if (!ProcessFolder(m_workers[0], MakeExtendedLengthPath(folderPath),
+                           subfolders)) {
+            return std::nullopt;
+        }
+
+        if (!subfolders.empty()) {
+            for (size_t i = 0; i < subfolders.size(); i++) {
+                m_workers[i % m_workers.size()].folders.push_back(
+                    std::move(subfolders[i]));
+            }
+
+            m_pendingFolders = subfolders.size();
+
+            size_t threadCount =
+                std::min(m_workers.size(), subfolders.size()) - 1;
+            std::vector<WorkerThreadParam> threadParams(threadCount);
+            std::vector<HANDLE> threads;
+            for (size_t i = 0; i < threadCount; i++) {
+                threadParams[i] = {this, i + 1};
+                HANDLE thread = CreateThread(nullptr, 0, WorkerThread,
+                                             &threadParams[i], 0, nullptr);
+                if (!thread) {
+                    Wh_Log(L"CreateThread failed: %u", GetLastError());
+                    break;
+                }
+
+                threads.push_back(thread);
+            }
+
+            RunWorker(0);
+
+            WaitForMultipleObjects(threads.size(), threads.data(), TRUE,
+                                   INFINITE);
+            for (HANDLE thread : threads) {
+                CloseHandle(thread);
+            }
+        }
+
+        if (IsCancelled()) {
+            return std::nullopt;
+        }
+
+        FolderSizeTotals totals;
+        std::vector<FolderSizeCache::FolderRecord> records;
+        for (auto& worker : m_workers) {
+            totals.Add(worker.totals);
+            std::move(worker.records.begin(), worker.records.end(),
+                      std::back_inserter(records));
+        }
+
+        if (m_cache) {
+            m_cache->Store(folderPath, std::move(records), changeSequence);
+        }
+
+        return totals;
+    }
+
+    static std::wstring MakeExtendedLengthPath(PCWSTR path) {
+        std::wstring_view pathView = path;
+        while (pathView.ends_with(L'\\')) {
+            pathView.remove_suffix(1);
+        }
+
+        // Paths with the extended-length prefix aren't limited to MAX_PATH.
+        if (pathView.starts_with(L"\\\\?\\"sv)) {
+            return std::wstring(pathView);
+        }
+
+        if (IsUncPath(path)) {
+            pathView.remove_prefix(2);
+            return L"\\\\?\\UNC\\" + std::wstring(pathView);
+        }
+
+        return L"\\\\?\\" + std::wstring(pathView);
+    }
+
+    static DWORD WINAPI WorkerThread(void* parameter) {
+        auto* param = static_cast<WorkerThreadParam*>(parameter);
+        param->walker->RunWorker(param->workerIndex);
+        return 0;
+    }
+
+    void RunWorker(size_t workerIndex) {
+        Worker& worker = m_workers[workerIndex];
+        std::vector<std::wstring> subfolders;
+        std::wstring folderPath;
+
+        while (TakeFolder(workerIndex, &folderPath)) {
+            ProcessFolder(worker, std::move(folderPath), subfolders);
+
+            if (!subfolders.empty()) {
+                m_pendingFolders += subfolders.size();
+
+                std::lock_guard<std::mutex> guard(worker.mutex);
+                for (auto& subfolder : subfolders) {
+                    worker.folders.push_back(std::move(subfolder));
+                }
+            }
+
+            subfolders.clear();
+
+            // The pending count includes the folder that was just processed,
+            // so it can only drop to zero after all folders are processed.
+            if (--m_pendingFolders == 0) {
+                return;
+            }
+        }
+    }
+
+    bool TakeFolder(size_t workerIndex, std::wstring* folderPath) {
+        Worker& worker = m_workers[workerIndex];
+        int idleSpins = 0;
+
+        while (m_pendingFolders > 0 && !IsCancelled()) {
+            {
+                std::lock_guard<std::mutex> guard(worker.mutex);
+                if (!worker.folders.empty()) {
+                    *folderPath = std::move(worker.folders.back());
+                    worker.folders.pop_back();
+                    return true;
+                }
+            }
+
+            for (size_t i = 1; i < m_workers.size(); i++) {
+                Worker& victim =
+                    m_workers[(workerIndex + i) % m_workers.size()];
+                std::lock_guard<std::mutex> guard(victim.mutex);
+                if (!victim.folders.empty()) {
+                    *folderPath = std::move(victim.folders.front());
+                    victim.folders.pop_front();
+                    return true;
+                }
+            }
+
+            // Other workers are still enumerating folders which might have
+            // subfolders to steal.
+            if (++idleSpins < 64) {
+                SwitchToThread();
+            } else {
+                Sleep(1);
+            }
+        }
+
+        return false;
+    }
+
+    // Enumerates the folder and adds the paths of subfolders which have to be
+    // enumerated to the list.
+    bool ProcessFolder(Worker& worker,
+                       std::wstring folderPath,
+                       std::vector<std::wstring>& subfolders) {
+        FolderSizeCache::FolderRecord record;
+        bool cached = false;
+        if (m_cache) {
+            if (auto cachedRecord = m_cache->LookupFolder(folderPath)) {
+                record = std::move(*cachedRecord);
+                cached = true;
+            }
+        }
+
+        if (!cached && !EnumerateFolder(folderPath, record)) {
+            return false;
+        }
+
+        worker.totals.Add(record.totals);
+
+        for (const auto& subfolder : record.subfolders) {
+            std::wstring subfolderPath = folderPath;
+            subfolderPath += L'\\';
+            subfolderPath += subfolder.name;
+
+            if (m_cache) {
+                if (auto cached = m_cache->LookupSubtree(subfolderPath)) {
+                    worker.totals.Add(*cached);
+                    continue;
+                }
+            }
+
+            subfolders.push_back(std::move(subfolderPath));
+        }
+
+        if (m_cache && !cached) {
+            record.path = std::move(folderPath);
+            worker.records.push_back(std::move(record));
+        }
+
+        return true;
+    }
+
+    static bool EnumerateFolder(const std::wstring& folderPath,
+                                FolderSizeCache::FolderRecord& record) {
+        std::wstring searchPath = folderPath;
+        searchPath += L"\\*";
+
+        WIN32_FIND_DATA findData;
+        HANDLE findHandle = FindFirstFileEx(
+            searchPath.c_str(), FindExInfoBasic, &findData,
+            FindExSearchNameMatch, nullptr, FIND_FIRST_EX_LARGE_FETCH);
+        if (findHandle == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        do {
+            if (findData.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+                PCWSTR name = findData.cFileName;
+                if (wcscmp(name, L".") == 0 || wcscmp(name, L"..") == 0) {
+                    continue;
+                }
+
+                record.totals.folderCount++;
+
+                // Don't follow reparse points such as junctions and symbolic
+                // links, which can point outside of the folder or form cycles.
+                if (findData.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT) {
+                    continue;
+                }
+
+                record.subfolders.push_back({name, findData.ftLastWriteTime});
+            } else {
+                record.totals.fileCount++;
+                record.totals.size +=
+                    (static_cast<ULONGLONG>(findData.nFileSizeHigh) << 32) |
+                    findData.nFileSizeLow;
+            }
+        } while (FindNextFile(findHandle, &findData));
+
+        FindClose(findHandle);
+        return true;
+    }
+
+    std::vector<Worker> m_workers;
+    FolderSizeCache* m_cache;
+    const std::atomic<bool>* m_cancelled;
+    std::atomic<size_t> m_pendingFolders = 0;
+};
+
+std::unique_ptr<FolderSizeCache> g_folderSizeCache;
+std::unique_ptr<DirectoryChangeFeed> g_folderChangeFeed;
+std::atomic<ULONGLONG> g_folderSizeCacheLastSaveTickCount;
+
+std::wstring GetFolderSizeCacheFilePath() {
+    WCHAR storagePath[MAX_PATH];
+    if (!Wh_GetModStoragePath(storagePath, ARRAYSIZE(storagePath))) {
+        Wh_Log(L"Wh_GetModStoragePath failed");
+        return std::wstring{};
+    }
+
+    return std::wstring(storagePath) + L"\\folder-size-cache.bin";
+}
+
+void SaveFolderSizeCacheIfNeeded() {
+    if (!g_settings.persistFolderSizes) {
+        return;
+    }
+
+    // Save at most once a minute, from one thread at a time.
+    ULONGLONG tickCount = GetTickCount64();
+    ULONGLONG lastSaveTickCount = g_folderSizeCacheLastSaveTickCount;
+    if (tickCount - lastSaveTickCount < 60 * 1000 ||
+        !g_folderSizeCacheLastSaveTickCount.compare_exchange_strong(
+            lastSaveTickCount, tickCount)) {
+        return;
+    }
+
+    auto filePath = GetFolderSizeCacheFilePath();
+    if (!filePath.empty()) {
+        g_folderSizeCache->SaveToFile(filePath.c_str());
+    }
+}
+
+std::wstring GetFolderPathFromIShellFolder(IShellFolder2* shellFolder) {
+    LPITEMIDLIST pidl;
+    HRESULT hr = SHGetIDListFromObject(shellFolder, &pidl);
+    if (FAILED(hr)) {
+        return {};
+    }
+
+    std::wstring path;
+    path.resize(MAX_PATH);
+    while (
+        !SHGetPathFromIDListEx(pidl, &path[0], path.size(), GPFIDL_DEFAULT)) {
+        // The maximum path length is documented to be "approximately" 32,767.
+        if (path.size() >= 32767 + 256) {
+            CoTaskMemFree(pidl);
+            return {};
+        }
+
+        path.resize(path.size() * 2);
+    }
+
+    path.resize(wcslen(path.c_str()));
+    CoTaskMemFree(pidl);
+
+    // SHGetPathFromIDListEx() for long path returns path with super path prefix
+    // "\\\\?\\".
+    constexpr auto kSuperPathPrefix = L"\\\\?\\"sv;
+    if (path.starts_with(kSuperPathPrefix)) {
+        path = path.substr(kSuperPathPrefix.size());
+    }
+
+    return path;
+}
+
+// Returns the folder size cache if changes in the folder are tracked,
+// otherwise the cache can't be used for the folder. The changes are watched in
+// the folder's parent, which is usually the listed folder, so that a single
+// watch covers all of the listed subfolders. If waitForWatch is false, the
+// cache isn't returned until the watch has started, which is used on UI
+// threads.
+FolderSizeCache* GetFolderSizeCacheForPath(const std::wstring& path,
+                                           bool waitForWatch = true) {
+    if (!g_folderSizeCache) {
+        return nullptr;
+    }
+
+    std::wstring normalizedPath = NormalizeFolderPath(path);
+    std::wstring_view watchedPath = normalizedPath;
+    if (size_t separator = watchedPath.rfind(L'\\');
+        separator != watchedPath.npos) {
+        watchedPath = watchedPath.substr(0, separator);
+    }
+
+    if (!g_folderChangeFeed->WatchFolder(watchedPath, waitForWatch)) {
+        return nullptr;
+    }
+
+    return g_folderSizeCache.get();
+}
+
+std::optional<ULONGLONG> CalculateFolderSizeFromPath(
+    const std::wstring& path,
+    const std::atomic<bool>* cancelled = nullptr) {
+    FolderSizeCache* cache = GetFolderSizeCacheForPath(path);
+    if (cache) {
+        if (auto totals = cache->Lookup(path)) {
+            Wh_Log(L"Using cached folder size");
+            return totals->size;
+        }
+    }
+
+    auto totals = FolderSizeWalker::Walk(path.c_str(), cache, cancelled);
+    if (!totals) {
+        Wh_Log(L"Failed to enumerate %s", path.c_str());
+        return std::nullopt;
+    }
+
+    Wh_Log(L"%s: %I64u files, %I64u folders", path.c_str(), totals->fileCount,
+           totals->folderCount);
+
+    if (cache) {
+        SaveFolderSizeCacheIfNeeded();
+    }
+
+    return totals->size;
+}
+
+std::optional<ULONGLONG> CalculateFolderSize(IShellFolder2* shellFolder) {
+    const auto path = GetFolderPathFromIShellFolder(shellFolder);
+    if (path.empty()) {
+        // Not a file system folder, fall back to the shell namespace.
+        return CalculateFolderSizeWithNamespaceWalker(shellFolder);
+    }
+
+    return CalculateFolderSizeFromPath(path);
+}
+
+// A set of folder size requests which can be cancelled together, such as the
+// requests of a single folder listing.
+class FolderSizeRequestGroup {
+   public:
+    virtual ~FolderSizeRequestGroup() = default;
+
+    // Returns true once the results are no longer needed, for example after
+    // navigating away from the listed folder.
+    virtual bool IsAbandoned() = 0;
+};
+
+// Calculates folder sizes on background threads. Pending requests are served
+// most recent first, and a repeated request moves a folder to the front.
+// Explorer requests the properties of visible rows first, and again when rows
+// are scrolled into view, so the most recent requests are the best available
+// approximation of the visible rows.
+class FolderSizeQueue {
+   public:
+    static constexpr size_t kWorkerCount = 2;
+    static constexpr size_t kMaxPending = 1024;
+    static constexpr size_t kMaxResults = 4096;
+
+    // A result is considered up to date for this long, which is enough for
+    // the refresh that follows its calculation.
+    static constexpr ULONGLONG kResultFreshTimeout = 5000;
+
+    class Delegate {
+       public:
+        virtual ~Delegate() = default;
+
+        // Called on a worker thread, which is initialized as a COM
+        // single-threaded apartment. Should return early if cancelled is set.
+        virtual std::optional<ULONGLONG> CalculateSize(
+            const std::wstring& path,
+            const std::atomic<bool>& cancelled) = 0;
+
+        // Called on a worker thread after a result was stored.
+        virtual void OnSizeCalculated(const std::wstring& path) = 0;
+    };
+
+    explicit FolderSizeQueue(Delegate& delegate) : m_delegate(delegate) {
+        for (size_t i = 0; i < kWorkerCount; i++) {
+            HANDLE thread =
+                CreateThread(nullptr, 0, WorkerThread, this, 0, nullptr);
+            if (!thread) {
+                Wh_Log(L"CreateThread failed: %u", GetLastError());
+                continue;
+            }
+
+            m_threads.push_back(thread);
+        }
+    }
+
+    ~FolderSizeQueue() {
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+            m_stopping = true;
+            for (auto& running : m_running) {
+                running->cancelled = true;
+            }
+        }
+
+        m_condition.notify_all();
+
+        WaitForMultipleObjects(m_threads.size(), m_threads.data(), TRUE,
+                               INFINITE);
+        for (HANDLE thread : m_threads) {
+            CloseHandle(thread);
+        }
+    }
+
+    // Returns the last calculated size of the folder, if any. Unless that
+    // size is up to date, a calculation is queued, and the delegate is
+    // notified when it completes. The path is passed to the delegate as is,
+    // and can be any string which identifies the folder.
+    std::optional<ULONGLONG> Request(
+        const std::wstring& path,
+        std::shared_ptr<FolderSizeRequestGroup> group) {
+        std::optional<ULONGLONG> lastSize;
+        bool queued = false;
+
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            CancelAbandonedRequests();
+
+            if (auto it = m_results.find(path); it != m_results.end()) {
+                lastSize = it->second.size;
+                if (GetTickCount64() - it->second.tickCount <
+                    kResultFreshTimeout) {
+                    return lastSize;
+                }
+            }
+
+            bool running = std::any_of(
+                m_running.begin(), m_running.end(),
+                [&path](const auto& running) { return running->path == path; });
+            if (!running) {
+                if (auto it = m_pendingByPath.find(path);
+                    it != m_pendingByPath.end()) {
+                    auto node = m_pending.extract(it->second);
+                    node.key() = ++m_priority;
+                    it->second = node.key();
+                    m_pending.insert(std::move(node));
+                } else {
+                    m_pending.try_emplace(++m_priority,
+                                          PendingRequest{path, group});
+                    m_pendingByPath.try_emplace(path, m_priority);
+
+                    if (m_pending.size() > kMaxPending) {
+                        // Drop the least recently requested folder.
+                        auto oldest = m_pending.begin();
+                        m_pendingByPath.erase(oldest->second.path);
+                        m_pending.erase(oldest);
+                    }
+                }
+
+                queued = true;
+            }
+        }
+
+        if (queued) {
+            m_condition.notify_one();
+        }
+
+        return lastSize;
+    }
+
+    // Returns the last calculated size of the folder, if any, without queuing
+    // a calculation.
+    std::optional<ULONGLONG> LastResult(const std::wstring& path) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        auto it = m_results.find(path);
+        if (it == m_results.end()) {
+            return std::nullopt;
+        }
+
+        return it->second.size;
+    }
+
+   private:
+    struct PendingRequest {
+        std::wstring path;
+        std::shared_ptr<FolderSizeRequestGroup> group;
+    };
+
+    struct RunningRequest {
+        std::wstring path;
+        std::shared_ptr<FolderSizeRequestGroup> group;
+        std::atomic<bool> cancelled = false;
+    };
+
+    struct Result {
+        std::optional<ULONGLONG> size;
+        ULONGLONG tickCount;
+    };
+
+    static DWORD WINAPI WorkerThread(void* parameter) {
+        // Shell folder objects, used to calculate the sizes of folders outside
+        // the file system, are mostly apartment threaded.
+        HRESULT hr = CoInitializeEx(nullptr, COINIT_APARTMENTTHREADED);
+
+        static_cast<FolderSizeQueue*>(parameter)->RunWorker();
+
+        if (SUCCEEDED(hr)) {
+            CoUninitialize();
+        }
+
+        return 0;
+    }
+
+    void CancelAbandonedRequests() {
+        // Each group is only checked once, as checking might not be cheap.
+        std::vector<FolderSizeRequestGroup*> checkedGroups;
+        std::vector<FolderSizeRequestGroup*> abandonedGroups;
+        auto isAbandoned = [&](FolderSizeRequestGroup* group) {
+            if (std::find(checkedGroups.begin(), checkedGroups.end(), group) ==
+                checkedGroups.end()) {
+                checkedGroups.push_back(group);
+                if (group->IsAbandoned()) {
+                    abandonedGroups.push_back(group);
+                }
+            }
+
+            return std::find(abandonedGroups.begin(), abandonedGroups.end(),
+                             group) != abandonedGroups.end();
+        };
+
+        for (auto it = m_pending.begin(); it != m_pending.end();) {
+            if (isAbandoned(it->second.group.get())) {
+                m_pendingByPath.erase(it->second.path);
+                it = m_pending.erase(it);
+            } else {
+                ++it;
+            }
+        }
+
+        for (auto& running : m_running) {
+            if (isAbandoned(running->group.get())) {
+                running->cancelled = true;
+            }
+        }
+    }
+
+    void StoreResult(const std::wstring& path, std::optional<ULONGLONG> size) {
+        if (m_results.size() >= kMaxResults) {
+            // Drop the older half of the results.
+            std::vector<ULONGLONG> tickCounts;
+            tickCounts.reserve(m_results.size());
+            for (const auto& [resultPath, result] : m_results) {
+                tickCounts.push_back(result.tickCount);
+            }
+
+            auto median = tickCounts.begin() + tickCounts.size() / 2;
+            std::nth_element(tickCounts.begin(), median, tickCounts.end());
+            std::erase_if(m_results, [median](const auto& item) {
+                return item.second.tickCount <= *median;
+            });
+        }
+
+        m_results.insert_or_assign(path, Result{size, GetTickCount64()});
+    }
+
+    void RunWorker() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (true) {
+            m_condition.wait(
+                lock, [this] { return m_stopping || !m_pending.empty(); });
+            if (m_stopping) {
+                return;
+            }
+
+            // Serve the most recent request first.
+            auto node = m_pending.extract(std::prev(m_pending.end()));
+            m_pendingByPath.erase(node.mapped().path);
+
+            auto running = std::make_shared<RunningRequest>();
+            running->path = std::move(node.mapped().path);
+            running->group = std::move(node.mapped().group);
+            m_running.push_back(running);
+
+            lock.unlock();
+
+            std::optional<ULONGLONG> size;
+            if (!running->group->IsAbandoned()) {
+                size = m_delegate.CalculateSize(running->path,
+                                                running->cancelled);
+            } else {
+                running->cancelled = true;
+            }
+
+            lock.lock();
+
+            std::erase(m_running, running);
+
+            if (!running->cancelled) {
+                StoreResult(running->path, size);
+
+                lock.unlock();
+                m_delegate.OnSizeCalculated(running->path);
+                lock.lock();
+            }
+        }
+    }
+
+    Delegate& m_delegate;
+    std::vector<HANDLE> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stopping = false;
+    uint64_t m_priority = 0;
+    std::map<uint64_t, PendingRequest> m_pending;
+    std::map<std::wstring, uint64_t, std::less<>> m_pendingByPath;
+    std::vector<std::shared_ptr<RunningRequest>> m_running;
+    std::map<std::wstring, Result, std::less<>> m_results;
+};
+
+// The requests of a single folder listing. Each Explorer window requests the
+// sizes of the listed folders from its own thread, so the listing is abandoned
+// once its thread requests sizes for another listing, after navigating away, or
+// once the thread exits, after the window is closed.
+class ListingRequestGroup final : public FolderSizeRequestGroup {
+   public:
+    explicit ListingRequestGroup(const IShellFolder2* listedFolder)
+        : m_listedFolder(listedFolder), m_threadId(GetCurrentThreadId()) {
+        m_thread = OpenThread(SYNCHRONIZE, FALSE, m_threadId);
+    }
+
+    ~ListingRequestGroup() override {
+        if (m_thread) {
+            CloseHandle(m_thread);
+        }
+    }
+
+    ListingRequestGroup(const ListingRequestGroup&) = delete;
+    ListingRequestGroup& operator=(const ListingRequestGroup&) = delete;
+
+    bool IsAbandoned() override {
+        return m_abandoned ||
+               (m_thread && WaitForSingleObject(m_thread, 0) == WAIT_OBJECT_0);
+    }
+
+    void Abandon() { m_abandoned = true; }
+
+    // Only used to tell listings apart, the object isn't referenced.
+    const IShellFolder2* ListedFolder() const { return m_listedFolder; }
+
+    DWORD ThreadId() const { return m_threadId; }
+
+   private:
+    const IShellFolder2* m_listedFolder;
+    DWORD m_threadId;
+    HANDLE m_thread;
+    std::atomic<bool> m_abandoned = false;
+};
+
+// Folders outside the file system have no path, and are queued by their ID
+// list instead, which is kept as hex digits after this prefix. The colon can't
+// appear at this position in a path.
+constexpr auto kIDListKeyPrefix = L"pidl:"sv;
+
+std::wstring GetIDListKey(IShellFolder2* shellFolder) {
+    LPITEMIDLIST pidl;
+    HRESULT hr = SHGetIDListFromObject(shellFolder, &pidl);
+    if (FAILED(hr)) {
+        Wh_Log(L"Failed: %08X", hr);
+        return {};
+    }
+
+    std::vector<BYTE> idList = PIDLToVector(pidl);
+    CoTaskMemFree(pidl);
+
+    std::wstring key(kIDListKeyPrefix);
+    for (BYTE b : idList) {
+        WCHAR hex[3];
+        swprintf_s(hex, L"%02X", b);
+        key += hex;
+    }
+
+    return key;
+}
+
+std::vector<BYTE> IDListFromKey(std::wstring_view key) {
+    key.remove_prefix(kIDListKeyPrefix.size());
+
+    std::vector<BYTE> idList(key.size() / 2);
+    for (size_t i = 0; i < idList.size(); i++) {
+        WCHAR hex[] = {key[i * 2], key[i * 2 + 1], L'\0'};
+        idList[i] = static_cast<BYTE>(wcstoul(hex, nullptr, 16));
+    }
+
+    // An ID list ends with a zero-sized item.
+    if (idList.size() < sizeof(USHORT) || idList.end()[-1] != 0 ||
+        idList.end()[-2] != 0) {
+        return {};
+    }
+
+    return idList;
+}
+
+std::optional<ULONGLONG> CalculateFolderSizeFromIDListKey(
+    std::wstring_view key,
+    const std::atomic<bool>* cancelled) {
+    std::vector<BYTE> idList = IDListFromKey(key);
+    if (idList.empty()) {
+        return std::nullopt;
+    }
+
+    winrt::com_ptr<IShellFolder2> shellFolder;
+    HRESULT hr = SHBindToObject(
+        nullptr, reinterpret_cast<PCIDLIST_ABSOLUTE>(idList.data()), nullptr,
+        IID_PPV_ARGS(shellFolder.put()));
+    if (FAILED(hr)) {
+        Wh_Log(L"Failed: %08X", hr);
+        return std::nullopt;
+    }
+
+    return CalculateFolderSizeWithNamespaceWalker(shellFolder.get(), cancelled);
+}
+
+class ShellFolderSizeQueueDelegate final : public FolderSizeQueue::Delegate {
+   public:
+    std::optional<ULONGLONG> CalculateSize(
+        const std::wstring& path,
+        const std::atomic<bool>& cancelled) override {
+        if (path.starts_with(kIDListKeyPrefix)) {
+            return CalculateFolderSizeFromIDListKey(path, &cancelled);
+        }
+
+        return CalculateFolderSizeFromPath(path, &cancelled);
+    }
+
+    void OnSizeCalculated(const std::wstring& path) override {
+        // Make Explorer query the folder's properties again.
+        if (path.starts_with(kIDListKeyPrefix)) {
+            std::vector<BYTE> idList = IDListFromKey(path);
+            if (!idList.empty()) {
+                SHChangeNotify(SHCNE_UPDATEITEM,
+                               SHCNF_IDLIST | SHCNF_FLUSHNOWAIT,
+                               idList.data(), nullptr);
+            }
+
+            return;
+        }
+
+        SHChangeNotify(SHCNE_UPDATEITEM, SHCNF_PATH | SHCNF_FLUSHNOWAIT,
+                       path.c_str(), nullptr);
+    }
+};
+
+ShellFolderSizeQueueDelegate g_folderSizeQueueDelegate;
+std::unique_ptr<FolderSizeQueue> g_folderSizeQueue;
+std::mutex g_folderSizeRequestGroupsMutex;
+std::vector<std::shared_ptr<ListingRequestGroup>> g_folderSizeRequestGroups;
+
+std::shared_ptr<FolderSizeRequestGroup> GetFolderSizeRequestGroup(
+    IShellFolder2* shellFolder) {
+    std::lock_guard<std::mutex> guard(g_folderSizeRequestGroupsMutex);
+
+    DWORD threadId = GetCurrentThreadId();
+    for (const auto& group : g_folderSizeRequestGroups) {
+        if (group->ThreadId() != threadId) {
+            continue;
+        }
+
+        if (group->ListedFolder() == shellFolder) {
+            return group;
+        }
+
+        group->Abandon();
+    }
+
+    std::erase_if(g_folderSizeRequestGroups,
+                  [](const auto& group) { return group->IsAbandoned(); });
+
+    return g_folderSizeRequestGroups.emplace_back(
+        std::make_shared<ListingRequestGroup>(shellFolder));
+}
+
+// Returns the size of the folder if it's known, otherwise queues its
+// calculation and returns the last known size, if any. If startRequests is
+// false, only sizes which were already calculated are returned.
+std::optional<ULONGLONG> RequestFolderSize(IShellFolder2* shellFolder,
+                                           const ITEMID_CHILD* itemidChild,
+                                           bool startRequests) {
+    winrt::com_ptr<IShellFolder2> childFolder;
+    HRESULT hr = shellFolder->BindToObject(itemidChild, nullptr,
+                                           IID_PPV_ARGS(childFolder.put()));
+    if (FAILED(hr) || !childFolder) {
+        Wh_Log(L"Failed: %08X", hr);
+        return std::nullopt;
+    }
+
+    const auto path = GetFolderPathFromIShellFolder(childFolder.get());
+    if (path.empty()) {
+        // Not a file system folder, walk the shell namespace in the
+        // background.
+        std::wstring key = GetIDListKey(childFolder.get());
+        if (key.empty()) {
+            return std::nullopt;
+        }
+
+        if (!startRequests) {
+            return g_folderSizeQueue->LastResult(key);
+        }
+
+        return g_folderSizeQueue->Request(
+            key, GetFolderSizeRequestGroup(shellFolder));
+    }
+
+    // Called on the window's thread, so don't wait for a new watch to start.
+    // Until it starts, the cache is skipped, and the queued calculation uses
+    // it once the watch is ready.
+    if (FolderSizeCache* cache =
+            GetFolderSizeCacheForPath(path, /*waitForWatch=*/false)) {
+        if (auto totals = cache->Lookup(path)) {
+            Wh_Log(L"Using cached folder size");
+            return totals->size;
+        }
+    }
+
+    if (!startRequests) {
+        return g_folderSizeQueue->LastResult(path);
+    }
+
+    std::optional<ULONGLONG> size = g_folderSizeQueue->Request(
+        path, GetFolderSizeRequestGroup(shellFolder));
+    if (!size) {
+        // Until the calculation completes, show the last known size, such as
+        // a size remembered from before Explorer was restarted.
+        if (auto totals = g_folderSizeCache->LookupHint(path)) {
+            Wh_Log(L"Using folder size hint");
+            size = totals->size;
+        }
+    }
+
+    return size;
+}
+
+// Returns the size of a subfolder from a single Everything query for all
+// subfolders of the folder, which is made once per listing. Returns nullopt if
+// the subfolder isn't in the query results.
+std::optional<int64_t> GetEverythingChildFolderSize(
+    IShellFolder2* shellFolder,
+    std::wstring_view childPath) {
+    if (!g_cacheEverythingChildSizes) {
+        auto& childSizes = g_cacheEverythingChildSizes.emplace();
+
+        const auto folderPath = GetFolderPathFromIShellFolder(shellFolder);
+        if (folderPath.empty()) {
+            Wh_Log(L"Failed to get path");
+            return std::nullopt;
+        }
+
+        std::vector<EverythingChildSize> children;
+        unsigned result =
+            Everything4Wh_GetChildFolderSizes(folderPath.c_str(), &children);
+        if (result != ES_QUERY_OK) {
+            Wh_Log(L"Failed to get child folder sizes: %s",
+                   g_gsQueryStatus[result]);
+            return std::nullopt;
+        }
+
+        for (auto& child : children) {
+            childSizes.try_emplace(std::move(child.name), child.size);
+        }
+
+        Wh_Log(L"Got %zu child folder sizes for %s", childSizes.size(),
+               folderPath.c_str());
+    }
+
+    size_t nameOffset = childPath.find_last_of(L'\\');
+    if (nameOffset == childPath.npos) {
+        return std::nullopt;
+    }
+
+    auto it = g_cacheEverythingChildSizes->find(
+        childPath.substr(nameOffset + 1));
+    if (it == g_cacheEverythingChildSizes->end()) {
+        return std::nullopt;
+    }
+
+    return it->second;
+}
+
+using CFSFolder__GetSize_t = HRESULT(WINAPI*)(void* pCFSFolder,
+                                              const ITEMID_CHILD* itemidChild,
+                                              const void* idFolder,
+                                              PROPVARIANT* propVariant);
+CFSFolder__GetSize_t CFSFolder__GetSize_Original;
+HRESULT WINAPI CFSFolder__GetSize_Hook(void* pCFSFolder,
+                                       const ITEMID_CHILD* itemidChild,
+                                       const void* idFolder,
+                                       PROPVARIANT* propVariant) {
+    auto hookScope = hookRefCountScope();
+
+    HRESULT ret = CFSFolder__GetSize_Original(pCFSFolder, itemidChild, idFolder,
+                                              propVariant);
+    if (g_inCRecursiveFolderOperation_Prepare ||
+        g_inCRecursiveFolderOperation_Do || ret != S_OK ||
+        propVariant->vt != VT_EMPTY) {
+        return ret;
+    }
+
+    bool startRequests = true;
+
+    switch (g_settings.calculateFolderSizes) {
+        case CalculateFolderSizes::disabled:
+            return ret;
+
+        case CalculateFolderSizes::withShiftKey:
+            if (GetAsyncKeyState(VK_SHIFT) >= 0) {
+                // In the background mode, the item is refreshed once its size
+                // is calculated, usually after Shift was released, so sizes
+                // which are already calculated are shown regardless.
+                if (!g_folderSizeQueue) {
+                    return ret;
+                }
+
+                startRequests = false;
+            }
+            break;
+
+        case CalculateFolderSizes::everything:
+        case CalculateFolderSizes::always:
+            break;
+    }
+
+    Wh_Log(L">");
+
+    winrt::com_ptr<IShellFolder2> shellFolder2;
+    HRESULT hr =
+        ((IUnknown*)pCFSFolder)
+            ->QueryInterface(IID_IShellFolder2, shellFolder2.put_void());
+    if (FAILED(hr) || !shellFolder2) {
+        Wh_Log(L"Failed: %08X", hr);
+        return S_OK;
+    }
+
+    // In the background mode, results which aren't ready yet mustn't be
+    // cached below, as the item is refreshed once they're ready.
+    if (g_folderSizeQueue) {
+        std::optional<ULONGLONG> folderSize =
+            RequestFolderSize(shellFolder2.get(), itemidChild, startRequests);
+        if (folderSize) {
+            propVariant->uhVal.QuadPart = *folderSize;
+            propVariant->vt = VT_UI8;
+            Wh_Log(L"Done: %I64u", propVariant->uhVal.QuadPart);
+        }
+
+        return S_OK;
+    }
+
+    if (shellFolder2 != g_cacheShellFolder ||
+        GetTickCount() - g_cacheShellFolderLastUsedTickCount > 1000) {
+        g_cacheShellFolderSizes.clear();
+        g_cacheEverythingChildSizes.reset();
+    }
+
+    g_cacheShellFolder = shellFolder2;
+
+    auto [cacheIt, cacheMissing] = g_cacheShellFolderSizes.try_emplace(
+        PIDLToVector(itemidChild), std::nullopt);
+
+    if (cacheMissing) {
+        winrt::com_ptr<IShellFolder2> childFolder;
+        hr = shellFolder2->BindToObject(itemidChild, nullptr,
+                                        IID_PPV_ARGS(childFolder.put()));
+        if (FAILED(hr) || !childFolder) {
+            Wh_Log(L"Failed: %08X", hr);
+        } else if (g_settings.calculateFolderSizes ==
+                   CalculateFolderSizes::everything) {
+            const auto path = GetFolderPathFromIShellFolder(childFolder.get());
+            if (!path.empty()) {
+                Wh_Log(L"Getting size for %s", path.c_str());
+
+                int64_t size;
+                unsigned result;
+                if (auto childSize = GetEverythingChildFolderSize(
+                        shellFolder2.get(), path)) {
+                    Wh_Log(L"Using size from child folder sizes query");
+                    size = *childSize;
+                    result = !size && IsReparse(path.c_str())
+                                 ? ES_QUERY_ZERO_SIZE_REPARSE_POINT
+                                 : ES_QUERY_OK;
+                } else {
+                    result = Everything4Wh_GetFileSize(path.c_str(), &size);
+                }
 
                 // Regular reparse points are indexed with size 0, and
                 // ES_QUERY_ZERO_SIZE_REPARSE_POINT is returned when querying
@@ -2441,6 +4765,19 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpReserved) {
     return TRUE;
 }
 
+bool IsExplorerProcess() {
+    WCHAR moduleFilePath[MAX_PATH];
+    DWORD moduleFilePathLength =
+        GetModuleFileName(nullptr, moduleFilePath, ARRAYSIZE(moduleFilePath));
+    if (!moduleFilePathLength ||
+        moduleFilePathLength == ARRAYSIZE(moduleFilePath)) {
+        return false;
+    }
+
+    PCWSTR moduleFileName = wcsrchr(moduleFilePath, L'\\');
+    return moduleFileName && _wcsicmp(moduleFileName + 1, L"explorer.exe") == 0;
+}
+
 void LoadSettings() {
     PCWSTR calculateFolderSizes = Wh_GetStringSetting(L"calculateFolderSizes");
     g_settings.calculateFolderSizes = CalculateFolderSizes::disabled;
@@ -2453,6 +4790,14 @@ void LoadSettings() {
     }
     Wh_FreeStringSetting(calculateFolderSizes);
 
+    g_settings.calculateFolderSizesInBackground =
+        Wh_GetIntSetting(L"calculateFolderSizesInBackground");
+
+    // Only Explorer keeps the cache, other processes using the file dialogs
+    // would overwrite it with their own, much smaller caches.
+    g_settings.persistFolderSizes =
+        Wh_GetIntSetting(L"persistFolderSizes") && IsExplorerProcess();
+
     g_settings.sortSizesMixFolders = Wh_GetIntSetting(L"sortSizesMixFolders");
     g_settings.disableKbOnlySizes = Wh_GetIntSetting(L"disableKbOnlySizes");
     g_settings.useIecTerms = Wh_GetIntSetting(L"useIecTerms");
@@ -2472,6 +4817,27 @@ BOOL Wh_ModInit() {
         }
     }
 
+    if (g_settings.calculateFolderSizes == CalculateFolderSizes::always ||
+        g_settings.calculateFolderSizes == CalculateFolderSizes::withShiftKey) {
+        g_folderSizeCache = std::make_unique<FolderSizeCache>();
+        g_folderChangeFeed =
+            std::make_unique<DirectoryChangeFeed>(*g_folderSizeCache);
+
+        if (g_settings.persistFolderSizes) {
+            auto filePath = GetFolderSizeCacheFilePath();
+            if (!filePath.empty()) {
+                g_folderSizeCache->LoadFromFile(filePath.c_str());
+            }
+
+            g_folderSizeCacheLastSaveTickCount = GetTickCount64();
+        }
+
+        if (g_settings.calculateFolderSizesInBackground) {
+            g_folderSizeQueue =
+                std::make_unique<FolderSizeQueue>(g_folderSizeQueueDelegate);
+        }
+    }
+
     if (g_settings.calculateFolderSizes == CalculateFolderSizes::everything) {
         bool isEverything = false;
         WCHAR moduleFilePath[MAX_PATH];
@@ -2566,6 +4932,21 @@ void Wh_ModUninit() {
         Sleep(200);
     }
 
+    // Stop the background calculations and the change notifications before
+    // saving and destroying the cache.
+    g_folderSizeQueue.reset();
+    g_folderSizeRequestGroups.clear();
+    g_folderChangeFeed.reset();
+
+    if (g_folderSizeCache && g_settings.persistFolderSizes) {
+        auto filePath = GetFolderSizeCacheFilePath();
+        if (!filePath.empty()) {
+            g_folderSizeCache->SaveToFile(filePath.c_str());
+        }
+    }
+
+    g_folderSizeCache.reset();
+
     if (HANDLE thread = g_everything4Wh_Thread.exchange(nullptr)) {
         PostThreadMessage(GetThreadId(thread), WM_APP, 0, 0);
         WaitForSingleObject(thread, INFINITE);
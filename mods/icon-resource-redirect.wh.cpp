@@ -301,6 +301,17 @@ The resource lookup order then becomes:
   $description: >-
     Try to redirect all loaded resources, not only the supported resources
     that are listed in the description.
+- themePacks: false
+  $name: Theme packs (experimental)
+  $description: >-
+    Pack the resources of each theme into a single indexed file, and serve
+    resource lookups from it when possible instead of loading each of the
+    theme's files. Requires "Redirect all loaded resources", since only the
+    resource lookups of that option are served from the packs. Icons, cursors
+    and bitmaps which are loaded as a whole still load the theme's files, the
+    packs only let them skip files which don't have the requested resource.
+    The packs are created in the background by Explorer in the mod's storage
+    folder, and are used by processes which load the theme after that.
 - themeFolder: ""
   $name: Theme folder (deprecated)
   $description: >-
@@ -321,9 +332,12 @@ The resource lookup order then becomes:
 #include <shlobj.h>
 #include <winrt/base.h>
 
+#include <algorithm>
+#include <array>
 #include <atomic>
 #include <filesystem>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <optional>
 #include <shared_mutex>
@@ -336,21 +350,230 @@ The resource lookup order then becomes:
 #define LR_EXACTSIZEONLY 0x10000
 #endif
 
+// Matches a string against a set of wildcard patterns in a single pass over the
+// string. '*' matches any sequence of characters and '?' matches any single
+// character. The patterns are compiled into one NFA with a bit for each pattern
+// position, which is simulated with bitwise operations. A pattern of length n
+// has the states 0..n, where state k means that the first k characters of the
+// pattern were matched.
+template <typename T>
+class WildcardPatternSet {
+   public:
+    void Add(std::basic_string_view<T> pattern) {
+        std::basic_string<T> collapsed;
+        collapsed.reserve(pattern.size());
+        for (T ch : pattern) {
+            if (ch == '*' && !collapsed.empty() && collapsed.back() == '*') {
+                continue;
+            }
+
+            collapsed.push_back(ch);
+        }
+
+        size_t base = m_stateCount;
+        m_stateCount += collapsed.size() + 1;
+
+        size_t wordCount = (m_stateCount + 63) / 64;
+        m_startMask.resize(wordCount);
+        m_anyMask.resize(wordCount);
+        m_starMask.resize(wordCount);
+        for (auto& literalMask : m_literalMasks) {
+            literalMask.resize(wordCount);
+        }
+
+        SetBit(m_startMask, base);
+
+        for (size_t i = 0; i < collapsed.size(); i++) {
+            T ch = collapsed[i];
+            if (ch == '*') {
+                SetBit(m_starMask, base + i);
+            } else if (ch == '?') {
+                SetBit(m_anyMask, base + i);
+            } else {
+                SetBit(GetOrAddLiteralMask(ch), base + i);
+            }
+        }
+
+        m_acceptStates.push_back(base + collapsed.size());
+    }
+
+    // Calls callback with the index of each pattern that matches the string,
+    // in the order in which the patterns were added, until callback returns
+    // true. Returns whether callback returned true.
+    template <typename F>
+    bool ForEachMatch(std::basic_string_view<T> str, F&& callback) const {
+        if (m_acceptStates.empty()) {
+            return false;
+        }
+
+        const size_t wordCount = m_startMask.size();
+
+        uint64_t stackBuffer[kStackWordCount * 2];
+        std::unique_ptr<uint64_t[]> heapBuffer;
+        uint64_t* buffer = stackBuffer;
+        if (wordCount > kStackWordCount) {
+            heapBuffer = std::make_unique<uint64_t[]>(wordCount * 2);
+            buffer = heapBuffer.get();
+        }
+
+        uint64_t* current = buffer;
+        uint64_t* next = buffer + wordCount;
+
+        std::copy(m_startMask.begin(), m_startMask.end(), current);
+        if (!AddStarTransitions(current)) {
+            return false;
+        }
+
+        for (T ch : str) {
+            const uint64_t* literalMask = FindLiteralMask(ch);
+
+            uint64_t carry = 0;
+            for (size_t i = 0; i < wordCount; i++) {
+                uint64_t mask = m_anyMask[i];
+                if (literalMask) {
+                    mask |= literalMask[i];
+                }
+
+                uint64_t advance = current[i] & mask;
+                next[i] = (advance << 1) | carry | (current[i] & m_starMask[i]);
+                carry = advance >> 63;
+            }
+
+            if (!AddStarTransitions(next)) {
+                return false;
+            }
+
+            std::swap(current, next);
+        }
+
+        for (size_t i = 0; i < m_acceptStates.size(); i++) {
+            size_t state = m_acceptStates[i];
+            if ((current[state / 64] & (1ull << (state % 64))) &&
+                callback(i)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+   private:
+    using UnsignedT = std::make_unsigned_t<T>;
+
+    static constexpr size_t kStackWordCount = 32;
+
+    static void SetBit(std::vector<uint64_t>& mask, size_t bit) {
+        mask[bit / 64] |= 1ull << (bit % 64);
+    }
+
+    std::vector<uint64_t>& GetOrAddLiteralMask(T ch) {
+        UnsignedT uch = static_cast<UnsignedT>(ch);
+        uint32_t* index;
+        if (uch < m_asciiLiteralMaskIndex.size()) {
+            index = &m_asciiLiteralMaskIndex[uch];
+        } else {
+            auto it = std::lower_bound(
+                m_otherLiteralMaskIndex.begin(), m_otherLiteralMaskIndex.end(),
+                uch,
+                [](const auto& item, UnsignedT value) {
+                    return item.first < value;
+                });
+            if (it == m_otherLiteralMaskIndex.end() || it->first != uch) {
+                it = m_otherLiteralMaskIndex.insert(it, {uch, 0});
+            }
+
+            index = &it->second;
+        }
+
+        if (!*index) {
+            m_literalMasks.emplace_back(m_startMask.size());
+            *index = static_cast<uint32_t>(m_literalMasks.size());
+        }
+
+        return m_literalMasks[*index - 1];
+    }
+
+    const uint64_t* FindLiteralMask(T ch) const {
+        UnsignedT uch = static_cast<UnsignedT>(ch);
+        uint32_t index = 0;
+        if (uch < m_asciiLiteralMaskIndex.size()) {
+            index = m_asciiLiteralMaskIndex[uch];
+        } else {
+            auto it = std::lower_bound(
+                m_otherLiteralMaskIndex.begin(), m_otherLiteralMaskIndex.end(),
+                uch,
+                [](const auto& item, UnsignedT value) {
+                    return item.first < value;
+                });
+            if (it != m_otherLiteralMaskIndex.end() && it->first == uch) {
+                index = it->second;
+            }
+        }
+
+        return index ? m_literalMasks[index - 1].data() : nullptr;
+    }
+
+    // A '*' can match an empty sequence, so an active '*' state also activates
+    // the state after it. Consecutive '*' characters are collapsed, so a single
+    // pass is enough. Returns whether any state is active.
+    bool AddStarTransitions(uint64_t* states) const {
+        uint64_t carry = 0;
+        uint64_t any = 0;
+        for (size_t i = 0; i < m_starMask.size(); i++) {
+            states[i] |= carry;
+            uint64_t star = states[i] & m_starMask[i];
+            states[i] |= star << 1;
+            carry = star >> 63;
+            any |= states[i];
+        }
+
+        return any != 0;
+    }
+
+    size_t m_stateCount = 0;
+    std::vector<uint64_t> m_startMask;
+    std::vector<uint64_t> m_anyMask;
+    std::vector<uint64_t> m_starMask;
+    std::vector<std::vector<uint64_t>> m_literalMasks;
+    // One-based indices into m_literalMasks, zero if there's no mask.
+    std::array<uint32_t, 128> m_asciiLiteralMaskIndex{};
+    std::vector<std::pair<UnsignedT, uint32_t>> m_otherLiteralMaskIndex;
+    std::vector<size_t> m_acceptStates;
+};
+
 struct {
     WindhawkUtils::StringSetting iconTheme;
     bool allResourceRedirect;
+    bool themePacks;
 } g_settings;
 
+// Allows looking up strings by string views without an allocation.
+template <typename T>
+struct StringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::basic_string_view<T> str) const {
+        return std::hash<std::basic_string_view<T>>{}(str);
+    }
+};
+
+template <typename T>
+using RedirectionPathMap =
+    std::unordered_map<std::basic_string<T>,
+                       std::vector<std::basic_string<T>>,
+                       StringHash<T>,
+                       std::equal_to<>>;
+
 std::shared_mutex g_redirectionResourcePathsMutex;
 thread_local bool g_redirectionResourcePathsMutexLocked;
-std::unordered_map<std::wstring, std::vector<std::wstring>>
-    g_redirectionResourcePaths;
-std::unordered_map<std::string, std::vector<std::string>>
-    g_redirectionResourcePathsA;
+RedirectionPathMap<WCHAR> g_redirectionResourcePaths;
+RedirectionPathMap<char> g_redirectionResourcePathsA;
 std::vector<std::pair<std::wstring, std::wstring>>
     g_redirectionResourcePathPatterns;
 std::vector<std::pair<std::string, std::string>>
     g_redirectionResourcePathPatternsA;
+WildcardPatternSet<WCHAR> g_redirectionResourcePathPatternSet;
+WildcardPatternSet<char> g_redirectionResourcePathPatternSetA;
 
 std::shared_mutex g_redirectionResourceModulesMutex;
 std::unordered_map<std::wstring, HMODULE> g_redirectionResourceModules;
@@ -398,49 +621,6 @@ constexpr WCHAR kClearCacheCommand[] =
     LR"( & echo Starting Explorer...)"
     LR"( & timeout /t 3 /nobreak >nul")";
 
-// https://github.com/tidwall/match.c
-//
-// match returns true if str matches pattern. This is a very
-// simple wildcard match where '*' matches on any number characters
-// and '?' matches on any one character.
-//
-// pattern:
-//   { term }
-// term:
-// 	 '*'         matches any sequence of non-Separator characters
-// 	 '?'         matches any single non-Separator character
-// 	 c           matches character c (c != '*', '?')
-template <typename T>
-bool strmatch(const T* pat, size_t plen, const T* str, size_t slen) {
-    while (plen > 0) {
-        if (pat[0] == '*') {
-            if (plen == 1)
-                return true;
-            if (pat[1] == '*') {
-                pat++;
-                plen--;
-                continue;
-            }
-            if (strmatch(pat + 1, plen - 1, str, slen))
-                return true;
-            if (slen == 0)
-                return false;
-            str++;
-            slen--;
-            continue;
-        }
-        if (slen == 0)
-            return false;
-        if (pat[0] != '?' && str[0] != pat[0])
-            return false;
-        pat++;
-        plen--;
-        str++;
-        slen--;
-    }
-    return slen == 0 && plen == 0;
-}
-
 // chooseAW<char> returns OptionA.
 // chooseAW<WCHAR> returns OptionW.
 template <typename T, auto OptionA, auto OptionW>
@@ -483,6 +663,40 @@ auto StrToW(PCSTR str) {
     return result;
 }
 
+// An uppercase copy of a string for redirection lookups. Uses a stack buffer
+// unless the string is unusually long, since it's created in hot hooks.
+template <typename T>
+class UppercaseString {
+   public:
+    explicit UppercaseString(const T* str) {
+        size_t length = std::char_traits<T>::length(str);
+
+        T* buffer = m_stackBuffer;
+        if (length > ARRAYSIZE(m_stackBuffer)) {
+            m_heapBuffer.resize(length);
+            buffer = m_heapBuffer.data();
+        }
+
+        if (length > 0) {
+            (chooseAW<T, LCMapStringA, LCMapStringW>())(
+                LOCALE_USER_DEFAULT, LCMAP_UPPERCASE, str,
+                static_cast<int>(length), buffer, static_cast<int>(length));
+        }
+
+        m_view = std::basic_string_view<T>(buffer, length);
+    }
+
+    UppercaseString(const UppercaseString&) = delete;
+    UppercaseString& operator=(const UppercaseString&) = delete;
+
+    std::basic_string_view<T> View() const { return m_view; }
+
+   private:
+    T m_stackBuffer[MAX_PATH];
+    std::basic_string<T> m_heapBuffer;
+    std::basic_string_view<T> m_view;
+};
+
 // A helper function to skip locking if the thread already holds the lock, since
 // it's UB. Nested locks may happen if one hooked function is implemented with
 // the help of another hooked function. We assume here that the locks are freed
@@ -585,7 +799,1032 @@ HMODULE GetRedirectedModule(std::wstring_view fileName) {
     return module;
 }
 
+// Identifies the module mapped at a module handle, so that cached results of a
+// module which was unloaded aren't used for another module which was later
+// mapped at the same address.
+struct ModuleIdentity {
+    DWORD timeDateStamp;
+    DWORD sizeOfImage;
+    DWORD checkSum;
+
+    bool operator==(const ModuleIdentity&) const = default;
+};
+
+std::optional<ModuleIdentity> GetModuleIdentity(HMODULE hModule) {
+    // The low bits are set for modules loaded as data files.
+    BYTE* base = (BYTE*)((ULONG_PTR)hModule & ~(ULONG_PTR)3);
+    if (!base) {
+        base = (BYTE*)GetModuleHandle(nullptr);
+    }
+
+    MEMORY_BASIC_INFORMATION mbi;
+    if (!VirtualQuery(base, &mbi, sizeof(mbi)) || mbi.AllocationBase != base ||
+        mbi.State != MEM_COMMIT ||
+        (mbi.Protect & (PAGE_GUARD | PAGE_NOACCESS))) {
+        return std::nullopt;
+    }
+
+    auto* dosHeader = (IMAGE_DOS_HEADER*)base;
+    if (mbi.RegionSize < sizeof(IMAGE_DOS_HEADER) ||
+        dosHeader->e_magic != IMAGE_DOS_SIGNATURE || dosHeader->e_lfanew < 0 ||
+        (SIZE_T)dosHeader->e_lfanew + sizeof(IMAGE_NT_HEADERS) >
+            mbi.RegionSize) {
+        return std::nullopt;
+    }
+
+    // The fields below are at the same offsets for 32-bit and 64-bit modules.
+    auto* ntHeaders = (IMAGE_NT_HEADERS*)(base + dosHeader->e_lfanew);
+    if (ntHeaders->Signature != IMAGE_NT_SIGNATURE) {
+        return std::nullopt;
+    }
+
+    return ModuleIdentity{
+        .timeDateStamp = ntHeaders->FileHeader.TimeDateStamp,
+        .sizeOfImage = ntHeaders->OptionalHeader.SizeOfImage,
+        .checkSum = ntHeaders->OptionalHeader.CheckSum,
+    };
+}
+
+// A resource as requested from FindResourceEx. Named types and names are
+// stored as strings, numbered ones as ids.
+struct ResourceKey {
+    HMODULE module;
+    std::wstring type;
+    std::wstring name;
+    WORD typeId;
+    WORD nameId;
+    WORD language;
+
+    bool operator==(const ResourceKey&) const = default;
+};
+
+struct ResourceKeyHash {
+    size_t operator()(const ResourceKey& key) const {
+        size_t hash = std::hash<HMODULE>{}(key.module);
+        auto combine = [&hash](size_t value) {
+            hash ^= value + 0x9E3779B9 + (hash << 6) + (hash >> 2);
+        };
+        combine(std::hash<std::wstring>{}(key.type));
+        combine(std::hash<std::wstring>{}(key.name));
+        combine(key.typeId);
+        combine(key.nameId);
+        combine(key.language);
+        return hash;
+    }
+};
+
+template <typename T>
+ResourceKey MakeResourceKey(HMODULE hModule,
+                            const T* lpType,
+                            const T* lpName,
+                            WORD wLanguage) {
+    ResourceKey key{.module = hModule, .language = wLanguage};
+
+    if (IS_INTRESOURCE(lpType)) {
+        key.typeId = (WORD)(ULONG_PTR)lpType;
+    } else {
+        key.type = StrToW(lpType).p;
+    }
+
+    if (IS_INTRESOURCE(lpName)) {
+        key.nameId = (WORD)(ULONG_PTR)lpName;
+    } else {
+        key.name = StrToW(lpName).p;
+    }
+
+    return key;
+}
+
+struct ResolvedResource {
+    ModuleIdentity moduleIdentity;
+    // nullptr if the resource isn't redirected or is from a theme pack.
+    HMODULE redirectModule;
+    // nullptr if the resource isn't redirected.
+    HRSRC resource;
+};
+
+struct ResourceHandleKey {
+    HMODULE module;
+    HRSRC resource;
+
+    bool operator==(const ResourceHandleKey&) const = default;
+};
+
+struct ResourceHandleKeyHash {
+    size_t operator()(const ResourceHandleKey& key) const {
+        return std::hash<HMODULE>{}(key.module) ^
+               (std::hash<HRSRC>{}(key.resource) << 1);
+    }
+};
+
+struct ResolvedResourceHandle {
+    ModuleIdentity moduleIdentity;
+    // nullptr if the resource handle isn't part of a redirected module.
+    HMODULE redirectModule;
+};
+
+struct ModuleRedirects {
+    ModuleIdentity moduleIdentity;
+    // The redirection targets of the module, in the order in which they
+    // should be tried.
+    std::shared_ptr<const std::vector<std::wstring>> redirects;
+};
+
+// Caches the results of redirection, which are the same for repeated requests
+// as long as the settings don't change. The redirected modules referenced by
+// the cache are owned by g_redirectionResourceModules, so the cache must be
+// cleared before they're freed. Results which were resolved with an older
+// generation of the settings aren't stored.
+constexpr size_t kResolvedResourceCacheMaxSize = 4096;
+
+std::shared_mutex g_resolvedResourceCacheMutex;
+DWORD g_resolvedResourceCacheGeneration;
+std::unordered_map<HMODULE, ModuleRedirects> g_moduleRedirectsCache;
+std::unordered_map<ResourceKey, ResolvedResource, ResourceKeyHash>
+    g_resolvedResourceCache;
+std::unordered_map<ResourceHandleKey,
+                   ResolvedResourceHandle,
+                   ResourceHandleKeyHash>
+    g_resolvedResourceHandleCache;
+std::atomic<DWORD> g_resolvedResourceCacheHits;
+std::atomic<DWORD> g_resolvedResourceCacheMisses;
+
+void LogResolvedResourceCacheStats() {
+    DWORD hits = g_resolvedResourceCacheHits;
+    DWORD misses = g_resolvedResourceCacheMisses;
+    DWORD total = hits + misses;
+    Wh_Log(L"Resolved resource cache: %u hits, %u misses (%u%% hit rate)",
+           hits, misses, total ? (DWORD)((ULONGLONG)hits * 100 / total) : 0);
+}
+
+void CountResolvedResourceCacheLookup(bool hit) {
+    DWORD count = hit ? ++g_resolvedResourceCacheHits
+                      : ++g_resolvedResourceCacheMisses;
+    if (count % 10000 == 0) {
+        LogResolvedResourceCacheStats();
+    }
+}
+
+DWORD GetResolvedResourceCacheGeneration() {
+    std::shared_lock lock{g_resolvedResourceCacheMutex};
+    return g_resolvedResourceCacheGeneration;
+}
+
+// Looks up a cache entry, validating that it belongs to the module which is
+// currently mapped at its address.
+template <typename Map, typename Key>
+const typename Map::mapped_type* FindResolvedResourceCacheEntry(
+    const Map& map,
+    const Key& key,
+    const ModuleIdentity& moduleIdentity) {
+    const auto it = map.find(key);
+    if (it == map.end() || it->second.moduleIdentity != moduleIdentity) {
+        return nullptr;
+    }
+
+    return &it->second;
+}
+
+template <typename Map, typename Key>
+void StoreResolvedResourceCacheEntry(Map& map,
+                                     DWORD generation,
+                                     Key key,
+                                     typename Map::mapped_type value) {
+    std::unique_lock lock{g_resolvedResourceCacheMutex};
+
+    if (generation != g_resolvedResourceCacheGeneration) {
+        return;
+    }
+
+    if (map.size() >= kResolvedResourceCacheMaxSize) {
+        map.clear();
+    }
+
+    map.insert_or_assign(std::move(key), std::move(value));
+}
+
+void ClearResolvedResourceCache() {
+    {
+        std::unique_lock lock{g_resolvedResourceCacheMutex};
+        g_resolvedResourceCacheGeneration++;
+        g_moduleRedirectsCache.clear();
+        g_resolvedResourceCache.clear();
+        g_resolvedResourceHandleCache.clear();
+    }
+
+    LogResolvedResourceCacheStats();
+}
+
+// Theme packs contain the resources of all module files of a theme folder in a
+// single indexed file, which is mapped once and from which FindResourceEx and
+// LoadResource requests can be served without loading each file as a module.
+//
+// Layout: a header, a table of files, a table of resources sorted by type,
+// name and language for each file, a pool of length-prefixed uppercase
+// strings, and the resource payloads, which start at a page boundary. All
+// offsets are relative to the start of the file.
+constexpr DWORD kThemePackMagic = 0x50545252;  // "RRTP"
+constexpr DWORD kThemePackVersion = 1;
+constexpr DWORD kThemePackPayloadAlignment = 0x1000;
+constexpr DWORD kThemePackResourceAlignment = 8;
+// Set for type and name values which are string pool offsets.
+constexpr DWORD kThemePackStringFlag = 0x80000000;
+// The first resource value of files which couldn't be loaded as modules.
+constexpr DWORD kThemePackNotModule = 0xFFFFFFFF;
+
+struct ThemePackHeader {
+    DWORD magic;
+    DWORD version;
+    DWORD fileCount;
+    DWORD fileTableOffset;
+    DWORD resourceCount;
+    DWORD resourceTableOffset;
+    DWORD stringPoolOffset;
+    DWORD stringPoolSize;
+    DWORD payloadOffset;
+    DWORD payloadSize;
+};
+
+struct ThemePackFile {
+    DWORD nameOffset;
+    DWORD reserved;
+    ULONGLONG fileSize;
+    ULONGLONG lastWriteTime;
+    DWORD firstResource;
+    DWORD resourceCount;
+};
+
+struct ThemePackResource {
+    DWORD type;
+    DWORD name;
+    WORD language;
+    WORD reserved1;
+    DWORD reserved2;
+    // Returned as the HRSRC of the resource, like in modules. OffsetToData is
+    // relative to the start of the file.
+    IMAGE_RESOURCE_DATA_ENTRY dataEntry;
+};
+
+// A resource type or name, either a numeric id or an uppercase string.
+struct ThemePackResourceName {
+    WORD id;
+    std::wstring_view name;
+};
+
+int CompareThemePackResourceNames(const ThemePackResourceName& a,
+                                  const ThemePackResourceName& b) {
+    // Numeric ids come before strings, as in modules.
+    if (a.name.empty() != b.name.empty()) {
+        return a.name.empty() ? -1 : 1;
+    }
+
+    if (a.name.empty()) {
+        return a.id < b.id ? -1 : a.id > b.id;
+    }
+
+    return a.name.compare(b.name);
+}
+
+class ThemePackWriter {
+   public:
+    // Adds a file. Resources which are added afterwards belong to it.
+    void AddFile(std::wstring_view name,
+                 ULONGLONG fileSize,
+                 ULONGLONG lastWriteTime,
+                 bool isModule) {
+        m_files.push_back({
+            .name = std::wstring(name),
+            .fileSize = fileSize,
+            .lastWriteTime = lastWriteTime,
+            .isModule = isModule,
+        });
+    }
+
+    void AddResource(ThemePackResourceName type,
+                     ThemePackResourceName name,
+                     WORD language,
+                     const void* data,
+                     DWORD size) {
+        m_files.back().resources.push_back({
+            .typeId = type.id,
+            .typeName = std::wstring(type.name),
+            .nameId = name.id,
+            .name = std::wstring(name.name),
+            .language = language,
+            .data = std::vector<BYTE>((const BYTE*)data,
+                                      (const BYTE*)data + size),
+        });
+    }
+
+    // Returns an empty vector if the result is too large for the format.
+    std::vector<BYTE> Serialize() {
+        size_t resourceCount = 0;
+        for (auto& file : m_files) {
+            std::sort(file.resources.begin(), file.resources.end(),
+                      [](const Resource& a, const Resource& b) {
+                          return CompareResources(a, b) < 0;
+                      });
+            resourceCount += file.resources.size();
+        }
+
+        std::vector<BYTE> stringPool;
+        auto addString = [&stringPool](std::wstring_view str) {
+            DWORD offset = (DWORD)stringPool.size();
+            WORD length = (WORD)str.size();
+            stringPool.insert(stringPool.end(), (const BYTE*)&length,
+                              (const BYTE*)(&length + 1));
+            stringPool.insert(stringPool.end(), (const BYTE*)str.data(),
+                              (const BYTE*)(str.data() + length));
+            return offset;
+        };
+
+        auto encodeName = [&addString](WORD id, std::wstring_view name) {
+            return name.empty() ? (DWORD)id
+                                : kThemePackStringFlag | addString(name);
+        };
+
+        std::vector<ThemePackFile> files;
+        std::vector<ThemePackResource> resources;
+        std::vector<const Resource*> payloads;
+        resources.reserve(resourceCount);
+        payloads.reserve(resourceCount);
+
+        ULONGLONG payloadSize = 0;
+        for (const auto& file : m_files) {
+            files.push_back({
+                .nameOffset = addString(file.name),
+                .fileSize = file.fileSize,
+                .lastWriteTime = file.lastWriteTime,
+                .firstResource = file.isModule ? (DWORD)resources.size()
+                                               : kThemePackNotModule,
+                .resourceCount = (DWORD)file.resources.size(),
+            });
+
+            for (const auto& resource : file.resources) {
+                payloadSize = AlignUp(payloadSize, kThemePackResourceAlignment);
+                resources.push_back({
+                    .type = encodeName(resource.typeId, resource.typeName),
+                    .name = encodeName(resource.nameId, resource.name),
+                    .language = resource.language,
+                    .dataEntry =
+                        {
+                            // Relative to the payloads for now.
+                            .OffsetToData = (DWORD)payloadSize,
+                            .Size = (DWORD)resource.data.size(),
+                        },
+                });
+                payloads.push_back(&resource);
+                payloadSize += resource.data.size();
+            }
+        }
+
+        ThemePackHeader header{
+            .magic = kThemePackMagic,
+            .version = kThemePackVersion,
+            .fileCount = (DWORD)files.size(),
+            .resourceCount = (DWORD)resources.size(),
+        };
+
+        ULONGLONG offset = sizeof(header);
+        header.fileTableOffset = (DWORD)offset;
+        offset += files.size() * sizeof(ThemePackFile);
+        header.resourceTableOffset = (DWORD)offset;
+        offset += resources.size() * sizeof(ThemePackResource);
+        header.stringPoolOffset = (DWORD)offset;
+        header.stringPoolSize = (DWORD)stringPool.size();
+        offset += stringPool.size();
+        offset = AlignUp(offset, kThemePackPayloadAlignment);
+        header.payloadOffset = (DWORD)offset;
+        header.payloadSize = (DWORD)payloadSize;
+        offset += payloadSize;
+
+        if (offset > MAXDWORD) {
+            return {};
+        }
+
+        for (auto& resource : resources) {
+            resource.dataEntry.OffsetToData += header.payloadOffset;
+        }
+
+        std::vector<BYTE> result(offset);
+        memcpy(result.data(), &header, sizeof(header));
+        std::copy(files.begin(), files.end(),
+                  (ThemePackFile*)(result.data() + header.fileTableOffset));
+        std::copy(
+            resources.begin(), resources.end(),
+            (ThemePackResource*)(result.data() + header.resourceTableOffset));
+        std::copy(stringPool.begin(), stringPool.end(),
+                  result.data() + header.stringPoolOffset);
+        for (size_t i = 0; i < resources.size(); i++) {
+            std::copy(payloads[i]->data.begin(), payloads[i]->data.end(),
+                      result.data() + resources[i].dataEntry.OffsetToData);
+        }
+
+        return result;
+    }
+
+   private:
+    struct Resource {
+        WORD typeId;
+        std::wstring typeName;
+        WORD nameId;
+        std::wstring name;
+        WORD language;
+        std::vector<BYTE> data;
+    };
+
+    struct File {
+        std::wstring name;
+        ULONGLONG fileSize;
+        ULONGLONG lastWriteTime;
+        bool isModule;
+        std::vector<Resource> resources;
+    };
+
+    static ULONGLONG AlignUp(ULONGLONG value, DWORD alignment) {
+        return (value + alignment - 1) & ~(ULONGLONG)(alignment - 1);
+    }
+
+    static int CompareResources(const Resource& a, const Resource& b) {
+        int result = CompareThemePackResourceNames({a.typeId, a.typeName},
+                                                   {b.typeId, b.typeName});
+        if (result == 0) {
+            result =
+                CompareThemePackResourceNames({a.nameId, a.name},
+                                              {b.nameId, b.name});
+        }
+
+        if (result == 0) {
+            result = a.language < b.language ? -1 : a.language > b.language;
+        }
+
+        return result;
+    }
+
+    std::vector<File> m_files;
+};
+
+enum class ThemePackLookupResult {
+    found,
+    // The file doesn't have the resource.
+    notFound,
+    // The result can't be determined without loading the file as a module,
+    // e.g. because the language fallback rules of the loader apply.
+    unknown,
+};
+
+class ThemePackReader {
+   public:
+    // Validates the whole theme pack, so that lookups don't need any checks.
+    bool Parse(const BYTE* data, size_t size) {
+        if (size < sizeof(ThemePackHeader)) {
+            return false;
+        }
+
+        const auto* header = (const ThemePackHeader*)data;
+        if (header->magic != kThemePackMagic ||
+            header->version != kThemePackVersion ||
+            !IsRangeValid(size, header->fileTableOffset,
+                          (ULONGLONG)header->fileCount *
+                              sizeof(ThemePackFile)) ||
+            !IsRangeValid(size, header->resourceTableOffset,
+                          (ULONGLONG)header->resourceCount *
+                              sizeof(ThemePackResource)) ||
+            !IsRangeValid(size, header->stringPoolOffset,
+                          header->stringPoolSize) ||
+            !IsRangeValid(size, header->payloadOffset, header->payloadSize) ||
+            header->fileTableOffset % alignof(ThemePackFile) ||
+            header->resourceTableOffset % alignof(ThemePackResource) ||
+            header->stringPoolOffset % sizeof(WCHAR)) {
+            return false;
+        }
+
+        m_data = data;
+        m_header = header;
+        m_files = (const ThemePackFile*)(data + header->fileTableOffset);
+        m_resources =
+            (const ThemePackResource*)(data + header->resourceTableOffset);
+
+        for (DWORD i = 0; i < header->fileCount; i++) {
+            const auto& file = m_files[i];
+            if (!IsStringValid(file.nameOffset) ||
+                (file.firstResource == kThemePackNotModule
+                     ? file.resourceCount != 0
+                     : file.firstResource > header->resourceCount ||
+                           file.resourceCount >
+                               header->resourceCount - file.firstResource)) {
+                m_header = nullptr;
+                return false;
+            }
+        }
+
+        for (DWORD i = 0; i < header->resourceCount; i++) {
+            const auto& resource = m_resources[i];
+            if (((resource.type & kThemePackStringFlag) &&
+                 !IsStringValid(resource.type & ~kThemePackStringFlag)) ||
+                ((resource.name & kThemePackStringFlag) &&
+                 !IsStringValid(resource.name & ~kThemePackStringFlag)) ||
+                resource.dataEntry.OffsetToData < header->payloadOffset ||
+                !IsRangeValid(
+                    (ULONGLONG)header->payloadOffset + header->payloadSize,
+                    resource.dataEntry.OffsetToData,
+                    resource.dataEntry.Size)) {
+                m_header = nullptr;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    DWORD FileCount() const { return m_header->fileCount; }
+
+    std::wstring_view FileName(DWORD fileIndex) const {
+        return GetString(m_files[fileIndex].nameOffset);
+    }
+
+    ULONGLONG FileSize(DWORD fileIndex) const {
+        return m_files[fileIndex].fileSize;
+    }
+
+    ULONGLONG FileLastWriteTime(DWORD fileIndex) const {
+        return m_files[fileIndex].lastWriteTime;
+    }
+
+    bool IsModule(DWORD fileIndex) const {
+        return m_files[fileIndex].firstResource != kThemePackNotModule;
+    }
+
+    ThemePackLookupResult FindResource(
+        DWORD fileIndex,
+        const ThemePackResourceName& type,
+        const ThemePackResourceName& name,
+        WORD language,
+        const IMAGE_RESOURCE_DATA_ENTRY** result) const {
+        const auto& file = m_files[fileIndex];
+        if (file.firstResource == kThemePackNotModule) {
+            return ThemePackLookupResult::unknown;
+        }
+
+        const ThemePackResource* begin = m_resources + file.firstResource;
+        const ThemePackResource* end = begin + file.resourceCount;
+
+        auto compare = [this, &type, &name](const ThemePackResource& resource) {
+            int result = CompareThemePackResourceNames(
+                DecodeName(resource.type), type);
+            if (result == 0) {
+                result = CompareThemePackResourceNames(
+                    DecodeName(resource.name), name);
+            }
+
+            return result;
+        };
+
+        const ThemePackResource* first = std::partition_point(
+            begin, end,
+            [&compare](const ThemePackResource& r) { return compare(r) < 0; });
+        const ThemePackResource* last = std::partition_point(
+            first, end,
+            [&compare](const ThemePackResource& r) { return compare(r) == 0; });
+
+        if (first == last) {
+            return ThemePackLookupResult::notFound;
+        }
+
+        // With a single language, the loader falls back to it for neutral
+        // requests. Otherwise, only exact requests for specific languages are
+        // served, and the rest are left to the loader.
+        bool neutral = PRIMARYLANGID(language) == LANG_NEUTRAL;
+        if (last - first == 1) {
+            if (neutral || first->language == language) {
+                *result = &first->dataEntry;
+                return ThemePackLookupResult::found;
+            }
+        } else if (!neutral) {
+            for (const auto* it = first; it != last; it++) {
+                if (it->language == language) {
+                    *result = &it->dataEntry;
+                    return ThemePackLookupResult::found;
+                }
+            }
+        }
+
+        return ThemePackLookupResult::unknown;
+    }
+
+    // Returns the data of a resource if the handle is the data entry of one of
+    // the resources of the theme pack.
+    bool GetResourceData(const void* handle,
+                         const void** data,
+                         DWORD* size) const {
+        const BYTE* p = (const BYTE*)handle;
+        const BYTE* tableBegin = (const BYTE*)m_resources;
+        const BYTE* tableEnd =
+            tableBegin + m_header->resourceCount * sizeof(ThemePackResource);
+        if (p < tableBegin || p >= tableEnd ||
+            (size_t)(p - tableBegin) % sizeof(ThemePackResource) !=
+                offsetof(ThemePackResource, dataEntry)) {
+            return false;
+        }
+
+        const auto* dataEntry = (const IMAGE_RESOURCE_DATA_ENTRY*)p;
+        *data = m_data + dataEntry->OffsetToData;
+        *size = dataEntry->Size;
+        return true;
+    }
+
+   private:
+    static bool IsRangeValid(ULONGLONG size, ULONGLONG offset,
+                             ULONGLONG length) {
+        return offset <= size && length <= size - offset;
+    }
+
+    bool IsStringValid(DWORD offset) const {
+        if (offset % sizeof(WCHAR) ||
+            !IsRangeValid(m_header->stringPoolSize, offset, sizeof(WORD))) {
+            return false;
+        }
+
+        WORD length =
+            *(const WORD*)(m_data + m_header->stringPoolOffset + offset);
+        return IsRangeValid(m_header->stringPoolSize, offset + sizeof(WORD),
+                            (ULONGLONG)length * sizeof(WCHAR));
+    }
+
+    std::wstring_view GetString(DWORD offset) const {
+        const BYTE* p = m_data + m_header->stringPoolOffset + offset;
+        return std::wstring_view((PCWSTR)(p + sizeof(WORD)), *(const WORD*)p);
+    }
+
+    ThemePackResourceName DecodeName(DWORD value) const {
+        if (value & kThemePackStringFlag) {
+            return {0, GetString(value & ~kThemePackStringFlag)};
+        }
+
+        return {(WORD)value, {}};
+    }
+
+    const BYTE* m_data = nullptr;
+    const ThemePackHeader* m_header = nullptr;
+    const ThemePackFile* m_files = nullptr;
+    const ThemePackResource* m_resources = nullptr;
+};
+
+bool GetFileSizeAndLastWriteTime(PCWSTR path,
+                                 ULONGLONG* fileSize,
+                                 ULONGLONG* lastWriteTime) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesEx(path, GetFileExInfoStandard, &data)) {
+        return false;
+    }
+
+    *fileSize = ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    *lastWriteTime = ((ULONGLONG)data.ftLastWriteTime.dwHighDateTime << 32) |
+                     data.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+// A mapped theme pack of a theme folder.
+class ThemePack {
+   public:
+    static std::unique_ptr<ThemePack> Open(
+        const std::filesystem::path& packPath,
+        const std::filesystem::path& themeFolder) {
+        HANDLE file = CreateFile(packPath.c_str(), GENERIC_READ,
+                                 FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+
+        LARGE_INTEGER fileSize;
+        HANDLE mapping = nullptr;
+        if (GetFileSizeEx(file, &fileSize) && fileSize.QuadPart > 0 &&
+            fileSize.QuadPart <= MAXDWORD) {
+            mapping =
+                CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        }
+
+        CloseHandle(file);
+
+        if (!mapping) {
+            return nullptr;
+        }
+
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+
+        if (!view) {
+            return nullptr;
+        }
+
+        std::unique_ptr<ThemePack> themePack(
+            new ThemePack(view, (size_t)fileSize.QuadPart));
+        if (!themePack->m_reader.Parse((const BYTE*)view,
+                                       (size_t)fileSize.QuadPart)) {
+            Wh_Log(L"Invalid theme pack: %s", packPath.c_str());
+            return nullptr;
+        }
+
+        const auto& reader = themePack->m_reader;
+        for (DWORD i = 0; i < reader.FileCount(); i++) {
+            auto path = themeFolder / reader.FileName(i);
+
+            ULONGLONG currentFileSize;
+            ULONGLONG currentLastWriteTime;
+            if (!GetFileSizeAndLastWriteTime(path.c_str(), &currentFileSize,
+                                             &currentLastWriteTime) ||
+                currentFileSize != reader.FileSize(i) ||
+                currentLastWriteTime != reader.FileLastWriteTime(i)) {
+                Wh_Log(L"Theme pack entry is outdated: %s", path.c_str());
+                continue;
+            }
+
+            // Keys are built the same way as redirection targets in
+            // LoadSettings.
+            UppercaseString<WCHAR> pathUpper{path.c_str()};
+            themePack->m_fileIndexes.try_emplace(
+                std::wstring(pathUpper.View()), i);
+        }
+
+        return themePack;
+    }
+
+    ~ThemePack() { UnmapViewOfFile(m_view); }
+
+    ThemePack(const ThemePack&) = delete;
+    ThemePack& operator=(const ThemePack&) = delete;
+
+    const ThemePackReader& Reader() const { return m_reader; }
+
+    const BYTE* ViewBegin() const { return (const BYTE*)m_view; }
+    const BYTE* ViewEnd() const { return ViewBegin() + m_viewSize; }
+
+    // Returns the index of a current file by its uppercase path.
+    std::optional<DWORD> FindFile(std::wstring_view pathUpper) const {
+        const auto it = m_fileIndexes.find(pathUpper);
+        if (it == m_fileIndexes.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+   private:
+    ThemePack(void* view, size_t viewSize)
+        : m_view(view), m_viewSize(viewSize) {}
+
+    void* m_view;
+    size_t m_viewSize;
+    ThemePackReader m_reader;
+    std::unordered_map<std::wstring, DWORD, StringHash<WCHAR>, std::equal_to<>>
+        m_fileIndexes;
+};
+
+struct ThemePackSource {
+    std::filesystem::path packPath;
+    std::filesystem::path themeFolder;
+
+    // Guarded by g_themePacksMutex.
+    bool opened = false;
+    // The last write time of the pack file when it last failed to open, zero
+    // if the file didn't exist.
+    std::optional<ULONGLONG> failedLastWriteTime;
+};
+
+// A pack which failed to open, for example since it wasn't built yet, is
+// retried at most this often, and only if the pack file changed.
+constexpr ULONGLONG kThemePackRetryInterval = 10 * 1000;
+
+// Theme packs are mapped on first use, and unmapped together with the
+// redirected modules, since resources which were returned from them are valid
+// until then.
+std::shared_mutex g_themePacksMutex;
+std::vector<ThemePackSource> g_themePackSources;
+std::vector<std::unique_ptr<ThemePack>> g_themePacks;
+bool g_themePacksOpened;
+// When to retry opening the packs which failed to open, zero if none did.
+ULONGLONG g_themePacksRetryTickCount;
+// The range of addresses which covers the views of all mapped packs, so that
+// resource handles which weren't returned from a pack are told apart without
+// taking the lock.
+std::atomic<ULONG_PTR> g_themePacksViewBegin;
+std::atomic<ULONG_PTR> g_themePacksViewEnd;
+
+// Must be called with g_themePacksMutex held.
+bool ShouldOpenThemePacks() {
+    return !g_themePacksOpened ||
+           (g_themePacksRetryTickCount &&
+            GetTickCount64() >= g_themePacksRetryTickCount);
+}
+
+// Maps the theme packs which weren't mapped yet. Packs which were mapped
+// already are kept, since resources might have been returned from them. Must
+// be called with g_themePacksMutex held exclusively.
+void OpenThemePacks() {
+    bool retry = false;
+
+    for (auto& source : g_themePackSources) {
+        if (source.opened) {
+            continue;
+        }
+
+        ULONGLONG fileSize;
+        ULONGLONG lastWriteTime = 0;
+        GetFileSizeAndLastWriteTime(source.packPath.c_str(), &fileSize,
+                                    &lastWriteTime);
+        if (source.failedLastWriteTime == lastWriteTime) {
+            retry = true;
+            continue;
+        }
+
+        auto themePack = ThemePack::Open(source.packPath, source.themeFolder);
+        if (!themePack) {
+            Wh_Log(L"Failed to open theme pack: %s", source.packPath.c_str());
+            source.failedLastWriteTime = lastWriteTime;
+            retry = true;
+            continue;
+        }
+
+        Wh_Log(L"Opened theme pack: %s", source.packPath.c_str());
+
+        auto viewBegin = (ULONG_PTR)themePack->ViewBegin();
+        auto viewEnd = (ULONG_PTR)themePack->ViewEnd();
+        if (!g_themePacksViewEnd || viewBegin < g_themePacksViewBegin) {
+            g_themePacksViewBegin = viewBegin;
+        }
+
+        if (viewEnd > g_themePacksViewEnd) {
+            g_themePacksViewEnd = viewEnd;
+        }
+
+        g_themePacks.push_back(std::move(themePack));
+        source.opened = true;
+        source.failedLastWriteTime.reset();
+    }
+
+    g_themePacksOpened = true;
+    g_themePacksRetryTickCount =
+        retry ? GetTickCount64() + kThemePackRetryInterval : 0;
+}
+
+// Makes the next lookup map a pack which was built by this process. If a
+// previous version of the pack is mapped, the new version is mapped in
+// addition to it, and is used for the files which are outdated in the
+// previous version.
+void ReopenBuiltThemePack(const std::filesystem::path& packPath) {
+    std::unique_lock lock{g_themePacksMutex};
+
+    for (auto& source : g_themePackSources) {
+        if (source.packPath == packPath) {
+            source.opened = false;
+            source.failedLastWriteTime.reset();
+            g_themePacksOpened = false;
+        }
+    }
+}
+
+// Calls callback for each theme pack until it returns true. Returns whether
+// callback returned true.
+template <typename F>
+bool ForEachThemePack(F&& callback) {
+    {
+        std::shared_lock lock{g_themePacksMutex};
+        if (!ShouldOpenThemePacks()) {
+            for (const auto& themePack : g_themePacks) {
+                if (callback(*themePack)) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+    }
+
+    std::unique_lock lock{g_themePacksMutex};
+
+    if (ShouldOpenThemePacks()) {
+        OpenThemePacks();
+    }
+
+    for (const auto& themePack : g_themePacks) {
+        if (callback(*themePack)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Looks up a resource of a redirection target in the theme packs. Returns
+// nullopt if the target has to be loaded as a module to find the resource, or
+// nullptr if the target doesn't have the resource.
+template <typename T>
+std::optional<HRSRC> FindThemePackResource(const std::wstring& redirect,
+                                           const T* lpType,
+                                           const T* lpName,
+                                           WORD wLanguage) {
+    if (!g_settings.themePacks) {
+        return std::nullopt;
+    }
+
+    UppercaseString<WCHAR> typeUpper{
+        IS_INTRESOURCE(lpType) ? L"" : StrToW(lpType).p};
+    UppercaseString<WCHAR> nameUpper{
+        IS_INTRESOURCE(lpName) ? L"" : StrToW(lpName).p};
+    ThemePackResourceName type{(WORD)(ULONG_PTR)lpType, typeUpper.View()};
+    ThemePackResourceName name{(WORD)(ULONG_PTR)lpName, nameUpper.View()};
+    if (!type.name.empty()) {
+        type.id = 0;
+    }
+
+    if (!name.name.empty()) {
+        name.id = 0;
+    }
+
+    // Names such as "#123" are parsed as ids by the loader.
+    if (type.name.starts_with(L'#') || name.name.starts_with(L'#')) {
+        return std::nullopt;
+    }
+
+    UppercaseString<WCHAR> redirectUpper{redirect.c_str()};
+
+    std::optional<HRSRC> result;
+    ForEachThemePack([&](const ThemePack& themePack) {
+        auto fileIndex = themePack.FindFile(redirectUpper.View());
+        if (!fileIndex) {
+            return false;
+        }
+
+        const IMAGE_RESOURCE_DATA_ENTRY* dataEntry;
+        switch (themePack.Reader().FindResource(*fileIndex, type, name,
+                                                wLanguage, &dataEntry)) {
+            case ThemePackLookupResult::found:
+                result = (HRSRC)dataEntry;
+                break;
+
+            case ThemePackLookupResult::notFound:
+                result = nullptr;
+                break;
+
+            case ThemePackLookupResult::unknown:
+                break;
+        }
+
+        return true;
+    });
+
+    return result;
+}
+
+// Returns whether the theme packs show that a redirection target doesn't have
+// a resource, in which case the target doesn't have to be loaded as a module.
+template <typename T>
+bool IsResourceMissingFromThemePack(const std::wstring& redirect,
+                                    const T* lpType,
+                                    const T* lpName) {
+    auto result =
+        FindThemePackResource(redirect, lpType, lpName,
+                              MAKELANGID(LANG_NEUTRAL, SUBLANG_NEUTRAL));
+    return result && !*result;
+}
+
+// Returns the data of a resource if the handle was returned from a theme pack.
+bool GetThemePackResourceData(HRSRC hResInfo, const void** data, DWORD* size) {
+    if (!g_settings.themePacks) {
+        return false;
+    }
+
+    // Called for every loaded resource, most of which are in modules.
+    auto address = (ULONG_PTR)hResInfo;
+    if (address < g_themePacksViewBegin || address >= g_themePacksViewEnd) {
+        return false;
+    }
+
+    return ForEachThemePack([&](const ThemePack& themePack) {
+        return themePack.Reader().GetResourceData(hResInfo, data, size);
+    });
+}
+
 void FreeAndClearRedirectedModules() {
+    ClearResolvedResourceCache();
+
+    std::vector<std::unique_ptr<ThemePack>> themePacks;
+
+    {
+        std::unique_lock lock{g_themePacksMutex};
+        themePacks.swap(g_themePacks);
+        g_themePacksOpened = false;
+        g_themePacksRetryTickCount = 0;
+        g_themePacksViewBegin = 0;
+        g_themePacksViewEnd = 0;
+
+        for (auto& source : g_themePackSources) {
+            source.opened = false;
+            source.failedLastWriteTime.reset();
+        }
+    }
+
     std::unordered_map<std::wstring, HMODULE> modules;
 
     {
@@ -608,11 +1847,7 @@ bool RedirectFileName(DWORD c,
         return false;
     }
 
-    std::basic_string<T> fileNameUpper{fileName};
-    (chooseAW<T, LCMapStringA, LCMapStringW>())(
-        LOCALE_USER_DEFAULT, LCMAP_UPPERCASE, &fileNameUpper[0],
-        static_cast<int>(fileNameUpper.length()), &fileNameUpper[0],
-        static_cast<int>(fileNameUpper.length()));
+    UppercaseString<T> fileNameUpper{fileName};
 
     bool triedRedirection = false;
 
@@ -622,7 +1857,8 @@ bool RedirectFileName(DWORD c,
         const auto& redirectionResourcePaths =
             *(chooseAW<T, &g_redirectionResourcePathsA,
                        &g_redirectionResourcePaths>());
-        if (const auto it = redirectionResourcePaths.find(fileNameUpper);
+        if (const auto it =
+                redirectionResourcePaths.find(fileNameUpper.View());
             it != redirectionResourcePaths.end()) {
             const auto& redirects = it->second;
             for (const auto& redirect : redirects) {
@@ -642,23 +1878,24 @@ bool RedirectFileName(DWORD c,
         const auto& redirectionResourcePathPatterns =
             *(chooseAW<T, &g_redirectionResourcePathPatternsA,
                        &g_redirectionResourcePathPatterns>());
-        for (const auto& [pattern, redirect] :
-             redirectionResourcePathPatterns) {
-            if (!strmatch(pattern.data(), pattern.size(), fileNameUpper.data(),
-                          fileNameUpper.size())) {
-                continue;
-            }
-
-            if (!triedRedirection) {
-                beforeFirstRedirectionFunction();
-                triedRedirection = true;
-            }
+        const auto& redirectionResourcePathPatternSet =
+            *(chooseAW<T, &g_redirectionResourcePathPatternSetA,
+                       &g_redirectionResourcePathPatternSet>());
+        if (redirectionResourcePathPatternSet.ForEachMatch(
+                fileNameUpper.View(), [&](size_t patternIndex) {
+                    const auto& redirect =
+                        redirectionResourcePathPatterns[patternIndex].second;
+
+                    if (!triedRedirection) {
+                        beforeFirstRedirectionFunction();
+                        triedRedirection = true;
+                    }
 
-            Wh_Log(L"[%u] Trying %s", c, StrToW(redirect.c_str()).p);
+                    Wh_Log(L"[%u] Trying %s", c, StrToW(redirect.c_str()).p);
 
-            if (redirectFunction(redirect.c_str())) {
-                return true;
-            }
+                    return redirectFunction(redirect.c_str());
+                })) {
+            return true;
         }
     }
 
@@ -669,10 +1906,22 @@ bool RedirectFileName(DWORD c,
     return false;
 }
 
-bool RedirectModule(DWORD c,
-                    HINSTANCE hInstance,
-                    std::function<void()> beforeFirstRedirectionFunction,
-                    std::function<bool(HINSTANCE)> redirectFunction) {
+// Returns the redirection targets of a module, in the order in which they
+// should be tried, or nullptr on error.
+std::shared_ptr<const std::vector<std::wstring>> GetModuleRedirects(
+    DWORD c,
+    HINSTANCE hInstance,
+    const std::optional<ModuleIdentity>& moduleIdentity) {
+    if (moduleIdentity) {
+        std::shared_lock lock{g_resolvedResourceCacheMutex};
+        if (const auto* entry = FindResolvedResourceCacheEntry(
+                g_moduleRedirectsCache, hInstance, *moduleIdentity)) {
+            return entry->redirects;
+        }
+    }
+
+    DWORD generation = GetResolvedResourceCacheGeneration();
+
     WCHAR szFileName[MAX_PATH];
     DWORD fileNameLen;
     if ((ULONG_PTR)hInstance & 3) {
@@ -683,13 +1932,13 @@ bool RedirectModule(DWORD c,
             DWORD dwError = GetLastError();
             Wh_Log(L"[%u] GetMappedFileName(%p) failed with error %u", c,
                    hInstance, dwError);
-            return false;
+            return nullptr;
         }
 
         if (!DevicePathToDosPath(szNtFileName, szFileName,
                                  ARRAYSIZE(szFileName))) {
             Wh_Log(L"[%u] DevicePathToDosPath failed", c);
-            return false;
+            return nullptr;
         }
 
         fileNameLen = wcslen(szFileName);
@@ -701,13 +1950,13 @@ bool RedirectModule(DWORD c,
                 DWORD dwError = GetLastError();
                 Wh_Log(L"[%u] GetModuleFileName(%p) failed with error %u", c,
                        hInstance, dwError);
-                return false;
+                return nullptr;
             }
 
             case ARRAYSIZE(szFileName):
                 Wh_Log(L"[%u] GetModuleFileName(%p) failed, name too long", c,
                        hInstance);
-                return false;
+                return nullptr;
         }
     }
 
@@ -717,57 +1966,82 @@ bool RedirectModule(DWORD c,
                   fileNameLen, &szFileName[0], fileNameLen, nullptr, nullptr,
                   0);
 
-    bool triedRedirection = false;
+    auto redirects = std::make_shared<std::vector<std::wstring>>();
 
     {
         auto lock{RedirectionResourcePathsMutexSharedLock()};
 
-        if (const auto it = g_redirectionResourcePaths.find(szFileName);
+        if (const auto it = g_redirectionResourcePaths.find(
+                std::wstring_view{szFileName, fileNameLen});
             it != g_redirectionResourcePaths.end()) {
-            const auto& redirects = it->second;
-            for (const auto& redirect : redirects) {
-                if (!triedRedirection) {
-                    beforeFirstRedirectionFunction();
-                    triedRedirection = true;
-                }
+            *redirects = it->second;
+        }
+
+        g_redirectionResourcePathPatternSet.ForEachMatch(
+            std::wstring_view{szFileName, fileNameLen},
+            [&](size_t patternIndex) {
+                redirects->push_back(
+                    g_redirectionResourcePathPatterns[patternIndex].second);
+                return false;
+            });
+    }
+
+    if (moduleIdentity) {
+        StoreResolvedResourceCacheEntry(g_moduleRedirectsCache, generation,
+                                        hInstance,
+                                        ModuleRedirects{
+                                            .moduleIdentity = *moduleIdentity,
+                                            .redirects = redirects,
+                                        });
+    }
+
+    return redirects;
+}
 
-                Wh_Log(L"[%u] Trying %s", c, redirect.c_str());
+// If set, redirectWithoutModuleFunction is called for each redirection target
+// before it's loaded as a module. It can return whether the redirection
+// succeeded, or nullopt to continue with redirectFunction.
+bool RedirectModule(
+    DWORD c,
+    HINSTANCE hInstance,
+    const std::optional<ModuleIdentity>& moduleIdentity,
+    std::function<void()> beforeFirstRedirectionFunction,
+    std::function<bool(HINSTANCE)> redirectFunction,
+    std::function<std::optional<bool>(const std::wstring&)>
+        redirectWithoutModuleFunction = nullptr) {
+    auto redirects = GetModuleRedirects(c, hInstance, moduleIdentity);
+    if (!redirects) {
+        return false;
+    }
 
-                HINSTANCE hInstanceRedirect = GetRedirectedModule(redirect);
-                if (!hInstanceRedirect) {
-                    Wh_Log(L"[%u] GetRedirectedModule failed", c);
-                    continue;
-                }
+    bool triedRedirection = false;
 
-                if (redirectFunction(hInstanceRedirect)) {
-                    return true;
-                }
-            }
+    for (const auto& redirect : *redirects) {
+        if (!triedRedirection) {
+            beforeFirstRedirectionFunction();
+            triedRedirection = true;
         }
 
-        for (const auto& [pattern, redirect] :
-             g_redirectionResourcePathPatterns) {
-            if (!strmatch(pattern.data(), pattern.size(), szFileName,
-                          fileNameLen)) {
-                continue;
-            }
-
-            if (!triedRedirection) {
-                beforeFirstRedirectionFunction();
-                triedRedirection = true;
-            }
+        Wh_Log(L"[%u] Trying %s", c, redirect.c_str());
 
-            Wh_Log(L"[%u] Trying %s", c, redirect.c_str());
+        if (redirectWithoutModuleFunction) {
+            if (auto result = redirectWithoutModuleFunction(redirect)) {
+                if (*result) {
+                    return true;
+                }
 
-            HINSTANCE hInstanceRedirect = GetRedirectedModule(redirect);
-            if (!hInstanceRedirect) {
-                Wh_Log(L"[%u] GetRedirectedModule failed", c);
                 continue;
             }
+        }
 
-            if (redirectFunction(hInstanceRedirect)) {
-                return true;
-            }
+        HINSTANCE hInstanceRedirect = GetRedirectedModule(redirect);
+        if (!hInstanceRedirect) {
+            Wh_Log(L"[%u] GetRedirectedModule failed", c);
+            continue;
+        }
+
+        if (redirectFunction(hInstanceRedirect)) {
+            return true;
         }
     }
 
@@ -778,6 +2052,15 @@ bool RedirectModule(DWORD c,
     return false;
 }
 
+bool RedirectModule(DWORD c,
+                    HINSTANCE hInstance,
+                    std::function<void()> beforeFirstRedirectionFunction,
+                    std::function<bool(HINSTANCE)> redirectFunction) {
+    return RedirectModule(c, hInstance, GetModuleIdentity(hInstance),
+                          std::move(beforeFirstRedirectionFunction),
+                          std::move(redirectFunction));
+}
+
 typedef struct {
     int targetIndex;
     int currentIndex;
@@ -1027,8 +2310,22 @@ HANDLE LoadImageAW_Hook(HINSTANCE hInst,
                 return false;
             });
     } else {
+        const T* resourceType = nullptr;
+        switch (type) {
+            case IMAGE_BITMAP:
+                resourceType = (const T*)RT_BITMAP;
+                break;
+            case IMAGE_ICON:
+                resourceType = (const T*)RT_GROUP_ICON;
+                break;
+            case IMAGE_CURSOR:
+                resourceType = (const T*)RT_GROUP_CURSOR;
+                break;
+        }
+
         redirected = RedirectModule(
-            c, hInst, std::move(beforeFirstRedirectionFunction),
+            c, hInst, GetModuleIdentity(hInst),
+            std::move(beforeFirstRedirectionFunction),
             [&](HINSTANCE hInstanceRedirect) {
                 result =
                     (*Original)(hInstanceRedirect, name, type, cx, cy, fuLoad);
@@ -1040,6 +2337,15 @@ HANDLE LoadImageAW_Hook(HINSTANCE hInst,
                 DWORD dwError = GetLastError();
                 Wh_Log(L"[%u] LoadImage failed with error %u", c, dwError);
                 return false;
+            },
+            [&](const std::wstring& redirect) -> std::optional<bool> {
+                if (resourceType && IsResourceMissingFromThemePack(
+                                        redirect, resourceType, name)) {
+                    Wh_Log(L"[%u] Resource not found in theme pack", c);
+                    return false;
+                }
+
+                return std::nullopt;
             });
     }
 
@@ -1094,7 +2400,7 @@ HICON LoadIconAW_Hook(HINSTANCE hInstance, const T* lpIconName) {
     HICON result;
 
     bool redirected = RedirectModule(
-        c, hInstance, []() {},
+        c, hInstance, GetModuleIdentity(hInstance), []() {},
         [&](HINSTANCE hInstanceRedirect) {
             result = (*Original)(hInstanceRedirect, lpIconName);
             if (result) {
@@ -1105,6 +2411,15 @@ HICON LoadIconAW_Hook(HINSTANCE hInstance, const T* lpIconName) {
             DWORD dwError = GetLastError();
             Wh_Log(L"[%u] LoadIcon failed with error %u", c, dwError);
             return false;
+        },
+        [&](const std::wstring& redirect) -> std::optional<bool> {
+            if (IsResourceMissingFromThemePack(
+                    redirect, (const T*)RT_GROUP_ICON, lpIconName)) {
+                Wh_Log(L"[%u] Resource not found in theme pack", c);
+                return false;
+            }
+
+            return std::nullopt;
         });
     if (redirected) {
         return result;
@@ -1515,21 +2830,94 @@ HRSRC FindResourceExAW_Hook(HMODULE hModule,
                logType().c_str(), StrToW(lpName).p, wLanguage);
     }
 
+    const auto moduleIdentity = GetModuleIdentity(hModule);
+    std::optional<ResourceKey> key;
+    if (moduleIdentity) {
+        key = MakeResourceKey(hModule, lpType, lpName, wLanguage);
+
+        std::optional<ResolvedResource> cached;
+        {
+            std::shared_lock lock{g_resolvedResourceCacheMutex};
+            if (const auto* entry = FindResolvedResourceCacheEntry(
+                    g_resolvedResourceCache, *key, *moduleIdentity)) {
+                cached = *entry;
+            }
+        }
+
+        CountResolvedResourceCacheLookup(cached.has_value());
+
+        if (cached) {
+            Wh_Log(L"[%u] Using cached result, redirected=%d", c,
+                   !!cached->resource);
+            if (cached->resource) {
+                return cached->resource;
+            }
+
+            return (*Original)(hModule, lpType, lpName, wLanguage);
+        }
+    }
+
+    DWORD generation = GetResolvedResourceCacheGeneration();
+
     HRSRC result;
+    HMODULE resultModule = nullptr;
 
     bool redirected = RedirectModule(
-        c, hModule, []() {},
+        c, hModule, moduleIdentity, []() {},
         [&](HINSTANCE hInstanceRedirect) {
             result = (*Original)(hInstanceRedirect, lpType, lpName, wLanguage);
             if (result) {
                 Wh_Log(L"[%u] Redirected successfully, result=%p", c, result);
+                resultModule = hInstanceRedirect;
                 return true;
             }
 
             DWORD dwError = GetLastError();
             Wh_Log(L"[%u] FindResourceEx failed with error %u", c, dwError);
             return false;
+        },
+        [&](const std::wstring& redirect) -> std::optional<bool> {
+            auto themePackResult =
+                FindThemePackResource(redirect, lpType, lpName, wLanguage);
+            if (!themePackResult) {
+                return std::nullopt;
+            }
+
+            result = *themePackResult;
+            if (result) {
+                Wh_Log(L"[%u] Redirected successfully from theme pack, "
+                       L"result=%p",
+                       c, result);
+                return true;
+            }
+
+            Wh_Log(L"[%u] Resource not found in theme pack", c);
+            return false;
         });
+
+    if (moduleIdentity) {
+        StoreResolvedResourceCacheEntry(
+            g_resolvedResourceCache, generation, std::move(*key),
+            ResolvedResource{
+                .moduleIdentity = *moduleIdentity,
+                .redirectModule = redirected ? resultModule : nullptr,
+                .resource = redirected ? result : nullptr,
+            });
+
+        // The handle is usually passed to LoadResource and SizeofResource
+        // with the original module next. Theme pack handles are recognized
+        // without the cache.
+        if (redirected && resultModule) {
+            StoreResolvedResourceCacheEntry(
+                g_resolvedResourceHandleCache, generation,
+                ResourceHandleKey{hModule, result},
+                ResolvedResourceHandle{
+                    .moduleIdentity = *moduleIdentity,
+                    .redirectModule = resultModule,
+                });
+        }
+    }
+
     if (redirected) {
         return result;
     }
@@ -1587,9 +2975,59 @@ bool IsResourceHandlePartOfModule(HMODULE hModule, HRSRC hResInfo) {
     }
 }
 
+// Returns the cached module which the resource handle should be used with, or
+// nullopt if there's no cached result.
+std::optional<HMODULE> FindCachedResourceHandleModule(
+    HMODULE hModule,
+    HRSRC hResInfo,
+    const std::optional<ModuleIdentity>& moduleIdentity) {
+    if (!moduleIdentity) {
+        return std::nullopt;
+    }
+
+    std::optional<HMODULE> result;
+    {
+        std::shared_lock lock{g_resolvedResourceCacheMutex};
+        if (const auto* entry = FindResolvedResourceCacheEntry(
+                g_resolvedResourceHandleCache,
+                ResourceHandleKey{hModule, hResInfo}, *moduleIdentity)) {
+            result = entry->redirectModule ? entry->redirectModule : hModule;
+        }
+    }
+
+    CountResolvedResourceCacheLookup(result.has_value());
+
+    return result;
+}
+
+void StoreResourceHandleModule(
+    DWORD generation,
+    HMODULE hModule,
+    HRSRC hResInfo,
+    const std::optional<ModuleIdentity>& moduleIdentity,
+    HMODULE redirectModule) {
+    if (!moduleIdentity) {
+        return;
+    }
+
+    StoreResolvedResourceCacheEntry(g_resolvedResourceHandleCache, generation,
+                                    ResourceHandleKey{hModule, hResInfo},
+                                    ResolvedResourceHandle{
+                                        .moduleIdentity = *moduleIdentity,
+                                        .redirectModule = redirectModule,
+                                    });
+}
+
 using LoadResource_t = decltype(&LoadResource);
 LoadResource_t LoadResource_Original;
 HGLOBAL WINAPI LoadResource_Hook(HMODULE hModule, HRSRC hResInfo) {
+    const void* themePackData;
+    DWORD themePackDataSize;
+    if (GetThemePackResourceData(hResInfo, &themePackData,
+                                 &themePackDataSize)) {
+        return (HGLOBAL)themePackData;
+    }
+
     if (g_resourceOperationCount > 0) {
         return LoadResource_Original(hModule, hResInfo);
     }
@@ -1598,10 +3036,20 @@ HGLOBAL WINAPI LoadResource_Hook(HMODULE hModule, HRSRC hResInfo) {
 
     Wh_Log(L"[%u] > hModule=%p, hResInfo=%p", c, hModule, hResInfo);
 
+    const auto moduleIdentity = GetModuleIdentity(hModule);
+    if (auto cachedModule = FindCachedResourceHandleModule(hModule, hResInfo,
+                                                           moduleIdentity)) {
+        Wh_Log(L"[%u] Using cached module %p", c, *cachedModule);
+        return LoadResource_Original(*cachedModule, hResInfo);
+    }
+
+    DWORD generation = GetResolvedResourceCacheGeneration();
+
     HGLOBAL result;
+    HMODULE resultModule = nullptr;
 
     bool redirected = RedirectModule(
-        c, hModule, []() {},
+        c, hModule, moduleIdentity, []() {},
         [&](HINSTANCE hInstanceRedirect) {
             if (!IsResourceHandlePartOfModule(hInstanceRedirect, hResInfo)) {
                 Wh_Log(
@@ -1613,6 +3061,7 @@ HGLOBAL WINAPI LoadResource_Hook(HMODULE hModule, HRSRC hResInfo) {
             result = LoadResource_Original(hInstanceRedirect, hResInfo);
             if (result) {
                 Wh_Log(L"[%u] Redirected successfully", c);
+                resultModule = hInstanceRedirect;
                 return true;
             }
 
@@ -1620,6 +3069,10 @@ HGLOBAL WINAPI LoadResource_Hook(HMODULE hModule, HRSRC hResInfo) {
             Wh_Log(L"[%u] LoadResource failed with error %u", c, dwError);
             return false;
         });
+
+    StoreResourceHandleModule(generation, hModule, hResInfo, moduleIdentity,
+                              resultModule);
+
     if (redirected) {
         return result;
     }
@@ -1630,6 +3083,13 @@ HGLOBAL WINAPI LoadResource_Hook(HMODULE hModule, HRSRC hResInfo) {
 using SizeofResource_t = decltype(&SizeofResource);
 SizeofResource_t SizeofResource_Original;
 DWORD WINAPI SizeofResource_Hook(HMODULE hModule, HRSRC hResInfo) {
+    const void* themePackData;
+    DWORD themePackDataSize;
+    if (GetThemePackResourceData(hResInfo, &themePackData,
+                                 &themePackDataSize)) {
+        return themePackDataSize;
+    }
+
     if (g_resourceOperationCount > 0) {
         return SizeofResource_Original(hModule, hResInfo);
     }
@@ -1638,10 +3098,20 @@ DWORD WINAPI SizeofResource_Hook(HMODULE hModule, HRSRC hResInfo) {
 
     Wh_Log(L"[%u] > hModule=%p, hResInfo=%p", c, hModule, hResInfo);
 
+    const auto moduleIdentity = GetModuleIdentity(hModule);
+    if (auto cachedModule = FindCachedResourceHandleModule(hModule, hResInfo,
+                                                           moduleIdentity)) {
+        Wh_Log(L"[%u] Using cached module %p", c, *cachedModule);
+        return SizeofResource_Original(*cachedModule, hResInfo);
+    }
+
+    DWORD generation = GetResolvedResourceCacheGeneration();
+
     DWORD result;
+    HMODULE resultModule = nullptr;
 
     bool redirected = RedirectModule(
-        c, hModule, []() {},
+        c, hModule, moduleIdentity, []() {},
         [&](HINSTANCE hInstanceRedirect) {
             if (!IsResourceHandlePartOfModule(hInstanceRedirect, hResInfo)) {
                 Wh_Log(
@@ -1657,12 +3127,17 @@ DWORD WINAPI SizeofResource_Hook(HMODULE hModule, HRSRC hResInfo) {
             DWORD dwError = GetLastError();
             if (result || dwError == 0) {
                 Wh_Log(L"[%u] Redirected successfully", c);
+                resultModule = hInstanceRedirect;
                 return true;
             }
 
             Wh_Log(L"[%u] SizeofResource failed with error %u", c, dwError);
             return false;
         });
+
+    StoreResourceHandleModule(generation, hModule, hResInfo, moduleIdentity,
+                              resultModule);
+
     if (redirected) {
         return result;
     }
@@ -2579,12 +4054,336 @@ std::wstring GetIconThemePath(std::wstring_view iconTheme) {
     return targetPath;
 }
 
+struct ThemePackSourceFile {
+    std::wstring name;
+    ULONGLONG fileSize;
+    ULONGLONG lastWriteTime;
+};
+
+// Returns the existing files of a theme folder, without duplicates.
+std::vector<ThemePackSourceFile> GetThemePackSourceFiles(
+    const std::filesystem::path& themeFolder,
+    const std::vector<std::wstring>& fileNames) {
+    std::vector<ThemePackSourceFile> result;
+
+    for (const auto& fileName : fileNames) {
+        if (std::any_of(result.begin(), result.end(), [&](const auto& file) {
+                return file.name == fileName;
+            })) {
+            continue;
+        }
+
+        ThemePackSourceFile file{.name = fileName};
+        if (GetFileSizeAndLastWriteTime((themeFolder / fileName).c_str(),
+                                        &file.fileSize, &file.lastWriteTime)) {
+            result.push_back(std::move(file));
+        }
+    }
+
+    return result;
+}
+
+bool IsThemePackUpToDate(const ThemePack& themePack,
+                         const std::vector<ThemePackSourceFile>& files) {
+    const auto& reader = themePack.Reader();
+    if (reader.FileCount() != files.size()) {
+        return false;
+    }
+
+    for (DWORD i = 0; i < reader.FileCount(); i++) {
+        if (reader.FileName(i) != files[i].name ||
+            reader.FileSize(i) != files[i].fileSize ||
+            reader.FileLastWriteTime(i) != files[i].lastWriteTime) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+struct ThemePackResourceEntry {
+    WORD typeId;
+    std::wstring typeName;
+    WORD nameId;
+    std::wstring name;
+    WORD language;
+};
+
+std::wstring ThemePackResourceNameToUpper(PCWSTR name) {
+    UppercaseString<WCHAR> nameUpper{name};
+    return std::wstring(nameUpper.View());
+}
+
+BOOL CALLBACK EnumThemePackResourceLanguagesProc(HMODULE hModule,
+                                                 LPCWSTR lpType,
+                                                 LPCWSTR lpName,
+                                                 WORD wLanguage,
+                                                 LONG_PTR lParam) {
+    auto* entries = (std::vector<ThemePackResourceEntry>*)lParam;
+
+    ThemePackResourceEntry entry{.language = wLanguage};
+
+    if (IS_INTRESOURCE(lpType)) {
+        entry.typeId = (WORD)(ULONG_PTR)lpType;
+    } else {
+        entry.typeName = ThemePackResourceNameToUpper(lpType);
+    }
+
+    if (IS_INTRESOURCE(lpName)) {
+        entry.nameId = (WORD)(ULONG_PTR)lpName;
+    } else {
+        entry.name = ThemePackResourceNameToUpper(lpName);
+    }
+
+    entries->push_back(std::move(entry));
+    return TRUE;
+}
+
+BOOL CALLBACK EnumThemePackResourceNamesProc(HMODULE hModule,
+                                             LPCWSTR lpType,
+                                             LPWSTR lpName,
+                                             LONG_PTR lParam) {
+    EnumResourceLanguagesExW(hModule, lpType, lpName,
+                             EnumThemePackResourceLanguagesProc, lParam,
+                             RESOURCE_ENUM_LN, 0);
+    return TRUE;
+}
+
+BOOL CALLBACK EnumThemePackResourceTypesProc(HMODULE hModule,
+                                             LPWSTR lpType,
+                                             LONG_PTR lParam) {
+    EnumResourceNamesExW(hModule, lpType, EnumThemePackResourceNamesProc,
+                         lParam, RESOURCE_ENUM_LN, 0);
+    return TRUE;
+}
+
+bool AddThemePackModuleResources(ThemePackWriter& writer, HMODULE module) {
+    std::vector<ThemePackResourceEntry> entries;
+    EnumResourceTypesExW(module, EnumThemePackResourceTypesProc,
+                         (LONG_PTR)&entries, RESOURCE_ENUM_LN, 0);
+
+    for (const auto& entry : entries) {
+        PCWSTR type = entry.typeName.empty() ? MAKEINTRESOURCE(entry.typeId)
+                                             : entry.typeName.c_str();
+        PCWSTR name = entry.name.empty() ? MAKEINTRESOURCE(entry.nameId)
+                                         : entry.name.c_str();
+
+        HRSRC resource = FindResourceExW(module, type, name, entry.language);
+        HGLOBAL loaded = resource ? LoadResource(module, resource) : nullptr;
+        const void* data = loaded ? LockResource(loaded) : nullptr;
+        if (!data) {
+            Wh_Log(L"Failed to load resource for theme pack");
+            return false;
+        }
+
+        writer.AddResource({entry.typeId, entry.typeName},
+                           {entry.nameId, entry.name}, entry.language, data,
+                           SizeofResource(module, resource));
+    }
+
+    return true;
+}
+
+struct ThemePackBuildJob {
+    std::filesystem::path themeFolder;
+    std::vector<std::wstring> fileNames;
+    std::filesystem::path packPath;
+};
+
+HANDLE g_themePackBuildThread;
+std::atomic<bool> g_themePackBuildCancelled;
+
+bool BuildThemePack(const std::filesystem::path& themeFolder,
+                    const std::vector<ThemePackSourceFile>& files,
+                    const std::filesystem::path& packPath) {
+    // Bypass the resource hooks while reading the theme's own resources.
+    auto scope = resourceOperationCountScope();
+
+    ThemePackWriter writer;
+
+    for (const auto& file : files) {
+        if (g_themePackBuildCancelled) {
+            Wh_Log(L"Theme pack build was cancelled");
+            return false;
+        }
+
+        auto path = themeFolder / file.name;
+
+        HMODULE module = LoadLibraryEx(
+            path.c_str(), nullptr,
+            LOAD_LIBRARY_AS_DATAFILE | LOAD_LIBRARY_AS_IMAGE_RESOURCE);
+
+        writer.AddFile(file.name, file.fileSize, file.lastWriteTime,
+                       module != nullptr);
+
+        if (module) {
+            bool added = AddThemePackModuleResources(writer, module);
+            FreeLibrary(module);
+            if (!added) {
+                return false;
+            }
+        }
+    }
+
+    std::vector<BYTE> data = writer.Serialize();
+    if (data.empty()) {
+        Wh_Log(L"Theme pack is too large");
+        return false;
+    }
+
+    auto tempPath = packPath;
+    tempPath += L".tmp";
+
+    HANDLE file = CreateFile(tempPath.c_str(), GENERIC_WRITE, 0, nullptr,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        DWORD dwError = GetLastError();
+        Wh_Log(L"Failed to create %s: %u", tempPath.c_str(), dwError);
+        return false;
+    }
+
+    DWORD written;
+    bool succeeded =
+        WriteFile(file, data.data(), (DWORD)data.size(), &written, nullptr) &&
+        written == data.size();
+    CloseHandle(file);
+
+    // Processes which mapped the previous version keep using it, and fall back
+    // to modules for its outdated files.
+    if (!succeeded || !MoveFileEx(tempPath.c_str(), packPath.c_str(),
+                                  MOVEFILE_REPLACE_EXISTING)) {
+        DWORD dwError = GetLastError();
+        Wh_Log(L"Failed to write %s: %u", packPath.c_str(), dwError);
+        DeleteFile(tempPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+// Builds the theme pack of a theme folder if it's missing or outdated.
+void EnsureThemePack(const std::filesystem::path& themeFolder,
+                     const std::vector<std::wstring>& fileNames,
+                     const std::filesystem::path& packPath) {
+    auto files = GetThemePackSourceFiles(themeFolder, fileNames);
+
+    auto isUpToDate = [&]() {
+        auto themePack = ThemePack::Open(packPath, themeFolder);
+        return themePack && IsThemePackUpToDate(*themePack, files);
+    };
+
+    if (isUpToDate()) {
+        return;
+    }
+
+    std::error_code ec;
+    std::filesystem::create_directories(packPath.parent_path(), ec);
+
+    auto lockFilePath = packPath;
+    lockFilePath += L".lock";
+
+    // Don't wait if another Explorer process is building the pack already.
+    HANDLE lockFile = LockTempFileExclusive(lockFilePath.c_str(), 0);
+    if (lockFile == INVALID_HANDLE_VALUE) {
+        Wh_Log(L"LockTempFileExclusive failed");
+        return;
+    }
+
+    if (!isUpToDate()) {
+        Wh_Log(L"Building theme pack %s", packPath.c_str());
+        if (BuildThemePack(themeFolder, files, packPath)) {
+            ReopenBuiltThemePack(packPath);
+        } else {
+            Wh_Log(L"Failed to build theme pack");
+        }
+    }
+
+    UnlockTempFileExclusive(lockFile);
+    DeleteFile(lockFilePath.c_str());
+}
+
+void StopThemePackBuild() {
+    if (!g_themePackBuildThread) {
+        return;
+    }
+
+    g_themePackBuildCancelled = true;
+    WaitForSingleObject(g_themePackBuildThread, INFINITE);
+    CloseHandle(g_themePackBuildThread);
+    g_themePackBuildThread = nullptr;
+    g_themePackBuildCancelled = false;
+}
+
+// Builds the theme packs in a background thread, so that loading the mod isn't
+// delayed by it. Until a pack is built, the theme's files are loaded instead.
+void StartThemePackBuild(std::vector<ThemePackBuildJob> jobs) {
+    StopThemePackBuild();
+
+    if (jobs.empty()) {
+        return;
+    }
+
+    auto* param = new std::vector<ThemePackBuildJob>(std::move(jobs));
+
+    g_themePackBuildThread = CreateThread(
+        nullptr, 0,
+        [](LPVOID lpParameter) WINAPI -> DWORD {
+            std::unique_ptr<std::vector<ThemePackBuildJob>> jobs(
+                (std::vector<ThemePackBuildJob>*)lpParameter);
+
+            for (const auto& job : *jobs) {
+                if (g_themePackBuildCancelled) {
+                    break;
+                }
+
+                EnsureThemePack(job.themeFolder, job.fileNames, job.packPath);
+            }
+
+            return 0;
+        },
+        param, 0, nullptr);
+    if (!g_themePackBuildThread) {
+        DWORD dwError = GetLastError();
+        Wh_Log(L"CreateThread failed with error %u", dwError);
+        delete param;
+    }
+}
+
+// Theme folders might not be writable, so the packs are kept in the mod's
+// storage folder, named after a hash of the theme folder path.
+std::filesystem::path GetThemePackPath(
+    const std::filesystem::path& themeFolder) {
+    WCHAR storagePathBuffer[MAX_PATH];
+    if (!Wh_GetModStoragePath(storagePathBuffer,
+                              ARRAYSIZE(storagePathBuffer))) {
+        Wh_Log(L"Wh_GetModStoragePath failed");
+        return std::filesystem::path{};
+    }
+
+    // FNV-1a, which is stable across processes and mod versions.
+    UppercaseString<WCHAR> themeFolderUpper{themeFolder.c_str()};
+    ULONGLONG hash = 14695981039346656037ULL;
+    for (WCHAR ch : themeFolderUpper.View()) {
+        hash ^= ch;
+        hash *= 1099511628211ULL;
+    }
+
+    WCHAR fileName[32];
+    swprintf_s(fileName, L"%016llX.pack", hash);
+
+    return std::filesystem::path{storagePathBuffer} / L"theme-packs" /
+           fileName;
+}
+
 void LoadSettings() {
     g_settings.iconTheme = WindhawkUtils::StringSetting::make(L"iconTheme");
     g_settings.allResourceRedirect = Wh_GetIntSetting(L"allResourceRedirect");
+    // Theme packs are only used by the FindResourceEx hooks.
+    g_settings.themePacks =
+        Wh_GetIntSetting(L"themePacks") && g_settings.allResourceRedirect;
 
-    std::unordered_map<std::wstring, std::vector<std::wstring>> paths;
-    std::unordered_map<std::string, std::vector<std::string>> pathsA;
+    RedirectionPathMap<WCHAR> paths;
+    RedirectionPathMap<char> pathsA;
     std::vector<std::pair<std::wstring, std::wstring>> pathPatterns;
     std::vector<std::pair<std::string, std::string>> pathPatternsA;
 
@@ -2635,7 +4434,15 @@ void LoadSettings() {
         }
     };
 
-    auto addRedirectionThemePath = [&addRedirectionPath](PCWSTR themePath) {
+    struct ThemeFolderFiles {
+        std::filesystem::path themeFolder;
+        std::vector<std::wstring> fileNames;
+    };
+
+    std::vector<ThemeFolderFiles> themeFolderFiles;
+
+    auto addRedirectionThemePath = [&addRedirectionPath,
+                                    &themeFolderFiles](PCWSTR themePath) {
         auto initialPath = std::filesystem::path{themePath};
 
         std::filesystem::path themeFolder;
@@ -2660,6 +4467,8 @@ void LoadSettings() {
             return false;
         }
 
+        ThemeFolderFiles folderFiles{.themeFolder = themeFolder};
+
         for (auto* p = data.data(); *p;) {
             auto* pNext = p + wcslen(p) + 1;
             auto* pEq = wcschr(p, L'=');
@@ -2668,6 +4477,8 @@ void LoadSettings() {
 
                 auto redirectFile = themeFolder / (pEq + 1);
                 addRedirectionPath(p, redirectFile.c_str());
+
+                folderFiles.fileNames.push_back(pEq + 1);
             } else {
                 Wh_Log(L"Skipping %s", p);
             }
@@ -2675,6 +4486,8 @@ void LoadSettings() {
             p = pNext;
         }
 
+        themeFolderFiles.push_back(std::move(folderFiles));
+
         return true;
     };
 
@@ -2740,11 +4553,55 @@ void LoadSettings() {
     std::reverse(pathPatterns.begin(), pathPatterns.end());
     std::reverse(pathPatternsA.begin(), pathPatternsA.end());
 
+    WildcardPatternSet<WCHAR> pathPatternSet;
+    for (const auto& [pattern, redirect] : pathPatterns) {
+        pathPatternSet.Add(pattern);
+    }
+
+    WildcardPatternSet<char> pathPatternSetA;
+    for (const auto& [pattern, redirect] : pathPatternsA) {
+        pathPatternSetA.Add(pattern);
+    }
+
+    std::vector<ThemePackSource> themePackSources;
+    std::vector<ThemePackBuildJob> themePackBuildJobs;
+    if (g_settings.themePacks) {
+        for (auto& folderFiles : themeFolderFiles) {
+            auto packPath = GetThemePackPath(folderFiles.themeFolder);
+            if (packPath.empty()) {
+                continue;
+            }
+
+            themePackSources.push_back({
+                .packPath = packPath,
+                .themeFolder = folderFiles.themeFolder,
+            });
+
+            themePackBuildJobs.push_back({
+                .themeFolder = std::move(folderFiles.themeFolder),
+                .fileNames = std::move(folderFiles.fileNames),
+                .packPath = std::move(packPath),
+            });
+        }
+    }
+
+    {
+        std::unique_lock lock{g_themePacksMutex};
+        g_themePackSources = std::move(themePackSources);
+    }
+
+    // Packs are built by explorer, and used as is by other processes.
+    if (IsExplorerProcess()) {
+        StartThemePackBuild(std::move(themePackBuildJobs));
+    }
+
     std::unique_lock lock{g_redirectionResourcePathsMutex};
     g_redirectionResourcePaths = std::move(paths);
     g_redirectionResourcePathsA = std::move(pathsA);
     g_redirectionResourcePathPatterns = std::move(pathPatterns);
     g_redirectionResourcePathPatternsA = std::move(pathPatternsA);
+    g_redirectionResourcePathPatternSet = std::move(pathPatternSet);
+    g_redirectionResourcePathPatternSetA = std::move(pathPatternSetA);
 }
 
 BOOL Wh_ModInit() {
@@ -2921,6 +4778,8 @@ BOOL Wh_ModInit() {
 void Wh_ModUninit() {
     Wh_Log(L">");
 
+    StopThemePackBuild();
+
     FreeAndClearRedirectedModules();
 
     HWND clearCachePromptWindow = g_clearCachePromptWindow;
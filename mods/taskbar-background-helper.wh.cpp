@@ -109,11 +109,14 @@ a workaround.
 
 #include <winrt/Windows.UI.ViewManagement.h>
 
+#include <algorithm>
 #include <atomic>
 #include <mutex>
 #include <optional>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 enum class BackgroundStyle {
     blur,
@@ -136,8 +139,6 @@ struct {
 
 std::mutex g_winEventHookThreadMutex;
 std::atomic<HANDLE> g_winEventHookThread;
-std::unordered_set<HMONITOR> g_pendingMonitors;
-UINT_PTR g_pendingMonitorsTimer;
 
 #if __cplusplus < 202302L
 // Missing in older MinGW headers.
@@ -468,60 +469,197 @@ std::wstring GetProcessFileName(DWORD dwProcessId) {
     return processFileNameUpper;
 }
 
-bool IsWindowExcluded(HWND hWnd) {
-    if (g_settings.excludedPrograms.empty()) {
-        return false;
+// Caches the uppercase process path and app ID of windows, which are
+// otherwise resolved on every exclusion check by opening the window's process
+// and creating an app resolver COM object. Each value is resolved on first
+// use, so that the app ID isn't resolved for windows which are matched by
+// their process path. Window entries are validated with the window's process
+// and thread IDs, in case the handle was reused, and process paths are keyed
+// by process ID and creation time for the same reason. Each cache is simply
+// cleared when it grows past its limit.
+class WindowIdentityCache {
+   public:
+    std::wstring GetProcessPathUpper(HWND hWnd) {
+        return GetWindowValue(hWnd, &WindowEntry::processPathUpper,
+                              [this](DWORD processId) {
+                                  return ResolveProcessPathUpper(processId);
+                              });
+    }
+
+    std::wstring GetAppIdUpper(HWND hWnd) {
+        return GetWindowValue(
+            hWnd, &WindowEntry::appIdUpper, [hWnd](DWORD) {
+                std::wstring appIdUpper = GetWindowAppId(hWnd);
+                LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_UPPERCASE,
+                              appIdUpper.data(), appIdUpper.length(),
+                              appIdUpper.data(), appIdUpper.length(), nullptr,
+                              nullptr, 0);
+                return appIdUpper;
+            });
     }
 
-    DWORD resolvedWindowProcessPathLen = 0;
-    WCHAR resolvedWindowProcessPath[MAX_PATH];
-    WCHAR resolvedWindowProcessPathUpper[MAX_PATH];
+    void InvalidateWindow(HWND hWnd) {
+        std::lock_guard<std::mutex> guard(m_mutex);
 
-    DWORD dwProcessId = 0;
-    if (GetWindowThreadProcessId(hWnd, &dwProcessId)) {
-        HANDLE hProcess =
-            OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, dwProcessId);
-        if (hProcess) {
-            DWORD dwSize = ARRAYSIZE(resolvedWindowProcessPath);
-            if (QueryFullProcessImageName(hProcess, 0,
-                                          resolvedWindowProcessPath, &dwSize)) {
-                resolvedWindowProcessPathLen = dwSize;
+        m_windows.erase(hWnd);
+    }
+
+    void InvalidateAllWindows() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        m_windows.clear();
+    }
+
+   private:
+    struct WindowEntry {
+        DWORD processId;
+        DWORD threadId;
+        std::optional<std::wstring> processPathUpper;
+        std::optional<std::wstring> appIdUpper;
+    };
+
+    struct ProcessEntry {
+        ULONGLONG creationTime;
+        std::wstring pathUpper;
+    };
+
+    static constexpr size_t kMaxWindows = 1024;
+    static constexpr size_t kMaxProcesses = 256;
+
+    template <typename F>
+    std::wstring GetWindowValue(HWND hWnd,
+                                std::optional<std::wstring> WindowEntry::*value,
+                                F&& resolve) {
+        DWORD processId = 0;
+        DWORD threadId = GetWindowThreadProcessId(hWnd, &processId);
+        if (!threadId) {
+            return std::wstring{};
+        }
+
+        auto isEntryValid = [processId, threadId](const WindowEntry& entry) {
+            return entry.processId == processId && entry.threadId == threadId;
+        };
+
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            auto it = m_windows.find(hWnd);
+            if (it != m_windows.end() && isEntryValid(it->second) &&
+                it->second.*value) {
+                return *(it->second.*value);
+            }
+        }
+
+        // Resolve without holding the lock, creating the app resolver can take
+        // a while.
+        std::wstring result = resolve(processId);
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        auto it = m_windows.find(hWnd);
+        if (it == m_windows.end() || !isEntryValid(it->second)) {
+            if (m_windows.size() >= kMaxWindows) {
+                m_windows.clear();
             }
 
-            CloseHandle(hProcess);
+            it = m_windows
+                     .insert_or_assign(hWnd,
+                                       WindowEntry{
+                                           .processId = processId,
+                                           .threadId = threadId,
+                                       })
+                     .first;
         }
+
+        it->second.*value = result;
+        return result;
     }
 
-    if (resolvedWindowProcessPathLen > 0) {
-        LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_UPPERCASE,
-                      resolvedWindowProcessPath,
-                      resolvedWindowProcessPathLen + 1,
-                      resolvedWindowProcessPathUpper,
-                      resolvedWindowProcessPathLen + 1, nullptr, nullptr, 0);
-    } else {
-        *resolvedWindowProcessPath = L'\0';
-        *resolvedWindowProcessPathUpper = L'\0';
+    std::wstring ResolveProcessPathUpper(DWORD processId) {
+        HANDLE hProcess =
+            OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+        if (!hProcess) {
+            return std::wstring{};
+        }
+
+        ULONGLONG creationTime = 0;
+        FILETIME creationFileTime, exitFileTime, kernelFileTime, userFileTime;
+        if (GetProcessTimes(hProcess, &creationFileTime, &exitFileTime,
+                            &kernelFileTime, &userFileTime)) {
+            creationTime =
+                ((ULONGLONG)creationFileTime.dwHighDateTime << 32) |
+                creationFileTime.dwLowDateTime;
+        }
+
+        if (creationTime) {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            auto it = m_processes.find(processId);
+            if (it != m_processes.end() &&
+                it->second.creationTime == creationTime) {
+                CloseHandle(hProcess);
+                return it->second.pathUpper;
+            }
+        }
+
+        std::wstring pathUpper;
+
+        WCHAR path[MAX_PATH];
+        DWORD dwSize = ARRAYSIZE(path);
+        if (QueryFullProcessImageName(hProcess, 0, path, &dwSize)) {
+            pathUpper.assign(path, dwSize);
+            LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_UPPERCASE,
+                          pathUpper.data(), pathUpper.length(),
+                          pathUpper.data(), pathUpper.length(), nullptr,
+                          nullptr, 0);
+        }
+
+        CloseHandle(hProcess);
+
+        if (creationTime && !pathUpper.empty()) {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            if (m_processes.size() >= kMaxProcesses) {
+                m_processes.clear();
+            }
+
+            m_processes.insert_or_assign(processId,
+                                         ProcessEntry{creationTime, pathUpper});
+        }
+
+        return pathUpper;
     }
 
-    if (resolvedWindowProcessPathLen > 0 &&
-        g_settings.excludedPrograms.contains(resolvedWindowProcessPathUpper)) {
-        return true;
+    std::mutex m_mutex;
+    std::unordered_map<HWND, WindowEntry> m_windows;
+    std::unordered_map<DWORD, ProcessEntry> m_processes;
+};
+
+WindowIdentityCache g_windowIdentityCache;
+
+bool IsWindowExcluded(HWND hWnd) {
+    if (g_settings.excludedPrograms.empty()) {
+        return false;
     }
 
-    if (PCWSTR programFileNameUpper =
-            wcsrchr(resolvedWindowProcessPathUpper, L'\\')) {
-        programFileNameUpper++;
-        if (*programFileNameUpper &&
-            g_settings.excludedPrograms.contains(programFileNameUpper)) {
+    std::wstring processPathUpper =
+        g_windowIdentityCache.GetProcessPathUpper(hWnd);
+    if (!processPathUpper.empty()) {
+        if (g_settings.excludedPrograms.contains(processPathUpper)) {
+            return true;
+        }
+
+        size_t fileNamePos = processPathUpper.rfind(L'\\');
+        if (fileNamePos != std::wstring::npos &&
+            fileNamePos + 1 < processPathUpper.length() &&
+            g_settings.excludedPrograms.contains(
+                processPathUpper.substr(fileNamePos + 1))) {
             return true;
         }
     }
 
-    std::wstring appId = GetWindowAppId(hWnd);
-    LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_UPPERCASE, appId.data(),
-                  appId.length(), appId.data(), appId.length(), nullptr,
-                  nullptr, 0);
-    if (g_settings.excludedPrograms.contains(appId.c_str())) {
+    if (g_settings.excludedPrograms.contains(
+            g_windowIdentityCache.GetAppIdUpper(hWnd))) {
         return true;
     }
 
@@ -599,81 +737,291 @@ bool DoesMonitorHaveMaximizedWindow(HMONITOR monitor, HWND hMMTaskbarWnd) {
     return hasMaximizedWindow;
 }
 
-void CALLBACK WinEventProc(HWINEVENTHOOK hWinEventHook,
-                           DWORD event,
-                           HWND hWnd,
-                           LONG idObject,
-                           LONG idChild,
-                           DWORD dwEventThread,
-                           DWORD dwmsEventTime) {
-    if (idObject != OBJID_WINDOW ||
-        (GetWindowLong(hWnd, GWL_STYLE) & WS_CHILD) || IsTaskbarWindow(hWnd)) {
-        return;
+// Coalesces window events into per-monitor updates. Events which are likely to
+// change the taskbar state right away, such as a window being maximized or
+// moved to another monitor, are due immediately, while other events, such as
+// location changes which come in floods while a window is dragged or animated,
+// are due kLocationChangeDelay ms after the first one. The current time is
+// passed by the caller, which keeps the scheduling deterministic.
+class MonitorEventCoalescer {
+   public:
+    static constexpr DWORD kUrgentDelay = 0;
+    static constexpr DWORD kLocationChangeDelay = 200;
+
+    void AddEvent(HMONITOR monitor, bool urgent, DWORD now) {
+        DWORD dueTime = now + (urgent ? kUrgentDelay : kLocationChangeDelay);
+
+        auto [it, inserted] = m_pending.try_emplace(monitor);
+        PendingMonitor& pending = it->second;
+        if (inserted) {
+            pending.firstEventTime = now;
+            pending.dueTime = dueTime;
+        } else if ((LONG)(dueTime - pending.dueTime) < 0) {
+            pending.dueTime = dueTime;
+        }
+
+        pending.eventCount++;
     }
 
-    HWND hParentWnd = GetAncestor(hWnd, GA_PARENT);
-    if (hParentWnd && hParentWnd != GetDesktopWindow()) {
-        return;
+    // Returns the time until the next monitor is due, or INFINITE if there are
+    // no pending events.
+    DWORD GetDelay(DWORD now) const {
+        DWORD delay = INFINITE;
+        for (const auto& [monitor, pending] : m_pending) {
+            LONG remaining = (LONG)(pending.dueTime - now);
+            delay = std::min(delay, remaining > 0 ? (DWORD)remaining : 0);
+        }
+
+        return delay;
     }
 
-    Wh_Log(L"> %08X", (DWORD)(ULONG_PTR)hWnd);
+    // Removes and returns up to maxCount monitors which are due, earliest
+    // first, to limit the work done at once.
+    std::vector<HMONITOR> TakeDue(DWORD now, size_t maxCount) {
+        std::vector<std::pair<DWORD, HMONITOR>> due;
+        for (const auto& [monitor, pending] : m_pending) {
+            if ((LONG)(pending.dueTime - now) <= 0) {
+                due.emplace_back(now - pending.dueTime, monitor);
+            }
+        }
 
-    HMONITOR monitor = MonitorFromWindow(hWnd, MONITOR_DEFAULTTONEAREST);
-    g_pendingMonitors.insert(monitor);
+        std::sort(due.begin(), due.end(), [](const auto& a, const auto& b) {
+            return a.first > b.first;
+        });
+        if (due.size() > maxCount) {
+            due.resize(maxCount);
+        }
 
-    if (g_pendingMonitorsTimer) {
-        return;
+        std::vector<HMONITOR> monitors;
+        DWORD eventCount = 0;
+        DWORD maxLatency = 0;
+        for (const auto& [overdue, monitor] : due) {
+            auto it = m_pending.find(monitor);
+            eventCount += it->second.eventCount;
+            maxLatency = std::max(maxLatency, now - it->second.firstEventTime);
+            m_pending.erase(it);
+            monitors.push_back(monitor);
+        }
+
+        if (!monitors.empty()) {
+            Wh_Log(L"%d monitors due after %u events, latency %u ms, %d left",
+                   (int)monitors.size(), eventCount, maxLatency,
+                   (int)m_pending.size());
+        }
+
+        return monitors;
     }
 
-    g_pendingMonitorsTimer = SetTimer(
-        nullptr, 0, 200,
-        [](HWND hwnd,         // handle of window for timer messages
-           UINT uMsg,         // WM_TIMER message
-           UINT_PTR idEvent,  // timer identifier
-           DWORD dwTime       // current system time
-        ) {
-            Wh_Log(L">");
+    void Clear() { m_pending.clear(); }
+
+   private:
+    struct PendingMonitor {
+        DWORD firstEventTime;
+        DWORD dueTime;
+        DWORD eventCount;
+    };
+
+    std::unordered_map<HMONITOR, PendingMonitor> m_pending;
+};
+
+struct WindowEventState {
+    HMONITOR monitor;
+    bool maximized;
+};
+
+constexpr size_t kMaxWindowEventStates = 4096;
+
+// Only accessed from the WinEvent thread.
+MonitorEventCoalescer g_monitorEventCoalescer;
+std::unordered_map<HWND, WindowEventState> g_windowEventStates;
+
+void AddWindowEvent(DWORD event, HWND hWnd) {
+    DWORD now = GetTickCount();
+
+    WindowEventState state{
+        .monitor = MonitorFromWindow(hWnd, MONITOR_DEFAULTTONEAREST),
+        .maximized = !!IsZoomed(hWnd),
+    };
+
+    // Only events which are likely to change the taskbar state are urgent.
+    // Others, such as windows being created, or non-maximized windows being
+    // shown or hidden, might come in bursts, and each update enumerates all
+    // windows.
+    bool urgent = event == EVENT_SYSTEM_FOREGROUND;
+    bool wasMaximized = false;
+
+    auto it = g_windowEventStates.find(hWnd);
+    if (it != g_windowEventStates.end()) {
+        if (it->second.monitor != state.monitor) {
+            // The monitor the window left might need an update too.
+            g_monitorEventCoalescer.AddEvent(it->second.monitor,
+                                             /*urgent=*/true, now);
+            urgent = true;
+        }
 
+        if (it->second.maximized != state.maximized) {
+            urgent = true;
+        }
+
+        wasMaximized = it->second.maximized;
+    } else if (state.maximized) {
+        urgent = true;
+    }
+
+    if (state.maximized || wasMaximized) {
+        switch (event) {
+            case EVENT_OBJECT_DESTROY:
+            case EVENT_OBJECT_SHOW:
+            case EVENT_OBJECT_HIDE:
+            case EVENT_OBJECT_CLOAKED:
+            case EVENT_OBJECT_UNCLOAKED:
+                // A maximized window appeared or disappeared.
+                urgent = true;
+                break;
+        }
+    }
+
+    if (event == EVENT_OBJECT_DESTROY) {
+        if (it != g_windowEventStates.end()) {
+            g_windowEventStates.erase(it);
+        }
+    } else if (it != g_windowEventStates.end()) {
+        it->second = state;
+    } else {
+        if (g_windowEventStates.size() >= kMaxWindowEventStates) {
+            g_windowEventStates.clear();
+        }
+
+        g_windowEventStates.try_emplace(hWnd, state);
+    }
+
+    g_monitorEventCoalescer.AddEvent(state.monitor, urgent, now);
+}
+
+// Evaluating a monitor enumerates all windows, so spread the work over
+// several timer ticks if many monitors are due at once.
+constexpr size_t kMaxMonitorsPerTick = 2;
+
+// Only accessed from the WinEvent thread.
+UINT_PTR g_pendingMonitorsTimer;
+DWORD g_pendingMonitorsTimerDueTime;
+
+void CALLBACK PendingMonitorsTimerProc(HWND hwnd,
+                                       UINT uMsg,
+                                       UINT_PTR idEvent,
+                                       DWORD dwTime);
+
+void SchedulePendingEvents() {
+    DWORD now = GetTickCount();
+    DWORD delay = g_monitorEventCoalescer.GetDelay(now);
+    if (delay == INFINITE) {
+        if (g_pendingMonitorsTimer) {
             KillTimer(nullptr, g_pendingMonitorsTimer);
             g_pendingMonitorsTimer = 0;
+        }
+
+        return;
+    }
+
+    // Timers never fire sooner than this. Accounting for it prevents a stream
+    // of urgent events from pushing the timer back again and again.
+    delay = std::max(delay, (DWORD)USER_TIMER_MINIMUM);
+
+    // Keep the current timer if it's due earlier anyway.
+    if (g_pendingMonitorsTimer &&
+        (LONG)(g_pendingMonitorsTimerDueTime - (now + delay)) <= 0) {
+        return;
+    }
 
-            std::unordered_set<HWND> secondaryTaskbarWindows;
-            HWND hTaskbarWnd = FindTaskbarWindows(&secondaryTaskbarWindows);
+    g_pendingMonitorsTimer = SetTimer(nullptr, g_pendingMonitorsTimer, delay,
+                                      PendingMonitorsTimerProc);
+    g_pendingMonitorsTimerDueTime = now + delay;
+}
 
-            for (HMONITOR monitor : g_pendingMonitors) {
-                HWND hMMTaskbarWnd = nullptr;
+void CALLBACK PendingMonitorsTimerProc(HWND hwnd,
+                                       UINT uMsg,
+                                       UINT_PTR idEvent,
+                                       DWORD dwTime) {
+    Wh_Log(L">");
 
-                if (hTaskbarWnd &&
-                    MonitorFromWindow(hTaskbarWnd, MONITOR_DEFAULTTONEAREST) ==
+    KillTimer(nullptr, g_pendingMonitorsTimer);
+    g_pendingMonitorsTimer = 0;
+
+    std::vector<HMONITOR> monitors =
+        g_monitorEventCoalescer.TakeDue(GetTickCount(), kMaxMonitorsPerTick);
+    if (!monitors.empty()) {
+        std::unordered_set<HWND> secondaryTaskbarWindows;
+        HWND hTaskbarWnd = FindTaskbarWindows(&secondaryTaskbarWindows);
+
+        for (HMONITOR monitor : monitors) {
+            HWND hMMTaskbarWnd = nullptr;
+
+            if (hTaskbarWnd &&
+                MonitorFromWindow(hTaskbarWnd, MONITOR_DEFAULTTONEAREST) ==
+                    monitor) {
+                hMMTaskbarWnd = hTaskbarWnd;
+            } else {
+                for (HWND hSecondaryTaskbarWnd : secondaryTaskbarWindows) {
+                    if (MonitorFromWindow(hSecondaryTaskbarWnd,
+                                          MONITOR_DEFAULTTONEAREST) ==
                         monitor) {
-                    hMMTaskbarWnd = hTaskbarWnd;
-                } else {
-                    for (HWND hSecondaryTaskbarWnd : secondaryTaskbarWindows) {
-                        if (MonitorFromWindow(hSecondaryTaskbarWnd,
-                                              MONITOR_DEFAULTTONEAREST) ==
-                            monitor) {
-                            hMMTaskbarWnd = hSecondaryTaskbarWnd;
-                            break;
-                        }
+                        hMMTaskbarWnd = hSecondaryTaskbarWnd;
+                        break;
                     }
                 }
+            }
 
-                if (!hMMTaskbarWnd) {
-                    continue;
-                }
+            if (!hMMTaskbarWnd) {
+                continue;
+            }
 
-                if (DoesMonitorHaveMaximizedWindow(monitor, hMMTaskbarWnd)) {
-                    SetTaskbarStyle(hMMTaskbarWnd);
-                } else {
-                    ResetTaskbarStyle(hMMTaskbarWnd);
-                }
+            if (DoesMonitorHaveMaximizedWindow(monitor, hMMTaskbarWnd)) {
+                SetTaskbarStyle(hMMTaskbarWnd);
+            } else {
+                ResetTaskbarStyle(hMMTaskbarWnd);
             }
+        }
+    }
 
-            g_pendingMonitors.clear();
-        });
+    SchedulePendingEvents();
+}
+
+void CALLBACK WinEventProc(HWINEVENTHOOK hWinEventHook,
+                           DWORD event,
+                           HWND hWnd,
+                           LONG idObject,
+                           LONG idChild,
+                           DWORD dwEventThread,
+                           DWORD dwmsEventTime) {
+    if (idObject != OBJID_WINDOW ||
+        (GetWindowLong(hWnd, GWL_STYLE) & WS_CHILD) || IsTaskbarWindow(hWnd)) {
+        return;
+    }
+
+    HWND hParentWnd = GetAncestor(hWnd, GA_PARENT);
+    if (hParentWnd && hParentWnd != GetDesktopWindow()) {
+        return;
+    }
+
+    if (event == EVENT_OBJECT_CREATE || event == EVENT_OBJECT_DESTROY ||
+        event == EVENT_OBJECT_SHOW) {
+        // The handle might be reused, or the window might have got a new app
+        // ID before being shown.
+        g_windowIdentityCache.InvalidateWindow(hWnd);
+    }
+
+    Wh_Log(L"> %08X", (DWORD)(ULONG_PTR)hWnd);
+
+    AddWindowEvent(event, hWnd);
+    SchedulePendingEvents();
 }
 
 DWORD WINAPI WinEventHookThread(LPVOID lpThreadParameter) {
+    // Timers of a previous thread are gone, start from a clean state.
+    g_monitorEventCoalescer.Clear();
+    g_windowEventStates.clear();
+    g_pendingMonitorsTimer = 0;
+
     HWINEVENTHOOK winObjectEventHook1 =
         SetWinEventHook(EVENT_OBJECT_CREATE, EVENT_OBJECT_HIDE, nullptr,
                         WinEventProc, 0, 0, WINEVENT_OUTOFCONTEXT);
@@ -71,9 +71,13 @@ or a similar tool), enable the relevant option in the mod's settings.
 #include <winrt/Windows.UI.Xaml.Input.h>
 
 #include <atomic>
-#include <regex>
+#include <initializer_list>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
 using namespace winrt::Windows::UI::Xaml;
 
@@ -115,6 +119,386 @@ std::atomic<DWORD> g_groupMenuCommandThreadId;
 void* g_groupMenuCommandTaskItem;
 ULONGLONG g_noDismissHoverUIUntil;
 
+// Identifies a module build. Cached symbol addresses and offsets are only
+// valid for the build they were resolved for.
+struct ModuleBuildId {
+    uint32_t machine;
+    uint32_t timeDateStamp;
+    uint32_t sizeOfImage;
+    uint32_t fileVersionMS;
+    uint32_t fileVersionLS;
+
+    bool operator==(const ModuleBuildId&) const = default;
+};
+
+// Symbol RVAs and derived offsets of a module build, keyed by name. The
+// serialized form is validated as a whole, so a partially written or corrupt
+// file is treated as missing.
+class SymbolCache {
+   public:
+    // Bump when the symbols or the offset calculations change.
+    static constexpr uint32_t kVersion = 2;
+
+    std::optional<uint32_t> Get(std::wstring_view name) const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto it = m_values.find(std::wstring(name));
+        if (it == m_values.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+    void Set(std::wstring_view name, uint32_t value) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto [it, inserted] = m_values.try_emplace(std::wstring(name), value);
+        if (inserted || it->second != value) {
+            it->second = value;
+            m_dirty = true;
+        }
+    }
+
+    bool IsDirty() const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_dirty;
+    }
+
+    std::vector<BYTE> Serialize(const ModuleBuildId& buildId) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        std::vector<BYTE> entries;
+        auto write = [&entries](const void* data, size_t size) {
+            const BYTE* p = static_cast<const BYTE*>(data);
+            entries.insert(entries.end(), p, p + size);
+        };
+
+        for (const auto& [name, value] : m_values) {
+            uint32_t nameLength = static_cast<uint32_t>(name.size());
+            write(&value, sizeof(value));
+            write(&nameLength, sizeof(nameLength));
+            write(name.data(), nameLength * sizeof(WCHAR));
+        }
+
+        Header header{
+            .magic = kMagic,
+            .version = kVersion,
+            .buildId = buildId,
+            .entryCount = static_cast<uint32_t>(m_values.size()),
+            .entriesSize = static_cast<uint32_t>(entries.size()),
+            .entriesChecksum = Checksum(entries.data(), entries.size()),
+        };
+
+        std::vector<BYTE> buffer(sizeof(header) + entries.size());
+        memcpy(buffer.data(), &header, sizeof(header));
+        std::copy(entries.begin(), entries.end(),
+                  buffer.begin() + sizeof(header));
+
+        m_dirty = false;
+        return buffer;
+    }
+
+    // Replaces the values with the serialized ones if they're valid and were
+    // created for the given build.
+    bool Parse(const BYTE* data, size_t size, const ModuleBuildId& buildId) {
+        Header header;
+        if (size < sizeof(header)) {
+            return false;
+        }
+
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != kMagic || header.version != kVersion ||
+            header.buildId != buildId ||
+            header.entriesSize != size - sizeof(header)) {
+            return false;
+        }
+
+        const BYTE* p = data + sizeof(header);
+        const BYTE* end = p + header.entriesSize;
+        if (Checksum(p, header.entriesSize) != header.entriesChecksum) {
+            return false;
+        }
+
+        std::unordered_map<std::wstring, uint32_t> values;
+        for (uint32_t i = 0; i < header.entryCount; i++) {
+            uint32_t value;
+            uint32_t nameLength;
+            if (static_cast<size_t>(end - p) <
+                sizeof(value) + sizeof(nameLength)) {
+                return false;
+            }
+
+            memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            memcpy(&nameLength, p, sizeof(nameLength));
+            p += sizeof(nameLength);
+
+            if (nameLength > static_cast<size_t>(end - p) / sizeof(WCHAR) ||
+                value >= buildId.sizeOfImage) {
+                return false;
+            }
+
+            std::wstring name(nameLength, L'\0');
+            memcpy(name.data(), p, nameLength * sizeof(WCHAR));
+            p += nameLength * sizeof(WCHAR);
+
+            values.insert_or_assign(std::move(name), value);
+        }
+
+        if (p != end) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_values = std::move(values);
+        m_dirty = false;
+        return true;
+    }
+
+   private:
+    static constexpr uint32_t kMagic = 0x43535748;  // "HWSC"
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        ModuleBuildId buildId;
+        uint32_t entryCount;
+        uint32_t entriesSize;
+        uint32_t entriesChecksum;
+    };
+
+    // FNV-1a.
+    static uint32_t Checksum(const BYTE* data, size_t size) {
+        uint32_t hash = 2166136261;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 16777619;
+        }
+
+        return hash;
+    }
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::wstring, uint32_t> m_values;
+    bool m_dirty = false;
+};
+
+VS_FIXEDFILEINFO* GetModuleVersionInfo(HMODULE hModule, UINT* puPtrLen) {
+    void* pFixedFileInfo = nullptr;
+    UINT uPtrLen = 0;
+
+    HRSRC hResource =
+        FindResource(hModule, MAKEINTRESOURCE(VS_VERSION_INFO), RT_VERSION);
+    if (hResource) {
+        HGLOBAL hGlobal = LoadResource(hModule, hResource);
+        if (hGlobal) {
+            void* pData = LockResource(hGlobal);
+            if (pData) {
+                if (!VerQueryValue(pData, L"\\", &pFixedFileInfo, &uPtrLen) ||
+                    uPtrLen == 0) {
+                    pFixedFileInfo = nullptr;
+                    uPtrLen = 0;
+                }
+            }
+        }
+    }
+
+    if (puPtrLen) {
+        *puPtrLen = uPtrLen;
+    }
+
+    return (VS_FIXEDFILEINFO*)pFixedFileInfo;
+}
+
+std::optional<ModuleBuildId> GetModuleBuildId(HMODULE module) {
+    VS_FIXEDFILEINFO* fixedFileInfo = GetModuleVersionInfo(module, nullptr);
+    if (!fixedFileInfo) {
+        return std::nullopt;
+    }
+
+    auto* dosHeader = (IMAGE_DOS_HEADER*)module;
+    auto* ntHeaders = (IMAGE_NT_HEADERS*)((BYTE*)module + dosHeader->e_lfanew);
+
+    return ModuleBuildId{
+        .machine = ntHeaders->FileHeader.Machine,
+        .timeDateStamp = ntHeaders->FileHeader.TimeDateStamp,
+        .sizeOfImage = ntHeaders->OptionalHeader.SizeOfImage,
+        .fileVersionMS = fixedFileInfo->dwFileVersionMS,
+        .fileVersionLS = fixedFileInfo->dwFileVersionLS,
+    };
+}
+
+// The symbol cache of a loaded module, stored in the mod storage folder.
+class ModuleSymbolCache {
+   public:
+    void Load(HMODULE module) {
+        m_module = module;
+        m_buildId = GetModuleBuildId(module);
+        if (!m_buildId) {
+            Wh_Log(L"Symbol cache disabled, no version info");
+            return;
+        }
+
+        WCHAR storagePath[MAX_PATH];
+        WCHAR modulePath[MAX_PATH];
+        if (!Wh_GetModStoragePath(storagePath, ARRAYSIZE(storagePath)) ||
+            !GetModuleFileName(module, modulePath, ARRAYSIZE(modulePath))) {
+            Wh_Log(L"Symbol cache disabled, failed to get paths");
+            m_buildId.reset();
+            return;
+        }
+
+        PCWSTR moduleName = wcsrchr(modulePath, L'\\');
+        moduleName = moduleName ? moduleName + 1 : modulePath;
+
+        m_filePath = std::wstring(storagePath) + L"\\symbol-cache-" +
+                     moduleName + L".bin";
+
+        HANDLE file = CreateFile(m_filePath.c_str(), GENERIC_READ,
+                                 FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        std::vector<BYTE> buffer;
+        LARGE_INTEGER fileSize;
+        DWORD bytesRead = 0;
+        bool succeeded =
+            GetFileSizeEx(file, &fileSize) && fileSize.QuadPart <= 1024 * 1024;
+        if (succeeded) {
+            buffer.resize(static_cast<size_t>(fileSize.QuadPart));
+            succeeded = ReadFile(file, buffer.data(),
+                                 static_cast<DWORD>(buffer.size()), &bytesRead,
+                                 nullptr) &&
+                        bytesRead == buffer.size();
+        }
+
+        CloseHandle(file);
+
+        if (!succeeded ||
+            !m_cache.Parse(buffer.data(), buffer.size(), *m_buildId)) {
+            Wh_Log(L"Ignoring outdated or invalid symbol cache %s",
+                   m_filePath.c_str());
+        }
+    }
+
+    void SaveIfChanged() {
+        if (!m_buildId || !m_cache.IsDirty()) {
+            return;
+        }
+
+        std::vector<BYTE> buffer = m_cache.Serialize(*m_buildId);
+
+        std::wstring tempFilePath =
+            m_filePath + L"." + std::to_wstring(GetCurrentProcessId()) +
+            L".tmp";
+
+        HANDLE file =
+            CreateFile(tempFilePath.c_str(), GENERIC_WRITE, 0, nullptr,
+                       CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            Wh_Log(L"CreateFile failed: %u", GetLastError());
+            return;
+        }
+
+        DWORD written = 0;
+        bool succeeded =
+            WriteFile(file, buffer.data(), static_cast<DWORD>(buffer.size()),
+                      &written, nullptr) &&
+            written == buffer.size();
+        CloseHandle(file);
+
+        if (!succeeded || !MoveFileEx(tempFilePath.c_str(), m_filePath.c_str(),
+                                      MOVEFILE_REPLACE_EXISTING)) {
+            Wh_Log(L"Failed to write symbol cache: %u", GetLastError());
+            DeleteFile(tempFilePath.c_str());
+        }
+    }
+
+    // Like HookSymbols, but skips symbol resolution if all symbols are cached.
+    bool HookSymbols(WindhawkUtils::SYMBOL_HOOK* symbolHooks,
+                     size_t symbolHooksCount) {
+        std::vector<void*> addresses(symbolHooksCount);
+
+        bool cached = true;
+        for (size_t i = 0; i < symbolHooksCount; i++) {
+            auto rva = m_cache.Get(symbolHooks[i].symbols[0]);
+            if (!rva || (!*rva && !symbolHooks[i].optional)) {
+                cached = false;
+                break;
+            }
+
+            addresses[i] = *rva ? (BYTE*)m_module + *rva : nullptr;
+        }
+
+        if (cached) {
+            Wh_Log(L"Using cached symbols");
+        } else {
+            // Resolve the addresses only, and hook them below.
+            std::vector<WindhawkUtils::SYMBOL_HOOK> symbolLookups(
+                symbolHooks, symbolHooks + symbolHooksCount);
+            for (size_t i = 0; i < symbolHooksCount; i++) {
+                addresses[i] = nullptr;
+                symbolLookups[i].pOriginalFunction = &addresses[i];
+                symbolLookups[i].hookFunction = nullptr;
+            }
+
+            if (!WindhawkUtils::HookSymbols(m_module, symbolLookups.data(),
+                                            symbolHooksCount)) {
+                return false;
+            }
+
+            for (size_t i = 0; i < symbolHooksCount; i++) {
+                m_cache.Set(symbolHooks[i].symbols[0],
+                            addresses[i] ? (uint32_t)((BYTE*)addresses[i] -
+                                                      (BYTE*)m_module)
+                                         : 0);
+            }
+        }
+
+        for (size_t i = 0; i < symbolHooksCount; i++) {
+            if (!addresses[i]) {
+                continue;
+            }
+
+            if (symbolHooks[i].hookFunction) {
+                Wh_SetFunctionHook(addresses[i], symbolHooks[i].hookFunction,
+                                   symbolHooks[i].pOriginalFunction);
+            } else {
+                *symbolHooks[i].pOriginalFunction = addresses[i];
+            }
+        }
+
+        return true;
+    }
+
+    std::optional<uint32_t> GetOffset(PCWSTR name) {
+        auto offset = m_cache.Get(std::wstring(L"offset:") + name);
+        if (offset) {
+            Wh_Log(L"%s=0x%X (cached)", name, *offset);
+        }
+
+        return offset;
+    }
+
+    // Failed discoveries (0) aren't stored, so that they're retried on the
+    // next start instead of being used until the module changes.
+    void SetOffset(PCWSTR name, uint32_t offset) {
+        if (!offset) {
+            return;
+        }
+
+        m_cache.Set(std::wstring(L"offset:") + name, offset);
+    }
+
+   private:
+    HMODULE m_module = nullptr;
+    std::optional<ModuleBuildId> m_buildId;
+    std::wstring m_filePath;
+    SymbolCache m_cache;
+};
+
+ModuleSymbolCache g_taskbarSymbolCache;
+
 #pragma region offsets
 
 void* CTaskListWnd_SetTaskFilter;
@@ -123,51 +507,235 @@ void* CTaskListWnd_SetTaskFilter;
 using CTaskListWnd_GetTaskFilterPtr_t = void** (*)(void*);
 CTaskListWnd_GetTaskFilterPtr_t CTaskListWnd_GetTaskFilterPtr;
 
-size_t OffsetFromAssemblyRegex(void* func,
-                               size_t defValue,
-                               std::regex regex,
-                               int limit = 30) {
+// Instruction patterns are matched against the instruction encoding, which is
+// much faster than formatting the disassembly and matching it as text.
+#if defined(_M_X64)
+// An instruction with a ModR/M byte, and either a memory operand with a
+// displacement or a register operand with an immediate.
+struct InstructionPattern {
+    // A mandatory prefix such as 0xF2, or 0 if there's none.
+    BYTE prefix;
+    bool rexW;
+    BYTE opcode[2];
+    BYTE opcodeSize;
+    // The ModR/M reg field of opcodes with an opcode extension, or -1.
+    int8_t extension;
+    // The base register of the memory operand, or the register operand, or -1
+    // for any register.
+    int8_t rm;
+    // The size of the immediate, or 0 for a memory operand.
+    BYTE immediateSize;
+};
+#elif defined(_M_ARM64)
+constexpr BYTE kInstructionFieldRd = 1 << 0;
+constexpr BYTE kInstructionFieldRn = 1 << 1;
+
+struct InstructionPattern {
+    DWORD mask;
+    DWORD value;
+    // Fields which must be general purpose registers, not sp or zr (31).
+    BYTE registerFields;
+    // The scale of the unsigned 12-bit immediate, or 0 if there's none.
+    BYTE imm12Scale;
+};
+#else
+#error "Unsupported architecture"
+#endif
+
+struct InstructionOperands {
+    // The ModR/M reg register (x64), or Rd/Rt (ARM64).
+    int reg;
+    // The r/m register (x64), or Rn (ARM64).
+    int base;
+    // Rm (ARM64).
+    int index;
+    // The displacement or immediate.
+    LONG_PTR value;
+};
+
+bool MatchInstruction(const void* instruction,
+                      const InstructionPattern& pattern,
+                      InstructionOperands* operands) {
+#if defined(_M_X64)
+    const BYTE* p = (const BYTE*)instruction;
+    if (pattern.prefix && *p++ != pattern.prefix) {
+        return false;
+    }
+
+    BYTE rex = 0;
+    if ((*p & 0xF0) == 0x40) {
+        rex = *p++;
+    }
+
+    if (pattern.rexW && !(rex & 0x08)) {
+        return false;
+    }
+
+    if (memcmp(p, pattern.opcode, pattern.opcodeSize) != 0) {
+        return false;
+    }
+
+    p += pattern.opcodeSize;
+
+    BYTE modRm = *p++;
+    BYTE mod = modRm >> 6;
+    BYTE reg = (modRm >> 3) & 7;
+    BYTE rm = modRm & 7;
+
+    if (pattern.extension >= 0 && reg != pattern.extension) {
+        return false;
+    }
+
+    LONG_PTR value;
+    if (pattern.immediateSize) {
+        if (mod != 3) {
+            return false;
+        }
+
+        value = pattern.immediateSize == 1 ? (LONG_PTR)*(const int8_t*)p
+                                           : (LONG_PTR)*(const int32_t*)p;
+    } else {
+        // No displacement, or a SIB byte.
+        if (mod == 0 || mod == 3 || rm == 4) {
+            return false;
+        }
+
+        value = mod == 1 ? (LONG_PTR)*(const int8_t*)p
+                         : (LONG_PTR)*(const int32_t*)p;
+    }
+
+    operands->reg = reg | ((rex & 0x04) << 1);
+    operands->base = rm | ((rex & 0x01) << 3);
+    operands->index = -1;
+    operands->value = value;
+
+    return pattern.rm < 0 || operands->base == pattern.rm;
+#elif defined(_M_ARM64)
+    DWORD insn = *(const DWORD*)instruction;
+    if ((insn & pattern.mask) != pattern.value) {
+        return false;
+    }
+
+    operands->reg = insn & 0x1F;
+    operands->base = (insn >> 5) & 0x1F;
+    operands->index = (insn >> 16) & 0x1F;
+    operands->value = ((insn >> 10) & 0xFFF) * pattern.imm12Scale;
+
+    if (((pattern.registerFields & kInstructionFieldRd) &&
+         operands->reg == 31) ||
+        ((pattern.registerFields & kInstructionFieldRn) &&
+         operands->base == 31)) {
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+bool IsRetInstruction(const void* instruction) {
+#if defined(_M_X64)
+    return *(const BYTE*)instruction == 0xC3;
+#elif defined(_M_ARM64)
+    return *(const DWORD*)instruction == 0xD65F03C0;
+#endif
+}
+
+size_t OffsetFromAssembly(void* func,
+                          size_t defValue,
+                          std::initializer_list<InstructionPattern> patterns,
+                          int limit = 30) {
     BYTE* p = (BYTE*)func;
     for (int i = 0; i < limit; i++) {
-        WH_DISASM_RESULT result;
-        if (!Wh_Disasm(p, &result)) {
+        if (IsRetInstruction(p)) {
             break;
         }
 
-        p += result.length;
+        for (const auto& pattern : patterns) {
+            InstructionOperands operands;
+            if (MatchInstruction(p, pattern, &operands) && operands.value > 0) {
+                return operands.value;
+            }
+        }
 
-        std::string_view s = result.text;
-        if (s == "ret") {
+#if defined(_M_X64)
+        WH_DISASM_RESULT result;
+        if (!Wh_Disasm(p, &result)) {
             break;
         }
 
-        std::match_results<std::string_view::const_iterator> match;
-        if (std::regex_match(s.begin(), s.end(), match, regex)) {
-            // Wh_Log(L"%S", result.text);
-            return std::stoull(match[1], nullptr, 16);
-        }
+        p += result.length;
+#elif defined(_M_ARM64)
+        p += sizeof(DWORD);
+#endif
     }
 
     Wh_Log(L"Failed for %p", func);
     return defValue;
 }
 
-void* Get_TaskItemFilter_For_CTaskListWnd_ITaskListUI(void* pThis_ITaskListUI) {
-    static size_t offset =
+size_t GetTaskItemFilterOffset() {
+    static size_t taskItemFilterOffset = []() -> size_t {
+        if (auto offset =
+                g_taskbarSymbolCache.GetOffset(L"taskItemFilterOffset")) {
+            return (size_t)*offset;
+        }
+
+        if (!CTaskListWnd_SetTaskFilter) {
+            Wh_Log(L"Error: CTaskListWnd_SetTaskFilter is null");
+            return 0;
+        }
+
+        size_t offset =
 #if defined(_M_X64)
-        OffsetFromAssemblyRegex(CTaskListWnd_SetTaskFilter, 0x1F8,
-                                std::regex(R"(add rcx, 0x([0-9a-f]+))",
-                                           std::regex_constants::icase),
-                                10);
+            // add rcx, 0x...
+            OffsetFromAssembly(CTaskListWnd_SetTaskFilter, 0,
+                               {
+                                   {
+                                       .rexW = true,
+                                       .opcode = {0x83},
+                                       .opcodeSize = 1,
+                                       .extension = 0,
+                                       .rm = 1,
+                                       .immediateSize = 1,
+                                   },
+                                   {
+                                       .rexW = true,
+                                       .opcode = {0x81},
+                                       .opcodeSize = 1,
+                                       .extension = 0,
+                                       .rm = 1,
+                                       .immediateSize = 4,
+                                   },
+                               },
+                               10);
 #elif defined(_M_ARM64)
-        OffsetFromAssemblyRegex(
-            CTaskListWnd_SetTaskFilter, 0x1F8,
-            std::regex(R"(add\s+x\d+, x\d+, #0x([0-9a-f]+))",
-                       std::regex_constants::icase),
-            10);
+            // add xN, xN, #0x...
+            OffsetFromAssembly(CTaskListWnd_SetTaskFilter, 0,
+                               {
+                                   {
+                                       .mask = 0xFFC00000,
+                                       .value = 0x91000000,
+                                       .registerFields = kInstructionFieldRd |
+                                                         kInstructionFieldRn,
+                                       .imm12Scale = 1,
+                                   },
+                               },
+                               10);
 #else
 #error "Unsupported architecture"
 #endif
+        Wh_Log(L"taskItemFilterOffset=0x%X", offset);
+        return offset;
+    }();
+
+    return taskItemFilterOffset;
+}
+
+void* Get_TaskItemFilter_For_CTaskListWnd_ITaskListUI(void* pThis_ITaskListUI) {
+    size_t offset = GetTaskItemFilterOffset();
+    if (!offset) {
+        offset = 0x1F8;
+    }
 
     return *(void**)((DWORD_PTR)pThis_ITaskListUI + offset);
 }
@@ -897,11 +1465,16 @@ bool HookTaskbarViewDllSymbols(HMODULE module) {
         },
     };
 
-    if (!HookSymbols(module, symbolHooks, ARRAYSIZE(symbolHooks))) {
+    ModuleSymbolCache symbolCache;
+    symbolCache.Load(module);
+
+    if (!symbolCache.HookSymbols(symbolHooks, ARRAYSIZE(symbolHooks))) {
         Wh_Log(L"HookSymbols failed");
         return false;
     }
 
+    symbolCache.SaveIfChanged();
+
     // Only hook second OnPointerWheelChanged if the address is different from
     // the first one.
     bool hookFlyoutFrame_OnPointerWheelChanged_Original =
@@ -1072,39 +1645,20 @@ bool HookTaskbarSymbols() {
         },
     };
 
-    if (!HookSymbols(module, symbolHooks, ARRAYSIZE(symbolHooks))) {
+    g_taskbarSymbolCache.Load(module);
+
+    if (!g_taskbarSymbolCache.HookSymbols(symbolHooks,
+                                          ARRAYSIZE(symbolHooks))) {
         Wh_Log(L"HookSymbols failed");
         return false;
     }
 
-    return true;
-}
-
-VS_FIXEDFILEINFO* GetModuleVersionInfo(HMODULE hModule, UINT* puPtrLen) {
-    void* pFixedFileInfo = nullptr;
-    UINT uPtrLen = 0;
-
-    HRSRC hResource =
-        FindResource(hModule, MAKEINTRESOURCE(VS_VERSION_INFO), RT_VERSION);
-    if (hResource) {
-        HGLOBAL hGlobal = LoadResource(hModule, hResource);
-        if (hGlobal) {
-            void* pData = LockResource(hGlobal);
-            if (pData) {
-                if (!VerQueryValue(pData, L"\\", &pFixedFileInfo, &uPtrLen) ||
-                    uPtrLen == 0) {
-                    pFixedFileInfo = nullptr;
-                    uPtrLen = 0;
-                }
-            }
-        }
-    }
+    g_taskbarSymbolCache.SetOffset(L"taskItemFilterOffset",
+                                   GetTaskItemFilterOffset());
 
-    if (puPtrLen) {
-        *puPtrLen = uPtrLen;
-    }
+    g_taskbarSymbolCache.SaveIfChanged();
 
-    return (VS_FIXEDFILEINFO*)pFixedFileInfo;
+    return true;
 }
 
 WinVersion GetExplorerVersion() {
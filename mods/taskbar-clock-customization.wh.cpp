@@ -395,12 +395,12 @@ styles, such as the font color and size.
 using WindhawkUtils::StringSetting;
 
 #include <atomic>
-#include <functional>
 #include <mutex>
 #include <optional>
 #include <regex>
 #include <string>
 #include <string_view>
+#include <unordered_map>
 #include <vector>
 
 using namespace std::string_view_literals;
@@ -2138,6 +2138,58 @@ PCWSTR GetRamFormatted() {
     return g_ramFormatted.buffer;
 }
 
+enum class FormatLineOp : BYTE {
+    Literal,
+    Time,
+    Date,
+    Weekday,
+    WeekdayNum,
+    Weeknum,
+    WeeknumIso,
+    DayOfYear,
+    Timezone,
+    UploadSpeed,
+    DownloadSpeed,
+    Cpu,
+    Ram,
+    Newline,
+    TimeTz,
+    DateTz,
+    WeekdayTz,
+    Web,
+    WebFull,
+    TimeExtra,
+    DateExtra,
+    WebIndexed,
+    WebIndexedFull,
+    Weather,
+};
+
+struct FormatLineInstruction {
+    FormatLineOp op;
+    // For tokens with a digit, such as %time_tz1%, the digit (1-9).
+    BYTE digit;
+    // For literals, the span in FormatLineProgram::literals.
+    UINT literalOffset;
+    UINT literalLength;
+};
+
+// A format line compiled once when the settings are loaded. Literal text is
+// stored in a single buffer, and tokens are resolved to opcodes, so that
+// formatting the line on each clock update doesn't need to parse the format
+// string or allocate memory.
+struct FormatLineProgram {
+    std::wstring literals;
+    std::vector<FormatLineInstruction> instructions;
+};
+
+struct {
+    FormatLineProgram topLine;
+    FormatLineProgram bottomLine;
+    FormatLineProgram middleLine;
+    FormatLineProgram tooltipLine;
+} g_formatLinePrograms;
+
 int ResolveFormatTokenWithDigit(std::wstring_view format,
                                 std::wstring_view formatTokenPrefix,
                                 std::wstring_view formatTokenSuffix) {
@@ -2163,186 +2215,285 @@ int ResolveFormatTokenWithDigit(std::wstring_view format,
     return digitChar - L'0';
 }
 
-size_t ResolveFormatToken(
-    std::wstring_view format,
-    std::function<void(PCWSTR resolvedStr)> resolvedCallback) {
-    using FormattedStringValueGetter = PCWSTR (*)();
-
+size_t CompileFormatToken(std::wstring_view format,
+                          FormatLineInstruction* instruction) {
     struct {
         std::wstring_view token;
-        FormattedStringValueGetter valueGetter;
+        FormatLineOp op;
     } formatTokens[] = {
-        {L"%time%"sv, GetTimeFormatted},
-        {L"%date%"sv, GetDateFormatted},
-        {L"%weekday%"sv, GetWeekdayFormatted},
-        {L"%weekday_num%"sv, GetWeekdayNumFormatted},
-        {L"%weeknum%"sv, GetWeeknumFormatted},
-        {L"%weeknum_iso%"sv, GetWeeknumIsoFormatted},
-        {L"%dayofyear%"sv, GetDayOfYearFormatted},
-        {L"%timezone%"sv, GetTimezoneFormatted},
-        {L"%upload_speed%"sv, GetUploadSpeedFormatted},
-        {L"%download_speed%"sv, GetDownloadSpeedFormatted},
-        {L"%cpu%"sv, GetCpuFormatted},
-        {L"%ram%"sv, GetRamFormatted},
-        {L"%newline%"sv, []() { return L"\n"; }},
+        {L"%time%"sv, FormatLineOp::Time},
+        {L"%date%"sv, FormatLineOp::Date},
+        {L"%weekday%"sv, FormatLineOp::Weekday},
+        {L"%weekday_num%"sv, FormatLineOp::WeekdayNum},
+        {L"%weeknum%"sv, FormatLineOp::Weeknum},
+        {L"%weeknum_iso%"sv, FormatLineOp::WeeknumIso},
+        {L"%dayofyear%"sv, FormatLineOp::DayOfYear},
+        {L"%timezone%"sv, FormatLineOp::Timezone},
+        {L"%upload_speed%"sv, FormatLineOp::UploadSpeed},
+        {L"%download_speed%"sv, FormatLineOp::DownloadSpeed},
+        {L"%cpu%"sv, FormatLineOp::Cpu},
+        {L"%ram%"sv, FormatLineOp::Ram},
+        {L"%newline%"sv, FormatLineOp::Newline},
+        {L"%web%"sv, FormatLineOp::Web},
+        {L"%web_full%"sv, FormatLineOp::WebFull},
+        {L"%weather%"sv, FormatLineOp::Weather},
     };
 
     for (const auto& formatToken : formatTokens) {
         if (format.starts_with(formatToken.token)) {
-            resolvedCallback(formatToken.valueGetter());
+            *instruction = {.op = formatToken.op};
             return formatToken.token.size();
         }
     }
 
-    using FormattedStringValueGetterTz = PCWSTR (*)(size_t index);
-
     struct {
         std::wstring_view prefix;
-        FormattedStringValueGetterTz valueGetter;
-    } formatTzTokens[] = {
-        {L"%time_tz"sv, GetTimeFormattedTz},
-        {L"%date_tz"sv, GetDateFormattedTz},
-        {L"%weekday_tz"sv, GetWeekdayFormattedTz},
+        std::wstring_view suffix;
+        FormatLineOp op;
+    } formatDigitTokens[] = {
+        {L"%time_tz"sv, L"%"sv, FormatLineOp::TimeTz},
+        {L"%date_tz"sv, L"%"sv, FormatLineOp::DateTz},
+        {L"%weekday_tz"sv, L"%"sv, FormatLineOp::WeekdayTz},
+        {L"%time"sv, L"%"sv, FormatLineOp::TimeExtra},
+        {L"%date"sv, L"%"sv, FormatLineOp::DateExtra},
+        {L"%web"sv, L"%"sv, FormatLineOp::WebIndexed},
+        {L"%web"sv, L"_full%"sv, FormatLineOp::WebIndexedFull},
     };
 
-    for (auto formatTzToken : formatTzTokens) {
-        int digit =
-            ResolveFormatTokenWithDigit(format, formatTzToken.prefix, L"%"sv);
+    for (const auto& formatDigitToken : formatDigitTokens) {
+        int digit = ResolveFormatTokenWithDigit(
+            format, formatDigitToken.prefix, formatDigitToken.suffix);
         if (!digit) {
             continue;
         }
 
-        PCWSTR value = formatTzToken.valueGetter(digit - 1);
-        if (!value) {
-            value = L"-";
-        }
-
-        resolvedCallback(value);
-        return formatTzToken.prefix.size() + 2;
+        *instruction = {
+            .op = formatDigitToken.op,
+            .digit = static_cast<BYTE>(digit),
+        };
+        return formatDigitToken.prefix.size() + 1 +
+               formatDigitToken.suffix.size();
     }
 
-    if (auto token = L"%web%"sv; format.starts_with(token)) {
-        std::lock_guard<std::mutex> guard(g_webContentMutex);
-        resolvedCallback(*g_webContent ? g_webContent : L"Loading...");
-        return token.size();
-    }
+    return 0;
+}
 
-    if (auto token = L"%web_full%"sv; format.starts_with(token)) {
-        std::lock_guard<std::mutex> guard(g_webContentMutex);
-        resolvedCallback(*g_webContentFull ? g_webContentFull : L"Loading...");
-        return token.size();
-    }
+FormatLineProgram CompileFormatLine(std::wstring_view format) {
+    FormatLineProgram program;
 
-    using FormattedStringVectorGetter = std::vector<std::wstring>* (*)();
+    auto appendLiteral = [&program](std::wstring_view literal) {
+        if (!program.instructions.empty() &&
+            program.instructions.back().op == FormatLineOp::Literal) {
+            program.instructions.back().literalLength += literal.size();
+        } else {
+            program.instructions.push_back({
+                .op = FormatLineOp::Literal,
+                .literalOffset = static_cast<UINT>(program.literals.size()),
+                .literalLength = static_cast<UINT>(literal.size()),
+            });
+        }
 
-    struct {
-        std::wstring_view prefix;
-        FormattedStringVectorGetter valueVectorGetter;
-    } formatExtraTokens[] = {
-        {L"%time"sv, GetTimeFormattedExtra},
-        {L"%date"sv, GetDateFormattedExtra},
+        program.literals += literal;
     };
 
-    for (auto formatExtraToken : formatExtraTokens) {
-        int digit = ResolveFormatTokenWithDigit(format, formatExtraToken.prefix,
-                                                L"%"sv);
-        if (!digit) {
-            continue;
+    while (!format.empty()) {
+        size_t literalLength = format.find(L'%');
+        if (literalLength == format.npos) {
+            appendLiteral(format);
+            break;
         }
 
-        const auto& valueVector = *formatExtraToken.valueVectorGetter();
+        if (literalLength > 0) {
+            appendLiteral(format.substr(0, literalLength));
+            format = format.substr(literalLength);
+        }
 
-        PCWSTR value;
-        if (digit < 2 || static_cast<size_t>(digit - 2) >= valueVector.size()) {
-            value = L"-";
+        FormatLineInstruction instruction;
+        size_t formatTokenLen = CompileFormatToken(format, &instruction);
+        if (formatTokenLen > 0) {
+            program.instructions.push_back(instruction);
+            format = format.substr(formatTokenLen);
         } else {
-            value = valueVector[digit - 2].c_str();
+            // Not a known token, keep the '%' as is.
+            appendLiteral(format.substr(0, 1));
+            format = format.substr(1);
         }
+    }
 
-        resolvedCallback(value);
-        return formatExtraToken.prefix.size() + 2;
+    return program;
+}
+
+PCWSTR GetOptionalWebContentString(
+    const std::vector<std::optional<std::wstring>>& strings,
+    size_t index) {
+    if (index >= strings.size()) {
+        return L"-";
     }
 
-    if (int digit = ResolveFormatTokenWithDigit(format, L"%web"sv, L"%"sv)) {
-        size_t index = digit - 1;
+    if (!strings[index]) {
+        return L"Loading...";
+    }
 
-        std::lock_guard<std::mutex> guard(g_webContentMutex);
+    return strings[index]->c_str();
+}
 
-        PCWSTR value;
-        if (index >= g_webContentStrings.size()) {
-            value = L"-";
-        } else if (!g_webContentStrings[index]) {
-            value = L"Loading...";
-        } else {
-            value = g_webContentStrings[index]->c_str();
+// Returns the number of characters written, or -1 if the value was truncated.
+int ExecuteFormatLineInstruction(PWSTR buffer,
+                                 size_t bufferSize,
+                                 const FormatLineProgram& program,
+                                 const FormatLineInstruction& instruction) {
+    auto copyValue = [buffer, bufferSize](PCWSTR value) {
+        bool truncated;
+        int length = StringCopyTruncated(buffer, bufferSize, value, &truncated);
+        return truncated ? -1 : length;
+    };
+
+    PCWSTR value;
+    switch (instruction.op) {
+        case FormatLineOp::Literal: {
+            size_t length = instruction.literalLength;
+            bool truncated = length > bufferSize - 1;
+            if (truncated) {
+                length = bufferSize - 1;
+            }
+
+            wmemcpy(buffer, program.literals.data() + instruction.literalOffset,
+                    length);
+            buffer[length] = L'\0';
+            return truncated ? -1 : static_cast<int>(length);
         }
 
-        resolvedCallback(value);
-        return "%web1%"sv.size();
-    }
+        case FormatLineOp::Time:
+            value = GetTimeFormatted();
+            break;
+        case FormatLineOp::Date:
+            value = GetDateFormatted();
+            break;
+        case FormatLineOp::Weekday:
+            value = GetWeekdayFormatted();
+            break;
+        case FormatLineOp::WeekdayNum:
+            value = GetWeekdayNumFormatted();
+            break;
+        case FormatLineOp::Weeknum:
+            value = GetWeeknumFormatted();
+            break;
+        case FormatLineOp::WeeknumIso:
+            value = GetWeeknumIsoFormatted();
+            break;
+        case FormatLineOp::DayOfYear:
+            value = GetDayOfYearFormatted();
+            break;
+        case FormatLineOp::Timezone:
+            value = GetTimezoneFormatted();
+            break;
+        case FormatLineOp::UploadSpeed:
+            value = GetUploadSpeedFormatted();
+            break;
+        case FormatLineOp::DownloadSpeed:
+            value = GetDownloadSpeedFormatted();
+            break;
+        case FormatLineOp::Cpu:
+            value = GetCpuFormatted();
+            break;
+        case FormatLineOp::Ram:
+            value = GetRamFormatted();
+            break;
+        case FormatLineOp::Newline:
+            value = L"\n";
+            break;
 
-    if (int digit =
-            ResolveFormatTokenWithDigit(format, L"%web"sv, L"_full%"sv)) {
-        size_t index = digit - 1;
+        case FormatLineOp::TimeTz:
+            value = GetTimeFormattedTz(instruction.digit - 1);
+            break;
+        case FormatLineOp::DateTz:
+            value = GetDateFormattedTz(instruction.digit - 1);
+            break;
+        case FormatLineOp::WeekdayTz:
+            value = GetWeekdayFormattedTz(instruction.digit - 1);
+            break;
 
-        std::lock_guard<std::mutex> guard(g_webContentMutex);
+        case FormatLineOp::TimeExtra:
+        case FormatLineOp::DateExtra: {
+            const auto& valueVector = instruction.op == FormatLineOp::TimeExtra
+                                          ? *GetTimeFormattedExtra()
+                                          : *GetDateFormattedExtra();
+            size_t digit = instruction.digit;
+            if (digit >= 2 && digit - 2 < valueVector.size()) {
+                value = valueVector[digit - 2].c_str();
+            } else {
+                value = nullptr;
+            }
+            break;
+        }
 
-        PCWSTR value;
-        if (index >= g_webContentStringsFull.size()) {
-            value = L"-";
-        } else if (!g_webContentStringsFull[index]) {
-            value = L"Loading...";
-        } else {
-            value = g_webContentStringsFull[index]->c_str();
+        case FormatLineOp::Web: {
+            std::lock_guard<std::mutex> guard(g_webContentMutex);
+            return copyValue(*g_webContent ? g_webContent : L"Loading...");
         }
 
-        resolvedCallback(value);
-        return "%web1_full%"sv.size();
-    }
+        case FormatLineOp::WebFull: {
+            std::lock_guard<std::mutex> guard(g_webContentMutex);
+            return copyValue(*g_webContentFull ? g_webContentFull
+                                               : L"Loading...");
+        }
 
-    if (auto token = L"%weather%"sv; format.starts_with(token)) {
-        std::lock_guard<std::mutex> guard(g_webContentMutex);
-        resolvedCallback(g_webContentWeather ? g_webContentWeather->c_str()
-                                             : L"Loading...");
-        return token.size();
+        case FormatLineOp::WebIndexed: {
+            std::lock_guard<std::mutex> guard(g_webContentMutex);
+            return copyValue(GetOptionalWebContentString(
+                g_webContentStrings, instruction.digit - 1));
+        }
+
+        case FormatLineOp::WebIndexedFull: {
+            std::lock_guard<std::mutex> guard(g_webContentMutex);
+            return copyValue(GetOptionalWebContentString(
+                g_webContentStringsFull, instruction.digit - 1));
+        }
+
+        case FormatLineOp::Weather: {
+            std::lock_guard<std::mutex> guard(g_webContentMutex);
+            return copyValue(g_webContentWeather
+                                 ? g_webContentWeather->c_str()
+                                 : L"Loading...");
+        }
+
+        default:
+            value = nullptr;
+            break;
     }
 
-    return 0;
+    return copyValue(value ? value : L"-");
 }
 
-int FormatLine(PWSTR buffer, size_t bufferSize, std::wstring_view format) {
+int FormatLine(PWSTR buffer,
+               size_t bufferSize,
+               const FormatLineProgram& program) {
     if (bufferSize == 0) {
         return 0;
     }
 
-    std::wstring_view formatSuffix = format;
-
     PWSTR bufferStart = buffer;
     PWSTR bufferEnd = bufferStart + bufferSize;
-    while (!formatSuffix.empty() && bufferEnd - buffer > 1) {
-        if (formatSuffix[0] == L'%') {
-            bool truncated = false;
-            size_t formatTokenLen = ResolveFormatToken(
-                formatSuffix,
-                [&buffer, bufferEnd, &truncated](PCWSTR resolvedStr) {
-                    buffer += StringCopyTruncated(buffer, bufferEnd - buffer,
-                                                  resolvedStr, &truncated);
-                });
-            if (formatTokenLen > 0) {
-                if (truncated) {
-                    break;
-                }
+    bool truncated = false;
+    for (const auto& instruction : program.instructions) {
+        if (bufferEnd - buffer <= 1) {
+            truncated = true;
+            break;
+        }
 
-                formatSuffix = formatSuffix.substr(formatTokenLen);
-                continue;
-            }
+        int length = ExecuteFormatLineInstruction(buffer, bufferEnd - buffer,
+                                                  program, instruction);
+        if (length < 0) {
+            // A truncated value always fills the remaining buffer.
+            buffer = bufferEnd - 1;
+            truncated = true;
+            break;
         }
 
-        *buffer++ = formatSuffix[0];
-        formatSuffix = formatSuffix.substr(1);
+        buffer += length;
     }
 
-    if (!formatSuffix.empty() && bufferSize >= 4) {
+    if (truncated && bufferSize >= 4) {
         buffer[-1] = L'.';
         buffer[-2] = L'.';
         buffer[-3] = L'.';
@@ -2446,7 +2597,7 @@ void UpdateToolTipString(LPVOID tooltipPtrPtr) {
 
     WCHAR extraLine[256];
     size_t extraLength = FormatLine(extraLine, ARRAYSIZE(extraLine),
-                                    g_settings.tooltipLine.get());
+                                    g_formatLinePrograms.tooltipLine);
     if (extraLength == 0) {
         return;
     }
@@ -3017,7 +3168,9 @@ int WINAPI GetTimeFormatEx_Hook_Win11(LPCWSTR lpLocaleName,
                 return FORMATTED_BUFFER_SIZE;
             }
 
-            return FormatLine(lpTimeStr, cchTime, g_settings.topLine.get()) + 1;
+            return FormatLine(lpTimeStr, cchTime,
+                              g_formatLinePrograms.topLine) +
+                   1;
         }
     }
 
@@ -3087,7 +3240,7 @@ int WINAPI GetDateFormatEx_Hook_Win11(LPCWSTR lpLocaleName,
                 }
 
                 return FormatLine(lpDateStr, cchDate,
-                                  g_settings.bottomLine.get()) +
+                                  g_formatLinePrograms.bottomLine) +
                        1;
             }
         }
@@ -3192,7 +3345,7 @@ HRESULT WINAPI ClockButton_v_GetTooltipText_Hook(LPVOID pThis,
         size_t size = g_getTooltipTextBufferSize + stringLen;
         if (size > 4) {
             wcscpy(p, L"\r\n\r\n");
-            FormatLine(p + 4, size - 4, g_settings.tooltipLine.get());
+            FormatLine(p + 4, size - 4, g_formatLinePrograms.tooltipLine);
         }
     }
 
@@ -3302,7 +3455,9 @@ int WINAPI GetTimeFormatEx_Hook_Win10(LPCWSTR lpLocaleName,
         g_formatIndex++;
 
         if (wcscmp(g_settings.topLine, L"-") != 0) {
-            return FormatLine(lpTimeStr, cchTime, g_settings.topLine.get()) + 1;
+            return FormatLine(lpTimeStr, cchTime,
+                              g_formatLinePrograms.topLine) +
+                   1;
         }
     }
 
@@ -3321,10 +3476,14 @@ int WINAPI GetDateFormatEx_Hook_Win10(LPCWSTR lpLocaleName,
                                       LPCWSTR lpCalendar) {
     if (g_updateTextStringThreadId == GetCurrentThreadId()) {
         g_getDateFormatExCounter++;
-        PCWSTR format = g_getDateFormatExCounter > 1 ? g_settings.middleLine
-                                                     : g_settings.bottomLine;
+        bool middleLine = g_getDateFormatExCounter > 1;
+        PCWSTR format =
+            middleLine ? g_settings.middleLine : g_settings.bottomLine;
         if (wcscmp(format, L"-") != 0) {
-            return FormatLine(lpDateStr, cchDate, format) + 1;
+            return FormatLine(lpDateStr, cchDate,
+                              middleLine ? g_formatLinePrograms.middleLine
+                                         : g_formatLinePrograms.bottomLine) +
+                   1;
         }
     }
 
@@ -3354,6 +3513,168 @@ int WINAPI GetDateFormatW_Hook_Win10(LCID Locale,
 
 #pragma endregion Win10Hooks
 
+// Identifies a module build. Cached symbol addresses and offsets are only
+// valid for the build they were resolved for.
+struct ModuleBuildId {
+    uint32_t machine;
+    uint32_t timeDateStamp;
+    uint32_t sizeOfImage;
+    uint32_t fileVersionMS;
+    uint32_t fileVersionLS;
+
+    bool operator==(const ModuleBuildId&) const = default;
+};
+
+// Symbol RVAs and derived offsets of a module build, keyed by name. The
+// serialized form is validated as a whole, so a partially written or corrupt
+// file is treated as missing.
+class SymbolCache {
+   public:
+    // Bump when the symbols or the offset calculations change.
+    static constexpr uint32_t kVersion = 2;
+
+    std::optional<uint32_t> Get(std::wstring_view name) const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto it = m_values.find(std::wstring(name));
+        if (it == m_values.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+    void Set(std::wstring_view name, uint32_t value) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto [it, inserted] = m_values.try_emplace(std::wstring(name), value);
+        if (inserted || it->second != value) {
+            it->second = value;
+            m_dirty = true;
+        }
+    }
+
+    bool IsDirty() const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_dirty;
+    }
+
+    std::vector<BYTE> Serialize(const ModuleBuildId& buildId) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        std::vector<BYTE> entries;
+        auto write = [&entries](const void* data, size_t size) {
+            const BYTE* p = static_cast<const BYTE*>(data);
+            entries.insert(entries.end(), p, p + size);
+        };
+
+        for (const auto& [name, value] : m_values) {
+            uint32_t nameLength = static_cast<uint32_t>(name.size());
+            write(&value, sizeof(value));
+            write(&nameLength, sizeof(nameLength));
+            write(name.data(), nameLength * sizeof(WCHAR));
+        }
+
+        Header header{
+            .magic = kMagic,
+            .version = kVersion,
+            .buildId = buildId,
+            .entryCount = static_cast<uint32_t>(m_values.size()),
+            .entriesSize = static_cast<uint32_t>(entries.size()),
+            .entriesChecksum = Checksum(entries.data(), entries.size()),
+        };
+
+        std::vector<BYTE> buffer(sizeof(header) + entries.size());
+        memcpy(buffer.data(), &header, sizeof(header));
+        std::copy(entries.begin(), entries.end(),
+                  buffer.begin() + sizeof(header));
+
+        m_dirty = false;
+        return buffer;
+    }
+
+    // Replaces the values with the serialized ones if they're valid and were
+    // created for the given build.
+    bool Parse(const BYTE* data, size_t size, const ModuleBuildId& buildId) {
+        Header header;
+        if (size < sizeof(header)) {
+            return false;
+        }
+
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != kMagic || header.version != kVersion ||
+            header.buildId != buildId ||
+            header.entriesSize != size - sizeof(header)) {
+            return false;
+        }
+
+        const BYTE* p = data + sizeof(header);
+        const BYTE* end = p + header.entriesSize;
+        if (Checksum(p, header.entriesSize) != header.entriesChecksum) {
+            return false;
+        }
+
+        std::unordered_map<std::wstring, uint32_t> values;
+        for (uint32_t i = 0; i < header.entryCount; i++) {
+            uint32_t value;
+            uint32_t nameLength;
+            if (static_cast<size_t>(end - p) <
+                sizeof(value) + sizeof(nameLength)) {
+                return false;
+            }
+
+            memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            memcpy(&nameLength, p, sizeof(nameLength));
+            p += sizeof(nameLength);
+
+            if (nameLength > static_cast<size_t>(end - p) / sizeof(WCHAR) ||
+                value >= buildId.sizeOfImage) {
+                return false;
+            }
+
+            std::wstring name(nameLength, L'\0');
+            memcpy(name.data(), p, nameLength * sizeof(WCHAR));
+            p += nameLength * sizeof(WCHAR);
+
+            values.insert_or_assign(std::move(name), value);
+        }
+
+        if (p != end) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_values = std::move(values);
+        m_dirty = false;
+        return true;
+    }
+
+   private:
+    static constexpr uint32_t kMagic = 0x43535748;  // "HWSC"
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        ModuleBuildId buildId;
+        uint32_t entryCount;
+        uint32_t entriesSize;
+        uint32_t entriesChecksum;
+    };
+
+    // FNV-1a.
+    static uint32_t Checksum(const BYTE* data, size_t size) {
+        uint32_t hash = 2166136261;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 16777619;
+        }
+
+        return hash;
+    }
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::wstring, uint32_t> m_values;
+    bool m_dirty = false;
+};
+
 VS_FIXEDFILEINFO* GetModuleVersionInfo(HMODULE hModule, UINT* puPtrLen) {
     void* pFixedFileInfo = nullptr;
     UINT uPtrLen = 0;
@@ -3381,6 +3702,195 @@ VS_FIXEDFILEINFO* GetModuleVersionInfo(HMODULE hModule, UINT* puPtrLen) {
     return (VS_FIXEDFILEINFO*)pFixedFileInfo;
 }
 
+std::optional<ModuleBuildId> GetModuleBuildId(HMODULE module) {
+    VS_FIXEDFILEINFO* fixedFileInfo = GetModuleVersionInfo(module, nullptr);
+    if (!fixedFileInfo) {
+        return std::nullopt;
+    }
+
+    auto* dosHeader = (IMAGE_DOS_HEADER*)module;
+    auto* ntHeaders = (IMAGE_NT_HEADERS*)((BYTE*)module + dosHeader->e_lfanew);
+
+    return ModuleBuildId{
+        .machine = ntHeaders->FileHeader.Machine,
+        .timeDateStamp = ntHeaders->FileHeader.TimeDateStamp,
+        .sizeOfImage = ntHeaders->OptionalHeader.SizeOfImage,
+        .fileVersionMS = fixedFileInfo->dwFileVersionMS,
+        .fileVersionLS = fixedFileInfo->dwFileVersionLS,
+    };
+}
+
+// The symbol cache of a loaded module, stored in the mod storage folder.
+class ModuleSymbolCache {
+   public:
+    void Load(HMODULE module) {
+        m_module = module;
+        m_buildId = GetModuleBuildId(module);
+        if (!m_buildId) {
+            Wh_Log(L"Symbol cache disabled, no version info");
+            return;
+        }
+
+        WCHAR storagePath[MAX_PATH];
+        WCHAR modulePath[MAX_PATH];
+        if (!Wh_GetModStoragePath(storagePath, ARRAYSIZE(storagePath)) ||
+            !GetModuleFileName(module, modulePath, ARRAYSIZE(modulePath))) {
+            Wh_Log(L"Symbol cache disabled, failed to get paths");
+            m_buildId.reset();
+            return;
+        }
+
+        PCWSTR moduleName = wcsrchr(modulePath, L'\\');
+        moduleName = moduleName ? moduleName + 1 : modulePath;
+
+        m_filePath = std::wstring(storagePath) + L"\\symbol-cache-" +
+                     moduleName + L".bin";
+
+        HANDLE file = CreateFile(m_filePath.c_str(), GENERIC_READ,
+                                 FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        std::vector<BYTE> buffer;
+        LARGE_INTEGER fileSize;
+        DWORD bytesRead = 0;
+        bool succeeded =
+            GetFileSizeEx(file, &fileSize) && fileSize.QuadPart <= 1024 * 1024;
+        if (succeeded) {
+            buffer.resize(static_cast<size_t>(fileSize.QuadPart));
+            succeeded = ReadFile(file, buffer.data(),
+                                 static_cast<DWORD>(buffer.size()), &bytesRead,
+                                 nullptr) &&
+                        bytesRead == buffer.size();
+        }
+
+        CloseHandle(file);
+
+        if (!succeeded ||
+            !m_cache.Parse(buffer.data(), buffer.size(), *m_buildId)) {
+            Wh_Log(L"Ignoring outdated or invalid symbol cache %s",
+                   m_filePath.c_str());
+        }
+    }
+
+    void SaveIfChanged() {
+        if (!m_buildId || !m_cache.IsDirty()) {
+            return;
+        }
+
+        std::vector<BYTE> buffer = m_cache.Serialize(*m_buildId);
+
+        std::wstring tempFilePath =
+            m_filePath + L"." + std::to_wstring(GetCurrentProcessId()) +
+            L".tmp";
+
+        HANDLE file =
+            CreateFile(tempFilePath.c_str(), GENERIC_WRITE, 0, nullptr,
+                       CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            Wh_Log(L"CreateFile failed: %u", GetLastError());
+            return;
+        }
+
+        DWORD written = 0;
+        bool succeeded =
+            WriteFile(file, buffer.data(), static_cast<DWORD>(buffer.size()),
+                      &written, nullptr) &&
+            written == buffer.size();
+        CloseHandle(file);
+
+        if (!succeeded || !MoveFileEx(tempFilePath.c_str(), m_filePath.c_str(),
+                                      MOVEFILE_REPLACE_EXISTING)) {
+            Wh_Log(L"Failed to write symbol cache: %u", GetLastError());
+            DeleteFile(tempFilePath.c_str());
+        }
+    }
+
+    // Like HookSymbols, but skips symbol resolution if all symbols are cached.
+    bool HookSymbols(WindhawkUtils::SYMBOL_HOOK* symbolHooks,
+                     size_t symbolHooksCount) {
+        std::vector<void*> addresses(symbolHooksCount);
+
+        bool cached = true;
+        for (size_t i = 0; i < symbolHooksCount; i++) {
+            auto rva = m_cache.Get(symbolHooks[i].symbols[0]);
+            if (!rva || (!*rva && !symbolHooks[i].optional)) {
+                cached = false;
+                break;
+            }
+
+            addresses[i] = *rva ? (BYTE*)m_module + *rva : nullptr;
+        }
+
+        if (cached) {
+            Wh_Log(L"Using cached symbols");
+        } else {
+            // Resolve the addresses only, and hook them below.
+            std::vector<WindhawkUtils::SYMBOL_HOOK> symbolLookups(
+                symbolHooks, symbolHooks + symbolHooksCount);
+            for (size_t i = 0; i < symbolHooksCount; i++) {
+                addresses[i] = nullptr;
+                symbolLookups[i].pOriginalFunction = &addresses[i];
+                symbolLookups[i].hookFunction = nullptr;
+            }
+
+            if (!WindhawkUtils::HookSymbols(m_module, symbolLookups.data(),
+                                            symbolHooksCount)) {
+                return false;
+            }
+
+            for (size_t i = 0; i < symbolHooksCount; i++) {
+                m_cache.Set(symbolHooks[i].symbols[0],
+                            addresses[i] ? (uint32_t)((BYTE*)addresses[i] -
+                                                      (BYTE*)m_module)
+                                         : 0);
+            }
+        }
+
+        for (size_t i = 0; i < symbolHooksCount; i++) {
+            if (!addresses[i]) {
+                continue;
+            }
+
+            if (symbolHooks[i].hookFunction) {
+                Wh_SetFunctionHook(addresses[i], symbolHooks[i].hookFunction,
+                                   symbolHooks[i].pOriginalFunction);
+            } else {
+                *symbolHooks[i].pOriginalFunction = addresses[i];
+            }
+        }
+
+        return true;
+    }
+
+    std::optional<uint32_t> GetOffset(PCWSTR name) {
+        auto offset = m_cache.Get(std::wstring(L"offset:") + name);
+        if (offset) {
+            Wh_Log(L"%s=0x%X (cached)", name, *offset);
+        }
+
+        return offset;
+    }
+
+    // Failed discoveries (0) aren't stored, so that they're retried on the
+    // next start instead of being used until the module changes.
+    void SetOffset(PCWSTR name, uint32_t offset) {
+        if (!offset) {
+            return;
+        }
+
+        m_cache.Set(std::wstring(L"offset:") + name, offset);
+    }
+
+   private:
+    HMODULE m_module = nullptr;
+    std::optional<ModuleBuildId> m_buildId;
+    std::wstring m_filePath;
+    SymbolCache m_cache;
+};
+
 WinVersion GetExplorerVersion() {
     VS_FIXEDFILEINFO* fixedFileInfo = GetModuleVersionInfo(nullptr, nullptr);
     if (!fixedFileInfo) {
@@ -3561,12 +4071,17 @@ bool HookWin10TaskbarSymbols() {
         },
     };
 
-    if (!HookSymbols(GetModuleHandle(nullptr), explorerExeHooks,
-                     ARRAYSIZE(explorerExeHooks))) {
+    ModuleSymbolCache symbolCache;
+    symbolCache.Load(GetModuleHandle(nullptr));
+
+    if (!symbolCache.HookSymbols(explorerExeHooks,
+                                 ARRAYSIZE(explorerExeHooks))) {
         Wh_Log(L"HookSymbols failed");
         return false;
     }
 
+    symbolCache.SaveIfChanged();
+
     return true;
 }
 
@@ -3655,11 +4170,16 @@ bool HookTaskbarViewDllSymbols(HMODULE module) {
             },
         };
 
-    if (!HookSymbols(module, symbolHooks, ARRAYSIZE(symbolHooks))) {
+    ModuleSymbolCache symbolCache;
+    symbolCache.Load(module);
+
+    if (!symbolCache.HookSymbols(symbolHooks, ARRAYSIZE(symbolHooks))) {
         Wh_Log(L"HookSymbols failed");
         return false;
     }
 
+    symbolCache.SaveIfChanged();
+
     return true;
 }
 
@@ -3720,6 +4240,14 @@ void LoadSettings() {
     g_settings.bottomLine = StringSetting::make(L"BottomLine");
     g_settings.middleLine = StringSetting::make(L"MiddleLine");
     g_settings.tooltipLine = StringSetting::make(L"TooltipLine");
+
+    g_formatLinePrograms.topLine = CompileFormatLine(g_settings.topLine.get());
+    g_formatLinePrograms.bottomLine =
+        CompileFormatLine(g_settings.bottomLine.get());
+    g_formatLinePrograms.middleLine =
+        CompileFormatLine(g_settings.middleLine.get());
+    g_formatLinePrograms.tooltipLine =
+        CompileFormatLine(g_settings.tooltipLine.get());
     g_settings.width = Wh_GetIntSetting(L"Width");
     g_settings.height = Wh_GetIntSetting(L"Height");
     g_settings.maxWidth = Wh_GetIntSetting(L"MaxWidth");
@@ -9,7 +9,7 @@
 // @homepage        https://m417z.com/
 // @include         explorer.exe
 // @architecture    x86-64
-// @compilerOptions -DWINVER=0x0A00 -lole32 -loleaut32 -lruntimeobject -lshcore
+// @compilerOptions -DWINVER=0x0A00 -lole32 -loleaut32 -lruntimeobject -lshcore -lversion
 // ==/WindhawkMod==
 
 // Source code is published under The GNU General Public License v3.0.
@@ -94,9 +94,14 @@ Also check out the **Taskbar tray icon spacing and grid** mod.
 
 #include <atomic>
 #include <functional>
+#include <initializer_list>
 #include <limits>
+#include <mutex>
 #include <optional>
-#include <regex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
 
 using namespace winrt::Windows::UI::Xaml;
 
@@ -138,35 +143,216 @@ STDAPI GetDpiForMonitor(HMONITOR hmonitor,
                         UINT* dpiX,
                         UINT* dpiY);
 
-size_t OffsetFromAssemblyRegex(void* func,
-                               size_t defValue,
-                               std::regex regex,
-                               int limit = 30) {
+// Instruction patterns are matched against the instruction encoding, which is
+// much faster than formatting the disassembly and matching it as text.
+#if defined(_M_X64)
+// An instruction with a ModR/M byte, and either a memory operand with a
+// displacement or a register operand with an immediate.
+struct InstructionPattern {
+    // A mandatory prefix such as 0xF2, or 0 if there's none.
+    BYTE prefix;
+    bool rexW;
+    BYTE opcode[2];
+    BYTE opcodeSize;
+    // The ModR/M reg field of opcodes with an opcode extension, or -1.
+    int8_t extension;
+    // The base register of the memory operand, or the register operand, or -1
+    // for any register.
+    int8_t rm;
+    // The size of the immediate, or 0 for a memory operand.
+    BYTE immediateSize;
+};
+#elif defined(_M_ARM64)
+constexpr BYTE kInstructionFieldRd = 1 << 0;
+constexpr BYTE kInstructionFieldRn = 1 << 1;
+
+struct InstructionPattern {
+    DWORD mask;
+    DWORD value;
+    // Fields which must be general purpose registers, not sp or zr (31).
+    BYTE registerFields;
+    // The scale of the unsigned 12-bit immediate, or 0 if there's none.
+    BYTE imm12Scale;
+};
+#else
+#error "Unsupported architecture"
+#endif
+
+struct InstructionOperands {
+    // The ModR/M reg register (x64), or Rd/Rt (ARM64).
+    int reg;
+    // The r/m register (x64), or Rn (ARM64).
+    int base;
+    // Rm (ARM64).
+    int index;
+    // The displacement or immediate.
+    LONG_PTR value;
+};
+
+bool MatchInstruction(const void* instruction,
+                      const InstructionPattern& pattern,
+                      InstructionOperands* operands) {
+#if defined(_M_X64)
+    const BYTE* p = (const BYTE*)instruction;
+    if (pattern.prefix && *p++ != pattern.prefix) {
+        return false;
+    }
+
+    BYTE rex = 0;
+    if ((*p & 0xF0) == 0x40) {
+        rex = *p++;
+    }
+
+    if (pattern.rexW && !(rex & 0x08)) {
+        return false;
+    }
+
+    if (memcmp(p, pattern.opcode, pattern.opcodeSize) != 0) {
+        return false;
+    }
+
+    p += pattern.opcodeSize;
+
+    BYTE modRm = *p++;
+    BYTE mod = modRm >> 6;
+    BYTE reg = (modRm >> 3) & 7;
+    BYTE rm = modRm & 7;
+
+    if (pattern.extension >= 0 && reg != pattern.extension) {
+        return false;
+    }
+
+    LONG_PTR value;
+    if (pattern.immediateSize) {
+        if (mod != 3) {
+            return false;
+        }
+
+        value = pattern.immediateSize == 1 ? (LONG_PTR)*(const int8_t*)p
+                                           : (LONG_PTR)*(const int32_t*)p;
+    } else {
+        // No displacement, or a SIB byte.
+        if (mod == 0 || mod == 3 || rm == 4) {
+            return false;
+        }
+
+        value = mod == 1 ? (LONG_PTR)*(const int8_t*)p
+                         : (LONG_PTR)*(const int32_t*)p;
+    }
+
+    operands->reg = reg | ((rex & 0x04) << 1);
+    operands->base = rm | ((rex & 0x01) << 3);
+    operands->index = -1;
+    operands->value = value;
+
+    return pattern.rm < 0 || operands->base == pattern.rm;
+#elif defined(_M_ARM64)
+    DWORD insn = *(const DWORD*)instruction;
+    if ((insn & pattern.mask) != pattern.value) {
+        return false;
+    }
+
+    operands->reg = insn & 0x1F;
+    operands->base = (insn >> 5) & 0x1F;
+    operands->index = (insn >> 16) & 0x1F;
+    operands->value = ((insn >> 10) & 0xFFF) * pattern.imm12Scale;
+
+    if (((pattern.registerFields & kInstructionFieldRd) &&
+         operands->reg == 31) ||
+        ((pattern.registerFields & kInstructionFieldRn) &&
+         operands->base == 31)) {
+        return false;
+    }
+
+    return true;
+#endif
+}
+
+bool IsRetInstruction(const void* instruction) {
+#if defined(_M_X64)
+    return *(const BYTE*)instruction == 0xC3;
+#elif defined(_M_ARM64)
+    return *(const DWORD*)instruction == 0xD65F03C0;
+#endif
+}
+
+size_t OffsetFromAssembly(void* func,
+                          size_t defValue,
+                          std::initializer_list<InstructionPattern> patterns,
+                          int limit = 30) {
     BYTE* p = (BYTE*)func;
     for (int i = 0; i < limit; i++) {
-        WH_DISASM_RESULT result;
-        if (!Wh_Disasm(p, &result)) {
+        if (IsRetInstruction(p)) {
             break;
         }
 
-        p += result.length;
+        for (const auto& pattern : patterns) {
+            InstructionOperands operands;
+            if (MatchInstruction(p, pattern, &operands) && operands.value > 0) {
+                return operands.value;
+            }
+        }
 
-        std::string_view s = result.text;
-        if (s == "ret") {
+#if defined(_M_X64)
+        WH_DISASM_RESULT result;
+        if (!Wh_Disasm(p, &result)) {
             break;
         }
 
-        std::match_results<std::string_view::const_iterator> match;
-        if (std::regex_match(s.begin(), s.end(), match, regex)) {
-            // Wh_Log(L"%S", result.text);
-            return std::stoull(match[1], nullptr, 16);
-        }
+        p += result.length;
+#elif defined(_M_ARM64)
+        p += sizeof(DWORD);
+#endif
     }
 
     Wh_Log(L"Failed for %p", func);
     return defValue;
 }
 
+#ifdef _M_ARM64
+// ldr dN, [xN, #0x...]
+constexpr InstructionPattern kLdrDoubleImmPattern{
+    .mask = 0xFFC00000,
+    .value = 0xFD400000,
+    .registerFields = kInstructionFieldRn,
+    .imm12Scale = 8,
+};
+
+// str dN, [xN, #0x...]
+constexpr InstructionPattern kStrDoubleImmPattern{
+    .mask = 0xFFC00000,
+    .value = 0xFD000000,
+    .registerFields = kInstructionFieldRn,
+    .imm12Scale = 8,
+};
+
+// ldr xN, [xN, #0x...]
+constexpr InstructionPattern kLdrImmPattern{
+    .mask = 0xFFC00000,
+    .value = 0xF9400000,
+    .registerFields = kInstructionFieldRd | kInstructionFieldRn,
+    .imm12Scale = 8,
+};
+
+// fcmp dN, dN
+constexpr InstructionPattern kFcmpDoublePattern{
+    .mask = 0xFFE0FC1F,
+    .value = 0x1E602000,
+};
+
+// b.eq 0x...
+constexpr InstructionPattern kBeqPattern{
+    .mask = 0xFF00001F,
+    .value = 0x54000000,
+};
+
+// fsub dN, dN, dN
+constexpr InstructionPattern kFsubDoublePattern{
+    .mask = 0xFFE0FC00,
+    .value = 0x1E603800,
+};
+#endif  // _M_ARM64
+
 std::optional<bool> IsOsFeatureEnabled(UINT32 featureId) {
     enum FEATURE_ENABLED_STATE {
         FEATURE_ENABLED_STATE_DEFAULT = 0,
@@ -658,11 +844,396 @@ TaskbarConfiguration_GetIconHeightInViewPixels_method_Hook(void* pThis) {
     return iconSize;
 }
 
+// Identifies a module build. Cached symbol addresses and offsets are only
+// valid for the build they were resolved for.
+struct ModuleBuildId {
+    uint32_t machine;
+    uint32_t timeDateStamp;
+    uint32_t sizeOfImage;
+    uint32_t fileVersionMS;
+    uint32_t fileVersionLS;
+
+    bool operator==(const ModuleBuildId&) const = default;
+};
+
+// Symbol RVAs and derived offsets of a module build, keyed by name. The
+// serialized form is validated as a whole, so a partially written or corrupt
+// file is treated as missing.
+class SymbolCache {
+   public:
+    // Bump when the symbols or the offset calculations change.
+    static constexpr uint32_t kVersion = 2;
+
+    std::optional<uint32_t> Get(std::wstring_view name) const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto it = m_values.find(std::wstring(name));
+        if (it == m_values.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+    void Set(std::wstring_view name, uint32_t value) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto [it, inserted] = m_values.try_emplace(std::wstring(name), value);
+        if (inserted || it->second != value) {
+            it->second = value;
+            m_dirty = true;
+        }
+    }
+
+    bool IsDirty() const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_dirty;
+    }
+
+    std::vector<BYTE> Serialize(const ModuleBuildId& buildId) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        std::vector<BYTE> entries;
+        auto write = [&entries](const void* data, size_t size) {
+            const BYTE* p = static_cast<const BYTE*>(data);
+            entries.insert(entries.end(), p, p + size);
+        };
+
+        for (const auto& [name, value] : m_values) {
+            uint32_t nameLength = static_cast<uint32_t>(name.size());
+            write(&value, sizeof(value));
+            write(&nameLength, sizeof(nameLength));
+            write(name.data(), nameLength * sizeof(WCHAR));
+        }
+
+        Header header{
+            .magic = kMagic,
+            .version = kVersion,
+            .buildId = buildId,
+            .entryCount = static_cast<uint32_t>(m_values.size()),
+            .entriesSize = static_cast<uint32_t>(entries.size()),
+            .entriesChecksum = Checksum(entries.data(), entries.size()),
+        };
+
+        std::vector<BYTE> buffer(sizeof(header) + entries.size());
+        memcpy(buffer.data(), &header, sizeof(header));
+        std::copy(entries.begin(), entries.end(),
+                  buffer.begin() + sizeof(header));
+
+        m_dirty = false;
+        return buffer;
+    }
+
+    // Replaces the values with the serialized ones if they're valid and were
+    // created for the given build.
+    bool Parse(const BYTE* data, size_t size, const ModuleBuildId& buildId) {
+        Header header;
+        if (size < sizeof(header)) {
+            return false;
+        }
+
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != kMagic || header.version != kVersion ||
+            header.buildId != buildId ||
+            header.entriesSize != size - sizeof(header)) {
+            return false;
+        }
+
+        const BYTE* p = data + sizeof(header);
+        const BYTE* end = p + header.entriesSize;
+        if (Checksum(p, header.entriesSize) != header.entriesChecksum) {
+            return false;
+        }
+
+        std::unordered_map<std::wstring, uint32_t> values;
+        for (uint32_t i = 0; i < header.entryCount; i++) {
+            uint32_t value;
+            uint32_t nameLength;
+            if (static_cast<size_t>(end - p) <
+                sizeof(value) + sizeof(nameLength)) {
+                return false;
+            }
+
+            memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            memcpy(&nameLength, p, sizeof(nameLength));
+            p += sizeof(nameLength);
+
+            if (nameLength > static_cast<size_t>(end - p) / sizeof(WCHAR) ||
+                value >= buildId.sizeOfImage) {
+                return false;
+            }
+
+            std::wstring name(nameLength, L'\0');
+            memcpy(name.data(), p, nameLength * sizeof(WCHAR));
+            p += nameLength * sizeof(WCHAR);
+
+            values.insert_or_assign(std::move(name), value);
+        }
+
+        if (p != end) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_values = std::move(values);
+        m_dirty = false;
+        return true;
+    }
+
+   private:
+    static constexpr uint32_t kMagic = 0x43535748;  // "HWSC"
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        ModuleBuildId buildId;
+        uint32_t entryCount;
+        uint32_t entriesSize;
+        uint32_t entriesChecksum;
+    };
+
+    // FNV-1a.
+    static uint32_t Checksum(const BYTE* data, size_t size) {
+        uint32_t hash = 2166136261;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 16777619;
+        }
+
+        return hash;
+    }
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::wstring, uint32_t> m_values;
+    bool m_dirty = false;
+};
+
+VS_FIXEDFILEINFO* GetModuleVersionInfo(HMODULE hModule, UINT* puPtrLen) {
+    void* pFixedFileInfo = nullptr;
+    UINT uPtrLen = 0;
+
+    HRSRC hResource =
+        FindResource(hModule, MAKEINTRESOURCE(VS_VERSION_INFO), RT_VERSION);
+    if (hResource) {
+        HGLOBAL hGlobal = LoadResource(hModule, hResource);
+        if (hGlobal) {
+            void* pData = LockResource(hGlobal);
+            if (pData) {
+                if (!VerQueryValue(pData, L"\\", &pFixedFileInfo, &uPtrLen) ||
+                    uPtrLen == 0) {
+                    pFixedFileInfo = nullptr;
+                    uPtrLen = 0;
+                }
+            }
+        }
+    }
+
+    if (puPtrLen) {
+        *puPtrLen = uPtrLen;
+    }
+
+    return (VS_FIXEDFILEINFO*)pFixedFileInfo;
+}
+
+std::optional<ModuleBuildId> GetModuleBuildId(HMODULE module) {
+    VS_FIXEDFILEINFO* fixedFileInfo = GetModuleVersionInfo(module, nullptr);
+    if (!fixedFileInfo) {
+        return std::nullopt;
+    }
+
+    auto* dosHeader = (IMAGE_DOS_HEADER*)module;
+    auto* ntHeaders = (IMAGE_NT_HEADERS*)((BYTE*)module + dosHeader->e_lfanew);
+
+    return ModuleBuildId{
+        .machine = ntHeaders->FileHeader.Machine,
+        .timeDateStamp = ntHeaders->FileHeader.TimeDateStamp,
+        .sizeOfImage = ntHeaders->OptionalHeader.SizeOfImage,
+        .fileVersionMS = fixedFileInfo->dwFileVersionMS,
+        .fileVersionLS = fixedFileInfo->dwFileVersionLS,
+    };
+}
+
+// The symbol cache of a loaded module, stored in the mod storage folder.
+class ModuleSymbolCache {
+   public:
+    void Load(HMODULE module) {
+        m_module = module;
+        m_buildId = GetModuleBuildId(module);
+        if (!m_buildId) {
+            Wh_Log(L"Symbol cache disabled, no version info");
+            return;
+        }
+
+        WCHAR storagePath[MAX_PATH];
+        WCHAR modulePath[MAX_PATH];
+        if (!Wh_GetModStoragePath(storagePath, ARRAYSIZE(storagePath)) ||
+            !GetModuleFileName(module, modulePath, ARRAYSIZE(modulePath))) {
+            Wh_Log(L"Symbol cache disabled, failed to get paths");
+            m_buildId.reset();
+            return;
+        }
+
+        PCWSTR moduleName = wcsrchr(modulePath, L'\\');
+        moduleName = moduleName ? moduleName + 1 : modulePath;
+
+        m_filePath = std::wstring(storagePath) + L"\\symbol-cache-" +
+                     moduleName + L".bin";
+
+        HANDLE file = CreateFile(m_filePath.c_str(), GENERIC_READ,
+                                 FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        std::vector<BYTE> buffer;
+        LARGE_INTEGER fileSize;
+        DWORD bytesRead = 0;
+        bool succeeded =
+            GetFileSizeEx(file, &fileSize) && fileSize.QuadPart <= 1024 * 1024;
+        if (succeeded) {
+            buffer.resize(static_cast<size_t>(fileSize.QuadPart));
+            succeeded = ReadFile(file, buffer.data(),
+                                 static_cast<DWORD>(buffer.size()), &bytesRead,
+                                 nullptr) &&
+                        bytesRead == buffer.size();
+        }
+
+        CloseHandle(file);
+
+        if (!succeeded ||
+            !m_cache.Parse(buffer.data(), buffer.size(), *m_buildId)) {
+            Wh_Log(L"Ignoring outdated or invalid symbol cache %s",
+                   m_filePath.c_str());
+        }
+    }
+
+    void SaveIfChanged() {
+        if (!m_buildId || !m_cache.IsDirty()) {
+            return;
+        }
+
+        std::vector<BYTE> buffer = m_cache.Serialize(*m_buildId);
+
+        std::wstring tempFilePath =
+            m_filePath + L"." + std::to_wstring(GetCurrentProcessId()) +
+            L".tmp";
+
+        HANDLE file =
+            CreateFile(tempFilePath.c_str(), GENERIC_WRITE, 0, nullptr,
+                       CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            Wh_Log(L"CreateFile failed: %u", GetLastError());
+            return;
+        }
+
+        DWORD written = 0;
+        bool succeeded =
+            WriteFile(file, buffer.data(), static_cast<DWORD>(buffer.size()),
+                      &written, nullptr) &&
+            written == buffer.size();
+        CloseHandle(file);
+
+        if (!succeeded || !MoveFileEx(tempFilePath.c_str(), m_filePath.c_str(),
+                                      MOVEFILE_REPLACE_EXISTING)) {
+            Wh_Log(L"Failed to write symbol cache: %u", GetLastError());
+            DeleteFile(tempFilePath.c_str());
+        }
+    }
+
+    // Like HookSymbols, but skips symbol resolution if all symbols are cached.
+    bool HookSymbols(WindhawkUtils::SYMBOL_HOOK* symbolHooks,
+                     size_t symbolHooksCount) {
+        std::vector<void*> addresses(symbolHooksCount);
+
+        bool cached = true;
+        for (size_t i = 0; i < symbolHooksCount; i++) {
+            auto rva = m_cache.Get(symbolHooks[i].symbols[0]);
+            if (!rva || (!*rva && !symbolHooks[i].optional)) {
+                cached = false;
+                break;
+            }
+
+            addresses[i] = *rva ? (BYTE*)m_module + *rva : nullptr;
+        }
+
+        if (cached) {
+            Wh_Log(L"Using cached symbols");
+        } else {
+            // Resolve the addresses only, and hook them below.
+            std::vector<WindhawkUtils::SYMBOL_HOOK> symbolLookups(
+                symbolHooks, symbolHooks + symbolHooksCount);
+            for (size_t i = 0; i < symbolHooksCount; i++) {
+                addresses[i] = nullptr;
+                symbolLookups[i].pOriginalFunction = &addresses[i];
+                symbolLookups[i].hookFunction = nullptr;
+            }
+
+            if (!WindhawkUtils::HookSymbols(m_module, symbolLookups.data(),
+                                            symbolHooksCount)) {
+                return false;
+            }
+
+            for (size_t i = 0; i < symbolHooksCount; i++) {
+                m_cache.Set(symbolHooks[i].symbols[0],
+                            addresses[i] ? (uint32_t)((BYTE*)addresses[i] -
+                                                      (BYTE*)m_module)
+                                         : 0);
+            }
+        }
+
+        for (size_t i = 0; i < symbolHooksCount; i++) {
+            if (!addresses[i]) {
+                continue;
+            }
+
+            if (symbolHooks[i].hookFunction) {
+                Wh_SetFunctionHook(addresses[i], symbolHooks[i].hookFunction,
+                                   symbolHooks[i].pOriginalFunction);
+            } else {
+                *symbolHooks[i].pOriginalFunction = addresses[i];
+            }
+        }
+
+        return true;
+    }
+
+    std::optional<uint32_t> GetOffset(PCWSTR name) {
+        auto offset = m_cache.Get(std::wstring(L"offset:") + name);
+        if (offset) {
+            Wh_Log(L"%s=0x%X (cached)", name, *offset);
+        }
+
+        return offset;
+    }
+
+    // Failed discoveries (0) aren't stored, so that they're retried on the
+    // next start instead of being used until the module changes.
+    void SetOffset(PCWSTR name, uint32_t offset) {
+        if (!offset) {
+            return;
+        }
+
+        m_cache.Set(std::wstring(L"offset:") + name, offset);
+    }
+
+   private:
+    HMODULE m_module = nullptr;
+    std::optional<ModuleBuildId> m_buildId;
+    std::wstring m_filePath;
+    SymbolCache m_cache;
+};
+
+ModuleSymbolCache g_taskbarViewDllSymbolCache;
+
 using TaskListButton_IconHeight_t = void(WINAPI*)(void* pThis, double height);
 TaskListButton_IconHeight_t TaskListButton_IconHeight_Original;
 
 size_t GetIconHeightOffset() {
     static size_t iconHeightOffset = []() -> size_t {
+        if (auto offset =
+                g_taskbarViewDllSymbolCache.GetOffset(L"iconHeightOffset")) {
+            return (size_t)*offset;
+        }
+
         if (!TaskListButton_IconHeight_Original) {
             Wh_Log(L"Error: TaskListButton_IconHeight_Original is null");
             return 0;
@@ -670,17 +1241,22 @@ size_t GetIconHeightOffset() {
 
         size_t offset =
 #if defined(_M_X64)
-            OffsetFromAssemblyRegex(
-                (void*)TaskListButton_IconHeight_Original, 0,
-                std::regex(R"(movsd xmm\d+, qword ptr \[rcx\+0x([0-9a-f]+)\])",
-                           std::regex_constants::icase),
-                30);
+            // movsd xmmN, qword ptr [rcx+0x...]
+            OffsetFromAssembly((void*)TaskListButton_IconHeight_Original, 0,
+                               {
+                                   {
+                                       .prefix = 0xF2,
+                                       .opcode = {0x0F, 0x10},
+                                       .opcodeSize = 2,
+                                       .extension = -1,
+                                       .rm = 1,
+                                   },
+                               },
+                               30);
 #elif defined(_M_ARM64)
-            OffsetFromAssemblyRegex(
-                (void*)TaskListButton_IconHeight_Original, 0,
-                std::regex(R"(ldr\s+d\d+, \[x\d+, #0x([0-9a-f]+)\])",
-                           std::regex_constants::icase),
-                30);
+            // ldr dN, [xN, #0x...]
+            OffsetFromAssembly((void*)TaskListButton_IconHeight_Original, 0,
+                               {kLdrDoubleImmPattern}, 30);
 #else
 #error "Unsupported architecture"
 #endif
@@ -692,7 +1268,8 @@ size_t GetIconHeightOffset() {
 }
 
 void TaskListButton_IconHeight_InitOffsets() {
-    GetIconHeightOffset();
+    g_taskbarViewDllSymbolCache.SetOffset(L"iconHeightOffset",
+                                          GetIconHeightOffset());
 }
 
 using SystemTrayController_GetFrameSize_t =
@@ -757,6 +1334,11 @@ TaskbarConfiguration_UpdateFrameSize_t
 
 LONG GetFrameSizeOffset() {
     static LONG frameSizeOffset = []() -> LONG {
+        if (auto offset =
+                g_taskbarViewDllSymbolCache.GetOffset(L"frameSizeOffset")) {
+            return (LONG)*offset;
+        }
+
         if (!TaskbarConfiguration_UpdateFrameSize_SymbolAddress) {
             Wh_Log(
                 L"Error: TaskbarConfiguration_UpdateFrameSize_SymbolAddress is "
@@ -769,25 +1351,14 @@ LONG GetFrameSizeOffset() {
         const DWORD* start =
             (const DWORD*)TaskbarConfiguration_UpdateFrameSize_SymbolAddress;
         const DWORD* end = start + 0x80;
-        std::regex regex1(R"(str\s+d\d+, \[x\d+, #0x([0-9a-f]+)\])");
-        for (const DWORD* p = start; p != end; p++) {
-            WH_DISASM_RESULT result1;
-            if (!Wh_Disasm((void*)p, &result1)) {
-                break;
-            }
-
-            std::string_view s1 = result1.text;
-            if (s1 == "ret") {
-                break;
-            }
-
-            std::match_results<std::string_view::const_iterator> match1;
-            if (!std::regex_match(s1.begin(), s1.end(), match1, regex1)) {
+        for (const DWORD* p = start; p != end && !IsRetInstruction(p); p++) {
+            InstructionOperands operands1;
+            if (!MatchInstruction(p, kStrDoubleImmPattern, &operands1) ||
+                !operands1.value) {
                 continue;
             }
 
-            // Wh_Log(L"%S", result1.text);
-            LONG offset = std::stoull(match1[1], nullptr, 16);
+            LONG offset = operands1.value;
             Wh_Log(L"frameSizeOffset=0x%X", offset);
             return (offset < 0 || offset > 0xFFFF) ? 0 : offset;
         }
@@ -800,7 +1371,8 @@ LONG GetFrameSizeOffset() {
 }
 
 void TaskbarConfiguration_UpdateFrameSize_InitOffsets() {
-    GetFrameSizeOffset();
+    g_taskbarViewDllSymbolCache.SetOffset(L"frameSizeOffset",
+                                          GetFrameSizeOffset());
 }
 
 TaskbarConfiguration_UpdateFrameSize_t
@@ -849,6 +1421,11 @@ SystemTrayController_UpdateFrameSize_t
 
 LONG GetLastHeightOffset() {
     static LONG lastHeightOffset = []() -> LONG {
+        if (auto offset =
+                g_taskbarViewDllSymbolCache.GetOffset(L"lastHeightOffset")) {
+            return (LONG)*offset;
+        }
+
         if (!SystemTrayController_UpdateFrameSize_SymbolAddress) {
             Wh_Log(
                 L"Error: SystemTrayController_UpdateFrameSize_SymbolAddress is "
@@ -879,46 +1456,18 @@ LONG GetLastHeightOffset() {
         const DWORD* start =
             (const DWORD*)SystemTrayController_UpdateFrameSize_SymbolAddress;
         const DWORD* end = start + 0x80;
-        std::regex regex1(R"(ldr\s+d\d+, \[x\d+, #0x([0-9a-f]+)\])");
-        std::regex regex2(R"(fcmp\s+d\d+, d\d+)");
-        std::regex regex3(R"(b\.eq\s+0x[0-9a-f]+)");
-        for (const DWORD* p = start; p != end; p++) {
-            WH_DISASM_RESULT result1;
-            if (!Wh_Disasm((void*)p, &result1)) {
-                break;
-            }
-
-            std::string_view s1 = result1.text;
-            if (s1 == "ret") {
-                break;
-            }
-
-            std::match_results<std::string_view::const_iterator> match1;
-            if (!std::regex_match(s1.begin(), s1.end(), match1, regex1)) {
+        for (const DWORD* p = start; p != end && !IsRetInstruction(p); p++) {
+            InstructionOperands operands1;
+            InstructionOperands operands2;
+            InstructionOperands operands3;
+            if (!MatchInstruction(p, kLdrDoubleImmPattern, &operands1) ||
+                !operands1.value ||
+                !MatchInstruction(p + 1, kFcmpDoublePattern, &operands2) ||
+                !MatchInstruction(p + 2, kBeqPattern, &operands3)) {
                 continue;
             }
 
-            WH_DISASM_RESULT result2;
-            if (!Wh_Disasm((void*)(p + 1), &result2)) {
-                break;
-            }
-            std::string_view s2 = result2.text;
-            if (!std::regex_match(s2.begin(), s2.end(), regex2)) {
-                continue;
-            }
-            WH_DISASM_RESULT result3;
-            if (!Wh_Disasm((void*)(p + 2), &result3)) {
-                break;
-            }
-            std::string_view s3 = result3.text;
-            if (!std::regex_match(s3.begin(), s3.end(), regex3)) {
-                continue;
-            }
-
-            // Wh_Log(L"%S", result1.text);
-            // Wh_Log(L"%S", result2.text);
-            // Wh_Log(L"%S", result3.text);
-            LONG offset = std::stoull(match1[1], nullptr, 16);
+            LONG offset = operands1.value;
             Wh_Log(L"lastHeightOffset=0x%X", offset);
             return (offset < 0 || offset > 0xFFFF) ? 0 : offset;
         }
@@ -934,7 +1483,8 @@ LONG GetLastHeightOffset() {
 }
 
 void SystemTrayController_UpdateFrameSize_InitOffsets() {
-    GetLastHeightOffset();
+    g_taskbarViewDllSymbolCache.SetOffset(L"lastHeightOffset",
+                                          GetLastHeightOffset());
 }
 
 SystemTrayController_UpdateFrameSize_t
@@ -987,6 +1537,11 @@ void* TaskbarController_OnGroupingModeChanged_Original;
 
 LONG GetTaskbarFrameOffset() {
     static LONG taskbarFrameOffset = []() -> LONG {
+        if (auto offset =
+                g_taskbarViewDllSymbolCache.GetOffset(L"taskbarFrameOffset")) {
+            return (LONG)*offset;
+        }
+
         if (!TaskbarController_OnGroupingModeChanged_Original) {
             Wh_Log(
                 L"Error: TaskbarController_OnGroupingModeChanged_Original is "
@@ -1016,25 +1571,14 @@ LONG GetTaskbarFrameOffset() {
         const DWORD* start =
             (const DWORD*)TaskbarController_OnGroupingModeChanged_Original;
         const DWORD* end = start + 10;
-        std::regex regex1(R"(ldr\s+x\d+, \[x\d+, #0x([0-9a-f]+)\])");
-        for (const DWORD* p = start; p != end; p++) {
-            WH_DISASM_RESULT result1;
-            if (!Wh_Disasm((void*)p, &result1)) {
-                break;
-            }
-
-            std::string_view s1 = result1.text;
-            if (s1 == "ret") {
-                break;
-            }
-
-            std::match_results<std::string_view::const_iterator> match1;
-            if (!std::regex_match(s1.begin(), s1.end(), match1, regex1)) {
+        for (const DWORD* p = start; p != end && !IsRetInstruction(p); p++) {
+            InstructionOperands operands1;
+            if (!MatchInstruction(p, kLdrImmPattern, &operands1) ||
+                !operands1.value) {
                 continue;
             }
 
-            // Wh_Log(L"%S", result1.text);
-            LONG offset = std::stoull(match1[1], nullptr, 16);
+            LONG offset = operands1.value;
             Wh_Log(L"taskbarFrameOffset=0x%X", offset);
             return (offset < 0 || offset > 0xFFFF) ? 0 : offset;
         }
@@ -1050,7 +1594,8 @@ LONG GetTaskbarFrameOffset() {
 }
 
 void TaskbarController_OnGroupingModeChanged_InitOffsets() {
-    GetTaskbarFrameOffset();
+    g_taskbarViewDllSymbolCache.SetOffset(L"taskbarFrameOffset",
+                                          GetTaskbarFrameOffset());
 }
 
 using TaskbarController_UpdateFrameHeight_t = void(WINAPI*)(void* pThis);
@@ -1259,6 +1804,11 @@ void* TaskListButton_UpdateIconColumnDefinition_Original;
 
 LONG GetMediumTaskbarButtonExtentOffset() {
     static LONG mediumTaskbarButtonExtentOffset = []() -> LONG {
+        if (auto offset = g_taskbarViewDllSymbolCache.GetOffset(
+                L"mediumTaskbarButtonExtentOffset")) {
+            return (LONG)*offset;
+        }
+
 #if defined(_M_X64)
         // 40:53              | push rbx
         // 48:83EC 60         | sub rsp,60
@@ -1295,50 +1845,27 @@ LONG GetMediumTaskbarButtonExtentOffset() {
         const DWORD* start =
             (const DWORD*)TaskListButton_UpdateIconColumnDefinition_Original;
         const DWORD* end = start + 0x80;
-        std::regex regex1(R"(fsub\s+d\d+, (d\d+), d\d+)");
         const DWORD* cmdWithReg1 = nullptr;
-        std::string reg1;
-        for (const DWORD* p = start; p != end; p++) {
-            WH_DISASM_RESULT result1;
-            if (!Wh_Disasm((void*)p, &result1)) {
-                break;
-            }
-
-            std::string_view s1 = result1.text;
-            if (s1 == "ret") {
-                break;
-            }
-
-            std::match_results<std::string_view::const_iterator> match1;
-            if (std::regex_match(s1.begin(), s1.end(), match1, regex1)) {
-                // Wh_Log(L"%S", result1.text);
+        int reg1;
+        for (const DWORD* p = start; p != end && !IsRetInstruction(p); p++) {
+            InstructionOperands operands1;
+            if (MatchInstruction(p, kFsubDoublePattern, &operands1)) {
                 cmdWithReg1 = p;
-                reg1 = match1[1];
+                reg1 = operands1.base;
                 break;
             }
         }
 
         if (cmdWithReg1) {
-            std::regex regex2(R"(ldr\s+(d\d+), \[x\d+, #0x([0-9a-f]+)\])");
-            for (const DWORD* p = start; p != cmdWithReg1; p++) {
-                WH_DISASM_RESULT result1;
-                if (!Wh_Disasm((void*)p, &result1)) {
-                    break;
-                }
-
-                std::string_view s1 = result1.text;
-                if (s1 == "ret") {
-                    break;
-                }
-
-                std::match_results<std::string_view::const_iterator> match1;
-                if (!std::regex_match(s1.begin(), s1.end(), match1, regex2) ||
-                    match1[1] != reg1) {
+            for (const DWORD* p = start;
+                 p != cmdWithReg1 && !IsRetInstruction(p); p++) {
+                InstructionOperands operands1;
+                if (!MatchInstruction(p, kLdrDoubleImmPattern, &operands1) ||
+                    !operands1.value || operands1.reg != reg1) {
                     continue;
                 }
 
-                // Wh_Log(L"%S", result1.text);
-                LONG offset = std::stoull(match1[2], nullptr, 16);
+                LONG offset = operands1.value;
                 Wh_Log(L"mediumTaskbarButtonExtentOffset=0x%X", offset);
                 return (offset < 0 || offset > 0xFFFF) ? 0 : offset;
             }
@@ -1355,7 +1882,8 @@ LONG GetMediumTaskbarButtonExtentOffset() {
 }
 
 void TaskListButton_UpdateIconColumnDefinition_InitOffsets() {
-    GetMediumTaskbarButtonExtentOffset();
+    g_taskbarViewDllSymbolCache.SetOffset(L"mediumTaskbarButtonExtentOffset",
+                                          GetMediumTaskbarButtonExtentOffset());
 }
 
 using TaskListButton_UpdateVisualStates_t = void(WINAPI*)(void* pThis);
@@ -2113,7 +2641,10 @@ bool HookTaskbarViewDllSymbols(HMODULE module) {
             },
         };
 
-    if (!HookSymbols(module, symbolHooks, ARRAYSIZE(symbolHooks))) {
+    g_taskbarViewDllSymbolCache.Load(module);
+
+    if (!g_taskbarViewDllSymbolCache.HookSymbols(symbolHooks,
+                                                 ARRAYSIZE(symbolHooks))) {
         Wh_Log(L"HookSymbols failed");
         return false;
     }
@@ -2155,6 +2686,8 @@ bool HookTaskbarViewDllSymbols(HMODULE module) {
         Wh_Log(L"Dynamic icon scaling is enabled");
     }
 
+    g_taskbarViewDllSymbolCache.SaveIfChanged();
+
     return true;
 }
 
@@ -2173,11 +2706,16 @@ bool HookSearchUxUiDllSymbols(HMODULE module) {
         },
     };
 
-    if (!HookSymbols(module, symbolHooks, ARRAYSIZE(symbolHooks))) {
+    ModuleSymbolCache symbolCache;
+    symbolCache.Load(module);
+
+    if (!symbolCache.HookSymbols(symbolHooks, ARRAYSIZE(symbolHooks))) {
         Wh_Log(L"HookSymbols failed");
         return false;
     }
 
+    symbolCache.SaveIfChanged();
+
     return true;
 }
 
@@ -2238,11 +2776,17 @@ bool HookTaskbarDllSymbols() {
         },
     };
 
-    if (!HookSymbols(module, taskbarDllHooks, ARRAYSIZE(taskbarDllHooks))) {
+    ModuleSymbolCache symbolCache;
+    symbolCache.Load(module);
+
+    if (!symbolCache.HookSymbols(taskbarDllHooks,
+                                 ARRAYSIZE(taskbarDllHooks))) {
         Wh_Log(L"HookSymbols failed");
         return false;
     }
 
+    symbolCache.SaveIfChanged();
+
     return true;
 }
 
@@ -190,8 +190,12 @@ Labels can also be shown or hidden per-program in the settings.
 #include <algorithm>
 #include <atomic>
 #include <limits>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 using namespace winrt::Windows::UI::Xaml;
 
@@ -373,6 +377,174 @@ std::wstring GetWindowAppId(HWND hWnd) {
     return result;
 }
 
+// Caches the uppercase process path and app ID of windows, which are
+// otherwise resolved on every exclusion check by opening the window's process
+// and creating an app resolver COM object. Each value is resolved on first
+// use, so that the app ID isn't resolved for windows which are matched by
+// their process path. Window entries are validated with the window's process
+// and thread IDs, in case the handle was reused, and process paths are keyed
+// by process ID and creation time for the same reason. Each cache is simply
+// cleared when it grows past its limit.
+class WindowIdentityCache {
+   public:
+    std::wstring GetProcessPathUpper(HWND hWnd) {
+        return GetWindowValue(hWnd, &WindowEntry::processPathUpper,
+                              [this](DWORD processId) {
+                                  return ResolveProcessPathUpper(processId);
+                              });
+    }
+
+    std::wstring GetAppIdUpper(HWND hWnd) {
+        return GetWindowValue(
+            hWnd, &WindowEntry::appIdUpper, [hWnd](DWORD) {
+                std::wstring appIdUpper = GetWindowAppId(hWnd);
+                LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_UPPERCASE,
+                              appIdUpper.data(), appIdUpper.length(),
+                              appIdUpper.data(), appIdUpper.length(), nullptr,
+                              nullptr, 0);
+                return appIdUpper;
+            });
+    }
+
+    void InvalidateWindow(HWND hWnd) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        m_windows.erase(hWnd);
+    }
+
+    void InvalidateAllWindows() {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        m_windows.clear();
+    }
+
+   private:
+    struct WindowEntry {
+        DWORD processId;
+        DWORD threadId;
+        std::optional<std::wstring> processPathUpper;
+        std::optional<std::wstring> appIdUpper;
+    };
+
+    struct ProcessEntry {
+        ULONGLONG creationTime;
+        std::wstring pathUpper;
+    };
+
+    static constexpr size_t kMaxWindows = 1024;
+    static constexpr size_t kMaxProcesses = 256;
+
+    template <typename F>
+    std::wstring GetWindowValue(HWND hWnd,
+                                std::optional<std::wstring> WindowEntry::*value,
+                                F&& resolve) {
+        DWORD processId = 0;
+        DWORD threadId = GetWindowThreadProcessId(hWnd, &processId);
+        if (!threadId) {
+            return std::wstring{};
+        }
+
+        auto isEntryValid = [processId, threadId](const WindowEntry& entry) {
+            return entry.processId == processId && entry.threadId == threadId;
+        };
+
+        {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            auto it = m_windows.find(hWnd);
+            if (it != m_windows.end() && isEntryValid(it->second) &&
+                it->second.*value) {
+                return *(it->second.*value);
+            }
+        }
+
+        // Resolve without holding the lock, creating the app resolver can take
+        // a while.
+        std::wstring result = resolve(processId);
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        auto it = m_windows.find(hWnd);
+        if (it == m_windows.end() || !isEntryValid(it->second)) {
+            if (m_windows.size() >= kMaxWindows) {
+                m_windows.clear();
+            }
+
+            it = m_windows
+                     .insert_or_assign(hWnd,
+                                       WindowEntry{
+                                           .processId = processId,
+                                           .threadId = threadId,
+                                       })
+                     .first;
+        }
+
+        it->second.*value = result;
+        return result;
+    }
+
+    std::wstring ResolveProcessPathUpper(DWORD processId) {
+        HANDLE hProcess =
+            OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, processId);
+        if (!hProcess) {
+            return std::wstring{};
+        }
+
+        ULONGLONG creationTime = 0;
+        FILETIME creationFileTime, exitFileTime, kernelFileTime, userFileTime;
+        if (GetProcessTimes(hProcess, &creationFileTime, &exitFileTime,
+                            &kernelFileTime, &userFileTime)) {
+            creationTime =
+                ((ULONGLONG)creationFileTime.dwHighDateTime << 32) |
+                creationFileTime.dwLowDateTime;
+        }
+
+        if (creationTime) {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            auto it = m_processes.find(processId);
+            if (it != m_processes.end() &&
+                it->second.creationTime == creationTime) {
+                CloseHandle(hProcess);
+                return it->second.pathUpper;
+            }
+        }
+
+        std::wstring pathUpper;
+
+        WCHAR path[MAX_PATH];
+        DWORD dwSize = ARRAYSIZE(path);
+        if (QueryFullProcessImageName(hProcess, 0, path, &dwSize)) {
+            pathUpper.assign(path, dwSize);
+            LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_UPPERCASE,
+                          pathUpper.data(), pathUpper.length(),
+                          pathUpper.data(), pathUpper.length(), nullptr,
+                          nullptr, 0);
+        }
+
+        CloseHandle(hProcess);
+
+        if (creationTime && !pathUpper.empty()) {
+            std::lock_guard<std::mutex> guard(m_mutex);
+
+            if (m_processes.size() >= kMaxProcesses) {
+                m_processes.clear();
+            }
+
+            m_processes.insert_or_assign(processId,
+                                         ProcessEntry{creationTime, pathUpper});
+        }
+
+        return pathUpper;
+    }
+
+    std::mutex m_mutex;
+    std::unordered_map<HWND, WindowEntry> m_windows;
+    std::unordered_map<DWORD, ProcessEntry> m_processes;
+};
+
+WindowIdentityCache g_windowIdentityCache;
+
 void RecalculateLabels() {
     HWND hTaskbarWnd = FindCurrentProcessTaskbarWnd();
     if (!hTaskbarWnd) {
@@ -391,6 +563,10 @@ void RecalculateLabels() {
         return;
     }
 
+    // Resolve the window identities again for the new exclusion list, which
+    // also picks up app IDs which changed since they were cached.
+    g_windowIdentityCache.InvalidateAllWindows();
+
     g_applyingSettings = true;
 
     // Trigger CTaskBand::_HandleSyncDisplayChange.
@@ -765,6 +941,9 @@ LONG_PTR WINAPI CTaskListWnd_TaskDestroyed_Hook(void* pThis,
     LONG_PTR ret = CTaskListWnd_TaskDestroyed_Original(
         pThis, taskGroup, taskItem, taskDestroyedFlags);
 
+    // The task item of a window is recreated when its app ID changes.
+    g_windowIdentityCache.InvalidateAllWindows();
+
     // Trigger CTaskListWnd::GroupChanged to trigger the title change.
     int taskGroupProperty = 4;  // saw this in the debugger
     CTaskListWnd_GroupChanged_Hook(pThis, taskGroup, taskGroupProperty);
@@ -784,6 +963,9 @@ LONG_PTR WINAPI CTaskListWnd_TaskDestroyed_2_Hook(void* pThis,
     LONG_PTR ret =
         CTaskListWnd_TaskDestroyed_2_Original(pThis, taskGroup, taskItem);
 
+    // The task item of a window is recreated when its app ID changes.
+    g_windowIdentityCache.InvalidateAllWindows();
+
     // Trigger CTaskListWnd::GroupChanged to trigger the title change.
     int taskGroupProperty = 4;  // saw this in the debugger
     CTaskListWnd_GroupChanged_Hook(pThis, taskGroup, taskGroupProperty);
@@ -1581,68 +1763,33 @@ TaskListWindowViewModel_ITaskbarAppItemViewModel_get_HasLabel_Hook(
         }
 
         if (SUCCEEDED(hr) && hWnd) {
-            DWORD resolvedWindowProcessPathLen = 0;
-            WCHAR resolvedWindowProcessPath[MAX_PATH];
-            WCHAR resolvedWindowProcessPathUpper[MAX_PATH];
-
-            DWORD dwProcessId = 0;
-            if (GetWindowThreadProcessId(hWnd, &dwProcessId)) {
-                HANDLE hProcess = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION,
-                                              FALSE, dwProcessId);
-                if (hProcess) {
-                    DWORD dwSize = ARRAYSIZE(resolvedWindowProcessPath);
-                    if (QueryFullProcessImageName(
-                            hProcess, 0, resolvedWindowProcessPath, &dwSize)) {
-                        resolvedWindowProcessPathLen = dwSize;
-                    }
-
-                    CloseHandle(hProcess);
-                }
-            }
-
-            if (resolvedWindowProcessPathLen > 0) {
-                LCMapStringEx(
-                    LOCALE_NAME_USER_DEFAULT, LCMAP_UPPERCASE,
-                    resolvedWindowProcessPath, resolvedWindowProcessPathLen + 1,
-                    resolvedWindowProcessPathUpper,
-                    resolvedWindowProcessPathLen + 1, nullptr, nullptr, 0);
-            } else {
-                *resolvedWindowProcessPath = L'\0';
-                *resolvedWindowProcessPathUpper = L'\0';
-            }
+            std::wstring processPathUpper =
+                g_windowIdentityCache.GetProcessPathUpper(hWnd);
 
             bool excluded = false;
 
-            if (!excluded && resolvedWindowProcessPathLen > 0 &&
-                g_settings.excludedPrograms.contains(
-                    resolvedWindowProcessPathUpper)) {
+            if (!excluded && !processPathUpper.empty() &&
+                g_settings.excludedPrograms.contains(processPathUpper)) {
                 excluded = true;
             }
 
             if (!excluded) {
-                if (PCWSTR programFileNameUpper =
-                        wcsrchr(resolvedWindowProcessPathUpper, L'\\')) {
-                    programFileNameUpper++;
-                    if (*programFileNameUpper &&
-                        g_settings.excludedPrograms.contains(
-                            programFileNameUpper)) {
-                        excluded = true;
-                    }
+                size_t fileNamePos = processPathUpper.rfind(L'\\');
+                if (fileNamePos != std::wstring::npos &&
+                    fileNamePos + 1 < processPathUpper.length() &&
+                    g_settings.excludedPrograms.contains(
+                        processPathUpper.substr(fileNamePos + 1))) {
+                    excluded = true;
                 }
             }
 
-            if (!excluded) {
-                std::wstring appId = GetWindowAppId(hWnd);
-                LCMapStringEx(LOCALE_NAME_USER_DEFAULT, LCMAP_UPPERCASE,
-                              appId.data(), appId.length(), appId.data(),
-                              appId.length(), nullptr, nullptr, 0);
-                if (g_settings.excludedPrograms.contains(appId.c_str())) {
-                    excluded = true;
-                }
+            if (!excluded && g_settings.excludedPrograms.contains(
+                                 g_windowIdentityCache.GetAppIdUpper(hWnd))) {
+                excluded = true;
             }
 
             if (excluded) {
-                Wh_Log(L"Excluding %s", resolvedWindowProcessPath);
+                Wh_Log(L"Excluding %s", processPathUpper.c_str());
                 hideLabels = !hideLabels;
             }
         }
@@ -1885,6 +2032,384 @@ void ApplySettings() {
     }
 }
 
+// Identifies a module build. Cached symbol addresses and offsets are only
+// valid for the build they were resolved for.
+struct ModuleBuildId {
+    uint32_t machine;
+    uint32_t timeDateStamp;
+    uint32_t sizeOfImage;
+    uint32_t fileVersionMS;
+    uint32_t fileVersionLS;
+
+    bool operator==(const ModuleBuildId&) const = default;
+};
+
+// Symbol RVAs and derived offsets of a module build, keyed by name. The
+// serialized form is validated as a whole, so a partially written or corrupt
+// file is treated as missing.
+class SymbolCache {
+   public:
+    // Bump when the symbols or the offset calculations change.
+    static constexpr uint32_t kVersion = 2;
+
+    std::optional<uint32_t> Get(std::wstring_view name) const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto it = m_values.find(std::wstring(name));
+        if (it == m_values.end()) {
+            return std::nullopt;
+        }
+
+        return it->second;
+    }
+
+    void Set(std::wstring_view name, uint32_t value) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        auto [it, inserted] = m_values.try_emplace(std::wstring(name), value);
+        if (inserted || it->second != value) {
+            it->second = value;
+            m_dirty = true;
+        }
+    }
+
+    bool IsDirty() const {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_dirty;
+    }
+
+    std::vector<BYTE> Serialize(const ModuleBuildId& buildId) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        std::vector<BYTE> entries;
+        auto write = [&entries](const void* data, size_t size) {
+            const BYTE* p = static_cast<const BYTE*>(data);
+            entries.insert(entries.end(), p, p + size);
+        };
+
+        for (const auto& [name, value] : m_values) {
+            uint32_t nameLength = static_cast<uint32_t>(name.size());
+            write(&value, sizeof(value));
+            write(&nameLength, sizeof(nameLength));
+            write(name.data(), nameLength * sizeof(WCHAR));
+        }
+
+        Header header{
+            .magic = kMagic,
+            .version = kVersion,
+            .buildId = buildId,
+            .entryCount = static_cast<uint32_t>(m_values.size()),
+            .entriesSize = static_cast<uint32_t>(entries.size()),
+            .entriesChecksum = Checksum(entries.data(), entries.size()),
+        };
+
+        std::vector<BYTE> buffer(sizeof(header) + entries.size());
+        memcpy(buffer.data(), &header, sizeof(header));
+        std::copy(entries.begin(), entries.end(),
+                  buffer.begin() + sizeof(header));
+
+        m_dirty = false;
+        return buffer;
+    }
+
+    // Replaces the values with the serialized ones if they're valid and were
+    // created for the given build.
+    bool Parse(const BYTE* data, size_t size, const ModuleBuildId& buildId) {
+        Header header;
+        if (size < sizeof(header)) {
+            return false;
+        }
+
+        memcpy(&header, data, sizeof(header));
+        if (header.magic != kMagic || header.version != kVersion ||
+            header.buildId != buildId ||
+            header.entriesSize != size - sizeof(header)) {
+            return false;
+        }
+
+        const BYTE* p = data + sizeof(header);
+        const BYTE* end = p + header.entriesSize;
+        if (Checksum(p, header.entriesSize) != header.entriesChecksum) {
+            return false;
+        }
+
+        std::unordered_map<std::wstring, uint32_t> values;
+        for (uint32_t i = 0; i < header.entryCount; i++) {
+            uint32_t value;
+            uint32_t nameLength;
+            if (static_cast<size_t>(end - p) <
+                sizeof(value) + sizeof(nameLength)) {
+                return false;
+            }
+
+            memcpy(&value, p, sizeof(value));
+            p += sizeof(value);
+            memcpy(&nameLength, p, sizeof(nameLength));
+            p += sizeof(nameLength);
+
+            if (nameLength > static_cast<size_t>(end - p) / sizeof(WCHAR) ||
+                value >= buildId.sizeOfImage) {
+                return false;
+            }
+
+            std::wstring name(nameLength, L'\0');
+            memcpy(name.data(), p, nameLength * sizeof(WCHAR));
+            p += nameLength * sizeof(WCHAR);
+
+            values.insert_or_assign(std::move(name), value);
+        }
+
+        if (p != end) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_values = std::move(values);
+        m_dirty = false;
+        return true;
+    }
+
+   private:
+    static constexpr uint32_t kMagic = 0x43535748;  // "HWSC"
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        ModuleBuildId buildId;
+        uint32_t entryCount;
+        uint32_t entriesSize;
+        uint32_t entriesChecksum;
+    };
+
+    // FNV-1a.
+    static uint32_t Checksum(const BYTE* data, size_t size) {
+        uint32_t hash = 2166136261;
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ data[i]) * 16777619;
+        }
+
+        return hash;
+    }
+
+    mutable std::mutex m_mutex;
+    std::unordered_map<std::wstring, uint32_t> m_values;
+    bool m_dirty = false;
+};
+
+VS_FIXEDFILEINFO* GetModuleVersionInfo(HMODULE hModule, UINT* puPtrLen) {
+    void* pFixedFileInfo = nullptr;
+    UINT uPtrLen = 0;
+
+    HRSRC hResource =
+        FindResource(hModule, MAKEINTRESOURCE(VS_VERSION_INFO), RT_VERSION);
+    if (hResource) {
+        HGLOBAL hGlobal = LoadResource(hModule, hResource);
+        if (hGlobal) {
+            void* pData = LockResource(hGlobal);
+            if (pData) {
+                if (!VerQueryValue(pData, L"\\", &pFixedFileInfo, &uPtrLen) ||
+                    uPtrLen == 0) {
+                    pFixedFileInfo = nullptr;
+                    uPtrLen = 0;
+                }
+            }
+        }
+    }
+
+    if (puPtrLen) {
+        *puPtrLen = uPtrLen;
+    }
+
+    return (VS_FIXEDFILEINFO*)pFixedFileInfo;
+}
+
+std::optional<ModuleBuildId> GetModuleBuildId(HMODULE module) {
+    VS_FIXEDFILEINFO* fixedFileInfo = GetModuleVersionInfo(module, nullptr);
+    if (!fixedFileInfo) {
+        return std::nullopt;
+    }
+
+    auto* dosHeader = (IMAGE_DOS_HEADER*)module;
+    auto* ntHeaders = (IMAGE_NT_HEADERS*)((BYTE*)module + dosHeader->e_lfanew);
+
+    return ModuleBuildId{
+        .machine = ntHeaders->FileHeader.Machine,
+        .timeDateStamp = ntHeaders->FileHeader.TimeDateStamp,
+        .sizeOfImage = ntHeaders->OptionalHeader.SizeOfImage,
+        .fileVersionMS = fixedFileInfo->dwFileVersionMS,
+        .fileVersionLS = fixedFileInfo->dwFileVersionLS,
+    };
+}
+
+// The symbol cache of a loaded module, stored in the mod storage folder.
+class ModuleSymbolCache {
+   public:
+    void Load(HMODULE module) {
+        m_module = module;
+        m_buildId = GetModuleBuildId(module);
+        if (!m_buildId) {
+            Wh_Log(L"Symbol cache disabled, no version info");
+            return;
+        }
+
+        WCHAR storagePath[MAX_PATH];
+        WCHAR modulePath[MAX_PATH];
+        if (!Wh_GetModStoragePath(storagePath, ARRAYSIZE(storagePath)) ||
+            !GetModuleFileName(module, modulePath, ARRAYSIZE(modulePath))) {
+            Wh_Log(L"Symbol cache disabled, failed to get paths");
+            m_buildId.reset();
+            return;
+        }
+
+        PCWSTR moduleName = wcsrchr(modulePath, L'\\');
+        moduleName = moduleName ? moduleName + 1 : modulePath;
+
+        m_filePath = std::wstring(storagePath) + L"\\symbol-cache-" +
+                     moduleName + L".bin";
+
+        HANDLE file = CreateFile(m_filePath.c_str(), GENERIC_READ,
+                                 FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                                 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return;
+        }
+
+        std::vector<BYTE> buffer;
+        LARGE_INTEGER fileSize;
+        DWORD bytesRead = 0;
+        bool succeeded =
+            GetFileSizeEx(file, &fileSize) && fileSize.QuadPart <= 1024 * 1024;
+        if (succeeded) {
+            buffer.resize(static_cast<size_t>(fileSize.QuadPart));
+            succeeded = ReadFile(file, buffer.data(),
+                                 static_cast<DWORD>(buffer.size()), &bytesRead,
+                                 nullptr) &&
+                        bytesRead == buffer.size();
+        }
+
+        CloseHandle(file);
+
+        if (!succeeded ||
+            !m_cache.Parse(buffer.data(), buffer.size(), *m_buildId)) {
+            Wh_Log(L"Ignoring outdated or invalid symbol cache %s",
+                   m_filePath.c_str());
+        }
+    }
+
+    void SaveIfChanged() {
+        if (!m_buildId || !m_cache.IsDirty()) {
+            return;
+        }
+
+        std::vector<BYTE> buffer = m_cache.Serialize(*m_buildId);
+
+        std::wstring tempFilePath =
+            m_filePath + L"." + std::to_wstring(GetCurrentProcessId()) +
+            L".tmp";
+
+        HANDLE file =
+            CreateFile(tempFilePath.c_str(), GENERIC_WRITE, 0, nullptr,
+                       CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            Wh_Log(L"CreateFile failed: %u", GetLastError());
+            return;
+        }
+
+        DWORD written = 0;
+        bool succeeded =
+            WriteFile(file, buffer.data(), static_cast<DWORD>(buffer.size()),
+                      &written, nullptr) &&
+            written == buffer.size();
+        CloseHandle(file);
+
+        if (!succeeded || !MoveFileEx(tempFilePath.c_str(), m_filePath.c_str(),
+                                      MOVEFILE_REPLACE_EXISTING)) {
+            Wh_Log(L"Failed to write symbol cache: %u", GetLastError());
+            DeleteFile(tempFilePath.c_str());
+        }
+    }
+
+    // Like HookSymbols, but skips symbol resolution if all symbols are cached.
+    bool HookSymbols(WindhawkUtils::SYMBOL_HOOK* symbolHooks,
+                     size_t symbolHooksCount) {
+        std::vector<void*> addresses(symbolHooksCount);
+
+        bool cached = true;
+        for (size_t i = 0; i < symbolHooksCount; i++) {
+            auto rva = m_cache.Get(symbolHooks[i].symbols[0]);
+            if (!rva || (!*rva && !symbolHooks[i].optional)) {
+                cached = false;
+                break;
+            }
+
+            addresses[i] = *rva ? (BYTE*)m_module + *rva : nullptr;
+        }
+
+        if (cached) {
+            Wh_Log(L"Using cached symbols");
+        } else {
+            // Resolve the addresses only, and hook them below.
+            std::vector<WindhawkUtils::SYMBOL_HOOK> symbolLookups(
+                symbolHooks, symbolHooks + symbolHooksCount);
+            for (size_t i = 0; i < symbolHooksCount; i++) {
+                addresses[i] = nullptr;
+                symbolLookups[i].pOriginalFunction = &addresses[i];
+                symbolLookups[i].hookFunction = nullptr;
+            }
+
+            if (!WindhawkUtils::HookSymbols(m_module, symbolLookups.data(),
+                                            symbolHooksCount)) {
+                return false;
+            }
+
+            for (size_t i = 0; i < symbolHooksCount; i++) {
+                m_cache.Set(symbolHooks[i].symbols[0],
+                            addresses[i] ? (uint32_t)((BYTE*)addresses[i] -
+                                                      (BYTE*)m_module)
+                                         : 0);
+            }
+        }
+
+        for (size_t i = 0; i < symbolHooksCount; i++) {
+            if (!addresses[i]) {
+                continue;
+            }
+
+            if (symbolHooks[i].hookFunction) {
+                Wh_SetFunctionHook(addresses[i], symbolHooks[i].hookFunction,
+                                   symbolHooks[i].pOriginalFunction);
+            } else {
+                *symbolHooks[i].pOriginalFunction = addresses[i];
+            }
+        }
+
+        return true;
+    }
+
+    std::optional<uint32_t> GetOffset(PCWSTR name) {
+        auto offset = m_cache.Get(std::wstring(L"offset:") + name);
+        if (offset) {
+            Wh_Log(L"%s=0x%X (cached)", name, *offset);
+        }
+
+        return offset;
+    }
+
+    // Failed discoveries (0) aren't stored, so that they're retried on the
+    // next start instead of being used until the module changes.
+    void SetOffset(PCWSTR name, uint32_t offset) {
+        if (!offset) {
+            return;
+        }
+
+        m_cache.Set(std::wstring(L"offset:") + name, offset);
+    }
+
+   private:
+    HMODULE m_module = nullptr;
+    std::optional<ModuleBuildId> m_buildId;
+    std::wstring m_filePath;
+    SymbolCache m_cache;
+};
+
 bool HookTaskbarViewDllSymbols(HMODULE module) {
     // Taskbar.View.dll, ExplorerExtensions.dll
     WindhawkUtils::SYMBOL_HOOK symbolHooks[] =  //
@@ -1986,11 +2511,16 @@ bool HookTaskbarViewDllSymbols(HMODULE module) {
             },
         };
 
-    if (!HookSymbols(module, symbolHooks, ARRAYSIZE(symbolHooks))) {
+    ModuleSymbolCache symbolCache;
+    symbolCache.Load(module);
+
+    if (!symbolCache.HookSymbols(symbolHooks, ARRAYSIZE(symbolHooks))) {
         Wh_Log(L"HookSymbols failed");
         return false;
     }
 
+    symbolCache.SaveIfChanged();
+
     return true;
 }
 
@@ -2045,11 +2575,16 @@ bool HookTaskbarDllSymbols() {
         },
     };
 
-    if (!HookSymbols(module, taskbarDllHooks, ARRAYSIZE(taskbarDllHooks))) {
+    ModuleSymbolCache symbolCache;
+    symbolCache.Load(module);
+
+    if (!symbolCache.HookSymbols(taskbarDllHooks, ARRAYSIZE(taskbarDllHooks))) {
         Wh_Log(L"HookSymbols failed");
         return false;
     }
 
+    symbolCache.SaveIfChanged();
+
     return true;
 }
 
@@ -2104,11 +2639,16 @@ bool HookTaskbarDllSymbolsOldImplementation() {
         },
     };
 
-    if (!HookSymbols(module, taskbarDllHooks, ARRAYSIZE(taskbarDllHooks))) {
+    ModuleSymbolCache symbolCache;
+    symbolCache.Load(module);
+
+    if (!symbolCache.HookSymbols(taskbarDllHooks, ARRAYSIZE(taskbarDllHooks))) {
         Wh_Log(L"HookSymbols failed");
         return false;
     }
 
+    symbolCache.SaveIfChanged();
+
     return true;
 }
 
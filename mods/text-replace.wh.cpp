@@ -46,57 +46,232 @@ and usually doesn't work in custom ones.
 */
 // ==/WindhawkModSettings==
 
+#include <algorithm>
+#include <map>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <vector>
 
-struct ReplacementItem {
-    std::string searchA;
-    std::string replaceA;
-    std::wstring searchW;
-    std::wstring replaceW;
+// An Aho-Corasick automaton of the search strings of the replacement items,
+// used to find which items occur in a string with a single scan.
+template<typename T>
+class ReplacementMatcher
+{
+public:
+    void Build(const std::vector<std::basic_string<T>>& patterns)
+    {
+        struct BuildNode {
+            std::map<T, int> children;
+            std::vector<int> items;
+        };
+
+        std::vector<BuildNode> trie(1);
+        for (size_t i = 0; i < patterns.size(); i++) {
+            int node = 0;
+            for (T c : patterns[i]) {
+                auto [it, inserted] = trie[node].children.try_emplace(c, (int)trie.size());
+                node = it->second;
+                if (inserted) {
+                    trie.emplace_back();
+                }
+            }
+
+            trie[node].items.push_back((int)i);
+        }
+
+        m_nodes.assign(trie.size(), {});
+        m_edges.clear();
+        m_items.clear();
+
+        for (size_t i = 0; i < trie.size(); i++) {
+            m_nodes[i].firstEdge = (int)m_edges.size();
+            m_nodes[i].edgeCount = (int)trie[i].children.size();
+            for (const auto& [c, child] : trie[i].children) {
+                m_edges.push_back({c, child});
+            }
+
+            m_nodes[i].firstItem = (int)m_items.size();
+            m_nodes[i].itemCount = (int)trie[i].items.size();
+            m_items.insert(m_items.end(), trie[i].items.begin(), trie[i].items.end());
+        }
+
+        std::fill(std::begin(m_rootNext), std::end(m_rootNext), 0);
+        for (int e = 0; e < m_nodes[0].edgeCount; e++) {
+            auto c = (std::make_unsigned_t<T>)m_edges[e].c;
+            if (c < kRootTableSize) {
+                m_rootNext[c] = m_edges[e].next;
+            }
+        }
+
+        // Search strings are never empty, so the root doesn't end any items.
+        m_nodes[0].output = -1;
+
+        // Breadth-first, so that failure links always point to nodes which
+        // were already processed.
+        std::vector<int> queue{0};
+        for (size_t q = 0; q < queue.size(); q++) {
+            int node = queue[q];
+            Node& n = m_nodes[node];
+            if (node != 0) {
+                n.output = n.itemCount ? node : m_nodes[n.fail].output;
+            }
+
+            for (int e = n.firstEdge; e < n.firstEdge + n.edgeCount; e++) {
+                int child = m_edges[e].next;
+                m_nodes[child].fail = node == 0 ? 0 : Next(n.fail, m_edges[e].c);
+                queue.push_back(child);
+            }
+        }
+    }
+
+    // Returns the lowest item index which is at least minItem and whose search
+    // string occurs in str, or -1 if there's none.
+    int FindFirstItem(std::basic_string_view<T> str, int minItem) const
+    {
+        if (m_items.empty()) {
+            return -1;
+        }
+
+        int result = -1;
+        int node = 0;
+        for (T c : str) {
+            node = Next(node, c);
+
+            for (int output = m_nodes[node].output; output != -1; output = m_nodes[m_nodes[output].fail].output) {
+                const Node& n = m_nodes[output];
+                const int* itemsBegin = m_items.data() + n.firstItem;
+                const int* itemsEnd = itemsBegin + n.itemCount;
+                const int* item = std::lower_bound(itemsBegin, itemsEnd, minItem);
+                if (item != itemsEnd && (result == -1 || *item < result)) {
+                    result = *item;
+                    if (result == minItem) {
+                        return result;
+                    }
+                }
+            }
+        }
+
+        return result;
+    }
+
+private:
+    static constexpr size_t kRootTableSize = 128;
+
+    struct Node {
+        int firstEdge;
+        int edgeCount;
+        int firstItem;
+        int itemCount;
+        int fail;
+        // The node itself or the nearest node on its failure link chain which
+        // ends any items, or -1.
+        int output;
+    };
+
+    struct Edge {
+        T c;
+        int next;
+    };
+
+    int Next(int node, T c) const
+    {
+        while (true) {
+            if (node == 0 && (std::make_unsigned_t<T>)c < kRootTableSize) {
+                return m_rootNext[(std::make_unsigned_t<T>)c];
+            }
+
+            const Node& n = m_nodes[node];
+            const Edge* edgesBegin = m_edges.data() + n.firstEdge;
+            const Edge* edgesEnd = edgesBegin + n.edgeCount;
+            const Edge* edge = std::lower_bound(edgesBegin, edgesEnd, c,
+                [](const Edge& edge, T c) { return edge.c < c; });
+            if (edge != edgesEnd && edge->c == c) {
+                return edge->next;
+            }
+
+            if (node == 0) {
+                return 0;
+            }
+
+            node = n.fail;
+        }
+    }
+
+    std::vector<Node> m_nodes;
+    std::vector<Edge> m_edges;
+    std::vector<int> m_items;
+    int m_rootNext[kRootTableSize] = {};
 };
 
-std::vector<ReplacementItem> g_replacementItems;
+template<typename T>
+struct ReplacementRules {
+    std::vector<std::basic_string<T>> search;
+    std::vector<std::basic_string<T>> replace;
+    ReplacementMatcher<T> matcher;
+};
 
+ReplacementRules<char> g_replacementRulesA;
+ReplacementRules<WCHAR> g_replacementRulesW;
+
+// Replaces all occurrences of from, left to right, in linear time.
 template<typename T>
-T ReplaceAll(T str, const T& from, const T& to)
+void ReplaceAll(std::basic_string_view<T> str, std::basic_string_view<T> from, std::basic_string_view<T> to, std::basic_string<T>& result)
 {
-    size_t start_pos = 0;
-    while((start_pos = str.find(from, start_pos)) != T::npos) {
-        str.replace(start_pos, from.length(), to);
-        start_pos += to.length(); // Handles case where 'to' is a substring of 'from'
+    result.clear();
+
+    size_t pos = 0;
+    size_t matchPos;
+    while ((matchPos = str.find(from, pos)) != str.npos) {
+        result.append(str.data() + pos, matchPos - pos);
+        result.append(to);
+        pos = matchPos + from.length();
     }
-    return str;
+
+    result.append(str.data() + pos, str.length() - pos);
 }
 
-std::string ReplaceStringA(PCSTR string, size_t len = -1)
+// Applies the replacement items in order, each one to the result of the
+// previous ones. Returns nullopt without allocating if nothing is replaced,
+// which is by far the most common case.
+template<typename T>
+std::optional<std::basic_string<T>> ReplaceString(const ReplacementRules<T>& rules, std::basic_string_view<T> str)
 {
-    if (len == -1) {
-        len = strlen(string);
+    int item = rules.matcher.FindFirstItem(str, 0);
+    if (item == -1) {
+        return std::nullopt;
     }
 
-    std::string result(string, len);
+    std::basic_string<T> result;
+    ReplaceAll<T>(str, rules.search[item], rules.replace[item], result);
 
-    for (const auto& item : g_replacementItems) {
-        result = ReplaceAll<std::string>(std::move(result), item.searchA, item.replaceA);
+    // Items which didn't occur so far can still occur in the replaced string.
+    static thread_local std::basic_string<T> buffer;
+    while ((item = rules.matcher.FindFirstItem(result, item + 1)) != -1) {
+        ReplaceAll<T>(result, rules.search[item], rules.replace[item], buffer);
+        result.swap(buffer);
     }
 
     return result;
 }
 
-std::wstring ReplaceStringW(PCWSTR string, size_t len = -1)
+std::optional<std::string> ReplaceStringA(PCSTR string, size_t len = -1)
 {
     if (len == -1) {
-        len = wcslen(string);
+        len = strlen(string);
     }
 
-    std::wstring result(string, len);
+    return ReplaceString(g_replacementRulesA, std::string_view(string, len));
+}
 
-    for (const auto& item : g_replacementItems) {
-        result = ReplaceAll<std::wstring>(std::move(result), item.searchW, item.replaceW);
+std::optional<std::wstring> ReplaceStringW(PCWSTR string, size_t len = -1)
+{
+    if (len == -1) {
+        len = wcslen(string);
     }
 
-    return result;
+    return ReplaceString(g_replacementRulesW, std::wstring_view(string, len));
 }
 
 using SetWindowTextA_t = decltype(&SetWindowTextA);
@@ -104,8 +279,9 @@ SetWindowTextA_t pOriginalSetWindowTextA;
 BOOL WINAPI SetWindowTextAHook(HWND hWnd, LPCSTR lpString)
 {
     if (lpString) {
-        std::string str = ReplaceStringA(lpString);
-        return pOriginalSetWindowTextA(hWnd, str.c_str());
+        if (auto str = ReplaceStringA(lpString)) {
+            return pOriginalSetWindowTextA(hWnd, str->c_str());
+        }
     }
 
     return pOriginalSetWindowTextA(hWnd, lpString);
@@ -116,8 +292,9 @@ SetWindowTextW_t pOriginalSetWindowTextW;
 BOOL WINAPI SetWindowTextWHook(HWND hWnd, LPCWSTR lpString)
 {
     if (lpString) {
-        std::wstring str = ReplaceStringW(lpString);
-        return pOriginalSetWindowTextW(hWnd, str.c_str());
+        if (auto str = ReplaceStringW(lpString)) {
+            return pOriginalSetWindowTextW(hWnd, str->c_str());
+        }
     }
 
     return pOriginalSetWindowTextW(hWnd, lpString);
@@ -128,8 +305,9 @@ InsertMenuA_t pOriginalInsertMenuA;
 BOOL WINAPI InsertMenuAHook(HMENU hMenu,UINT uPosition,UINT uFlags,UINT_PTR uIDNewItem,LPCSTR lpNewItem)
 {
     if (!(uFlags & (MF_BITMAP | MF_OWNERDRAW)) && lpNewItem) {
-        std::string str = ReplaceStringA(lpNewItem);
-        return pOriginalInsertMenuA(hMenu,uPosition,uFlags,uIDNewItem,str.c_str());
+        if (auto str = ReplaceStringA(lpNewItem)) {
+            return pOriginalInsertMenuA(hMenu,uPosition,uFlags,uIDNewItem,str->c_str());
+        }
     }
 
     return pOriginalInsertMenuA(hMenu,uPosition,uFlags,uIDNewItem,lpNewItem);
@@ -140,8 +318,9 @@ InsertMenuW_t pOriginalInsertMenuW;
 BOOL WINAPI InsertMenuWHook(HMENU hMenu,UINT uPosition,UINT uFlags,UINT_PTR uIDNewItem,LPCWSTR lpNewItem)
 {
     if (!(uFlags & (MF_BITMAP | MF_OWNERDRAW)) && lpNewItem) {
-        std::wstring str = ReplaceStringW(lpNewItem);
-        return pOriginalInsertMenuW(hMenu,uPosition,uFlags,uIDNewItem,str.c_str());
+        if (auto str = ReplaceStringW(lpNewItem)) {
+            return pOriginalInsertMenuW(hMenu,uPosition,uFlags,uIDNewItem,str->c_str());
+        }
     }
 
     return pOriginalInsertMenuW(hMenu,uPosition,uFlags,uIDNewItem,lpNewItem);
@@ -152,8 +331,9 @@ AppendMenuA_t pOriginalAppendMenuA;
 BOOL WINAPI AppendMenuAHook(HMENU hMenu,UINT uFlags,UINT_PTR uIDNewItem,LPCSTR lpNewItem)
 {
     if (!(uFlags & (MF_BITMAP | MF_OWNERDRAW)) && lpNewItem) {
-        std::string str = ReplaceStringA(lpNewItem);
-        return pOriginalAppendMenuA(hMenu,uFlags,uIDNewItem,str.c_str());
+        if (auto str = ReplaceStringA(lpNewItem)) {
+            return pOriginalAppendMenuA(hMenu,uFlags,uIDNewItem,str->c_str());
+        }
     }
 
     return pOriginalAppendMenuA(hMenu,uFlags,uIDNewItem,lpNewItem);
@@ -164,8 +344,9 @@ AppendMenuW_t pOriginalAppendMenuW;
 BOOL WINAPI AppendMenuWHook(HMENU hMenu,UINT uFlags,UINT_PTR uIDNewItem,LPCWSTR lpNewItem)
 {
     if (!(uFlags & (MF_BITMAP | MF_OWNERDRAW)) && lpNewItem) {
-        std::wstring str = ReplaceStringW(lpNewItem);
-        return pOriginalAppendMenuW(hMenu,uFlags,uIDNewItem,str.c_str());
+        if (auto str = ReplaceStringW(lpNewItem)) {
+            return pOriginalAppendMenuW(hMenu,uFlags,uIDNewItem,str->c_str());
+        }
     }
 
     return pOriginalAppendMenuW(hMenu,uFlags,uIDNewItem,lpNewItem);
@@ -176,8 +357,9 @@ ModifyMenuA_t pOriginalModifyMenuA;
 BOOL WINAPI ModifyMenuAHook(HMENU hMenu,UINT uPosition,UINT uFlags,UINT_PTR uIDNewItem,LPCSTR lpNewItem)
 {
     if (!(uFlags & (MF_BITMAP | MF_OWNERDRAW)) && lpNewItem) {
-        std::string str = ReplaceStringA(lpNewItem);
-        return pOriginalModifyMenuA(hMenu,uPosition,uFlags,uIDNewItem,str.c_str());
+        if (auto str = ReplaceStringA(lpNewItem)) {
+            return pOriginalModifyMenuA(hMenu,uPosition,uFlags,uIDNewItem,str->c_str());
+        }
     }
 
     return pOriginalModifyMenuA(hMenu,uPosition,uFlags,uIDNewItem,lpNewItem);
@@ -188,8 +370,9 @@ ModifyMenuW_t pOriginalModifyMenuW;
 BOOL WINAPI ModifyMenuWHook(HMENU hMenu,UINT uPosition,UINT uFlags,UINT_PTR uIDNewItem,LPCWSTR lpNewItem)
 {
     if (!(uFlags & (MF_BITMAP | MF_OWNERDRAW)) && lpNewItem) {
-        std::wstring str = ReplaceStringW(lpNewItem);
-        return pOriginalModifyMenuW(hMenu,uPosition,uFlags,uIDNewItem,str.c_str());
+        if (auto str = ReplaceStringW(lpNewItem)) {
+            return pOriginalModifyMenuW(hMenu,uPosition,uFlags,uIDNewItem,str->c_str());
+        }
     }
 
     return pOriginalModifyMenuW(hMenu,uPosition,uFlags,uIDNewItem,lpNewItem);
@@ -203,10 +386,11 @@ BOOL WINAPI InsertMenuItemAHook(HMENU hmenu,UINT item,BOOL fByPosition,LPCMENUIT
         (lpmi->fMask & MIIM_STRING) ||
         ((lpmi->fMask & MIIM_TYPE) && (lpmi->fType & MFT_STRING))
     ) && lpmi->dwTypeData) {
-        std::string str = ReplaceStringA(lpmi->dwTypeData);
-        MENUITEMINFOA mi = *lpmi;
-        mi.dwTypeData = str.data();
-        return pOriginalInsertMenuItemA(hmenu,item,fByPosition,&mi);
+        if (auto str = ReplaceStringA(lpmi->dwTypeData)) {
+            MENUITEMINFOA mi = *lpmi;
+            mi.dwTypeData = str->data();
+            return pOriginalInsertMenuItemA(hmenu,item,fByPosition,&mi);
+        }
     }
 
     return pOriginalInsertMenuItemA(hmenu,item,fByPosition,lpmi);
@@ -220,10 +404,11 @@ BOOL WINAPI InsertMenuItemWHook(HMENU hmenu,UINT item,BOOL fByPosition,LPCMENUIT
         (lpmi->fMask & MIIM_STRING) ||
         ((lpmi->fMask & MIIM_TYPE) && (lpmi->fType & MFT_STRING))
     ) && lpmi->dwTypeData) {
-        std::wstring str = ReplaceStringW(lpmi->dwTypeData);
-        MENUITEMINFOW mi = *lpmi;
-        mi.dwTypeData = str.data();
-        return pOriginalInsertMenuItemW(hmenu,item,fByPosition,&mi);
+        if (auto str = ReplaceStringW(lpmi->dwTypeData)) {
+            MENUITEMINFOW mi = *lpmi;
+            mi.dwTypeData = str->data();
+            return pOriginalInsertMenuItemW(hmenu,item,fByPosition,&mi);
+        }
     }
 
     return pOriginalInsertMenuItemW(hmenu,item,fByPosition,lpmi);
@@ -237,10 +422,11 @@ BOOL WINAPI SetMenuItemInfoAHook(HMENU hmenu,UINT item,BOOL fByPosition,LPCMENUI
         (lpmi->fMask & MIIM_STRING) ||
         ((lpmi->fMask & MIIM_TYPE) && (lpmi->fType & MFT_STRING))
     ) && lpmi->dwTypeData) {
-        std::string str = ReplaceStringA(lpmi->dwTypeData);
-        MENUITEMINFOA mi = *lpmi;
-        mi.dwTypeData = str.data();
-        return pOriginalSetMenuItemInfoA(hmenu,item,fByPosition,&mi);
+        if (auto str = ReplaceStringA(lpmi->dwTypeData)) {
+            MENUITEMINFOA mi = *lpmi;
+            mi.dwTypeData = str->data();
+            return pOriginalSetMenuItemInfoA(hmenu,item,fByPosition,&mi);
+        }
     }
 
     return pOriginalSetMenuItemInfoA(hmenu,item,fByPosition,lpmi);
@@ -254,10 +440,11 @@ BOOL WINAPI SetMenuItemInfoWHook(HMENU hmenu,UINT item,BOOL fByPosition,LPCMENUI
         (lpmi->fMask & MIIM_STRING) ||
         ((lpmi->fMask & MIIM_TYPE) && (lpmi->fType & MFT_STRING))
     ) && lpmi->dwTypeData) {
-        std::wstring str = ReplaceStringW(lpmi->dwTypeData);
-        MENUITEMINFOW mi = *lpmi;
-        mi.dwTypeData = str.data();
-        return pOriginalSetMenuItemInfoW(hmenu,item,fByPosition,&mi);
+        if (auto str = ReplaceStringW(lpmi->dwTypeData)) {
+            MENUITEMINFOW mi = *lpmi;
+            mi.dwTypeData = str->data();
+            return pOriginalSetMenuItemInfoW(hmenu,item,fByPosition,&mi);
+        }
     }
 
     return pOriginalSetMenuItemInfoW(hmenu,item,fByPosition,lpmi);
@@ -268,8 +455,9 @@ TextOutA_t pOriginalTextOutA;
 BOOL WINAPI TextOutAHook(HDC hdc,int x,int y,LPCSTR lpString,int c)
 {
     if (lpString) {
-        std::string str = ReplaceStringA(lpString, c);
-        return pOriginalTextOutA(hdc,x,y,str.c_str(),str.length());
+        if (auto str = ReplaceStringA(lpString, c)) {
+            return pOriginalTextOutA(hdc,x,y,str->c_str(),str->length());
+        }
     }
 
     return pOriginalTextOutA(hdc,x,y,lpString,c);
@@ -280,8 +468,9 @@ TextOutW_t pOriginalTextOutW;
 BOOL WINAPI TextOutWHook(HDC hdc,int x,int y,LPCWSTR lpString,int c)
 {
     if (lpString) {
-        std::wstring str = ReplaceStringW(lpString, c);
-        return pOriginalTextOutW(hdc,x,y,str.c_str(),str.length());
+        if (auto str = ReplaceStringW(lpString, c)) {
+            return pOriginalTextOutW(hdc,x,y,str->c_str(),str->length());
+        }
     }
 
     return pOriginalTextOutW(hdc,x,y,lpString,c);
@@ -292,8 +481,9 @@ ExtTextOutA_t pOriginalExtTextOutA;
 BOOL WINAPI ExtTextOutAHook(HDC hdc,int x,int y,UINT options,CONST RECT *lprect,LPCSTR lpString,UINT c,CONST INT *lpDx)
 {
     if (!(options & ETO_GLYPH_INDEX) && lpString) {
-        std::string str = ReplaceStringA(lpString, c);
-        return pOriginalExtTextOutA(hdc,x,y,options,lprect,str.c_str(),str.length(),lpDx);
+        if (auto str = ReplaceStringA(lpString, c)) {
+            return pOriginalExtTextOutA(hdc,x,y,options,lprect,str->c_str(),str->length(),lpDx);
+        }
     }
 
     return pOriginalExtTextOutA(hdc,x,y,options,lprect,lpString,c,lpDx);
@@ -304,8 +494,9 @@ ExtTextOutW_t pOriginalExtTextOutW;
 BOOL WINAPI ExtTextOutWHook(HDC hdc,int x,int y,UINT options,CONST RECT *lprect,LPCWSTR lpString,UINT c,CONST INT *lpDx)
 {
     if (!(options & ETO_GLYPH_INDEX) && lpString) {
-        std::wstring str = ReplaceStringW(lpString, c);
-        return pOriginalExtTextOutW(hdc,x,y,options,lprect,str.c_str(),str.length(),lpDx);
+        if (auto str = ReplaceStringW(lpString, c)) {
+            return pOriginalExtTextOutW(hdc,x,y,options,lprect,str->c_str(),str->length(),lpDx);
+        }
     }
 
     return pOriginalExtTextOutW(hdc,x,y,options,lprect,lpString,c,lpDx);
@@ -316,12 +507,13 @@ DrawTextA_t pOriginalDrawTextA;
 int WINAPI DrawTextAHook(HDC hdc,LPCSTR lpchText,int cchText,LPRECT lprc,UINT format)
 {
     if (lpchText) {
-        std::string str = ReplaceStringA(lpchText, cchText);
-        int len = str.length();
-        if (format & DT_MODIFYSTRING) {
-            str.resize(len + 4);
+        if (auto str = ReplaceStringA(lpchText, cchText)) {
+            int len = str->length();
+            if (format & DT_MODIFYSTRING) {
+                str->resize(len + 4);
+            }
+            return pOriginalDrawTextA(hdc,str->c_str(),len,lprc,format);
         }
-        return pOriginalDrawTextA(hdc,str.c_str(),len,lprc,format);
     }
 
     return pOriginalDrawTextA(hdc,lpchText,cchText,lprc,format);
@@ -332,12 +524,13 @@ DrawTextW_t pOriginalDrawTextW;
 int WINAPI DrawTextWHook(HDC hdc,LPCWSTR lpchText,int cchText,LPRECT lprc,UINT format)
 {
     if (lpchText) {
-        std::wstring str = ReplaceStringW(lpchText, cchText);
-        int len = str.length();
-        if (format & DT_MODIFYSTRING) {
-            str.resize(len + 4);
+        if (auto str = ReplaceStringW(lpchText, cchText)) {
+            int len = str->length();
+            if (format & DT_MODIFYSTRING) {
+                str->resize(len + 4);
+            }
+            return pOriginalDrawTextW(hdc,str->c_str(),len,lprc,format);
         }
-        return pOriginalDrawTextW(hdc,str.c_str(),len,lprc,format);
     }
 
     return pOriginalDrawTextW(hdc,lpchText,cchText,lprc,format);
@@ -348,12 +541,13 @@ DrawTextExA_t pOriginalDrawTextExA;
 int WINAPI DrawTextExAHook(HDC hdc,LPSTR lpchText,int cchText,LPRECT lprc,UINT format,LPDRAWTEXTPARAMS lpdtp)
 {
     if (lpchText) {
-        std::string str = ReplaceStringA(lpchText, cchText);
-        int len = str.length();
-        if (format & DT_MODIFYSTRING) {
-            str.resize(len + 4);
+        if (auto str = ReplaceStringA(lpchText, cchText)) {
+            int len = str->length();
+            if (format & DT_MODIFYSTRING) {
+                str->resize(len + 4);
+            }
+            return pOriginalDrawTextExA(hdc,str->data(),len,lprc,format,lpdtp);
         }
-        return pOriginalDrawTextExA(hdc,str.data(),len,lprc,format,lpdtp);
     }
 
     return pOriginalDrawTextExA(hdc,lpchText,cchText,lprc,format,lpdtp);
@@ -364,12 +558,13 @@ DrawTextExW_t pOriginalDrawTextExW;
 int WINAPI DrawTextExWHook(HDC hdc,LPWSTR lpchText,int cchText,LPRECT lprc,UINT format,LPDRAWTEXTPARAMS lpdtp)
 {
     if (lpchText) {
-        std::wstring str = ReplaceStringW(lpchText, cchText);
-        int len = str.length();
-        if (format & DT_MODIFYSTRING) {
-            str.resize(len + 4);
+        if (auto str = ReplaceStringW(lpchText, cchText)) {
+            int len = str->length();
+            if (format & DT_MODIFYSTRING) {
+                str->resize(len + 4);
+            }
+            return pOriginalDrawTextExW(hdc,str->data(),len,lprc,format,lpdtp);
         }
-        return pOriginalDrawTextExW(hdc,str.data(),len,lprc,format,lpdtp);
     }
 
     return pOriginalDrawTextExW(hdc,lpchText,cchText,lprc,format,lpdtp);
@@ -380,8 +575,9 @@ CreateWindowExA_t pOriginalCreateWindowExA;
 HWND WINAPI CreateWindowExAHook(DWORD dwExStyle,LPCSTR lpClassName,LPCSTR lpWindowName,DWORD dwStyle,int X,int Y,int nWidth,int nHeight,HWND hWndParent,HMENU hMenu,HINSTANCE hInstance,LPVOID lpParam)
 {
     if (lpWindowName) {
-        std::string str = ReplaceStringA(lpWindowName);
-        return pOriginalCreateWindowExA(dwExStyle,lpClassName,str.c_str(),dwStyle,X,Y,nWidth,nHeight,hWndParent,hMenu,hInstance,lpParam);
+        if (auto str = ReplaceStringA(lpWindowName)) {
+            return pOriginalCreateWindowExA(dwExStyle,lpClassName,str->c_str(),dwStyle,X,Y,nWidth,nHeight,hWndParent,hMenu,hInstance,lpParam);
+        }
     }
 
     return pOriginalCreateWindowExA(dwExStyle,lpClassName,lpWindowName,dwStyle,X,Y,nWidth,nHeight,hWndParent,hMenu,hInstance,lpParam);
@@ -392,8 +588,9 @@ CreateWindowExW_t pOriginalCreateWindowExW;
 HWND WINAPI CreateWindowExWHook(DWORD dwExStyle,LPCWSTR lpClassName,LPCWSTR lpWindowName,DWORD dwStyle,int X,int Y,int nWidth,int nHeight,HWND hWndParent,HMENU hMenu,HINSTANCE hInstance,LPVOID lpParam)
 {
     if (lpWindowName) {
-        std::wstring str = ReplaceStringW(lpWindowName);
-        return pOriginalCreateWindowExW(dwExStyle,lpClassName,str.c_str(),dwStyle,X,Y,nWidth,nHeight,hWndParent,hMenu,hInstance,lpParam);
+        if (auto str = ReplaceStringW(lpWindowName)) {
+            return pOriginalCreateWindowExW(dwExStyle,lpClassName,str->c_str(),dwStyle,X,Y,nWidth,nHeight,hWndParent,hMenu,hInstance,lpParam);
+        }
     }
 
     return pOriginalCreateWindowExW(dwExStyle,lpClassName,lpWindowName,dwStyle,X,Y,nWidth,nHeight,hWndParent,hMenu,hInstance,lpParam);
@@ -404,8 +601,9 @@ SendMessageA_t pOriginalSendMessageA;
 LRESULT WINAPI SendMessageAHook(HWND hWnd,UINT Msg,WPARAM wParam,LPARAM lParam)
 {
     if (Msg == WM_SETTEXT && lParam) {
-        std::string str = ReplaceStringA((PCSTR)lParam);
-        return pOriginalSendMessageA(hWnd,Msg,wParam,(LPARAM)str.c_str());
+        if (auto str = ReplaceStringA((PCSTR)lParam)) {
+            return pOriginalSendMessageA(hWnd,Msg,wParam,(LPARAM)str->c_str());
+        }
     }
 
     return pOriginalSendMessageA(hWnd,Msg,wParam,lParam);
@@ -416,8 +614,9 @@ SendMessageW_t pOriginalSendMessageW;
 LRESULT WINAPI SendMessageWHook(HWND hWnd,UINT Msg,WPARAM wParam,LPARAM lParam)
 {
     if (Msg == WM_SETTEXT && lParam) {
-        std::wstring str = ReplaceStringW((PCWSTR)lParam);
-        return pOriginalSendMessageW(hWnd,Msg,wParam,(LPARAM)str.c_str());
+        if (auto str = ReplaceStringW((PCWSTR)lParam)) {
+            return pOriginalSendMessageW(hWnd,Msg,wParam,(LPARAM)str->c_str());
+        }
     }
 
     return pOriginalSendMessageW(hWnd,Msg,wParam,lParam);
@@ -425,7 +624,8 @@ LRESULT WINAPI SendMessageWHook(HWND hWnd,UINT Msg,WPARAM wParam,LPARAM lParam)
 
 void LoadSettings()
 {
-    g_replacementItems.clear();
+    ReplacementRules<char> rulesA;
+    ReplacementRules<WCHAR> rulesW;
 
     WCHAR programPath[1024];
     DWORD dwSize = ARRAYSIZE(programPath);
@@ -466,17 +666,22 @@ void LoadSettings()
             PCWSTR replace = Wh_GetStringSetting(L"PerProgramConfig[%d].Replace", i);
 
             if (*search) {
-                g_replacementItems.push_back({
-                    std::string(search, search + wcslen(search)),
-                    std::string(replace, replace + wcslen(replace)),
-                    search, replace
-                });
+                rulesA.search.push_back(std::string(search, search + wcslen(search)));
+                rulesA.replace.push_back(std::string(replace, replace + wcslen(replace)));
+                rulesW.search.push_back(search);
+                rulesW.replace.push_back(replace);
             }
 
             Wh_FreeStringSetting(search);
             Wh_FreeStringSetting(replace);
         }
     }
+
+    rulesA.matcher.Build(rulesA.search);
+    rulesW.matcher.Build(rulesW.search);
+
+    g_replacementRulesA = std::move(rulesA);
+    g_replacementRulesW = std::move(rulesW);
 }
 
 BOOL Wh_ModInit(void)
@@ -69,9 +69,12 @@ No files are modified on disk - to revert all changes, disable the mod and resta
 
 #include <algorithm>
 #include <fstream>
+#include <iterator>
 #include <regex>
-#include <sstream>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 enum VSCODE_FILE {
     // Configurable with the mod.
@@ -154,48 +157,153 @@ std::string Base64Encode(const BYTE* data, size_t in_len)
     return ret;
 }
 
-// Calculates base64(md5(contents))
+// Writes a file while calculating base64(md5(contents)).
 // Based on: https://github.com/DownWithUp/SHA-ME
 // VSCode reference:
 // computeChecksum in build\gulpfile.vscode.js
-std::string FileHash(PCWSTR lpszFile)
+class HashingFileWriter
 {
-    HCRYPTPROV	hProv;
-    HCRYPTHASH	hHash;
-    HANDLE		hFile;
-    DWORD		dwBytesRead;
-    BYTE		bReadFile[0x512];
-    BYTE		bHash[16];
-    std::string ret;
-
-    hFile = CreateFile(lpszFile, FILE_READ_ACCESS, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
-    if (hFile == INVALID_HANDLE_VALUE) {
-        return ret;
+public:
+    HashingFileWriter() = default;
+    HashingFileWriter(const HashingFileWriter&) = delete;
+    HashingFileWriter& operator=(const HashingFileWriter&) = delete;
+
+    ~HashingFileWriter()
+    {
+        Close();
     }
-    if (!CryptAcquireContext(&hProv, NULL, NULL, PROV_RSA_AES, CRYPT_VERIFYCONTEXT)) {
-        CloseHandle(hFile);
-        return ret;
+
+    bool Open(PCWSTR filePath)
+    {
+        m_file = CreateFile(filePath, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        if (!CryptAcquireContext(&m_prov, nullptr, nullptr, PROV_RSA_AES, CRYPT_VERIFYCONTEXT)) {
+            m_prov = 0;
+            Close();
+            return false;
+        }
+
+        if (!CryptCreateHash(m_prov, CALG_MD5, 0, 0, &m_hash)) {
+            m_hash = 0;
+            Close();
+            return false;
+        }
+
+        m_failed = false;
+        return true;
+    }
+
+    void Write(std::string_view data)
+    {
+        while (!m_failed && !data.empty()) {
+            DWORD chunkSize = (DWORD)std::min(data.size(), (size_t)0x100000);
+            DWORD bytesWritten;
+            if (!WriteFile(m_file, data.data(), chunkSize, &bytesWritten, nullptr) ||
+                bytesWritten != chunkSize ||
+                !CryptHashData(m_hash, (const BYTE*)data.data(), chunkSize, 0)) {
+                m_failed = true;
+                break;
+            }
+
+            data.remove_prefix(chunkSize);
+        }
     }
-    if (!CryptCreateHash(hProv, CALG_MD5, 0, 0, &hHash)) {
-        CloseHandle(hFile);
-        CryptReleaseContext(hProv, 0);
+
+    // Closes the file and returns the hash, or an empty string on failure.
+    std::string Finish()
+    {
+        std::string ret;
+        BYTE hash[16];
+        DWORD hashSize = sizeof(hash);
+        if (!m_failed && CryptGetHashParam(m_hash, HP_HASHVAL, hash, &hashSize, 0)) {
+            ret = Base64Encode(hash, sizeof(hash));
+        }
+
+        Close();
         return ret;
     }
-    while (ReadFile(hFile, bReadFile, sizeof(bReadFile), &dwBytesRead, NULL)) {
-        if (dwBytesRead == 0) {
-            break; // End of file
+
+private:
+    void Close()
+    {
+        if (m_hash) {
+            CryptDestroyHash(m_hash);
+            m_hash = 0;
+        }
+
+        if (m_prov) {
+            CryptReleaseContext(m_prov, 0);
+            m_prov = 0;
         }
-        CryptHashData(hHash, bReadFile, dwBytesRead, 0);
+
+        if (m_file != INVALID_HANDLE_VALUE) {
+            CloseHandle(m_file);
+            m_file = INVALID_HANDLE_VALUE;
+        }
+
+        m_failed = true;
     }
-    dwBytesRead = sizeof(bHash); // Repurpose variable
-    if (CryptGetHashParam(hHash, HP_HASHVAL, bHash, &dwBytesRead, 0)) {
-        ret = Base64Encode(bHash, sizeof(bHash));
+
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HCRYPTPROV m_prov = 0;
+    HCRYPTHASH m_hash = 0;
+    bool m_failed = true;
+};
+
+// A read-only view of a whole file.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+        if (m_data) {
+            UnmapViewOfFile(m_data);
+        }
+    }
+
+    bool Open(PCWSTR filePath)
+    {
+        HANDLE file = CreateFile(filePath, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+
+        LARGE_INTEGER size;
+        bool succeeded = GetFileSizeEx(file, &size) && (ULONGLONG)size.QuadPart <= SIZE_MAX;
+        if (succeeded && size.QuadPart > 0) {
+            // Empty files can't be mapped, they're represented by an empty view.
+            HANDLE mapping = CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping) {
+                m_data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                CloseHandle(mapping);
+            }
+
+            succeeded = m_data != nullptr;
+            if (succeeded) {
+                m_size = (size_t)size.QuadPart;
+            }
+        }
+
+        CloseHandle(file);
+        return succeeded;
+    }
+
+    std::string_view Contents() const
+    {
+        return std::string_view(m_data, m_size);
     }
-    CryptReleaseContext(hProv, 0);
-    CryptDestroyHash(hHash);
-    CloseHandle(hFile);
-    return ret;
-}
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+};
 
 using CreateFileW_t = decltype(&CreateFileW);
 CreateFileW_t pOriginalCreateFileW;
@@ -278,7 +386,7 @@ void GetInitialTempFileName(WCHAR tempFileName[MAX_PATH])
     GetTempFileName(tempPath, L"vst", 0, tempFileName);
 }
 
-void RenameToFinalTempFileName(WCHAR tempFileName[MAX_PATH], const std::string& fileHash, WCHAR finalTempFileName[MAX_PATH])
+void GetFinalTempFileName(const std::string& fileHash, WCHAR finalTempFileName[MAX_PATH])
 {
     std::wstring fileName = std::wstring(fileHash.begin(), fileHash.end());
     std::replace(fileName.begin(), fileName.end(), L'+', L'-');
@@ -286,6 +394,11 @@ void RenameToFinalTempFileName(WCHAR tempFileName[MAX_PATH], const std::string&
 
     GetModTempPath(finalTempFileName);
     PathAppend(finalTempFileName, fileName.c_str());
+}
+
+void RenameToFinalTempFileName(WCHAR tempFileName[MAX_PATH], const std::string& fileHash, WCHAR finalTempFileName[MAX_PATH])
+{
+    GetFinalTempFileName(fileHash, finalTempFileName);
 
     if (GetFileAttributes(finalTempFileName) == INVALID_FILE_ATTRIBUTES) {
         MoveFile(tempFileName, finalTempFileName);
@@ -314,8 +427,66 @@ std::string wide_string_to_string(PCWSTR wide_string)
     return result;
 }
 
-std::string MakeReplacementsInCode(std::string code, PCWSTR fileType)
+struct CodeReplacement
 {
+    std::string search;
+    std::string replace;
+    std::regex regex;
+    // Set if the search pattern matches only itself and the replacement has
+    // no '$' references, so that plain string search can be used instead of
+    // the regex engine.
+    bool literal;
+    // Text every match starts with, used to skip the regex engine at
+    // positions where a match can't start. Empty if unknown.
+    std::string literalPrefix;
+};
+
+// Returns the literal text that every match of the ECMAScript pattern starts
+// with, and whether the pattern matches only that text. Only plain characters
+// and escaped punctuation are taken into account.
+std::string GetRegexLiteralPrefix(const std::string& pattern, bool* wholePattern)
+{
+    std::string prefix;
+    size_t i = 0;
+    while (i < pattern.length()) {
+        char c = pattern[i];
+        size_t charLength = 1;
+        if (c == '\\') {
+            if (i + 1 == pattern.length() || !ispunct((unsigned char)pattern[i + 1])) {
+                break;
+            }
+
+            c = pattern[i + 1];
+            charLength = 2;
+        }
+        else if (c == '\0' || strchr("^$.|?*+()[]{}", c)) {
+            break;
+        }
+
+        // A quantified character isn't necessarily part of the match.
+        char next = i + charLength < pattern.length() ? pattern[i + charLength] : '\0';
+        if (next != '\0' && strchr("?*+{", next)) {
+            break;
+        }
+
+        prefix += c;
+        i += charLength;
+    }
+
+    *wholePattern = i == pattern.length();
+
+    // An alternative might not start with the prefix.
+    if (pattern.find('|') != std::string::npos) {
+        prefix.clear();
+    }
+
+    return prefix;
+}
+
+std::vector<CodeReplacement> GetCodeReplacements(PCWSTR fileType)
+{
+    std::vector<CodeReplacement> replacements;
+
     for (int i = 0; ; i++) {
         PCWSTR type = Wh_GetStringSetting(L"CodeSnippets[%d].Type", i);
         bool done = !*type;
@@ -347,17 +518,88 @@ std::string MakeReplacementsInCode(std::string code, PCWSTR fileType)
             continue;
         }
 
-        std::string search = searchReplace.substr(0, splitPos);
-        std::string replace = searchReplace.substr(splitPos + 2);
+        CodeReplacement replacement;
+        replacement.replace = searchReplace.substr(splitPos + 2);
+
+        std::string pattern = searchReplace.substr(0, splitPos);
+        bool wholePattern;
+        std::string prefix = GetRegexLiteralPrefix(pattern, &wholePattern);
+
+        if (wholePattern && !prefix.empty() &&
+            replacement.replace.find('$') == std::string::npos) {
+            replacement.search = std::move(prefix);
+            replacement.literal = true;
+        }
+        else {
+            replacement.regex = std::regex(pattern);
+            replacement.literal = false;
+
+            // The prefix search restarts at each match, so the replacement
+            // can't refer to the text around the match.
+            if (replacement.replace.find("$`") == std::string::npos &&
+                replacement.replace.find("$'") == std::string::npos) {
+                replacement.literalPrefix = std::move(prefix);
+            }
+        }
+
+        replacements.push_back(std::move(replacement));
+    }
+
+    return replacements;
+}
+
+// Same as std::regex_replace, but avoids running the regex engine where
+// possible, which is slow on multi-megabyte bundles.
+std::string MakeReplacementInCode(std::string_view code, const CodeReplacement& replacement)
+{
+    std::string result;
+    result.reserve(code.length());
 
-        std::regex regex(search);
-        code = std::regex_replace(code, regex, replace);
+    if (!replacement.literal && replacement.literalPrefix.empty()) {
+        std::regex_replace(std::back_inserter(result), code.begin(), code.end(),
+            replacement.regex, replacement.replace);
+        return result;
     }
 
-    return code;
+    const std::string& search = replacement.literal ?
+        replacement.search : replacement.literalPrefix;
+
+    size_t copiedUntil = 0;
+    size_t searchFrom = 0;
+    size_t pos;
+    while ((pos = code.find(search, searchFrom)) != std::string_view::npos) {
+        size_t matchLength;
+        if (replacement.literal) {
+            result.append(code.substr(copiedUntil, pos - copiedUntil));
+            result.append(replacement.replace);
+            matchLength = search.length();
+        }
+        else {
+            auto flags = std::regex_constants::match_continuous;
+            if (pos > 0) {
+                flags |= std::regex_constants::match_prev_avail;
+            }
+
+            std::cmatch match;
+            if (!std::regex_search(code.data() + pos, code.data() + code.length(),
+                    match, replacement.regex, flags)) {
+                searchFrom = pos + 1;
+                continue;
+            }
+
+            result.append(code.substr(copiedUntil, pos - copiedUntil));
+            match.format(std::back_inserter(result), replacement.replace);
+            matchLength = match.length();
+        }
+
+        copiedUntil = searchFrom = pos + matchLength;
+    }
+
+    result.append(code.substr(copiedUntil));
+    return result;
 }
 
-void AppendModCodeToStream(std::ofstream& output, PCWSTR typeToAppend)
+void AppendModCodeToFile(HashingFileWriter& output, PCWSTR typeToAppend)
 {
     for (int i = 0; ; i++) {
         PCWSTR type = Wh_GetStringSetting(L"CodeSnippets[%d].Type", i);
@@ -380,14 +622,16 @@ void AppendModCodeToStream(std::ofstream& output, PCWSTR typeToAppend)
 
         PCWSTR code = Wh_GetStringSetting(L"CodeSnippets[%d].Code", i);
 
-        output << '\n';
+        output.Write("\n");
 
         if (fromFile) {
-            std::ifstream input(code);
-            output << input.rdbuf();
+            MappedFile input;
+            if (input.Open(code)) {
+                output.Write(input.Contents());
+            }
         }
         else if (fromInlineCode) {
-            output << wide_string_to_string(code);
+            output.Write(wide_string_to_string(code));
         }
 
         Wh_FreeStringSetting(code);
@@ -396,77 +640,392 @@ void AppendModCodeToStream(std::ofstream& output, PCWSTR typeToAppend)
 
 std::string CreateNewVscodeFile(PCWSTR fileType, WCHAR sourceFilePath[MAX_PATH], WCHAR targetFilePath[MAX_PATH])
 {
-    std::stringstream buffer;
-    {
-        std::ifstream input(sourceFilePath);
-        buffer << input.rdbuf();
+    MappedFile input;
+    if (!input.Open(sourceFilePath)) {
+        Wh_Log(L"Failed to read %s", sourceFilePath);
     }
 
     WCHAR tempFilePath[MAX_PATH];
     GetInitialTempFileName(tempFilePath);
 
-    {
-        std::ofstream output(tempFilePath);
-        output << MakeReplacementsInCode(buffer.str(), fileType);
-        AppendModCodeToStream(output, fileType);
+    HashingFileWriter output;
+    if (!output.Open(tempFilePath)) {
+        DeleteFile(tempFilePath);
+        return std::string();
+    }
+
+    std::vector<CodeReplacement> replacements = GetCodeReplacements(fileType);
+    if (replacements.empty()) {
+        output.Write(input.Contents());
+    }
+    else {
+        std::string code = MakeReplacementInCode(input.Contents(), replacements[0]);
+        for (size_t i = 1; i < replacements.size(); i++) {
+            code = MakeReplacementInCode(code, replacements[i]);
+        }
+
+        output.Write(code);
+    }
+
+    AppendModCodeToFile(output, fileType);
+
+    std::string fileHash = output.Finish();
+    if (fileHash.empty()) {
+        DeleteFile(tempFilePath);
+        return fileHash;
     }
 
-    std::string fileHash = FileHash(tempFilePath);
     RenameToFinalTempFileName(tempFilePath, fileHash, targetFilePath);
 
     return fileHash;
 }
 
+// Replaces the checksum in all occurrences of "path": "checksum".
+void ReplaceProductChecksum(std::string& content, std::string_view path, const std::string& newHash)
+{
+    auto isSpace = [](char c) { return c != '\0' && strchr(" \t\n\v\f\r", c); };
+    auto isBase64 = [](char c) { return isalnum((unsigned char)c) || c == '+' || c == '/'; };
+
+    std::string key = "\"" + std::string(path) + "\"";
+    size_t pos = 0;
+    while ((pos = content.find(key, pos)) != std::string::npos) {
+        pos += key.length();
+
+        size_t i = pos;
+        while (i < content.length() && isSpace(content[i])) {
+            i++;
+        }
+
+        if (i == content.length() || content[i] != ':') {
+            continue;
+        }
+
+        i++;
+        while (i < content.length() && isSpace(content[i])) {
+            i++;
+        }
+
+        if (i == content.length() || content[i] != '"') {
+            continue;
+        }
+
+        size_t hashStart = ++i;
+        while (i < content.length() && isBase64(content[i])) {
+            i++;
+        }
+
+        if (i == hashStart || i == content.length() || content[i] != '"') {
+            continue;
+        }
+
+        content.replace(hashStart, i - hashStart, newHash);
+        pos = hashStart + newHash.length() + 1;
+    }
+}
+
 std::string CreateNewProductFile(WCHAR sourceFilePath[MAX_PATH], WCHAR targetFilePath[MAX_PATH])
 {
-    std::stringstream buffer;
-    {
-        std::ifstream input(sourceFilePath);
-        buffer << input.rdbuf();
+    MappedFile input;
+    if (!input.Open(sourceFilePath)) {
+        Wh_Log(L"Failed to read %s", sourceFilePath);
     }
 
     struct {
-        std::string regexPath;
+        std::string_view path;
         std::string& newHash;
     } hashItems[] = {
         {
-            R"(vs/workbench/workbench\.desktop\.main\.js)",
+            "vs/workbench/workbench.desktop.main.js",
             g_vscodeFiles[VSCODE_FILE_JS].newFileHash
         },
         {
-            R"(vs/workbench/workbench\.desktop\.main\.css)",
+            "vs/workbench/workbench.desktop.main.css",
             g_vscodeFiles[VSCODE_FILE_CSS].newFileHash
         },
         {
-            R"(vs/code/electron-browser/workbench/workbench\.html)",
+            "vs/code/electron-browser/workbench/workbench.html",
             g_vscodeFiles[VSCODE_FILE_ELECTRON_WORKBENCH_HTML].newFileHash
         },
         {
-            R"(vs/code/electron-browser/workbench/workbench\.js)",
+            "vs/code/electron-browser/workbench/workbench.js",
             g_vscodeFiles[VSCODE_FILE_ELECTRON_WORKBENCH_JS].newFileHash
         },
     };
 
-    std::string newContent = buffer.str();
+    std::string newContent(input.Contents());
     for (const auto& item : hashItems) {
-        std::regex regex(R"((")" + item.regexPath + R"("\s*:\s*")[A-Za-z0-9+/]+("))");
-        newContent = std::regex_replace(newContent, regex, "$01" + item.newHash + "$02");
+        ReplaceProductChecksum(newContent, item.path, item.newHash);
     }
 
     WCHAR tempFilePath[MAX_PATH];
     GetInitialTempFileName(tempFilePath);
 
-    {
-        std::ofstream output(tempFilePath);
-        output << newContent;
+    HashingFileWriter output;
+    if (!output.Open(tempFilePath)) {
+        DeleteFile(tempFilePath);
+        return std::string();
+    }
+
+    output.Write(newContent);
+
+    std::string fileHash = output.Finish();
+    if (fileHash.empty()) {
+        DeleteFile(tempFilePath);
+        return fileHash;
     }
 
-    std::string fileHash = FileHash(tempFilePath);
     RenameToFinalTempFileName(tempFilePath, fileHash, targetFilePath);
 
     return fileHash;
 }
 
+// The patched files are kept in the mod's temp folder, named by their hash.
+// The manifest maps a key describing everything a patched file is derived
+// from (the source file and the snippets) to that hash, so that a warm start
+// doesn't have to read and patch the source files again.
+class PatchedFileManifest
+{
+public:
+    void Load(PCWSTR manifestPath)
+    {
+        m_entries.clear();
+
+        std::ifstream input(manifestPath, std::ios::binary);
+        std::string line;
+        if (!std::getline(input, line) || line != kHeader) {
+            return;
+        }
+
+        while (std::getline(input, line)) {
+            auto separatorPos = line.find(' ');
+            if (separatorPos == std::string::npos) {
+                continue;
+            }
+
+            Set(line.substr(0, separatorPos), line.substr(separatorPos + 1));
+        }
+    }
+
+    bool Save(PCWSTR manifestPath) const
+    {
+        WCHAR tempFilePath[MAX_PATH];
+        GetInitialTempFileName(tempFilePath);
+
+        {
+            std::ofstream output(tempFilePath, std::ios::binary);
+            output << kHeader << '\n';
+
+            // Keep only the most recently used entries.
+            size_t first = m_entries.size() > kMaxEntries ? m_entries.size() - kMaxEntries : 0;
+            for (size_t i = first; i < m_entries.size(); i++) {
+                output << m_entries[i].first << ' ' << m_entries[i].second << '\n';
+            }
+
+            if (!output.flush()) {
+                output.close();
+                DeleteFile(tempFilePath);
+                return false;
+            }
+        }
+
+        if (!MoveFileEx(tempFilePath, manifestPath, MOVEFILE_REPLACE_EXISTING)) {
+            DeleteFile(tempFilePath);
+            return false;
+        }
+
+        return true;
+    }
+
+    std::string Get(const std::string& key) const
+    {
+        for (const auto& entry : m_entries) {
+            if (entry.first == key) {
+                return entry.second;
+            }
+        }
+
+        return std::string();
+    }
+
+    void Set(const std::string& key, const std::string& fileHash)
+    {
+        m_entries.erase(
+            std::remove_if(m_entries.begin(), m_entries.end(),
+                [&key](const auto& entry) { return entry.first == key; }),
+            m_entries.end());
+        m_entries.emplace_back(key, fileHash);
+    }
+
+private:
+    static constexpr char kHeader[] = "vscode-tweaker-manifest 2";
+    static constexpr size_t kMaxEntries = 256;
+
+    std::vector<std::pair<std::string, std::string>> m_entries;
+};
+
+void AppendFileIdentityToKey(std::string& key, PCWSTR filePath)
+{
+    key += wide_string_to_string(filePath);
+    key += '\n';
+
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesEx(filePath, GetFileExInfoStandard, &data)) {
+        key += "-\n";
+        return;
+    }
+
+    ULONGLONG size = ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    ULONGLONG lastWriteTime = ((ULONGLONG)data.ftLastWriteTime.dwHighDateTime << 32) |
+        data.ftLastWriteTime.dwLowDateTime;
+
+    key += std::to_string(size);
+    key += ' ';
+    key += std::to_string(lastWriteTime);
+    key += '\n';
+}
+
+void AppendModCodeToKey(std::string& key, PCWSTR fileType)
+{
+    for (int i = 0; ; i++) {
+        PCWSTR type = Wh_GetStringSetting(L"CodeSnippets[%d].Type", i);
+        bool done = !*type;
+        bool typeMatch = !done && wcscmp(type, fileType) == 0;
+        Wh_FreeStringSetting(type);
+
+        if (done) {
+            break;
+        }
+
+        if (!typeMatch) {
+            continue;
+        }
+
+        PCWSTR source = Wh_GetStringSetting(L"CodeSnippets[%d].Source", i);
+        bool fromFile = wcscmp(source, L"file") == 0;
+        key += wide_string_to_string(source);
+        key += '\n';
+        Wh_FreeStringSetting(source);
+
+        PCWSTR code = Wh_GetStringSetting(L"CodeSnippets[%d].Code", i);
+        if (fromFile) {
+            AppendFileIdentityToKey(key, code);
+        }
+        else {
+            std::string codeString = wide_string_to_string(code);
+            key += std::to_string(codeString.length());
+            key += '\n';
+            key += codeString;
+            key += '\n';
+        }
+        Wh_FreeStringSetting(code);
+    }
+}
+
+// 64-bit FNV-1a, enough to tell apart the keys of a single installation.
+std::string KeyHash(const std::string& key)
+{
+    ULONGLONG hash = 0xCBF29CE484222325;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 0x100000001B3;
+    }
+
+    char hashString[17];
+    snprintf(hashString, sizeof(hashString), "%016llx", hash);
+    return hashString;
+}
+
+std::string GetPatchedFileKey(size_t fileIndex)
+{
+    std::string key;
+    AppendFileIdentityToKey(key, g_vscodeFiles[fileIndex].filePath);
+
+    if (fileIndex != VSCODE_FILE_PRODUCT_JSON) {
+        key += wide_string_to_string(g_vscodeFileTypes[fileIndex]);
+        key += '\n';
+        AppendModCodeToKey(key, g_vscodeFileTypes[fileIndex]);
+    }
+    else {
+        for (size_t i = 0; i < VSCODE_FILE_COUNT; i++) {
+            if (i != VSCODE_FILE_PRODUCT_JSON) {
+                key += g_vscodeFiles[i].newFileHash;
+                key += '\n';
+            }
+        }
+    }
+
+    return KeyHash(key);
+}
+
+// Fills in the patched file of each VSCode file from the manifest. If build is
+// true, missing patched files are created and added to the manifest, otherwise
+// the function returns false on the first missing file.
+bool ResolvePatchedFiles(PatchedFileManifest& manifest, bool build)
+{
+    for (size_t i = 0; i < VSCODE_FILE_COUNT; i++) {
+        // Must be resolved last, the key depends on the other hashes.
+        static_assert(VSCODE_FILE_PRODUCT_JSON == VSCODE_FILE_COUNT - 1);
+
+        auto& file = g_vscodeFiles[i];
+        std::string key = GetPatchedFileKey(i);
+
+        std::string fileHash = manifest.Get(key);
+        if (!fileHash.empty()) {
+            GetFinalTempFileName(fileHash, file.newFilePath);
+            if (GetFileAttributes(file.newFilePath) != INVALID_FILE_ATTRIBUTES) {
+                file.newFileHash = fileHash;
+                continue;
+            }
+        }
+
+        if (!build) {
+            return false;
+        }
+
+        if (i != VSCODE_FILE_PRODUCT_JSON) {
+            fileHash = CreateNewVscodeFile(g_vscodeFileTypes[i], file.filePath, file.newFilePath);
+        }
+        else {
+            fileHash = CreateNewProductFile(file.filePath, file.newFilePath);
+        }
+
+        file.newFileHash = fileHash;
+        if (!fileHash.empty()) {
+            manifest.Set(key, fileHash);
+        }
+    }
+
+    return true;
+}
+
+// Serializes building the patched files between VSCode processes, which are
+// usually launched together. Building without the lock is still safe, just
+// redundant.
+HANDLE LockPatchedFiles()
+{
+    HANDLE mutex = CreateMutex(nullptr, FALSE, L"Local\\windhawk-vscode-tweaker-patched-files");
+    if (!mutex) {
+        return nullptr;
+    }
+
+    DWORD waitResult = WaitForSingleObject(mutex, 60 * 1000);
+    if (waitResult != WAIT_OBJECT_0 && waitResult != WAIT_ABANDONED) {
+        Wh_Log(L"Failed to acquire lock: %u", waitResult);
+        CloseHandle(mutex);
+        return nullptr;
+    }
+
+    return mutex;
+}
+
+void UnlockPatchedFiles(HANDLE mutex)
+{
+    if (mutex) {
+        ReleaseMutex(mutex);
+        CloseHandle(mutex);
+    }
+}
+
 BOOL Wh_ModInit(void)
 {
     Wh_Log(L"Init");
@@ -477,16 +1036,30 @@ BOOL Wh_ModInit(void)
 
     for (size_t i = 0; i < VSCODE_FILE_COUNT; i++) {
         PathCombine(g_vscodeFiles[i].filePath, modulePath, g_vscodeFilePaths[i]);
+    }
 
-        if (i != VSCODE_FILE_PRODUCT_JSON) {
-            g_vscodeFiles[i].newFileHash = CreateNewVscodeFile(
-                g_vscodeFileTypes[i], g_vscodeFiles[i].filePath, g_vscodeFiles[i].newFilePath);
-        }
+    WCHAR manifestPath[MAX_PATH];
+    GetModTempPath(manifestPath);
+    PathAppend(manifestPath, L"manifest.txt");
+
+    PatchedFileManifest manifest;
+    manifest.Load(manifestPath);
+
+    if (ResolvePatchedFiles(manifest, false)) {
+        Wh_Log(L"Using cached patched files");
     }
+    else {
+        HANDLE lock = LockPatchedFiles();
 
-    CreateNewProductFile(
-        g_vscodeFiles[VSCODE_FILE_PRODUCT_JSON].filePath,
-        g_vscodeFiles[VSCODE_FILE_PRODUCT_JSON].newFilePath);
+        // Another process might have created the files while we were waiting.
+        manifest.Load(manifestPath);
+        ResolvePatchedFiles(manifest, true);
+        if (!manifest.Save(manifestPath)) {
+            Wh_Log(L"Failed to save manifest");
+        }
+
+        UnlockPatchedFiles(lock);
+    }
 
     Wh_SetFunctionHook((void*)CreateFileW, (void*)CreateFileWHook, (void**)&pOriginalCreateFileW);
     Wh_SetFunctionHook((void*)GetFileAttributesExW, (void*)GetFileAttributesExWHook, (void**)&pOriginalGetFileAttributesExW);
@@ -2094,6 +2094,36 @@ struct ElementCustomizationRules {
 thread_local std::vector<ElementCustomizationRules>
     g_elementsCustomizationRules;
 
+struct TransparentStringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::wstring_view s) const noexcept {
+        return std::hash<std::wstring_view>{}(s);
+    }
+};
+
+template <typename T>
+using StringMap =
+    std::unordered_map<std::wstring, T, TransparentStringHash, std::equal_to<>>;
+
+// Indices into g_elementsCustomizationRules, in ascending order.
+using ElementCustomizationRuleIndices = std::vector<size_t>;
+
+struct ElementCustomizationRulesForType {
+    ElementCustomizationRuleIndices anyName;
+    StringMap<ElementCustomizationRuleIndices> byName;
+};
+
+// Allows to only test the rules that can match an element's type and name
+// instead of testing all rules for each element.
+struct ElementCustomizationRulesIndex {
+    StringMap<ElementCustomizationRulesForType> byType;
+    // Rules without a target type, tested for all elements.
+    ElementCustomizationRuleIndices anyType;
+};
+
+thread_local ElementCustomizationRulesIndex g_elementsCustomizationRulesIndex;
+
 struct ElementPropertyCustomizationState {
     std::optional<winrt::Windows::Foundation::IInspectable> originalValue;
     std::optional<PropertyOverrideValue> customValue;
@@ -3320,8 +3350,11 @@ std::optional<PropertyOverrideValue> ParseNonXamlPropertyOverrideValue(
     };
 }
 
-Style GetStyleFromXamlSetters(const std::wstring_view type,
-                              const std::wstring_view xamlStyleSetters) {
+// Returns a resource dictionary with a style for each of the given setter
+// lists. The styles are keyed by their index.
+std::wstring GetXamlResourceDictionary(
+    const std::wstring_view type,
+    const std::vector<std::wstring>& xamlStylesSetters) {
     std::wstring xaml =
         LR"(<ResourceDictionary
     xmlns="http://schemas.microsoft.com/winfx/2006/xaml/presentation"
@@ -3330,30 +3363,45 @@ Style GetStyleFromXamlSetters(const std::wstring_view type,
     xmlns:mc="http://schemas.openxmlformats.org/markup-compatibility/2006"
     xmlns:muxc="using:Microsoft.UI.Xaml.Controls")";
 
+    std::wstring styleTargetType;
     if (auto pos = type.rfind('.'); pos != type.npos) {
         auto typeNamespace = std::wstring_view(type).substr(0, pos);
         auto typeName = std::wstring_view(type).substr(pos + 1);
 
         xaml += L"\n    xmlns:windhawkstyler=\"using:";
         xaml += EscapeXmlAttribute(typeNamespace);
-        xaml +=
-            L"\">\n"
-            L"    <Style TargetType=\"windhawkstyler:";
-        xaml += EscapeXmlAttribute(typeName);
         xaml += L"\">\n";
+
+        styleTargetType = L"windhawkstyler:";
+        styleTargetType += EscapeXmlAttribute(typeName);
     } else {
-        xaml +=
-            L">\n"
-            L"    <Style TargetType=\"";
-        xaml += EscapeXmlAttribute(type);
+        xaml += L">\n";
+
+        styleTargetType = EscapeXmlAttribute(type);
+    }
+
+    for (size_t i = 0; i < xamlStylesSetters.size(); i++) {
+        xaml += L"    <Style x:Key=\"";
+        xaml += std::to_wstring(i);
+        xaml += L"\" TargetType=\"";
+        xaml += styleTargetType;
         xaml += L"\">\n";
+        xaml += xamlStylesSetters[i];
+        xaml += L"    </Style>\n";
     }
 
-    xaml += xamlStyleSetters;
+    xaml += L"</ResourceDictionary>";
 
-    xaml +=
-        L"    </Style>\n"
-        L"</ResourceDictionary>";
+    return xaml;
+}
+
+// Number of XamlReader::Load calls for parsing styles, logged for diagnostics.
+thread_local int g_xamlReaderLoadCount;
+
+std::vector<Style> GetStylesFromXamlSetters(
+    const std::wstring_view type,
+    const std::vector<std::wstring>& xamlStylesSetters) {
+    std::wstring xaml = GetXamlResourceDictionary(type, xamlStylesSetters);
 
     Wh_Log(L"======================================== XAML:");
     std::wstringstream ss(xaml);
@@ -3363,11 +3411,28 @@ Style GetStyleFromXamlSetters(const std::wstring_view type,
     }
     Wh_Log(L"========================================");
 
+    g_xamlReaderLoadCount++;
+    Wh_Log(L"XamlReader::Load call #%d, %zu styles", g_xamlReaderLoadCount,
+           xamlStylesSetters.size());
+
     auto resourceDictionary =
         Markup::XamlReader::Load(xaml).as<ResourceDictionary>();
 
-    auto [styleKey, styleInspectable] = resourceDictionary.First().Current();
-    return styleInspectable.as<Style>();
+    std::vector<Style> styles;
+    styles.reserve(xamlStylesSetters.size());
+    for (size_t i = 0; i < xamlStylesSetters.size(); i++) {
+        styles.push_back(
+            resourceDictionary
+                .Lookup(winrt::box_value(winrt::hstring(std::to_wstring(i))))
+                .as<Style>());
+    }
+
+    return styles;
+}
+
+Style GetStyleFromXamlSetters(const std::wstring_view type,
+                              const std::wstring_view xamlStyleSetters) {
+    return GetStylesFromXamlSetters(type, {std::wstring(xamlStyleSetters)})[0];
 }
 
 Style GetStyleFromXamlSettersWithFallbackType(
@@ -3397,6 +3462,230 @@ Style GetStyleFromXamlSettersWithFallbackType(
     }
 }
 
+using NonXamlPropertyOverrideValues =
+    std::vector<std::optional<PropertyOverrideValue>>;
+
+NonXamlPropertyOverrideValues ParseNonXamlPropertyOverrideValues(
+    const PropertyOverridesUnresolved& styleRules) {
+    NonXamlPropertyOverrideValues propertyOverrideValues;
+    propertyOverrideValues.reserve(styleRules.size());
+
+    for (const auto& rule : styleRules) {
+        propertyOverrideValues.push_back(
+            rule.isXamlValue ? ParseNonXamlPropertyOverrideValue(rule.value)
+                             : std::nullopt);
+    }
+
+    return propertyOverrideValues;
+}
+
+std::wstring GetXamlSettersFromStyleRules(
+    const PropertyOverridesUnresolved& styleRules,
+    const NonXamlPropertyOverrideValues& propertyOverrideValues) {
+    std::wstring xaml;
+
+    for (size_t i = 0; i < styleRules.size(); i++) {
+        const auto& rule = styleRules[i];
+
+        xaml += L"        <Setter Property=\"";
+        xaml += EscapeXmlAttribute(rule.name);
+        xaml += L"\"";
+        if (propertyOverrideValues[i] ||
+            (rule.isXamlValue && rule.value.empty())) {
+            xaml += L" Value=\"{x:Null}\" />\n";
+        } else if (!rule.isXamlValue) {
+            xaml += L" Value=\"";
+            xaml += EscapeXmlAttribute(rule.value);
+            xaml += L"\" />\n";
+        } else {
+            xaml +=
+                L">\n"
+                L"            <Setter.Value>\n";
+            xaml += rule.value;
+            xaml +=
+                L"\n"
+                L"            </Setter.Value>\n"
+                L"        </Setter>\n";
+        }
+    }
+
+    return xaml;
+}
+
+PropertyOverrides GetPropertyOverridesFromStyle(
+    Style style,
+    const PropertyOverridesUnresolved& styleRules,
+    const NonXamlPropertyOverrideValues& propertyOverrideValues) {
+    PropertyOverrides propertyOverrides;
+
+    uint32_t i = 0;
+    for (const auto& rule : styleRules) {
+        const auto setter = style.Setters().GetAt(i).as<Setter>();
+        propertyOverrides[setter.Property()][rule.visualState] =
+            propertyOverrideValues[i].value_or(
+                rule.isXamlValue && rule.value.empty()
+                    ? DependencyProperty::UnsetValue()
+                    : setter.Value());
+        i++;
+    }
+
+    return propertyOverrides;
+}
+
+std::wstring GetXamlSettersFromPropertyValues(
+    const PropertyValuesUnresolved& propertyValuesStr) {
+    std::wstring xaml;
+
+    for (const auto& [property, value] : propertyValuesStr) {
+        xaml += L"        <Setter Property=\"";
+        xaml += EscapeXmlAttribute(property);
+        xaml += L"\" Value=\"";
+        xaml += EscapeXmlAttribute(value);
+        xaml += L"\" />\n";
+    }
+
+    return xaml;
+}
+
+PropertyValues GetPropertyValuesFromStyle(
+    Style style,
+    const PropertyValuesUnresolved& propertyValuesStr) {
+    PropertyValues propertyValues;
+
+    for (size_t i = 0; i < propertyValuesStr.size(); i++) {
+        const auto setter = style.Setters().GetAt(i).as<Setter>();
+        propertyValues.push_back({
+            setter.Property(),
+            setter.Value(),
+        });
+    }
+
+    return propertyValues;
+}
+
+thread_local std::unordered_set<std::wstring,
+                                TransparentStringHash,
+                                std::equal_to<>>
+    g_batchResolvedTypes;
+
+// Resolves all unresolved style rules and matcher property values of the
+// given type with a single XamlReader::Load call. Resolving each of them
+// separately is slow for themes with many rules. If the batch fails, nothing
+// is resolved, and the items are resolved one by one as before, which allows
+// to isolate the failing items and to retry with a fallback type.
+void BatchResolvePropertyOverridesAndValues(const std::wstring_view type) {
+    if (!g_batchResolvedTypes.insert(std::wstring(type)).second) {
+        return;
+    }
+
+    struct PendingPropertyOverrides {
+        PropertyOverridesMaybeUnresolved* propertyOverrides;
+        NonXamlPropertyOverrideValues nonXamlValues;
+    };
+
+    std::vector<PendingPropertyOverrides> pendingPropertyOverrides;
+    std::vector<PropertyValuesMaybeUnresolved*> pendingPropertyValues;
+    std::vector<std::wstring> xamlStylesSetters;
+
+    auto addPropertyValues = [&](ElementMatcher& matcher) {
+        if (matcher.type != type) {
+            return;
+        }
+
+        const auto* propertyValuesStr =
+            std::get_if<PropertyValuesUnresolved>(&matcher.propertyValues);
+        if (!propertyValuesStr || propertyValuesStr->empty()) {
+            return;
+        }
+
+        pendingPropertyValues.push_back(&matcher.propertyValues);
+        xamlStylesSetters.push_back(
+            GetXamlSettersFromPropertyValues(*propertyValuesStr));
+    };
+
+    for (auto& rules : g_elementsCustomizationRules) {
+        addPropertyValues(rules.elementMatcher);
+        for (auto& matcher : rules.parentElementMatchers) {
+            addPropertyValues(matcher);
+        }
+    }
+
+    for (auto& rules : g_elementsCustomizationRules) {
+        if (rules.elementMatcher.type != type) {
+            continue;
+        }
+
+        const auto* styleRules =
+            std::get_if<PropertyOverridesUnresolved>(&rules.propertyOverrides);
+        if (!styleRules || styleRules->empty()) {
+            continue;
+        }
+
+        NonXamlPropertyOverrideValues nonXamlValues;
+        try {
+            nonXamlValues = ParseNonXamlPropertyOverrideValues(*styleRules);
+        } catch (std::exception const&) {
+            // Leave it to be resolved, and the error to be reported, later.
+            continue;
+        }
+
+        xamlStylesSetters.push_back(
+            GetXamlSettersFromStyleRules(*styleRules, nonXamlValues));
+        pendingPropertyOverrides.push_back(
+            {&rules.propertyOverrides, std::move(nonXamlValues)});
+    }
+
+    // A single item is resolved the regular way.
+    if (xamlStylesSetters.size() < 2) {
+        return;
+    }
+
+    std::vector<Style> styles;
+    std::vector<PropertyValues> resolvedPropertyValues;
+    std::vector<PropertyOverrides> resolvedPropertyOverrides;
+
+    try {
+        styles = GetStylesFromXamlSetters(type, xamlStylesSetters);
+
+        size_t styleIndex = 0;
+
+        resolvedPropertyValues.reserve(pendingPropertyValues.size());
+        for (auto* propertyValues : pendingPropertyValues) {
+            resolvedPropertyValues.push_back(GetPropertyValuesFromStyle(
+                styles[styleIndex++],
+                std::get<PropertyValuesUnresolved>(*propertyValues)));
+        }
+
+        resolvedPropertyOverrides.reserve(pendingPropertyOverrides.size());
+        for (const auto& pending : pendingPropertyOverrides) {
+            resolvedPropertyOverrides.push_back(GetPropertyOverridesFromStyle(
+                styles[styleIndex++],
+                std::get<PropertyOverridesUnresolved>(
+                    *pending.propertyOverrides),
+                pending.nonXamlValues));
+        }
+    } catch (winrt::hresult_error const& ex) {
+        Wh_Log(L"Batch error %08X: %s", ex.code(), ex.message().c_str());
+        return;
+    } catch (std::exception const& ex) {
+        Wh_Log(L"Batch error: %S", ex.what());
+        return;
+    }
+
+    for (size_t i = 0; i < pendingPropertyValues.size(); i++) {
+        *pendingPropertyValues[i] = std::move(resolvedPropertyValues[i]);
+    }
+
+    for (size_t i = 0; i < pendingPropertyOverrides.size(); i++) {
+        *pendingPropertyOverrides[i].propertyOverrides =
+            std::move(resolvedPropertyOverrides[i]);
+    }
+
+    Wh_Log(L"%.*s: %zu matcher styles and %zu override styles resolved",
+           static_cast<int>(type.length()), type.data(),
+           pendingPropertyValues.size(), pendingPropertyOverrides.size());
+}
+
 const PropertyOverrides& GetResolvedPropertyOverrides(
     const std::wstring_view type,
     const std::wstring_view fallbackType,
@@ -3406,59 +3695,28 @@ const PropertyOverrides& GetResolvedPropertyOverrides(
         return *resolved;
     }
 
+    BatchResolvePropertyOverridesAndValues(type);
+    if (const auto* resolved =
+            std::get_if<PropertyOverrides>(propertyOverridesMaybeUnresolved)) {
+        return *resolved;
+    }
+
     PropertyOverrides propertyOverrides;
 
     try {
         const auto& styleRules = std::get<PropertyOverridesUnresolved>(
             *propertyOverridesMaybeUnresolved);
         if (!styleRules.empty()) {
-            std::wstring xaml;
-
-            std::vector<std::optional<PropertyOverrideValue>>
-                propertyOverrideValues;
-            propertyOverrideValues.reserve(styleRules.size());
-
-            for (const auto& rule : styleRules) {
-                propertyOverrideValues.push_back(
-                    rule.isXamlValue
-                        ? ParseNonXamlPropertyOverrideValue(rule.value)
-                        : std::nullopt);
-
-                xaml += L"        <Setter Property=\"";
-                xaml += EscapeXmlAttribute(rule.name);
-                xaml += L"\"";
-                if (propertyOverrideValues.back() ||
-                    (rule.isXamlValue && rule.value.empty())) {
-                    xaml += L" Value=\"{x:Null}\" />\n";
-                } else if (!rule.isXamlValue) {
-                    xaml += L" Value=\"";
-                    xaml += EscapeXmlAttribute(rule.value);
-                    xaml += L"\" />\n";
-                } else {
-                    xaml +=
-                        L">\n"
-                        L"            <Setter.Value>\n";
-                    xaml += rule.value;
-                    xaml +=
-                        L"\n"
-                        L"            </Setter.Value>\n"
-                        L"        </Setter>\n";
-                }
-            }
+            auto propertyOverrideValues =
+                ParseNonXamlPropertyOverrideValues(styleRules);
 
             auto style = GetStyleFromXamlSettersWithFallbackType(
-                type, fallbackType, xaml);
-
-            uint32_t i = 0;
-            for (const auto& rule : styleRules) {
-                const auto setter = style.Setters().GetAt(i).as<Setter>();
-                propertyOverrides[setter.Property()][rule.visualState] =
-                    propertyOverrideValues[i].value_or(
-                        rule.isXamlValue && rule.value.empty()
-                            ? DependencyProperty::UnsetValue()
-                            : setter.Value());
-                i++;
-            }
+                type, fallbackType,
+                GetXamlSettersFromStyleRules(styleRules,
+                                             propertyOverrideValues));
+
+            propertyOverrides = GetPropertyOverridesFromStyle(
+                style, styleRules, propertyOverrideValues);
         }
 
         Wh_Log(L"%.*s: %zu override styles", static_cast<int>(type.length()),
@@ -3482,32 +3740,24 @@ const PropertyValues& GetResolvedPropertyValues(
         return *resolved;
     }
 
+    BatchResolvePropertyOverridesAndValues(type);
+    if (const auto* resolved =
+            std::get_if<PropertyValues>(propertyValuesMaybeUnresolved)) {
+        return *resolved;
+    }
+
     PropertyValues propertyValues;
 
     try {
         const auto& propertyValuesStr =
             std::get<PropertyValuesUnresolved>(*propertyValuesMaybeUnresolved);
         if (!propertyValuesStr.empty()) {
-            std::wstring xaml;
-
-            for (const auto& [property, value] : propertyValuesStr) {
-                xaml += L"        <Setter Property=\"";
-                xaml += EscapeXmlAttribute(property);
-                xaml += L"\" Value=\"";
-                xaml += EscapeXmlAttribute(value);
-                xaml += L"\" />\n";
-            }
-
             auto style = GetStyleFromXamlSettersWithFallbackType(
-                type, fallbackType, xaml);
+                type, fallbackType,
+                GetXamlSettersFromPropertyValues(propertyValuesStr));
 
-            for (size_t i = 0; i < propertyValuesStr.size(); i++) {
-                const auto setter = style.Setters().GetAt(i).as<Setter>();
-                propertyValues.push_back({
-                    setter.Property(),
-                    setter.Value(),
-                });
-            }
+            propertyValues =
+                GetPropertyValuesFromStyle(style, propertyValuesStr);
         }
 
         Wh_Log(L"%.*s: %zu matcher styles", static_cast<int>(type.length()),
@@ -3626,15 +3876,80 @@ bool TestElementMatcher(FrameworkElement element,
     return true;
 }
 
+void BuildElementCustomizationRulesIndex() {
+    auto& index = g_elementsCustomizationRulesIndex;
+    index = {};
+
+    for (size_t i = 0; i < g_elementsCustomizationRules.size(); i++) {
+        const auto& matcher = g_elementsCustomizationRules[i].elementMatcher;
+        if (matcher.type.empty()) {
+            index.anyType.push_back(i);
+            continue;
+        }
+
+        auto& rulesForType = index.byType[matcher.type];
+        if (matcher.name.empty()) {
+            rulesForType.anyName.push_back(i);
+        } else {
+            rulesForType.byName[matcher.name].push_back(i);
+        }
+    }
+
+    Wh_Log(L"Indexed %zu rules, %zu types", g_elementsCustomizationRules.size(),
+           index.byType.size());
+}
+
+// Returns the indices of the rules which might match an element with the given
+// type and name, in descending order.
+ElementCustomizationRuleIndices GetCandidateElementCustomizationRules(
+    std::wstring_view className,
+    std::wstring_view fallbackClassName,
+    std::wstring_view name) {
+    const auto& index = g_elementsCustomizationRulesIndex;
+
+    ElementCustomizationRuleIndices candidates = index.anyType;
+
+    auto addRulesForType = [&](std::wstring_view type) {
+        auto it = index.byType.find(type);
+        if (it == index.byType.end()) {
+            return;
+        }
+
+        const auto& rulesForType = it->second;
+        candidates.insert(candidates.end(), rulesForType.anyName.begin(),
+                          rulesForType.anyName.end());
+
+        if (!name.empty()) {
+            if (auto nameIt = rulesForType.byName.find(name);
+                nameIt != rulesForType.byName.end()) {
+                candidates.insert(candidates.end(), nameIt->second.begin(),
+                                  nameIt->second.end());
+            }
+        }
+    };
+
+    addRulesForType(className);
+    if (!fallbackClassName.empty() && fallbackClassName != className) {
+        addRulesForType(fallbackClassName);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), std::greater<>{});
+
+    return candidates;
+}
+
 std::unordered_map<VisualStateGroup, PropertyOverrides>
 FindElementPropertyOverrides(FrameworkElement element,
                              PCWSTR fallbackClassName) {
     std::unordered_map<VisualStateGroup, PropertyOverrides> overrides;
     std::unordered_set<DependencyProperty> propertiesAdded;
 
-    for (auto it = g_elementsCustomizationRules.rbegin();
-         it != g_elementsCustomizationRules.rend(); ++it) {
-        auto& override = *it;
+    const auto candidates = GetCandidateElementCustomizationRules(
+        winrt::get_class_name(element),
+        fallbackClassName ? fallbackClassName : L"", element.Name());
+
+    for (size_t ruleIndex : candidates) {
+        auto& override = g_elementsCustomizationRules[ruleIndex];
 
         VisualStateGroup visualStateGroup = nullptr;
 
@@ -3930,7 +4245,171 @@ void CleanupCustomizations(InstanceHandle handle) {
 }
 
 using StyleConstant = std::pair<std::wstring, std::wstring>;
-using StyleConstants = std::vector<StyleConstant>;
+
+// Constant names are kept in a trie, which allows to substitute all constants
+// in a single pass by finding the longest name that follows each '$'. Constant
+// values can refer to other constants, and are expanded when loaded.
+class StyleConstants {
+   public:
+    StyleConstants() : m_nodes(1) {}
+
+    // Later definitions override earlier definitions with the same name.
+    explicit StyleConstants(std::vector<StyleConstant> constants)
+        : m_nodes(1) {
+        for (auto& [name, value] : constants) {
+            uint32_t nodeIndex = 0;
+            for (WCHAR c : name) {
+                nodeIndex = GetOrAddChild(nodeIndex, c);
+            }
+
+            if (m_nodes[nodeIndex].valueIndex == kNoValue) {
+                m_nodes[nodeIndex].valueIndex =
+                    static_cast<uint32_t>(m_values.size());
+                m_values.push_back(std::move(value));
+            } else {
+                m_values[m_nodes[nodeIndex].valueIndex] = std::move(value);
+            }
+        }
+
+        std::vector<ExpandState> expandStates(m_values.size(),
+                                              ExpandState::kNotExpanded);
+        for (size_t i = 0; i < m_values.size(); i++) {
+            ExpandValue(i, expandStates);
+        }
+    }
+
+    std::wstring Apply(std::wstring_view style) const {
+        // Calculate the result size first to allocate it only once.
+        size_t resultSize = 0;
+        ForEachPart(style, [&resultSize](std::wstring_view part) {
+            resultSize += part.size();
+        });
+
+        std::wstring result;
+        result.reserve(resultSize);
+        ForEachPart(style,
+                    [&result](std::wstring_view part) { result += part; });
+
+        return result;
+    }
+
+   private:
+    static constexpr uint32_t kNoValue = 0xFFFFFFFF;
+
+    struct Node {
+        std::vector<std::pair<WCHAR, uint32_t>> children;
+        uint32_t valueIndex = kNoValue;
+    };
+
+    enum class ExpandState {
+        kNotExpanded,
+        kExpanding,
+        kExpanded,
+    };
+
+    uint32_t FindChild(uint32_t nodeIndex, WCHAR c) const {
+        for (const auto& [childChar, childIndex] :
+             m_nodes[nodeIndex].children) {
+            if (childChar == c) {
+                return childIndex;
+            }
+        }
+
+        return 0;
+    }
+
+    uint32_t GetOrAddChild(uint32_t nodeIndex, WCHAR c) {
+        if (uint32_t childIndex = FindChild(nodeIndex, c)) {
+            return childIndex;
+        }
+
+        uint32_t childIndex = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.emplace_back();
+        m_nodes[nodeIndex].children.push_back({c, childIndex});
+        return childIndex;
+    }
+
+    // Returns the value index and the name length of the longest constant
+    // name which is a prefix of str.
+    std::pair<uint32_t, size_t> FindLongestMatch(std::wstring_view str) const {
+        uint32_t valueIndex = m_nodes[0].valueIndex;
+        size_t nameLength = 0;
+
+        uint32_t nodeIndex = 0;
+        for (size_t i = 0; i < str.size(); i++) {
+            nodeIndex = FindChild(nodeIndex, str[i]);
+            if (!nodeIndex) {
+                break;
+            }
+
+            if (m_nodes[nodeIndex].valueIndex != kNoValue) {
+                valueIndex = m_nodes[nodeIndex].valueIndex;
+                nameLength = i + 1;
+            }
+        }
+
+        return {valueIndex, nameLength};
+    }
+
+    // Calls the callback with consecutive parts of the result.
+    template <typename F>
+    void ForEachPart(std::wstring_view style, F&& callback) const {
+        size_t lastPos = 0;
+        size_t findPos;
+
+        while ((findPos = style.find('$', lastPos)) != style.npos) {
+            callback(style.substr(lastPos, findPos - lastPos));
+
+            auto [valueIndex, nameLength] =
+                FindLongestMatch(style.substr(findPos + 1));
+            if (valueIndex != kNoValue) {
+                callback(m_values[valueIndex]);
+                lastPos = findPos + 1 + nameLength;
+            } else {
+                callback(L"$");
+                lastPos = findPos + 1;
+            }
+        }
+
+        // Care for the rest after last occurrence.
+        callback(style.substr(lastPos));
+    }
+
+    void ExpandValue(size_t valueIndex, std::vector<ExpandState>& states) {
+        if (states[valueIndex] != ExpandState::kNotExpanded) {
+            return;
+        }
+
+        states[valueIndex] = ExpandState::kExpanding;
+
+        const auto& value = m_values[valueIndex];
+        for (size_t pos = value.find('$'); pos != value.npos;
+             pos = value.find('$', pos + 1)) {
+            auto [referencedIndex, nameLength] =
+                FindLongestMatch(std::wstring_view(value).substr(pos + 1));
+            if (referencedIndex == kNoValue) {
+                continue;
+            }
+
+            if (states[referencedIndex] == ExpandState::kExpanding) {
+                // Leave circular references as is.
+                Wh_Log(L"Circular style constant reference");
+                continue;
+            }
+
+            ExpandValue(referencedIndex, states);
+        }
+
+        // All referenced constants which aren't part of a cycle are expanded
+        // now. A constant that's part of a cycle is replaced with its value as
+        // it was at this point.
+        m_values[valueIndex] = Apply(m_values[valueIndex]);
+        states[valueIndex] = ExpandState::kExpanded;
+    }
+
+    std::vector<Node> m_nodes;
+    std::vector<std::wstring> m_values;
+};
 
 std::optional<StyleConstant> ParseStyleConstant(std::wstring_view constant) {
     // Skip if commented.
@@ -3953,7 +4432,7 @@ std::optional<StyleConstant> ParseStyleConstant(std::wstring_view constant) {
 
 StyleConstants LoadStyleConstants(
     const std::vector<PCWSTR>& themeStyleConstants) {
-    StyleConstants result;
+    std::vector<StyleConstant> result;
 
     for (const auto themeStyleConstant : themeStyleConstants) {
         if (auto parsed = ParseStyleConstant(themeStyleConstant)) {
@@ -3973,49 +4452,12 @@ StyleConstants LoadStyleConstants(
         }
     }
 
-    // Reverse the order to allow overriding definitions with the same name.
-    std::reverse(result.begin(), result.end());
-
-    // Sort by name length to replace long names first.
-    std::stable_sort(result.begin(), result.end(),
-                     [](const StyleConstant& a, const StyleConstant& b) {
-                         return a.first.size() > b.first.size();
-                     });
-
-    return result;
+    return StyleConstants(std::move(result));
 }
 
 std::wstring ApplyStyleConstants(std::wstring_view style,
                                  const StyleConstants& styleConstants) {
-    std::wstring result;
-
-    size_t lastPos = 0;
-    size_t findPos;
-
-    while ((findPos = style.find('$', lastPos)) != style.npos) {
-        result.append(style, lastPos, findPos - lastPos);
-
-        const StyleConstant* constant = nullptr;
-        for (const auto& s : styleConstants) {
-            if (s.first == style.substr(findPos + 1, s.first.size())) {
-                constant = &s;
-                break;
-            }
-        }
-
-        if (constant) {
-            result += constant->second;
-            lastPos = findPos + 1 + constant->first.size();
-        } else {
-            result += '$';
-            lastPos = findPos + 1;
-        }
-    }
-
-    // Care for the rest after last occurrence.
-    result += style.substr(lastPos);
-
-    return result;
+    return styleConstants.Apply(style);
 }
 
 ElementMatcher ElementMatcherFromString(std::wstring_view str) {
@@ -4373,6 +4815,8 @@ void UninitializeForCurrentThread() {
     g_elementsCustomizationState.clear();
 
     g_elementsCustomizationRules.clear();
+    g_elementsCustomizationRulesIndex = {};
+    g_batchResolvedTypes.clear();
 
     g_initializedForThread = false;
 }
@@ -4392,6 +4836,7 @@ void InitializeForCurrentThread() {
     }
 
     ProcessAllStylesFromSettings();
+    BuildElementCustomizationRulesIndex();
     ProcessResourceVariablesFromSettings();
 
     g_initializedForThread = true;
@@ -2943,9 +2943,14 @@ HRESULT InjectWindhawkTAP() noexcept
 // clang-format on
 ////////////////////////////////////////////////////////////////////////////////
 
+#include <array>
+#include <filesystem>
 #include <list>
+#include <map>
 #include <mutex>
+#include <new>
 #include <optional>
+#include <span>
 #include <sstream>
 #include <string>
 #include <string_view>
@@ -3029,6 +3034,23 @@ using PropertyOverrides =
 using PropertyOverridesMaybeUnresolved =
     std::variant<PropertyOverridesUnresolved, PropertyOverrides>;
 
+// An immutable, flat form of PropertyOverrides, shared by all elements with the
+// same matched rules.
+struct SharedPropertyOverridesData {
+    struct Entry {
+        DependencyProperty property;
+        // Interned, see InternVisualStateName.
+        const std::wstring* visualState;
+        PropertyOverrideValue value;
+    };
+
+    // Sorted by property, then by visual state.
+    std::vector<Entry> entries;
+};
+
+using SharedPropertyOverrides =
+    std::shared_ptr<const SharedPropertyOverridesData>;
+
 struct ElementCustomizationRules {
     ElementMatcher elementMatcher;
     std::vector<ElementMatcher> parentElementMatchers;
@@ -3038,6 +3060,79 @@ struct ElementCustomizationRules {
 thread_local std::vector<ElementCustomizationRules>
     g_elementsCustomizationRules;
 
+struct TransparentStringHash {
+    using is_transparent = void;
+
+    size_t operator()(std::wstring_view s) const noexcept {
+        return std::hash<std::wstring_view>{}(s);
+    }
+};
+
+template <typename T>
+using StringMap =
+    std::unordered_map<std::wstring, T, TransparentStringHash, std::equal_to<>>;
+
+// Indices into g_elementsCustomizationRules, in ascending order.
+using ElementCustomizationRuleIndices = std::vector<size_t>;
+
+struct ElementCustomizationRulesForType {
+    ElementCustomizationRuleIndices anyName;
+    StringMap<ElementCustomizationRuleIndices> byName;
+};
+
+// Allows to only test the rules that can match an element's type and name
+// instead of testing all rules for each element.
+struct ElementCustomizationRulesIndex {
+    StringMap<ElementCustomizationRulesForType> byType;
+    // Rules without a target type, tested for all elements.
+    ElementCustomizationRuleIndices anyType;
+
+    struct RuleInfo {
+        // Whether the rule matches an element only by the types and names of
+        // the element and its ancestors. Such match results can be cached.
+        bool matchesByTypesAndNames;
+        // The number of ancestors that need to be checked for the rule.
+        size_t parentDepth;
+        // 0 for the element itself, 1 for its parent, etc. Or -1 if the rule
+        // has no visual state group.
+        int visualStateGroupDepth;
+    };
+
+    std::vector<RuleInfo> ruleInfos;
+};
+
+thread_local ElementCustomizationRulesIndex g_elementsCustomizationRulesIndex;
+
+// Signature (types and names of an element and of its ancestors) -> indices of
+// the rules which match only by types and names, in descending order.
+//
+// Elements such as taskbar buttons are recycled and re-added with the same
+// signature, which allows to skip testing the rules against them.
+thread_local StringMap<ElementCustomizationRuleIndices> g_elementMatchCache;
+
+struct ElementMatchCacheStats {
+    size_t hits;
+    size_t misses;
+};
+
+thread_local ElementMatchCacheStats g_elementMatchCacheStats;
+
+// Matched rules (pairs of rule index and visual state group slot) -> overrides
+// per visual state group slot.
+thread_local std::map<std::vector<size_t>, std::vector<SharedPropertyOverrides>>
+    g_sharedPropertyOverrides;
+
+// Visual state names are interned to be stored and compared as pointers. The
+// set is never cleared, as the pointers are kept by the customized elements.
+thread_local std::unordered_set<std::wstring,
+                                TransparentStringHash,
+                                std::equal_to<>>
+    g_visualStateNames;
+
+// A hash of each rule's content, parallel to g_elementsCustomizationRules. Used
+// to find out which elements are affected by a settings change.
+thread_local std::vector<uint64_t> g_elementsCustomizationRulesKeys;
+
 struct ElementPropertyCustomizationState {
     std::optional<winrt::Windows::Foundation::IInspectable> originalValue;
     std::optional<PropertyOverrideValue> customValue;
@@ -3053,14 +3148,221 @@ struct ElementCustomizationStateForVisualStateGroup {
 struct ElementCustomizationState {
     winrt::weak_ref<FrameworkElement> element;
 
-    // Use list to avoid reallocations on insertion, as pointers to items are
-    // captured in callbacks and stored.
-    std::list<std::pair<std::optional<winrt::weak_ref<VisualStateGroup>>,
-                        ElementCustomizationStateForVisualStateGroup>>
+    // The keys of the rules which matched the element, in priority order.
+    std::vector<uint64_t> matchedRuleKeys;
+
+    // The states are allocated from g_elementCustomizationStatePools, as
+    // pointers to them are captured in callbacks and stored.
+    std::vector<std::pair<std::optional<winrt::weak_ref<VisualStateGroup>>,
+                          ElementCustomizationStateForVisualStateGroup*>>
         perVisualStateGroup;
 };
 
-thread_local std::unordered_map<InstanceHandle, ElementCustomizationState>
+// Allocates objects in fixed-size slabs. Objects never move, and freed slots
+// are reused, which avoids an allocation for each object.
+template <typename T, size_t kSlabSize = 64>
+class SlabPool {
+   public:
+    SlabPool() = default;
+    SlabPool(const SlabPool&) = delete;
+    SlabPool& operator=(const SlabPool&) = delete;
+    ~SlabPool() { Clear(); }
+
+    template <typename... Args>
+    T* New(Args&&... args) {
+        if (!m_freeList) {
+            AddSlab();
+        }
+
+        Slot* slot = m_freeList;
+        T* object = new (slot->storage) T(std::forward<Args>(args)...);
+        m_freeList = slot->next;
+        slot->used = true;
+        return object;
+    }
+
+    void Delete(T* object) {
+        object->~T();
+        // The storage is the first member of the slot.
+        Slot* slot = reinterpret_cast<Slot*>(object);
+        slot->used = false;
+        slot->next = m_freeList;
+        m_freeList = slot;
+    }
+
+    // Destroys all objects and frees all slabs at once.
+    void Clear() {
+        for (auto& slab : m_slabs) {
+            for (auto& slot : *slab) {
+                if (slot.used) {
+                    std::launder(reinterpret_cast<T*>(slot.storage))->~T();
+                }
+            }
+        }
+
+        m_slabs.clear();
+        m_freeList = nullptr;
+    }
+
+   private:
+    struct Slot {
+        alignas(T) unsigned char storage[sizeof(T)];
+        Slot* next;
+        bool used;
+    };
+
+    using Slab = std::array<Slot, kSlabSize>;
+
+    void AddSlab() {
+        auto slab = std::make_unique<Slab>();
+        for (auto it = slab->rbegin(); it != slab->rend(); ++it) {
+            it->used = false;
+            it->next = m_freeList;
+            m_freeList = &*it;
+        }
+
+        m_slabs.push_back(std::move(slab));
+    }
+
+    std::vector<std::unique_ptr<Slab>> m_slabs;
+    Slot* m_freeList = nullptr;
+};
+
+// An open addressing hash map from an instance handle to a non-null pointer,
+// with linear probing and backward shift deletion.
+template <typename T>
+class InstanceHandleMap {
+   public:
+    T* Find(InstanceHandle handle) const {
+        if (m_entries.empty()) {
+            return nullptr;
+        }
+
+        for (size_t i = Bucket(handle);; i = (i + 1) & Mask()) {
+            const auto& entry = m_entries[i];
+            if (!entry.value) {
+                return nullptr;
+            }
+
+            if (entry.handle == handle) {
+                return entry.value;
+            }
+        }
+    }
+
+    // The handle must not be in the map.
+    void Insert(InstanceHandle handle, T* value) {
+        if ((m_size + 1) * 4 > m_entries.size() * 3) {
+            Rehash(m_entries.empty() ? 64 : m_entries.size() * 2);
+        }
+
+        InsertNoGrow(handle, value);
+        m_size++;
+    }
+
+    // Returns the removed pointer, or nullptr if the handle isn't in the map.
+    T* Erase(InstanceHandle handle) {
+        if (m_entries.empty()) {
+            return nullptr;
+        }
+
+        size_t i = Bucket(handle);
+        while (m_entries[i].handle != handle) {
+            if (!m_entries[i].value) {
+                return nullptr;
+            }
+
+            i = (i + 1) & Mask();
+        }
+
+        T* value = m_entries[i].value;
+        if (!value) {
+            return nullptr;
+        }
+
+        m_entries[i] = {};
+        m_size--;
+
+        // Shift back the following entries of the probe sequence which can't
+        // be found anymore due to the new gap.
+        for (size_t j = (i + 1) & Mask(); m_entries[j].value;
+             j = (j + 1) & Mask()) {
+            size_t k = Bucket(m_entries[j].handle);
+            bool kInRange = i <= j ? (i < k && k <= j) : (i < k || k <= j);
+            if (!kInRange) {
+                m_entries[i] = m_entries[j];
+                m_entries[j] = {};
+                i = j;
+            }
+        }
+
+        return value;
+    }
+
+    template <typename F>
+    void ForEach(F&& callback) const {
+        for (const auto& entry : m_entries) {
+            if (entry.value) {
+                callback(entry.handle, entry.value);
+            }
+        }
+    }
+
+    void Clear() {
+        m_entries.clear();
+        m_size = 0;
+    }
+
+    size_t Size() const { return m_size; }
+
+   private:
+    struct Entry {
+        InstanceHandle handle = 0;
+        T* value = nullptr;
+    };
+
+    size_t Mask() const { return m_entries.size() - 1; }
+
+    size_t Bucket(InstanceHandle handle) const {
+        // splitmix64 finalizer, handles are pointer-like values.
+        uint64_t x = handle;
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+        x ^= x >> 31;
+        return static_cast<size_t>(x) & Mask();
+    }
+
+    void InsertNoGrow(InstanceHandle handle, T* value) {
+        size_t i = Bucket(handle);
+        while (m_entries[i].value) {
+            i = (i + 1) & Mask();
+        }
+
+        m_entries[i] = {handle, value};
+    }
+
+    void Rehash(size_t newSize) {
+        auto oldEntries = std::move(m_entries);
+        m_entries.assign(newSize, {});
+        for (const auto& entry : oldEntries) {
+            if (entry.value) {
+                InsertNoGrow(entry.handle, entry.value);
+            }
+        }
+    }
+
+    std::vector<Entry> m_entries;
+    size_t m_size = 0;
+};
+
+struct ElementCustomizationStatePools {
+    SlabPool<ElementCustomizationState> elements;
+    SlabPool<ElementCustomizationStateForVisualStateGroup> visualStateGroups;
+};
+
+thread_local ElementCustomizationStatePools g_elementCustomizationStatePools;
+
+thread_local InstanceHandleMap<ElementCustomizationState>
     g_elementsCustomizationState;
 
 thread_local bool g_elementPropertyModifying;
@@ -4309,8 +4611,11 @@ std::optional<PropertyOverrideValue> ParseNonXamlPropertyOverrideValue(
     };
 }
 
-Style GetStyleFromXamlSetters(const std::wstring_view type,
-                              const std::wstring_view xamlStyleSetters) {
+// Returns a resource dictionary with a style for each of the given setter
+// lists. The styles are keyed by their index.
+std::wstring GetXamlResourceDictionary(
+    const std::wstring_view type,
+    const std::vector<std::wstring>& xamlStylesSetters) {
     std::wstring xaml =
         LR"(<ResourceDictionary
     xmlns="http://schemas.microsoft.com/winfx/2006/xaml/presentation"
@@ -4319,30 +4624,45 @@ Style GetStyleFromXamlSetters(const std::wstring_view type,
     xmlns:mc="http://schemas.openxmlformats.org/markup-compatibility/2006"
     xmlns:muxc="using:Microsoft.UI.Xaml.Controls")";
 
+    std::wstring styleTargetType;
     if (auto pos = type.rfind('.'); pos != type.npos) {
         auto typeNamespace = std::wstring_view(type).substr(0, pos);
         auto typeName = std::wstring_view(type).substr(pos + 1);
 
         xaml += L"\n    xmlns:windhawkstyler=\"using:";
         xaml += EscapeXmlAttribute(typeNamespace);
-        xaml +=
-            L"\">\n"
-            L"    <Style TargetType=\"windhawkstyler:";
-        xaml += EscapeXmlAttribute(typeName);
         xaml += L"\">\n";
+
+        styleTargetType = L"windhawkstyler:";
+        styleTargetType += EscapeXmlAttribute(typeName);
     } else {
-        xaml +=
-            L">\n"
-            L"    <Style TargetType=\"";
-        xaml += EscapeXmlAttribute(type);
+        xaml += L">\n";
+
+        styleTargetType = EscapeXmlAttribute(type);
+    }
+
+    for (size_t i = 0; i < xamlStylesSetters.size(); i++) {
+        xaml += L"    <Style x:Key=\"";
+        xaml += std::to_wstring(i);
+        xaml += L"\" TargetType=\"";
+        xaml += styleTargetType;
         xaml += L"\">\n";
+        xaml += xamlStylesSetters[i];
+        xaml += L"    </Style>\n";
     }
 
-    xaml += xamlStyleSetters;
+    xaml += L"</ResourceDictionary>";
+
+    return xaml;
+}
+
+// Number of XamlReader::Load calls for parsing styles, logged for diagnostics.
+thread_local int g_xamlReaderLoadCount;
 
-    xaml +=
-        L"    </Style>\n"
-        L"</ResourceDictionary>";
+std::vector<Style> GetStylesFromXamlSetters(
+    const std::wstring_view type,
+    const std::vector<std::wstring>& xamlStylesSetters) {
+    std::wstring xaml = GetXamlResourceDictionary(type, xamlStylesSetters);
 
     Wh_Log(L"======================================== XAML:");
     std::wstringstream ss(xaml);
@@ -4352,11 +4672,28 @@ Style GetStyleFromXamlSetters(const std::wstring_view type,
     }
     Wh_Log(L"========================================");
 
+    g_xamlReaderLoadCount++;
+    Wh_Log(L"XamlReader::Load call #%d, %zu styles", g_xamlReaderLoadCount,
+           xamlStylesSetters.size());
+
     auto resourceDictionary =
         Markup::XamlReader::Load(xaml).as<ResourceDictionary>();
 
-    auto [styleKey, styleInspectable] = resourceDictionary.First().Current();
-    return styleInspectable.as<Style>();
+    std::vector<Style> styles;
+    styles.reserve(xamlStylesSetters.size());
+    for (size_t i = 0; i < xamlStylesSetters.size(); i++) {
+        styles.push_back(
+            resourceDictionary
+                .Lookup(winrt::box_value(winrt::hstring(std::to_wstring(i))))
+                .as<Style>());
+    }
+
+    return styles;
+}
+
+Style GetStyleFromXamlSetters(const std::wstring_view type,
+                              const std::wstring_view xamlStyleSetters) {
+    return GetStylesFromXamlSetters(type, {std::wstring(xamlStyleSetters)})[0];
 }
 
 Style GetStyleFromXamlSettersWithFallbackType(
@@ -4386,6 +4723,233 @@ Style GetStyleFromXamlSettersWithFallbackType(
     }
 }
 
+using NonXamlPropertyOverrideValues =
+    std::vector<std::optional<PropertyOverrideValue>>;
+
+NonXamlPropertyOverrideValues ParseNonXamlPropertyOverrideValues(
+    const PropertyOverridesUnresolved& styleRules) {
+    NonXamlPropertyOverrideValues propertyOverrideValues;
+    propertyOverrideValues.reserve(styleRules.size());
+
+    for (const auto& rule : styleRules) {
+        propertyOverrideValues.push_back(
+            // Allow to use WindhawkBlur without ":=" for compatibility, as it
+            // was always allowed in v1.5.
+            true  // rule.isXamlValue
+                ? ParseNonXamlPropertyOverrideValue(rule.value)
+                : std::nullopt);
+    }
+
+    return propertyOverrideValues;
+}
+
+std::wstring GetXamlSettersFromStyleRules(
+    const PropertyOverridesUnresolved& styleRules,
+    const NonXamlPropertyOverrideValues& propertyOverrideValues) {
+    std::wstring xaml;
+
+    for (size_t i = 0; i < styleRules.size(); i++) {
+        const auto& rule = styleRules[i];
+
+        xaml += L"        <Setter Property=\"";
+        xaml += EscapeXmlAttribute(rule.name);
+        xaml += L"\"";
+        if (propertyOverrideValues[i] ||
+            (rule.isXamlValue && rule.value.empty())) {
+            xaml += L" Value=\"{x:Null}\" />\n";
+        } else if (!rule.isXamlValue) {
+            xaml += L" Value=\"";
+            xaml += EscapeXmlAttribute(rule.value);
+            xaml += L"\" />\n";
+        } else {
+            xaml +=
+                L">\n"
+                L"            <Setter.Value>\n";
+            xaml += rule.value;
+            xaml +=
+                L"\n"
+                L"            </Setter.Value>\n"
+                L"        </Setter>\n";
+        }
+    }
+
+    return xaml;
+}
+
+PropertyOverrides GetPropertyOverridesFromStyle(
+    Style style,
+    const PropertyOverridesUnresolved& styleRules,
+    const NonXamlPropertyOverrideValues& propertyOverrideValues) {
+    PropertyOverrides propertyOverrides;
+
+    uint32_t i = 0;
+    for (const auto& rule : styleRules) {
+        const auto setter = style.Setters().GetAt(i).as<Setter>();
+        propertyOverrides[setter.Property()][rule.visualState] =
+            propertyOverrideValues[i].value_or(
+                rule.isXamlValue && rule.value.empty()
+                    ? DependencyProperty::UnsetValue()
+                    : setter.Value());
+        i++;
+    }
+
+    return propertyOverrides;
+}
+
+std::wstring GetXamlSettersFromPropertyValues(
+    const PropertyValuesUnresolved& propertyValuesStr) {
+    std::wstring xaml;
+
+    for (const auto& [property, value] : propertyValuesStr) {
+        xaml += L"        <Setter Property=\"";
+        xaml += EscapeXmlAttribute(property);
+        xaml += L"\" Value=\"";
+        xaml += EscapeXmlAttribute(value);
+        xaml += L"\" />\n";
+    }
+
+    return xaml;
+}
+
+PropertyValues GetPropertyValuesFromStyle(
+    Style style,
+    const PropertyValuesUnresolved& propertyValuesStr) {
+    PropertyValues propertyValues;
+
+    for (size_t i = 0; i < propertyValuesStr.size(); i++) {
+        const auto setter = style.Setters().GetAt(i).as<Setter>();
+        propertyValues.push_back({
+            setter.Property(),
+            setter.Value(),
+        });
+    }
+
+    return propertyValues;
+}
+
+thread_local std::unordered_set<std::wstring,
+                                TransparentStringHash,
+                                std::equal_to<>>
+    g_batchResolvedTypes;
+
+// Resolves all unresolved style rules and matcher property values of the
+// given type with a single XamlReader::Load call. Resolving each of them
+// separately is slow for themes with many rules. If the batch fails, nothing
+// is resolved, and the items are resolved one by one as before, which allows
+// to isolate the failing items and to retry with a fallback type.
+void BatchResolvePropertyOverridesAndValues(const std::wstring_view type) {
+    if (!g_batchResolvedTypes.insert(std::wstring(type)).second) {
+        return;
+    }
+
+    struct PendingPropertyOverrides {
+        PropertyOverridesMaybeUnresolved* propertyOverrides;
+        NonXamlPropertyOverrideValues nonXamlValues;
+    };
+
+    std::vector<PendingPropertyOverrides> pendingPropertyOverrides;
+    std::vector<PropertyValuesMaybeUnresolved*> pendingPropertyValues;
+    std::vector<std::wstring> xamlStylesSetters;
+
+    auto addPropertyValues = [&](ElementMatcher& matcher) {
+        if (matcher.type != type) {
+            return;
+        }
+
+        const auto* propertyValuesStr =
+            std::get_if<PropertyValuesUnresolved>(&matcher.propertyValues);
+        if (!propertyValuesStr || propertyValuesStr->empty()) {
+            return;
+        }
+
+        pendingPropertyValues.push_back(&matcher.propertyValues);
+        xamlStylesSetters.push_back(
+            GetXamlSettersFromPropertyValues(*propertyValuesStr));
+    };
+
+    for (auto& rules : g_elementsCustomizationRules) {
+        addPropertyValues(rules.elementMatcher);
+        for (auto& matcher : rules.parentElementMatchers) {
+            addPropertyValues(matcher);
+        }
+    }
+
+    for (auto& rules : g_elementsCustomizationRules) {
+        if (rules.elementMatcher.type != type) {
+            continue;
+        }
+
+        const auto* styleRules =
+            std::get_if<PropertyOverridesUnresolved>(&rules.propertyOverrides);
+        if (!styleRules || styleRules->empty()) {
+            continue;
+        }
+
+        NonXamlPropertyOverrideValues nonXamlValues;
+        try {
+            nonXamlValues = ParseNonXamlPropertyOverrideValues(*styleRules);
+        } catch (std::exception const&) {
+            // Leave it to be resolved, and the error to be reported, later.
+            continue;
+        }
+
+        xamlStylesSetters.push_back(
+            GetXamlSettersFromStyleRules(*styleRules, nonXamlValues));
+        pendingPropertyOverrides.push_back(
+            {&rules.propertyOverrides, std::move(nonXamlValues)});
+    }
+
+    // A single item is resolved the regular way.
+    if (xamlStylesSetters.size() < 2) {
+        return;
+    }
+
+    std::vector<Style> styles;
+    std::vector<PropertyValues> resolvedPropertyValues;
+    std::vector<PropertyOverrides> resolvedPropertyOverrides;
+
+    try {
+        styles = GetStylesFromXamlSetters(type, xamlStylesSetters);
+
+        size_t styleIndex = 0;
+
+        resolvedPropertyValues.reserve(pendingPropertyValues.size());
+        for (auto* propertyValues : pendingPropertyValues) {
+            resolvedPropertyValues.push_back(GetPropertyValuesFromStyle(
+                styles[styleIndex++],
+                std::get<PropertyValuesUnresolved>(*propertyValues)));
+        }
+
+        resolvedPropertyOverrides.reserve(pendingPropertyOverrides.size());
+        for (const auto& pending : pendingPropertyOverrides) {
+            resolvedPropertyOverrides.push_back(GetPropertyOverridesFromStyle(
+                styles[styleIndex++],
+                std::get<PropertyOverridesUnresolved>(
+                    *pending.propertyOverrides),
+                pending.nonXamlValues));
+        }
+    } catch (winrt::hresult_error const& ex) {
+        Wh_Log(L"Batch error %08X: %s", ex.code(), ex.message().c_str());
+        return;
+    } catch (std::exception const& ex) {
+        Wh_Log(L"Batch error: %S", ex.what());
+        return;
+    }
+
+    for (size_t i = 0; i < pendingPropertyValues.size(); i++) {
+        *pendingPropertyValues[i] = std::move(resolvedPropertyValues[i]);
+    }
+
+    for (size_t i = 0; i < pendingPropertyOverrides.size(); i++) {
+        *pendingPropertyOverrides[i].propertyOverrides =
+            std::move(resolvedPropertyOverrides[i]);
+    }
+
+    Wh_Log(L"%.*s: %zu matcher styles and %zu override styles resolved",
+           static_cast<int>(type.length()), type.data(),
+           pendingPropertyValues.size(), pendingPropertyOverrides.size());
+}
+
 const PropertyOverrides& GetResolvedPropertyOverrides(
     const std::wstring_view type,
     const std::wstring_view fallbackType,
@@ -4395,61 +4959,28 @@ const PropertyOverrides& GetResolvedPropertyOverrides(
         return *resolved;
     }
 
+    BatchResolvePropertyOverridesAndValues(type);
+    if (const auto* resolved =
+            std::get_if<PropertyOverrides>(propertyOverridesMaybeUnresolved)) {
+        return *resolved;
+    }
+
     PropertyOverrides propertyOverrides;
 
     try {
         const auto& styleRules = std::get<PropertyOverridesUnresolved>(
             *propertyOverridesMaybeUnresolved);
         if (!styleRules.empty()) {
-            std::wstring xaml;
-
-            std::vector<std::optional<PropertyOverrideValue>>
-                propertyOverrideValues;
-            propertyOverrideValues.reserve(styleRules.size());
-
-            for (const auto& rule : styleRules) {
-                propertyOverrideValues.push_back(
-                    // Allow to use WindhawkBlur without ":=" for compatibility,
-                    // as it was always allowed in v1.5.
-                    true  // rule.isXamlValue
-                        ? ParseNonXamlPropertyOverrideValue(rule.value)
-                        : std::nullopt);
-
-                xaml += L"        <Setter Property=\"";
-                xaml += EscapeXmlAttribute(rule.name);
-                xaml += L"\"";
-                if (propertyOverrideValues.back() ||
-                    (rule.isXamlValue && rule.value.empty())) {
-                    xaml += L" Value=\"{x:Null}\" />\n";
-                } else if (!rule.isXamlValue) {
-                    xaml += L" Value=\"";
-                    xaml += EscapeXmlAttribute(rule.value);
-                    xaml += L"\" />\n";
-                } else {
-                    xaml +=
-                        L">\n"
-                        L"            <Setter.Value>\n";
-                    xaml += rule.value;
-                    xaml +=
-                        L"\n"
-                        L"            </Setter.Value>\n"
-                        L"        </Setter>\n";
-                }
-            }
+            auto propertyOverrideValues =
+                ParseNonXamlPropertyOverrideValues(styleRules);
 
             auto style = GetStyleFromXamlSettersWithFallbackType(
-                type, fallbackType, xaml);
-
-            uint32_t i = 0;
-            for (const auto& rule : styleRules) {
-                const auto setter = style.Setters().GetAt(i).as<Setter>();
-                propertyOverrides[setter.Property()][rule.visualState] =
-                    propertyOverrideValues[i].value_or(
-                        rule.isXamlValue && rule.value.empty()
-                            ? DependencyProperty::UnsetValue()
-                            : setter.Value());
-                i++;
-            }
+                type, fallbackType,
+                GetXamlSettersFromStyleRules(styleRules,
+                                             propertyOverrideValues));
+
+            propertyOverrides = GetPropertyOverridesFromStyle(
+                style, styleRules, propertyOverrideValues);
         }
 
         Wh_Log(L"%.*s: %zu override styles", static_cast<int>(type.length()),
@@ -4473,32 +5004,24 @@ const PropertyValues& GetResolvedPropertyValues(
         return *resolved;
     }
 
+    BatchResolvePropertyOverridesAndValues(type);
+    if (const auto* resolved =
+            std::get_if<PropertyValues>(propertyValuesMaybeUnresolved)) {
+        return *resolved;
+    }
+
     PropertyValues propertyValues;
 
     try {
         const auto& propertyValuesStr =
             std::get<PropertyValuesUnresolved>(*propertyValuesMaybeUnresolved);
         if (!propertyValuesStr.empty()) {
-            std::wstring xaml;
-
-            for (const auto& [property, value] : propertyValuesStr) {
-                xaml += L"        <Setter Property=\"";
-                xaml += EscapeXmlAttribute(property);
-                xaml += L"\" Value=\"";
-                xaml += EscapeXmlAttribute(value);
-                xaml += L"\" />\n";
-            }
-
             auto style = GetStyleFromXamlSettersWithFallbackType(
-                type, fallbackType, xaml);
+                type, fallbackType,
+                GetXamlSettersFromPropertyValues(propertyValuesStr));
 
-            for (size_t i = 0; i < propertyValuesStr.size(); i++) {
-                const auto setter = style.Setters().GetAt(i).as<Setter>();
-                propertyValues.push_back({
-                    setter.Property(),
-                    setter.Value(),
-                });
-            }
+            propertyValues =
+                GetPropertyValuesFromStyle(style, propertyValuesStr);
         }
 
         Wh_Log(L"%.*s: %zu matcher styles", static_cast<int>(type.length()),
@@ -4640,110 +5163,514 @@ bool TestElementMatcher(FrameworkElement element,
     return true;
 }
 
-std::unordered_map<VisualStateGroup, PropertyOverrides>
-FindElementPropertyOverrides(FrameworkElement element,
-                             PCWSTR fallbackClassName) {
-    std::unordered_map<VisualStateGroup, PropertyOverrides> overrides;
-    std::unordered_set<DependencyProperty> propertiesAdded;
-
-    for (auto it = g_elementsCustomizationRules.rbegin();
-         it != g_elementsCustomizationRules.rend(); ++it) {
-        auto& override = *it;
+void BuildElementCustomizationRulesIndex() {
+    auto& index = g_elementsCustomizationRulesIndex;
+    index = {};
 
-        VisualStateGroup visualStateGroup = nullptr;
+    g_elementMatchCache.clear();
+    g_elementMatchCacheStats = {};
+    g_sharedPropertyOverrides.clear();
 
-        if (!TestElementMatcher(element, override.elementMatcher,
-                                &visualStateGroup, fallbackClassName)) {
-            continue;
+    auto matchesByTypeAndName = [](const ElementMatcher& matcher) {
+        if (matcher.oneBasedIndex) {
+            return false;
         }
 
-        auto parentElementIter = element;
-        bool parentElementMatchFailed = false;
+        return std::visit(
+            [](const auto& propertyValues) { return propertyValues.empty(); },
+            matcher.propertyValues);
+    };
+
+    index.ruleInfos.reserve(g_elementsCustomizationRules.size());
 
-        for (auto& matcher : override.parentElementMatchers) {
-            // Using parentElementIter.Parent() was sometimes returning null.
-            parentElementIter =
-                Media::VisualTreeHelper::GetParent(parentElementIter)
-                    .try_as<FrameworkElement>();
-            if (!parentElementIter) {
-                parentElementMatchFailed = true;
-                break;
+    for (size_t i = 0; i < g_elementsCustomizationRules.size(); i++) {
+        const auto& rules = g_elementsCustomizationRules[i];
+
+        ElementCustomizationRulesIndex::RuleInfo ruleInfo{
+            .matchesByTypesAndNames =
+                matchesByTypeAndName(rules.elementMatcher),
+            .parentDepth = rules.parentElementMatchers.size(),
+            .visualStateGroupDepth =
+                rules.elementMatcher.visualStateGroupName ? 0 : -1,
+        };
+
+        for (size_t j = 0; j < rules.parentElementMatchers.size(); j++) {
+            const auto& parentMatcher = rules.parentElementMatchers[j];
+            if (!matchesByTypeAndName(parentMatcher)) {
+                ruleInfo.matchesByTypesAndNames = false;
             }
 
-            if (!TestElementMatcher(parentElementIter, matcher,
-                                    &visualStateGroup, nullptr)) {
-                parentElementMatchFailed = true;
-                break;
+            if (parentMatcher.visualStateGroupName) {
+                ruleInfo.visualStateGroupDepth = static_cast<int>(j + 1);
             }
         }
 
-        if (parentElementMatchFailed) {
+        index.ruleInfos.push_back(ruleInfo);
+
+        const auto& matcher = rules.elementMatcher;
+        if (matcher.type.empty()) {
+            index.anyType.push_back(i);
             continue;
         }
 
-        auto& overridesForVisualStateGroup = overrides[visualStateGroup];
-        for (const auto& [property, valuesPerVisualState] :
-             GetResolvedPropertyOverrides(
-                 override.elementMatcher.type,
-                 fallbackClassName ? fallbackClassName
-                                   : winrt::name_of<FrameworkElement>(),
-                 &override.propertyOverrides)) {
-            bool propertyInserted = propertiesAdded.insert(property).second;
-            if (!propertyInserted) {
-                continue;
-            }
-
-            auto& propertyOverrides = overridesForVisualStateGroup[property];
-            for (const auto& [visualState, value] : valuesPerVisualState) {
-                propertyOverrides.insert({visualState, value});
-            }
+        auto& rulesForType = index.byType[matcher.type];
+        if (matcher.name.empty()) {
+            rulesForType.anyName.push_back(i);
+        } else {
+            rulesForType.byName[matcher.name].push_back(i);
         }
     }
 
-    std::erase_if(overrides, [](const auto& item) {
-        auto const& [key, value] = item;
-        return value.empty();
-    });
-
-    return overrides;
+    Wh_Log(L"Indexed %zu rules, %zu types", g_elementsCustomizationRules.size(),
+           index.byType.size());
 }
 
-void ApplyCustomizationsForVisualStateGroup(
-    FrameworkElement element,
-    VisualStateGroup visualStateGroup,
-    PropertyOverrides propertyOverrides,
-    ElementCustomizationStateForVisualStateGroup*
-        elementCustomizationStateForVisualStateGroup) {
-    auto elementDo = element.as<DependencyObject>();
-
-    VisualState currentVisualState(
-        visualStateGroup ? visualStateGroup.CurrentState() : nullptr);
+// Returns the indices of the rules which might match an element with the given
+// type and name, in descending order.
+ElementCustomizationRuleIndices GetCandidateElementCustomizationRules(
+    std::wstring_view className,
+    std::wstring_view fallbackClassName,
+    std::wstring_view name) {
+    const auto& index = g_elementsCustomizationRulesIndex;
 
-    std::wstring currentVisualStateName(
-        currentVisualState ? currentVisualState.Name() : L"");
+    ElementCustomizationRuleIndices candidates = index.anyType;
 
-    for (const auto& [property, valuesPerVisualState] : propertyOverrides) {
-        const auto [propertyCustomizationStatesIt, inserted] =
-            elementCustomizationStateForVisualStateGroup
-                ->propertyCustomizationStates.insert({property, {}});
-        if (!inserted) {
-            continue;
+    auto addRulesForType = [&](std::wstring_view type) {
+        auto it = index.byType.find(type);
+        if (it == index.byType.end()) {
+            return;
+        }
+
+        const auto& rulesForType = it->second;
+        candidates.insert(candidates.end(), rulesForType.anyName.begin(),
+                          rulesForType.anyName.end());
+
+        if (!name.empty()) {
+            if (auto nameIt = rulesForType.byName.find(name);
+                nameIt != rulesForType.byName.end()) {
+                candidates.insert(candidates.end(), nameIt->second.begin(),
+                                  nameIt->second.end());
+            }
+        }
+    };
+
+    addRulesForType(className);
+    if (!fallbackClassName.empty() && fallbackClassName != className) {
+        addRulesForType(fallbackClassName);
+    }
+
+    std::sort(candidates.begin(), candidates.end(), std::greater<>{});
+
+    return candidates;
+}
+
+struct MatchedElementCustomizationRules {
+    size_t ruleIndex;
+    VisualStateGroup visualStateGroup;
+};
+
+bool TestElementCustomizationRules(FrameworkElement element,
+                                   ElementCustomizationRules& rules,
+                                   VisualStateGroup* visualStateGroup,
+                                   PCWSTR fallbackClassName) {
+    if (!TestElementMatcher(element, rules.elementMatcher, visualStateGroup,
+                            fallbackClassName)) {
+        return false;
+    }
+
+    auto parentElementIter = element;
+
+    for (auto& matcher : rules.parentElementMatchers) {
+        // Using parentElementIter.Parent() was sometimes returning null.
+        parentElementIter =
+            Media::VisualTreeHelper::GetParent(parentElementIter)
+                .try_as<FrameworkElement>();
+        if (!parentElementIter) {
+            return false;
+        }
+
+        if (!TestElementMatcher(parentElementIter, matcher, visualStateGroup,
+                                nullptr)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Returns the visual state group of a rule which is known to match the
+// element.
+VisualStateGroup GetMatchedRulesVisualStateGroup(
+    FrameworkElement element,
+    const ElementCustomizationRules& rules,
+    int visualStateGroupDepth) {
+    if (visualStateGroupDepth < 0) {
+        return nullptr;
+    }
+
+    const ElementMatcher* matcher =
+        visualStateGroupDepth == 0
+            ? &rules.elementMatcher
+            : &rules.parentElementMatchers[visualStateGroupDepth - 1];
+
+    auto elementIter = element;
+    for (int i = 0; i < visualStateGroupDepth; i++) {
+        elementIter = Media::VisualTreeHelper::GetParent(elementIter)
+                          .try_as<FrameworkElement>();
+        if (!elementIter) {
+            return nullptr;
+        }
+    }
+
+    return GetVisualStateGroup(elementIter, *matcher->visualStateGroupName);
+}
+
+std::wstring GetElementMatchSignature(FrameworkElement element,
+                                      std::wstring_view className,
+                                      std::wstring_view fallbackClassName,
+                                      std::wstring_view name,
+                                      size_t parentDepth) {
+    std::wstring signature;
+
+    auto append = [&signature](std::wstring_view str) {
+        signature += str;
+        signature += L'\0';
+    };
+
+    append(className);
+    append(fallbackClassName);
+    append(name);
+
+    auto parentElementIter = element;
+    for (size_t i = 0; i < parentDepth; i++) {
+        parentElementIter =
+            Media::VisualTreeHelper::GetParent(parentElementIter)
+                .try_as<FrameworkElement>();
+        if (!parentElementIter) {
+            signature += L'\1';
+            break;
+        }
+
+        append(winrt::get_class_name(parentElementIter));
+        append(parentElementIter.Name());
+    }
+
+    return signature;
+}
+
+// Returns the rules which match the element, in priority order.
+std::vector<MatchedElementCustomizationRules>
+FindMatchingElementCustomizationRules(FrameworkElement element,
+                                      PCWSTR fallbackClassName) {
+    const auto& index = g_elementsCustomizationRulesIndex;
+
+    std::vector<MatchedElementCustomizationRules> matchedRules;
+
+    auto className = winrt::get_class_name(element);
+    std::wstring_view fallbackClassNameView =
+        fallbackClassName ? fallbackClassName : L"";
+    auto name = element.Name();
+
+    const auto candidates = GetCandidateElementCustomizationRules(
+        className, fallbackClassNameView, name);
+
+    // The signature only needs to include the ancestors checked by the
+    // candidate rules, which are the same for all elements with the same
+    // type and name.
+    bool hasCacheableCandidates = false;
+    size_t parentDepth = 0;
+    for (size_t ruleIndex : candidates) {
+        const auto& ruleInfo = index.ruleInfos[ruleIndex];
+        if (ruleInfo.matchesByTypesAndNames) {
+            hasCacheableCandidates = true;
+            parentDepth = std::max(parentDepth, ruleInfo.parentDepth);
+        }
+    }
+
+    std::wstring signature;
+    const ElementCustomizationRuleIndices* cachedRules = nullptr;
+    ElementCustomizationRuleIndices newCachedRules;
+
+    if (hasCacheableCandidates) {
+        signature = GetElementMatchSignature(
+            element, className, fallbackClassNameView, name, parentDepth);
+        if (auto it = g_elementMatchCache.find(signature);
+            it != g_elementMatchCache.end()) {
+            cachedRules = &it->second;
+            g_elementMatchCacheStats.hits++;
+        } else {
+            g_elementMatchCacheStats.misses++;
+        }
+
+        size_t lookups =
+            g_elementMatchCacheStats.hits + g_elementMatchCacheStats.misses;
+        if (lookups % 10000 == 0) {
+            Wh_Log(L"Match cache: %zu hits, %zu misses",
+                   g_elementMatchCacheStats.hits,
+                   g_elementMatchCacheStats.misses);
+        }
+    }
+
+    for (size_t ruleIndex : candidates) {
+        auto& rules = g_elementsCustomizationRules[ruleIndex];
+        const auto& ruleInfo = index.ruleInfos[ruleIndex];
+
+        if (cachedRules && ruleInfo.matchesByTypesAndNames) {
+            if (std::binary_search(cachedRules->begin(), cachedRules->end(),
+                                   ruleIndex, std::greater<>{})) {
+                matchedRules.push_back(
+                    {ruleIndex,
+                     GetMatchedRulesVisualStateGroup(
+                         element, rules, ruleInfo.visualStateGroupDepth)});
+            }
+
+            continue;
+        }
+
+        VisualStateGroup visualStateGroup = nullptr;
+        if (!TestElementCustomizationRules(element, rules, &visualStateGroup,
+                                           fallbackClassName)) {
+            continue;
+        }
+
+        if (ruleInfo.matchesByTypesAndNames) {
+            newCachedRules.push_back(ruleIndex);
+        }
+
+        matchedRules.push_back({ruleIndex, std::move(visualStateGroup)});
+    }
+
+    if (hasCacheableCandidates && !cachedRules) {
+        // Keep the cache bounded in case the signatures don't repeat.
+        constexpr size_t kMaxElementMatchCacheSize = 4096;
+        if (g_elementMatchCache.size() >= kMaxElementMatchCacheSize) {
+            g_elementMatchCache.clear();
+        }
+
+        g_elementMatchCache.emplace(std::move(signature),
+                                    std::move(newCachedRules));
+    }
+
+    return matchedRules;
+}
+
+const std::wstring* InternVisualStateName(std::wstring_view name) {
+    auto it = g_visualStateNames.find(name);
+    if (it == g_visualStateNames.end()) {
+        it = g_visualStateNames.emplace(name).first;
+    }
+
+    return &*it;
+}
+
+// Returns nullptr if no override uses the name.
+const std::wstring* FindVisualStateName(std::wstring_view name) {
+    auto it = g_visualStateNames.find(name);
+    return it != g_visualStateNames.end() ? &*it : nullptr;
+}
+
+SharedPropertyOverrides MakeSharedPropertyOverrides(
+    const PropertyOverrides& propertyOverrides) {
+    auto result = std::make_shared<SharedPropertyOverridesData>();
+
+    for (const auto& [property, valuesPerVisualState] : propertyOverrides) {
+        for (const auto& [visualState, value] : valuesPerVisualState) {
+            result->entries.push_back({
+                .property = property,
+                .visualState = InternVisualStateName(visualState),
+                .value = value,
+            });
+        }
+    }
+
+    std::sort(result->entries.begin(), result->entries.end(),
+              [](const auto& a, const auto& b) {
+                  auto aProperty = winrt::get_abi(a.property);
+                  auto bProperty = winrt::get_abi(b.property);
+                  if (aProperty != bProperty) {
+                      return aProperty < bProperty;
+                  }
+
+                  return a.visualState < b.visualState;
+              });
+
+    result->entries.shrink_to_fit();
+
+    return result;
+}
+
+using SharedPropertyOverridesEntries =
+    std::span<const SharedPropertyOverridesData::Entry>;
+
+// Returns the entries of the property of the entry at the given index. The
+// entries of the next property start at the returned span's end.
+SharedPropertyOverridesEntries GetSharedPropertyOverrideEntries(
+    const SharedPropertyOverridesData& propertyOverrides,
+    size_t index) {
+    const auto& entries = propertyOverrides.entries;
+
+    size_t end = index + 1;
+    while (end < entries.size() &&
+           entries[end].property == entries[index].property) {
+        end++;
+    }
+
+    return SharedPropertyOverridesEntries(entries.data() + index, end - index);
+}
+
+const PropertyOverrideValue* FindSharedPropertyOverrideValue(
+    SharedPropertyOverridesEntries entries,
+    const std::wstring* visualState) {
+    if (!visualState) {
+        return nullptr;
+    }
+
+    for (const auto& entry : entries) {
+        if (entry.visualState == visualState) {
+            return &entry.value;
+        }
+    }
+
+    return nullptr;
+}
+
+size_t GetSharedPropertyOverridesSize(
+    const SharedPropertyOverridesData& propertyOverrides) {
+    return sizeof(propertyOverrides) +
+           propertyOverrides.entries.capacity() *
+               sizeof(SharedPropertyOverridesData::Entry);
+}
+
+std::vector<std::pair<VisualStateGroup, SharedPropertyOverrides>>
+GetElementPropertyOverrides(
+    const std::vector<MatchedElementCustomizationRules>& matchedRules,
+    PCWSTR fallbackClassName) {
+    std::vector<VisualStateGroup> visualStateGroups;
+    std::vector<size_t> key;
+    key.reserve(matchedRules.size() * 2);
+
+    for (const auto& [ruleIndex, visualStateGroup] : matchedRules) {
+        auto it = std::find(visualStateGroups.begin(), visualStateGroups.end(),
+                            visualStateGroup);
+        size_t slot = it - visualStateGroups.begin();
+        if (it == visualStateGroups.end()) {
+            visualStateGroups.push_back(visualStateGroup);
+        }
+
+        key.push_back(ruleIndex);
+        key.push_back(slot);
+    }
+
+    auto it = g_sharedPropertyOverrides.find(key);
+    if (it == g_sharedPropertyOverrides.end()) {
+        std::vector<PropertyOverrides> overrides(visualStateGroups.size());
+        std::unordered_set<DependencyProperty> propertiesAdded;
+
+        for (size_t i = 0; i < key.size(); i += 2) {
+            size_t ruleIndex = key[i];
+            size_t slot = key[i + 1];
+
+            auto& override = g_elementsCustomizationRules[ruleIndex];
+
+            auto& overridesForVisualStateGroup = overrides[slot];
+            for (const auto& [property, valuesPerVisualState] :
+                 GetResolvedPropertyOverrides(
+                     override.elementMatcher.type,
+                     fallbackClassName ? fallbackClassName
+                                       : winrt::name_of<FrameworkElement>(),
+                     &override.propertyOverrides)) {
+                bool propertyInserted = propertiesAdded.insert(property).second;
+                if (!propertyInserted) {
+                    continue;
+                }
+
+                auto& propertyOverrides =
+                    overridesForVisualStateGroup[property];
+                for (const auto& [visualState, value] : valuesPerVisualState) {
+                    propertyOverrides.insert({visualState, value});
+                }
+            }
+        }
+
+        std::vector<SharedPropertyOverrides> sharedOverrides;
+        sharedOverrides.reserve(overrides.size());
+        for (const auto& overridesForVisualStateGroup : overrides) {
+            sharedOverrides.push_back(
+                overridesForVisualStateGroup.empty()
+                    ? nullptr
+                    : MakeSharedPropertyOverrides(
+                          overridesForVisualStateGroup));
+        }
+
+        // Keep the cache bounded in case the rule combinations don't repeat.
+        constexpr size_t kMaxSharedPropertyOverridesSize = 4096;
+        if (g_sharedPropertyOverrides.size() >=
+            kMaxSharedPropertyOverridesSize) {
+            g_sharedPropertyOverrides.clear();
+        }
+
+        it = g_sharedPropertyOverrides
+                 .emplace(std::move(key), std::move(sharedOverrides))
+                 .first;
+    }
+
+    std::vector<std::pair<VisualStateGroup, SharedPropertyOverrides>> result;
+    for (size_t slot = 0; slot < visualStateGroups.size(); slot++) {
+        if (it->second[slot]) {
+            result.push_back({visualStateGroups[slot], it->second[slot]});
+        }
+    }
+
+    return result;
+}
+
+void ApplyCustomizationsForVisualStateGroup(
+    FrameworkElement element,
+    VisualStateGroup visualStateGroup,
+    SharedPropertyOverrides propertyOverrides,
+    ElementCustomizationStateForVisualStateGroup*
+        elementCustomizationStateForVisualStateGroup) {
+    auto elementDo = element.as<DependencyObject>();
+
+    VisualState currentVisualState(
+        visualStateGroup ? visualStateGroup.CurrentState() : nullptr);
+
+    std::wstring currentVisualStateName(
+        currentVisualState ? currentVisualState.Name() : L"");
+
+    const std::wstring* currentVisualStateNameInterned =
+        FindVisualStateName(currentVisualStateName);
+    const std::wstring* emptyVisualStateNameInterned = FindVisualStateName(L"");
+
+    for (size_t i = 0; i < propertyOverrides->entries.size();) {
+        auto valuesPerVisualState =
+            GetSharedPropertyOverrideEntries(*propertyOverrides, i);
+        i += valuesPerVisualState.size();
+
+        const auto& property = valuesPerVisualState.front().property;
+
+        const auto [propertyCustomizationStatesIt, inserted] =
+            elementCustomizationStateForVisualStateGroup
+                ->propertyCustomizationStates.insert({property, {}});
+        if (!inserted) {
+            continue;
         }
 
         auto& propertyCustomizationState =
             propertyCustomizationStatesIt->second;
 
-        auto it = valuesPerVisualState.find(currentVisualStateName);
-        if (it == valuesPerVisualState.end() &&
-            !currentVisualStateName.empty()) {
-            it = valuesPerVisualState.find(L"");
+        auto* value = FindSharedPropertyOverrideValue(
+            valuesPerVisualState, currentVisualStateNameInterned);
+        if (!value && !currentVisualStateName.empty()) {
+            value = FindSharedPropertyOverrideValue(
+                valuesPerVisualState, emptyVisualStateNameInterned);
         }
 
-        if (it != valuesPerVisualState.end()) {
+        if (value) {
             propertyCustomizationState.originalValue =
                 ReadLocalValueWithWorkaround(element, property);
-            propertyCustomizationState.customValue = it->second;
-            SetOrClearValue(element, property, it->second,
+            propertyCustomizationState.customValue = *value;
+            SetOrClearValue(element, property, *value,
                             /*initialApply=*/true);
         }
 
@@ -4809,37 +5736,49 @@ void ApplyCustomizationsForVisualStateGroup(
                         elementCustomizationStateForVisualStateGroup
                             ->propertyCustomizationStates;
 
-                    for (const auto& [property, valuesPerVisualState] :
-                         propertyOverrides) {
+                    auto newState = e.NewState();
+                    const std::wstring* newStateName = FindVisualStateName(
+                        newState ? newState.Name() : L"");
+                    auto oldState = e.OldState();
+                    const std::wstring* oldStateName = FindVisualStateName(
+                        oldState ? oldState.Name() : L"");
+                    const std::wstring* emptyStateName =
+                        FindVisualStateName(L"");
+
+                    for (size_t i = 0; i < propertyOverrides->entries.size();) {
+                        auto valuesPerVisualState =
+                            GetSharedPropertyOverrideEntries(*propertyOverrides,
+                                                             i);
+                        i += valuesPerVisualState.size();
+
+                        const auto& property =
+                            valuesPerVisualState.front().property;
+
                         auto& propertyCustomizationState =
                             propertyCustomizationStates.at(property);
 
-                        auto newState = e.NewState();
-                        auto newStateName =
-                            std::wstring{newState ? newState.Name() : L""};
-                        auto it = valuesPerVisualState.find(newStateName);
-                        if (it == valuesPerVisualState.end()) {
-                            it = valuesPerVisualState.find(L"");
-                            if (it != valuesPerVisualState.end()) {
-                                auto oldState = e.OldState();
-                                auto oldStateName = std::wstring{
-                                    oldState ? oldState.Name() : L""};
-                                if (!valuesPerVisualState.contains(
-                                        oldStateName)) {
+                        auto* value = FindSharedPropertyOverrideValue(
+                            valuesPerVisualState, newStateName);
+                        if (!value) {
+                            value = FindSharedPropertyOverrideValue(
+                                valuesPerVisualState, emptyStateName);
+                            if (value) {
+                                if (!FindSharedPropertyOverrideValue(
+                                        valuesPerVisualState, oldStateName)) {
                                     continue;
                                 }
                             }
                         }
 
-                        if (it != valuesPerVisualState.end()) {
+                        if (value) {
                             if (!propertyCustomizationState.originalValue) {
                                 propertyCustomizationState.originalValue =
                                     ReadLocalValueWithWorkaround(element,
                                                                  property);
                             }
 
-                            propertyCustomizationState.customValue = it->second;
-                            SetOrClearValue(element, property, it->second);
+                            propertyCustomizationState.customValue = *value;
+                            SetOrClearValue(element, property, *value);
                         } else {
                             if (propertyCustomizationState.originalValue) {
                                 SetOrClearValue(
@@ -4891,61 +5830,269 @@ void RestoreCustomizationsForVisualStateGroup(
 void ApplyCustomizations(InstanceHandle handle,
                          FrameworkElement element,
                          PCWSTR fallbackClassName) {
-    auto overrides = FindElementPropertyOverrides(element, fallbackClassName);
+    auto matchedRules =
+        FindMatchingElementCustomizationRules(element, fallbackClassName);
+
+    std::vector<uint64_t> matchedRuleKeys;
+    matchedRuleKeys.reserve(matchedRules.size());
+    for (const auto& matchedRule : matchedRules) {
+        matchedRuleKeys.push_back(
+            g_elementsCustomizationRulesKeys[matchedRule.ruleIndex]);
+    }
+
+    // The element might already be customized if it's reported again after
+    // a settings change. Keep the existing customizations if the element is
+    // matched by the same rules.
+    if (auto* existingState = g_elementsCustomizationState.Find(handle)) {
+        if (existingState->matchedRuleKeys == matchedRuleKeys &&
+            existingState->element.get() == element) {
+            Wh_Log(L"Keeping unchanged styles");
+            return;
+        }
+
+        if (matchedRules.empty()) {
+            Wh_Log(L"Removing styles");
+            CleanupCustomizations(handle);
+            return;
+        }
+    }
+
+    auto overrides =
+        GetElementPropertyOverrides(matchedRules, fallbackClassName);
     if (overrides.empty()) {
+        CleanupCustomizations(handle);
         return;
     }
 
     Wh_Log(L"Applying styles");
 
-    auto& elementCustomizationState = g_elementsCustomizationState[handle];
+    auto& pools = g_elementCustomizationStatePools;
+
+    auto* elementCustomizationStatePtr =
+        g_elementsCustomizationState.Find(handle);
+    if (!elementCustomizationStatePtr) {
+        elementCustomizationStatePtr = pools.elements.New();
+        g_elementsCustomizationState.Insert(handle,
+                                            elementCustomizationStatePtr);
+    }
+
+    auto& elementCustomizationState = *elementCustomizationStatePtr;
 
     for (const auto& [visualStateGroupOptionalWeakPtrIter, stateIter] :
          elementCustomizationState.perVisualStateGroup) {
         RestoreCustomizationsForVisualStateGroup(
-            element, visualStateGroupOptionalWeakPtrIter, stateIter);
+            element, visualStateGroupOptionalWeakPtrIter, *stateIter);
+        pools.visualStateGroups.Delete(stateIter);
     }
 
     elementCustomizationState.element = element;
+    elementCustomizationState.matchedRuleKeys = std::move(matchedRuleKeys);
     elementCustomizationState.perVisualStateGroup.clear();
 
-    for (auto& [visualStateGroup, overridesForVisualStateGroup] : overrides) {
+    for (const auto& [visualStateGroup, overridesForVisualStateGroup] :
+         overrides) {
         std::optional<winrt::weak_ref<VisualStateGroup>>
             visualStateGroupOptionalWeakPtr;
         if (visualStateGroup) {
             visualStateGroupOptionalWeakPtr = visualStateGroup;
         }
 
-        elementCustomizationState.perVisualStateGroup.push_back(
-            {visualStateGroupOptionalWeakPtr, {}});
         auto* elementCustomizationStateForVisualStateGroup =
-            &elementCustomizationState.perVisualStateGroup.back().second;
+            pools.visualStateGroups.New();
+        elementCustomizationState.perVisualStateGroup.push_back(
+            {visualStateGroupOptionalWeakPtr,
+             elementCustomizationStateForVisualStateGroup});
 
         ApplyCustomizationsForVisualStateGroup(
-            element, visualStateGroup, std::move(overridesForVisualStateGroup),
+            element, visualStateGroup, overridesForVisualStateGroup,
             elementCustomizationStateForVisualStateGroup);
     }
 }
 
 void CleanupCustomizations(InstanceHandle handle) {
-    if (auto it = g_elementsCustomizationState.find(handle);
-        it != g_elementsCustomizationState.end()) {
-        auto& elementCustomizationState = it->second;
+    if (auto* elementCustomizationState =
+            g_elementsCustomizationState.Erase(handle)) {
+        auto& pools = g_elementCustomizationStatePools;
 
-        auto element = elementCustomizationState.element.get();
+        auto element = elementCustomizationState->element.get();
 
         for (const auto& [visualStateGroupOptionalWeakPtrIter, stateIter] :
-             elementCustomizationState.perVisualStateGroup) {
+             elementCustomizationState->perVisualStateGroup) {
             RestoreCustomizationsForVisualStateGroup(
-                element, visualStateGroupOptionalWeakPtrIter, stateIter);
+                element, visualStateGroupOptionalWeakPtrIter, *stateIter);
+            pools.visualStateGroups.Delete(stateIter);
         }
 
-        g_elementsCustomizationState.erase(it);
+        pools.elements.Delete(elementCustomizationState);
     }
 }
 
 using StyleConstant = std::pair<std::wstring, std::wstring>;
-using StyleConstants = std::vector<StyleConstant>;
+
+// Constant names are kept in a trie, which allows to substitute all constants
+// in a single pass by finding the longest name that follows each '$'. Constant
+// values can refer to other constants, and are expanded when loaded.
+class StyleConstants {
+   public:
+    StyleConstants() : m_nodes(1) {}
+
+    // Later definitions override earlier definitions with the same name.
+    explicit StyleConstants(std::vector<StyleConstant> constants)
+        : m_nodes(1) {
+        for (auto& [name, value] : constants) {
+            uint32_t nodeIndex = 0;
+            for (WCHAR c : name) {
+                nodeIndex = GetOrAddChild(nodeIndex, c);
+            }
+
+            if (m_nodes[nodeIndex].valueIndex == kNoValue) {
+                m_nodes[nodeIndex].valueIndex =
+                    static_cast<uint32_t>(m_values.size());
+                m_values.push_back(std::move(value));
+            } else {
+                m_values[m_nodes[nodeIndex].valueIndex] = std::move(value);
+            }
+        }
+
+        std::vector<ExpandState> expandStates(m_values.size(),
+                                              ExpandState::kNotExpanded);
+        for (size_t i = 0; i < m_values.size(); i++) {
+            ExpandValue(i, expandStates);
+        }
+    }
+
+    std::wstring Apply(std::wstring_view style) const {
+        // Calculate the result size first to allocate it only once.
+        size_t resultSize = 0;
+        ForEachPart(style, [&resultSize](std::wstring_view part) {
+            resultSize += part.size();
+        });
+
+        std::wstring result;
+        result.reserve(resultSize);
+        ForEachPart(style,
+                    [&result](std::wstring_view part) { result += part; });
+
+        return result;
+    }
+
+   private:
+    static constexpr uint32_t kNoValue = 0xFFFFFFFF;
+
+    struct Node {
+        std::vector<std::pair<WCHAR, uint32_t>> children;
+        uint32_t valueIndex = kNoValue;
+    };
+
+    enum class ExpandState {
+        kNotExpanded,
+        kExpanding,
+        kExpanded,
+    };
+
+    uint32_t FindChild(uint32_t nodeIndex, WCHAR c) const {
+        for (const auto& [childChar, childIndex] :
+             m_nodes[nodeIndex].children) {
+            if (childChar == c) {
+                return childIndex;
+            }
+        }
+
+        return 0;
+    }
+
+    uint32_t GetOrAddChild(uint32_t nodeIndex, WCHAR c) {
+        if (uint32_t childIndex = FindChild(nodeIndex, c)) {
+            return childIndex;
+        }
+
+        uint32_t childIndex = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.emplace_back();
+        m_nodes[nodeIndex].children.push_back({c, childIndex});
+        return childIndex;
+    }
+
+    // Returns the value index and the name length of the longest constant
+    // name which is a prefix of str.
+    std::pair<uint32_t, size_t> FindLongestMatch(std::wstring_view str) const {
+        uint32_t valueIndex = m_nodes[0].valueIndex;
+        size_t nameLength = 0;
+
+        uint32_t nodeIndex = 0;
+        for (size_t i = 0; i < str.size(); i++) {
+            nodeIndex = FindChild(nodeIndex, str[i]);
+            if (!nodeIndex) {
+                break;
+            }
+
+            if (m_nodes[nodeIndex].valueIndex != kNoValue) {
+                valueIndex = m_nodes[nodeIndex].valueIndex;
+                nameLength = i + 1;
+            }
+        }
+
+        return {valueIndex, nameLength};
+    }
+
+    // Calls the callback with consecutive parts of the result.
+    template <typename F>
+    void ForEachPart(std::wstring_view style, F&& callback) const {
+        size_t lastPos = 0;
+        size_t findPos;
+
+        while ((findPos = style.find('$', lastPos)) != style.npos) {
+            callback(style.substr(lastPos, findPos - lastPos));
+
+            auto [valueIndex, nameLength] =
+                FindLongestMatch(style.substr(findPos + 1));
+            if (valueIndex != kNoValue) {
+                callback(m_values[valueIndex]);
+                lastPos = findPos + 1 + nameLength;
+            } else {
+                callback(L"$");
+                lastPos = findPos + 1;
+            }
+        }
+
+        // Care for the rest after last occurrence.
+        callback(style.substr(lastPos));
+    }
+
+    void ExpandValue(size_t valueIndex, std::vector<ExpandState>& states) {
+        if (states[valueIndex] != ExpandState::kNotExpanded) {
+            return;
+        }
+
+        states[valueIndex] = ExpandState::kExpanding;
+
+        const auto& value = m_values[valueIndex];
+        for (size_t pos = value.find('$'); pos != value.npos;
+             pos = value.find('$', pos + 1)) {
+            auto [referencedIndex, nameLength] =
+                FindLongestMatch(std::wstring_view(value).substr(pos + 1));
+            if (referencedIndex == kNoValue) {
+                continue;
+            }
+
+            if (states[referencedIndex] == ExpandState::kExpanding) {
+                // Leave circular references as is.
+                Wh_Log(L"Circular style constant reference");
+                continue;
+            }
+
+            ExpandValue(referencedIndex, states);
+        }
+
+        // All referenced constants which aren't part of a cycle are expanded
+        // now. A constant that's part of a cycle is replaced with its value as
+        // it was at this point.
+        m_values[valueIndex] = Apply(m_values[valueIndex]);
+        states[valueIndex] = ExpandState::kExpanded;
+    }
+
+    std::vector<Node> m_nodes;
+    std::vector<std::wstring> m_values;
+};
 
 std::optional<StyleConstant> ParseStyleConstant(std::wstring_view constant) {
     // Skip if commented.
@@ -4968,7 +6115,7 @@ std::optional<StyleConstant> ParseStyleConstant(std::wstring_view constant) {
 
 StyleConstants LoadStyleConstants(
     const std::vector<PCWSTR>& themeStyleConstants) {
-    StyleConstants result;
+    std::vector<StyleConstant> result;
 
     for (const auto themeStyleConstant : themeStyleConstants) {
         if (auto parsed = ParseStyleConstant(themeStyleConstant)) {
@@ -4988,49 +6135,12 @@ StyleConstants LoadStyleConstants(
         }
     }
 
-    // Reverse the order to allow overriding definitions with the same name.
-    std::reverse(result.begin(), result.end());
-
-    // Sort by name length to replace long names first.
-    std::stable_sort(result.begin(), result.end(),
-                     [](const StyleConstant& a, const StyleConstant& b) {
-                         return a.first.size() > b.first.size();
-                     });
-
-    return result;
+    return StyleConstants(std::move(result));
 }
 
 std::wstring ApplyStyleConstants(std::wstring_view style,
                                  const StyleConstants& styleConstants) {
-    std::wstring result;
-
-    size_t lastPos = 0;
-    size_t findPos;
-
-    while ((findPos = style.find('$', lastPos)) != style.npos) {
-        result.append(style, lastPos, findPos - lastPos);
-
-        const StyleConstant* constant = nullptr;
-        for (const auto& s : styleConstants) {
-            if (s.first == style.substr(findPos + 1, s.first.size())) {
-                constant = &s;
-                break;
-            }
-        }
-
-        if (constant) {
-            result += constant->second;
-            lastPos = findPos + 1 + constant->first.size();
-        } else {
-            result += '$';
-            lastPos = findPos + 1;
-        }
-    }
-
-    // Care for the rest after last occurrence.
-    result += style.substr(lastPos);
-
-    return result;
+    return styleConstants.Apply(style);
 }
 
 ElementMatcher ElementMatcherFromString(std::wstring_view str) {
@@ -5322,7 +6432,7 @@ std::optional<bool> IsOsFeatureEnabled(UINT32 featureId) {
     return std::nullopt;
 }
 
-void ProcessAllStylesFromSettings() {
+const Theme* GetThemeFromSettings() {
     PCWSTR themeName = Wh_GetStringSetting(L"theme");
     const Theme* theme = nullptr;
     if (wcscmp(themeName, L"TranslucentTaskbar") == 0) {
@@ -5377,6 +6487,13 @@ void ProcessAllStylesFromSettings() {
     }
     Wh_FreeStringSetting(themeName);
 
+    return theme;
+}
+
+// Returns whether all styles were processed without errors.
+bool ProcessAllStylesFromSettings(const Theme* theme) {
+    bool succeeded = true;
+
     StyleConstants styleConstants = LoadStyleConstants(
         theme ? theme->styleConstants : std::vector<PCWSTR>{});
 
@@ -5393,8 +6510,10 @@ void ProcessAllStylesFromSettings() {
                                              std::move(styles));
             } catch (winrt::hresult_error const& ex) {
                 Wh_Log(L"Error %08X", ex.code());
+                succeeded = false;
             } catch (std::exception const& ex) {
                 Wh_Log(L"Error: %S", ex.what());
+                succeeded = false;
             }
         }
     }
@@ -5406,12 +6525,476 @@ void ProcessAllStylesFromSettings() {
             }
         } catch (winrt::hresult_error const& ex) {
             Wh_Log(L"Error %08X: %s", ex.code(), ex.message().c_str());
+            succeeded = false;
         } catch (std::exception const& ex) {
             Wh_Log(L"Error: %S", ex.what());
+            succeeded = false;
+        }
+    }
+
+    return succeeded;
+}
+
+// A cache of the parsed rules, which allows to skip parsing the theme and the
+// settings on the next explorer start. The cache is keyed by a hash of the
+// mod build, the theme's content and all style settings, so any change in
+// either of them invalidates it.
+constexpr uint32_t kRulesCacheMagic = 0x52535748;  // "WHSR"
+constexpr uint32_t kRulesCacheVersion = 2;
+
+struct RulesCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t settingsHash;
+    uint32_t ruleCount;
+};
+
+class StylesSettingsHasher {
+   public:
+    void AddBytes(const void* data, size_t size) {
+        // FNV-1a.
+        const BYTE* p = static_cast<const BYTE*>(data);
+        for (size_t i = 0; i < size; i++) {
+            m_hash ^= p[i];
+            m_hash *= 0x100000001B3;
+        }
+    }
+
+    void Add(std::wstring_view str) {
+        for (WCHAR c : str) {
+            AddBytes(&c, sizeof(c));
+        }
+
+        // Add a separator to distinguish e.g. "ab","c" from "a","bc".
+        uint32_t size = static_cast<uint32_t>(str.size());
+        AddBytes(&size, sizeof(size));
+    }
+
+    uint64_t Hash() const { return m_hash; }
+
+   private:
+    uint64_t m_hash = 0xCBF29CE484222325;
+};
+
+uint64_t HashStylesSettings(const Theme* theme) {
+    StylesSettingsHasher hasher;
+
+    hasher.Add(std::to_wstring(kRulesCacheVersion));
+
+    // The mod version and build time invalidate the cache on every update,
+    // even if a parser or serialization change didn't bump the version above.
+#ifdef WH_MOD_VERSION
+    hasher.AddBytes(WH_MOD_VERSION, sizeof(WH_MOD_VERSION));
+#endif
+    hasher.AddBytes(__DATE__ " " __TIME__, sizeof(__DATE__ " " __TIME__));
+
+    if (theme) {
+        for (const auto& themeTargetStyle : theme->targetStyles) {
+            hasher.Add(themeTargetStyle.target);
+            for (const auto& style : themeTargetStyle.styles) {
+                hasher.Add(style);
+            }
+
+            hasher.Add(L"");
+        }
+
+        for (const auto& styleConstant : theme->styleConstants) {
+            hasher.Add(styleConstant);
+        }
+    }
+
+    hasher.Add(L"");
+
+    for (int i = 0;; i++) {
+        string_setting_unique_ptr constantSetting(
+            Wh_GetStringSetting(L"styleConstants[%d]", i));
+        hasher.Add(constantSetting.get());
+        if (!*constantSetting.get()) {
+            break;
         }
     }
+
+    for (int i = 0;; i++) {
+        string_setting_unique_ptr targetStringSetting(
+            Wh_GetStringSetting(L"controlStyles[%d].target", i));
+        hasher.Add(targetStringSetting.get());
+        if (!*targetStringSetting.get()) {
+            break;
+        }
+
+        for (int styleIndex = 0;; styleIndex++) {
+            string_setting_unique_ptr styleSetting(Wh_GetStringSetting(
+                L"controlStyles[%d].styles[%d]", i, styleIndex));
+            hasher.Add(styleSetting.get());
+            if (!*styleSetting.get()) {
+                break;
+            }
+        }
+    }
+
+    return hasher.Hash();
 }
 
+class RulesCacheWriter {
+   public:
+    void Write(const void* data, size_t size) {
+        const BYTE* p = static_cast<const BYTE*>(data);
+        m_buffer.insert(m_buffer.end(), p, p + size);
+    }
+
+    void WriteUInt32(uint32_t value) { Write(&value, sizeof(value)); }
+
+    void WriteString(std::wstring_view str) {
+        WriteUInt32(static_cast<uint32_t>(str.size()));
+        Write(str.data(), str.size() * sizeof(WCHAR));
+    }
+
+    void WriteElementMatcher(const ElementMatcher& matcher) {
+        WriteString(matcher.type);
+        WriteString(matcher.name);
+        WriteUInt32(matcher.visualStateGroupName ? 1 : 0);
+        if (matcher.visualStateGroupName) {
+            WriteString(*matcher.visualStateGroupName);
+        }
+        WriteUInt32(static_cast<uint32_t>(matcher.oneBasedIndex));
+
+        const auto& propertyValues =
+            std::get<PropertyValuesUnresolved>(matcher.propertyValues);
+        WriteUInt32(static_cast<uint32_t>(propertyValues.size()));
+        for (const auto& [property, value] : propertyValues) {
+            WriteString(property);
+            WriteString(value);
+        }
+    }
+
+    void WriteElementCustomizationRules(
+        const ElementCustomizationRules& rules) {
+        WriteElementMatcher(rules.elementMatcher);
+
+        WriteUInt32(static_cast<uint32_t>(rules.parentElementMatchers.size()));
+        for (const auto& matcher : rules.parentElementMatchers) {
+            WriteElementMatcher(matcher);
+        }
+
+        const auto& styleRules =
+            std::get<PropertyOverridesUnresolved>(rules.propertyOverrides);
+        WriteUInt32(static_cast<uint32_t>(styleRules.size()));
+        for (const auto& styleRule : styleRules) {
+            WriteString(styleRule.name);
+            WriteString(styleRule.visualState);
+            WriteString(styleRule.value);
+            WriteUInt32(styleRule.isXamlValue ? 1 : 0);
+        }
+    }
+
+    const std::vector<BYTE>& Buffer() const { return m_buffer; }
+
+   private:
+    std::vector<BYTE> m_buffer;
+};
+
+class RulesCacheReader {
+   public:
+    RulesCacheReader(const BYTE* data, size_t size)
+        : m_p(data), m_end(data + size) {}
+
+    void Read(void* data, size_t size) {
+        if (size > static_cast<size_t>(m_end - m_p)) {
+            throw std::runtime_error("Rules cache is truncated");
+        }
+
+        memcpy(data, m_p, size);
+        m_p += size;
+    }
+
+    uint32_t ReadUInt32() {
+        uint32_t value;
+        Read(&value, sizeof(value));
+        return value;
+    }
+
+    std::wstring ReadString() {
+        uint32_t size = ReadUInt32();
+        if (size > static_cast<size_t>(m_end - m_p) / sizeof(WCHAR)) {
+            throw std::runtime_error("Rules cache is truncated");
+        }
+
+        std::wstring str(reinterpret_cast<const WCHAR*>(m_p), size);
+        m_p += size * sizeof(WCHAR);
+        return str;
+    }
+
+    ElementMatcher ReadElementMatcher() {
+        ElementMatcher matcher;
+        matcher.type = ReadString();
+        matcher.name = ReadString();
+        if (ReadUInt32()) {
+            matcher.visualStateGroupName = ReadString();
+        }
+        matcher.oneBasedIndex = static_cast<int>(ReadUInt32());
+
+        PropertyValuesUnresolved propertyValues;
+        uint32_t count = ReadUInt32();
+        for (uint32_t i = 0; i < count; i++) {
+            auto property = ReadString();
+            auto value = ReadString();
+            propertyValues.push_back({std::move(property), std::move(value)});
+        }
+
+        matcher.propertyValues = std::move(propertyValues);
+        return matcher;
+    }
+
+    ElementCustomizationRules ReadElementCustomizationRules() {
+        ElementCustomizationRules rules;
+        rules.elementMatcher = ReadElementMatcher();
+
+        uint32_t parentCount = ReadUInt32();
+        for (uint32_t i = 0; i < parentCount; i++) {
+            rules.parentElementMatchers.push_back(ReadElementMatcher());
+        }
+
+        PropertyOverridesUnresolved styleRules;
+        uint32_t styleCount = ReadUInt32();
+        for (uint32_t i = 0; i < styleCount; i++) {
+            StyleRule styleRule;
+            styleRule.name = ReadString();
+            styleRule.visualState = ReadString();
+            styleRule.value = ReadString();
+            styleRule.isXamlValue = ReadUInt32() != 0;
+            styleRules.push_back(std::move(styleRule));
+        }
+
+        rules.propertyOverrides = std::move(styleRules);
+        return rules;
+    }
+
+    bool AtEnd() const { return m_p == m_end; }
+
+   private:
+    const BYTE* m_p;
+    const BYTE* m_end;
+};
+
+std::filesystem::path GetRulesCacheFilePath() {
+    WCHAR storagePathBuffer[MAX_PATH];
+    if (!Wh_GetModStoragePath(storagePathBuffer,
+                              ARRAYSIZE(storagePathBuffer))) {
+        Wh_Log(L"Wh_GetModStoragePath failed");
+        return std::filesystem::path{};
+    }
+
+    return std::filesystem::path{storagePathBuffer} / L"rules-cache.bin";
+}
+
+bool LoadElementCustomizationRulesFromCache(uint64_t settingsHash) {
+    auto cacheFilePath = GetRulesCacheFilePath();
+    if (cacheFilePath.empty()) {
+        return false;
+    }
+
+    HANDLE file = CreateFile(cacheFilePath.c_str(), GENERIC_READ,
+                             FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr,
+                             OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER fileSize;
+    HANDLE mapping = nullptr;
+    const BYTE* view = nullptr;
+    if (GetFileSizeEx(file, &fileSize) &&
+        fileSize.QuadPart >= static_cast<LONGLONG>(sizeof(RulesCacheHeader))) {
+        mapping =
+            CreateFileMapping(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping) {
+            view = static_cast<const BYTE*>(
+                MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+        }
+    }
+
+    std::vector<ElementCustomizationRules> rules;
+    bool loaded = false;
+
+    if (view) {
+        try {
+            RulesCacheReader reader(view,
+                                    static_cast<size_t>(fileSize.QuadPart));
+
+            RulesCacheHeader header;
+            reader.Read(&header, sizeof(header));
+            if (header.magic == kRulesCacheMagic &&
+                header.version == kRulesCacheVersion &&
+                header.settingsHash == settingsHash) {
+                rules.reserve(header.ruleCount);
+                for (uint32_t i = 0; i < header.ruleCount; i++) {
+                    rules.push_back(reader.ReadElementCustomizationRules());
+                }
+
+                loaded = reader.AtEnd();
+            }
+        } catch (std::exception const& ex) {
+            Wh_Log(L"Rules cache error: %S", ex.what());
+        }
+    }
+
+    if (view) {
+        UnmapViewOfFile(view);
+    }
+
+    if (mapping) {
+        CloseHandle(mapping);
+    }
+
+    CloseHandle(file);
+
+    if (!loaded) {
+        return false;
+    }
+
+    g_elementsCustomizationRules = std::move(rules);
+    return true;
+}
+
+void SaveElementCustomizationRulesToCache(uint64_t settingsHash) {
+    auto cacheFilePath = GetRulesCacheFilePath();
+    if (cacheFilePath.empty()) {
+        return;
+    }
+
+    RulesCacheWriter writer;
+
+    RulesCacheHeader header{
+        .magic = kRulesCacheMagic,
+        .version = kRulesCacheVersion,
+        .settingsHash = settingsHash,
+        .ruleCount = static_cast<uint32_t>(g_elementsCustomizationRules.size()),
+    };
+    writer.Write(&header, sizeof(header));
+
+    for (const auto& rules : g_elementsCustomizationRules) {
+        writer.WriteElementCustomizationRules(rules);
+    }
+
+    // Write to a temporary file first, since other threads or explorer
+    // instances might be reading the cache at the same time.
+    auto tempFilePath = cacheFilePath;
+    tempFilePath += L"." + std::to_wstring(GetCurrentProcessId()) + L"." +
+                    std::to_wstring(GetCurrentThreadId()) + L".tmp";
+
+    HANDLE file = CreateFile(tempFilePath.c_str(), GENERIC_WRITE, 0, nullptr,
+                             CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        Wh_Log(L"CreateFile failed: %u", GetLastError());
+        return;
+    }
+
+    const auto& buffer = writer.Buffer();
+    DWORD written = 0;
+    bool succeeded = WriteFile(file, buffer.data(),
+                               static_cast<DWORD>(buffer.size()), &written,
+                               nullptr) &&
+                     written == buffer.size();
+    CloseHandle(file);
+
+    if (!succeeded ||
+        !MoveFileEx(tempFilePath.c_str(), cacheFilePath.c_str(),
+                    MOVEFILE_REPLACE_EXISTING)) {
+        Wh_Log(L"Failed to write rules cache: %u", GetLastError());
+        DeleteFile(tempFilePath.c_str());
+        return;
+    }
+
+    Wh_Log(L"Saved %zu rules to cache, %zu bytes",
+           g_elementsCustomizationRules.size(), buffer.size());
+}
+
+void LoadAllStylesFromSettings() {
+    const Theme* theme = GetThemeFromSettings();
+    uint64_t settingsHash = HashStylesSettings(theme);
+
+    if (LoadElementCustomizationRulesFromCache(settingsHash)) {
+        Wh_Log(L"Loaded %zu rules from cache",
+               g_elementsCustomizationRules.size());
+        return;
+    }
+
+    // Only cache rules which were processed without errors, so that the errors
+    // keep being reported until fixed.
+    if (ProcessAllStylesFromSettings(theme)) {
+        SaveElementCustomizationRulesToCache(settingsHash);
+    }
+}
+
+// Must be called before the rules are resolved.
+std::vector<uint64_t> GetElementCustomizationRulesKeys() {
+    std::vector<uint64_t> keys;
+    keys.reserve(g_elementsCustomizationRules.size());
+
+    for (const auto& rules : g_elementsCustomizationRules) {
+        RulesCacheWriter writer;
+        writer.WriteElementCustomizationRules(rules);
+
+        StylesSettingsHasher hasher;
+        hasher.AddBytes(writer.Buffer().data(), writer.Buffer().size());
+        keys.push_back(hasher.Hash());
+    }
+
+    return keys;
+}
+
+struct ElementCustomizationRulesDiff {
+    size_t added = 0;
+    size_t removed = 0;
+    size_t unchanged = 0;
+};
+
+ElementCustomizationRulesDiff DiffElementCustomizationRules(
+    const std::vector<uint64_t>& oldKeys,
+    const std::vector<uint64_t>& newKeys) {
+    std::unordered_map<uint64_t, size_t> oldKeyCounts;
+    for (auto key : oldKeys) {
+        oldKeyCounts[key]++;
+    }
+
+    ElementCustomizationRulesDiff diff;
+
+    for (auto key : newKeys) {
+        auto it = oldKeyCounts.find(key);
+        if (it != oldKeyCounts.end() && it->second > 0) {
+            it->second--;
+            diff.unchanged++;
+        } else {
+            diff.added++;
+        }
+    }
+
+    diff.removed = oldKeys.size() - diff.unchanged;
+
+    return diff;
+}
+
+uint64_t HashResourceVariablesSettings() {
+    StylesSettingsHasher hasher;
+
+    for (int i = 0;; i++) {
+        string_setting_unique_ptr variableKeyStringSetting(
+            Wh_GetStringSetting(L"resourceVariables[%d].variableKey", i));
+        hasher.Add(variableKeyStringSetting.get());
+        if (!*variableKeyStringSetting.get()) {
+            break;
+        }
+
+        string_setting_unique_ptr valueStringSetting(
+            Wh_GetStringSetting(L"resourceVariables[%d].value", i));
+        hasher.Add(valueStringSetting.get());
+    }
+
+    return hasher.Hash();
+}
+
+thread_local uint64_t g_resourceVariablesSettingsHash;
+
 bool ProcessSingleResourceVariableFromSettings(int index) {
     string_setting_unique_ptr variableKeyStringSetting(
         Wh_GetStringSetting(L"resourceVariables[%d].variableKey", index));
@@ -5477,20 +7060,43 @@ void UninitializeForCurrentThread() {
 
     g_delayedBackgroundFillSet.clear();
 
-    for (const auto& [handle, elementCustomizationState] :
-         g_elementsCustomizationState) {
-        auto element = elementCustomizationState.element.get();
+    g_elementsCustomizationState.ForEach(
+        [](InstanceHandle,
+           const ElementCustomizationState* elementCustomizationState) {
+            auto element = elementCustomizationState->element.get();
 
-        for (const auto& [visualStateGroupOptionalWeakPtrIter, stateIter] :
-             elementCustomizationState.perVisualStateGroup) {
-            RestoreCustomizationsForVisualStateGroup(
-                element, visualStateGroupOptionalWeakPtrIter, stateIter);
+            for (const auto& [visualStateGroupOptionalWeakPtrIter, stateIter] :
+                 elementCustomizationState->perVisualStateGroup) {
+                RestoreCustomizationsForVisualStateGroup(
+                    element, visualStateGroupOptionalWeakPtrIter, *stateIter);
+            }
+        });
+
+    // Approximate, excluding allocator overhead.
+    size_t sharedOverridesSize = 0;
+    for (const auto& [key, sharedOverrides] : g_sharedPropertyOverrides) {
+        for (const auto& overridesForVisualStateGroup : sharedOverrides) {
+            if (overridesForVisualStateGroup) {
+                sharedOverridesSize += GetSharedPropertyOverridesSize(
+                    *overridesForVisualStateGroup);
+            }
         }
     }
 
-    g_elementsCustomizationState.clear();
+    Wh_Log(L"Freeing the state of %zu elements, shared overrides: %zu bytes",
+           g_elementsCustomizationState.Size(), sharedOverridesSize);
+
+    // Free all states at once.
+    g_elementsCustomizationState.Clear();
+    g_elementCustomizationStatePools.visualStateGroups.Clear();
+    g_elementCustomizationStatePools.elements.Clear();
 
     g_elementsCustomizationRules.clear();
+    g_elementsCustomizationRulesIndex = {};
+    g_elementMatchCache.clear();
+    g_sharedPropertyOverrides.clear();
+    g_elementsCustomizationRulesKeys.clear();
+    g_batchResolvedTypes.clear();
 
     g_initializedForThread = false;
 }
@@ -5509,12 +7115,49 @@ void InitializeForCurrentThread() {
         return;
     }
 
-    ProcessAllStylesFromSettings();
+    LoadAllStylesFromSettings();
+    g_elementsCustomizationRulesKeys = GetElementCustomizationRulesKeys();
+    BuildElementCustomizationRulesIndex();
     ProcessResourceVariablesFromSettings();
+    g_resourceVariablesSettingsHash = HashResourceVariablesSettings();
 
     g_initializedForThread = true;
 }
 
+// Reloads the rules, but keeps the customizations of existing elements. When
+// the elements are reported again, only elements which are matched by a
+// different set of rules are re-styled.
+void ReloadForCurrentThread() {
+    if (!g_initializedForThread) {
+        InitializeForCurrentThread();
+        return;
+    }
+
+    // Resource variable changes can affect any resolved value, do a full
+    // reload in this case.
+    if (HashResourceVariablesSettings() != g_resourceVariablesSettingsHash) {
+        Wh_Log(L"Resource variables changed, reinitializing");
+        UninitializeForCurrentThread();
+        InitializeForCurrentThread();
+        return;
+    }
+
+    auto oldKeys = std::move(g_elementsCustomizationRulesKeys);
+
+    g_elementsCustomizationRules.clear();
+    g_elementsCustomizationRulesIndex = {};
+    g_batchResolvedTypes.clear();
+
+    LoadAllStylesFromSettings();
+    g_elementsCustomizationRulesKeys = GetElementCustomizationRulesKeys();
+    BuildElementCustomizationRulesIndex();
+
+    auto diff = DiffElementCustomizationRules(
+        oldKeys, g_elementsCustomizationRulesKeys);
+    Wh_Log(L"Rules: %zu added, %zu removed, %zu unchanged", diff.added,
+           diff.removed, diff.unchanged);
+}
+
 void InitializeSettingsAndTap() {
     if (g_initialized.exchange(true)) {
         return;
@@ -6016,24 +7659,14 @@ void Wh_ModSettingsChanged() {
     if (hTaskbarUiWnd) {
         Wh_Log(L"Reinitializing - Found DesktopWindowContentBridge window");
         RunFromWindowThread(
-            hTaskbarUiWnd,
-            [](PVOID) {
-                UninitializeForCurrentThread();
-                InitializeForCurrentThread();
-            },
-            nullptr);
+            hTaskbarUiWnd, [](PVOID) { ReloadForCurrentThread(); }, nullptr);
         initialize = true;
     }
 
     for (auto hXamlHostWnd : GetXamlHostWnds()) {
         Wh_Log(L"Reinitializing for %08X", (DWORD)(ULONG_PTR)hXamlHostWnd);
         RunFromWindowThread(
-            hXamlHostWnd,
-            [](PVOID) {
-                UninitializeForCurrentThread();
-                InitializeForCurrentThread();
-            },
-            nullptr);
+            hXamlHostWnd, [](PVOID) { ReloadForCurrentThread(); }, nullptr);
         initialize = true;
     }
 